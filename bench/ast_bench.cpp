@@ -0,0 +1,115 @@
+// Memory footprint and bottom-up pass time of the pointer AST against the
+// struct-of-arrays FlatTree, on a generated input.
+// Usage: ast_bench [thousands of nodes]
+#include "flatTree.hpp"
+#include "traversal.hpp"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+std::string generateSource(std::size_t functions)
+{
+    std::string source;
+    for (std::size_t i = 0; i < functions; i++)
+    {
+        source += "function f" + std::to_string(i) + " (int32 a, int32 b, int32 c) return int32 is\n";
+        source += "    int32 x := (a + b) * c - 3;\n";
+        source += "    if x > a and b != 0 then\n";
+        source += "        x := x + f" + std::to_string(i) + "(b, c, a) << 2;\n";
+        source += "    fi\n";
+        source += "    return int32(x) % 7;\n";
+        source += "endfunction\n";
+    }
+    return source;
+}
+
+// Nodes of every subtree of the pointer tree, computed bottom-up.
+std::size_t subtreeSize(Parser::NodeIdentifier identifier, std::size_t &visited)
+{
+    if (identifier.get() == nullptr)
+        return 0;
+    visited++;
+    std::size_t size = 1;
+    Parser::forEachChild(*identifier.get(), [&](Parser::NodeIdentifier child)
+                         { size += subtreeSize(child, visited); });
+    return size;
+}
+
+// The same on the flat tree, one forward sweep.
+void subtreeSizes(const Parser::FlatTree &tree, std::vector<std::size_t> &sizes)
+{
+    sizes.assign(tree.size(), 1);
+    for (Parser::FlatTree::Index node = 0; node < tree.size(); node++)
+    {
+        for (auto i = tree.firstChild[node]; i < tree.firstChild[node] + tree.childCount[node]; i++)
+            sizes[node] += sizes[tree.children[i]];
+    }
+}
+
+// Heap owned by the nodes outside of the arena: their child vectors.
+std::size_t childVectorBytes(const std::vector<Parser::NodeIdentifier> &roots)
+{
+    std::size_t bytes = 0;
+    for (auto root : roots)
+    {
+        Parser::forEachPostOrder(root, [&](Parser::NodeIdentifier identifier)
+                                 {
+            if (auto multiBlock = identifier.get<Parser::NodeMultiBlock>())
+                bytes += multiBlock->blocks.capacity() * sizeof(Parser::NodeIdentifier);
+            else if (auto function = identifier.get<Parser::NodeFunction>())
+                bytes += function->arguments.capacity() * sizeof(function->arguments[0]);
+            else if (auto call = identifier.get<Parser::NodeFunctionCall>())
+                bytes += call->arguments.capacity() * sizeof(Parser::NodeIdentifier); });
+    }
+    return bytes;
+}
+
+template <typename F>
+double bestOf(int runs, F f)
+{
+    double best = 1e30;
+    for (int run = 0; run < runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t thousands = argc > 1 ? std::stoul(argv[1]) : 1000;
+    // About 33 nodes per generated function.
+    auto source = std::make_shared<Lexer::SourceBuffer>(generateSource(thousands * 1000 / 33));
+
+    Lexer::LexerContext::init();
+    Parser::Arena arena;
+    Parser::Arena::setCurrent(arena);
+    Lexer::TokenStream ts(source);
+    std::vector<Parser::NodeIdentifier> roots;
+    while (!ts.isEmpty())
+        roots.push_back(Parser::parseBlock(ts));
+
+    auto tree = Parser::FlatTree::build(roots);
+    const double nodes = tree.size();
+    const double pointerBytes = arena.bytesUsed() + childVectorBytes(roots);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "nodes: " << tree.size() << std::endl;
+    std::cout << "pointer AST: " << std::setw(6) << pointerBytes / nodes << " bytes/node" << std::endl;
+    std::cout << "flat AST:    " << std::setw(6) << tree.bytes() / nodes << " bytes/node" << std::endl;
+
+    std::size_t visited = 0;
+    const double pointerTime = bestOf(5, [&]()
+                                      {
+        visited = 0;
+        for (auto root : roots)
+            subtreeSize(root, visited); });
+    std::vector<std::size_t> sizes;
+    const double flatTime = bestOf(5, [&]()
+                                   { subtreeSizes(tree, sizes); });
+    std::cout << "subtree pass, pointer AST: " << std::setw(8) << pointerTime << " ms (" << visited << " nodes)" << std::endl;
+    std::cout << "subtree pass, flat AST:    " << std::setw(8) << flatTime << " ms" << std::endl;
+    return 0;
+}
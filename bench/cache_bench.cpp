@@ -0,0 +1,87 @@
+// Front-end time of a cold compile, lexing, parsing and type checking the
+// source, against a warm one mapping the AST cached on disk, on a generated input.
+// Usage: cache_bench [functions]
+#include "astCache.hpp"
+#include "frontend.hpp"
+#include <llvm/Support/FileSystem.h>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+std::string generateSource(std::size_t functions)
+{
+    std::string source;
+    for (std::size_t i = 0; i < functions; i++)
+    {
+        source += "function f" + std::to_string(i) + " (int32 a, int32 b, int32 c) return int32 is\n";
+        source += "    int32 x := (a + b) * c - 3;\n";
+        source += "    if x > a and b != 0 then\n";
+        source += "        x := x + f" + std::to_string(i) + "(b, c, a) << 2;\n";
+        source += "    fi\n";
+        source += "    return int32(x) % 7;\n";
+        source += "endfunction\n";
+    }
+    return source;
+}
+
+double milliseconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t functions = argc > 1 ? std::stoul(argv[1]) : 20000;
+    auto source = std::make_shared<Lexer::SourceBuffer>(generateSource(functions));
+    llvm::SmallString<128> directory;
+    if (llvm::sys::fs::createUniqueDirectory("gkc-cache-bench", directory))
+    {
+        std::cerr << "Could not create a temporary directory" << std::endl;
+        return 1;
+    }
+    Lexer::LexerContext::init();
+
+    // The declarations of a run stay in the context, so there is one cold run.
+    auto start = std::chrono::steady_clock::now();
+    Lexer::TokenStream ts(source);
+    auto result = Frontend::run(ts, 1, false);
+    const double cold = milliseconds(start);
+    if (result.syntaxErrors > 0 || result.typeError)
+    {
+        std::cerr << "The generated source does not compile" << std::endl;
+        return 1;
+    }
+
+    start = std::chrono::steady_clock::now();
+    const auto hash = Cache::hash(*source);
+    const auto path = Cache::astPath(std::string(directory), hash);
+    if (!Cache::storeAst(path, hash, result.nodes))
+    {
+        std::cerr << "Could not write " << path << std::endl;
+        return 1;
+    }
+    const double store = milliseconds(start);
+    std::uint64_t bytes = 0;
+    llvm::sys::fs::file_size(path, bytes);
+
+    double warm = 1e30;
+    std::size_t roots = 0;
+    for (int run = 0; run < 5; run++)
+    {
+        Parser::Arena arena;
+        Parser::Arena::setCurrent(arena);
+        start = std::chrono::steady_clock::now();
+        auto file = Cache::AstFile::load(path, Cache::hash(*source));
+        warm = std::min(warm, milliseconds(start));
+        roots = file == nullptr ? 0 : file->roots.size();
+    }
+    llvm::sys::fs::remove_directories(directory);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "source: " << source->size() / 1024 << " KiB, " << roots << " top level blocks" << std::endl;
+    std::cout << "cache file: " << bytes / 1024 << " KiB, written in " << store << " ms" << std::endl;
+    std::cout << "cold front end (lex, parse, check): " << std::setw(8) << cold << " ms" << std::endl;
+    std::cout << "warm front end (hash, map, rebuild):" << std::setw(8) << warm << " ms" << std::endl;
+    return roots == result.nodes.size() ? 0 : 1;
+}
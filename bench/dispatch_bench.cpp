@@ -0,0 +1,154 @@
+// Cost per node of a full AST traversal through the virtual Node::accept
+// chain against the switch of visitor::Dispatcher.
+// Usage: dispatch_bench [thousands of nodes]
+#include "parser.hpp"
+#include "visitor/dispatcher.hpp"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+std::string generateSource(std::size_t functions)
+{
+    std::string source;
+    for (std::size_t i = 0; i < functions; i++)
+    {
+        source += "function f" + std::to_string(i) + " (int32 a, int32 b, int32 c) return int32 is\n";
+        source += "    int32 x := (a + b) * c - 3;\n";
+        source += "    if x > a and b != 0 then\n";
+        source += "        x := x + f" + std::to_string(i) + "(b, c, a) << 2;\n";
+        source += "    fi\n";
+        source += "    return int32(x) % 7;\n";
+        source += "endfunction\n";
+    }
+    return source;
+}
+
+// Visits every node, recursing with accept or with dispatch.
+template <bool Static>
+class CountVisitor final : public Parser::Visitor, public visitor::Dispatcher<CountVisitor<Static>>
+{
+public:
+    std::size_t visited = 0;
+
+    void visit(Parser::NodeIdentifier node)
+    {
+        if constexpr (Static)
+            this->dispatch(node);
+        else
+            node->accept(*this);
+    }
+    // dispatch visits the operands of operators, casts and calls itself.
+    void visitOperand(Parser::NodeIdentifier node)
+    {
+        if constexpr (!Static)
+            node->accept(*this);
+    }
+    void visitNodeIf(Parser::NodeIf &node) override
+    {
+        visited++;
+        visit(node.condition);
+        visit(node.thenStatement);
+        if (node.elseStatement.has_value())
+            visit(node.elseStatement.value());
+    }
+    void visitNodeGoto(Parser::NodeGoto &node) override { visited++; }
+    void visitBinOperator(Parser::NodeBinOperator &node) override
+    {
+        visited++;
+        visitOperand(node.left);
+        visitOperand(node.right);
+    }
+    void visitNode(Parser::Node &node) override {}
+    void visitNodeNumber(Parser::NodeNumber &node) override { visited++; }
+    void visitNodeVariableDeclaration(Parser::NodeVariableDeclaration &node) override
+    {
+        visited++;
+        if (node.value.has_value())
+            visit(node.value.value());
+    }
+    void visitNodeVariableAssignment(Parser::NodeVariableAssignment &node) override
+    {
+        visited++;
+        visit(node.value);
+    }
+    void visitNodeBlockModifier(Parser::NodeBlockModifier &node) override { visited++; }
+    void visitNodeText(Parser::NodeText &node) override { visited++; }
+    void visitNodeReturn(Parser::NodeReturn &node) override
+    {
+        visited++;
+        if (node.value.has_value())
+            visit(node.value.value());
+    }
+    void visitNodeUnaryOperator(Parser::NodeUnaryOperator &node) override
+    {
+        visited++;
+        visitOperand(node.right);
+    }
+    void visitNodeFunction(Parser::NodeFunction &node) override
+    {
+        visited++;
+        if (node.body.has_value())
+            visit(node.body.value());
+    }
+    void visitNodeFunctionCall(Parser::NodeFunctionCall &node) override
+    {
+        visited++;
+        for (auto argument : node.arguments)
+            visitOperand(argument);
+    }
+    void visitNodePragma(Parser::NodePragma &node) override { visited++; }
+    void visitNodeCast(Parser::NodeCast &node) override
+    {
+        visited++;
+        visitOperand(node.value);
+    }
+};
+
+template <typename Visitor>
+void run(const char *name, const std::vector<Parser::NodeIdentifier> &roots, int repeat)
+{
+    double best = 1e30;
+    std::size_t visited = 0;
+    for (int run = 0; run < 5; run++)
+    {
+        Visitor v;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; i++)
+            for (auto root : roots)
+                v.visit(root);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+        visited = v.visited;
+    }
+    std::cout << std::setw(10) << name << ": " << std::fixed << std::setprecision(2) << best / visited << " ns/node ("
+              << visited << " nodes, " << std::setprecision(1) << best / 1e6 << " ms)" << std::endl;
+}
+
+std::vector<Parser::NodeIdentifier> parse(std::shared_ptr<Lexer::SourceBuffer> source)
+{
+    Lexer::LexerContext::init();
+    Lexer::TokenStream ts(source);
+    std::vector<Parser::NodeIdentifier> roots;
+    while (!ts.isEmpty())
+        roots.push_back(Parser::parseBlock(ts));
+    return roots;
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t thousands = argc > 1 ? std::stoul(argv[1]) : 1000;
+    // A large tree is dominated by cache misses, a small one walked many
+    // times shows the cost of the dispatch itself.
+    auto large = std::make_shared<Lexer::SourceBuffer>(generateSource(thousands * 1000 / 33));
+    auto small = std::make_shared<Lexer::SourceBuffer>(generateSource(100));
+    auto largeRoots = parse(large);
+    auto smallRoots = parse(small);
+
+    std::cout << "large tree:" << std::endl;
+    run<CountVisitor<false>>("accept", largeRoots, 1);
+    run<CountVisitor<true>>("dispatch", largeRoots, 1);
+    std::cout << "small tree, in cache:" << std::endl;
+    run<CountVisitor<false>>("accept", smallRoots, 1000);
+    run<CountVisitor<true>>("dispatch", smallRoots, 1000);
+    return 0;
+}
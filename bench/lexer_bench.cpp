@@ -0,0 +1,84 @@
+// Lexing throughput on a large synthetic input, for every scanner level
+// supported by the CPU.
+// Usage: lexer_bench [size in MB]
+#include "lexer.hpp"
+#include "scanner.hpp"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+// Deeply nested generated code has long indentation and long identifiers.
+std::string generateSource(std::size_t size, int indent)
+{
+    const std::string pad(indent, ' ');
+    const std::string name = indent > 8 ? "accumulator_of_the_generated_state_machine" : "accumulator";
+    std::string source;
+    source.reserve(size + 1024);
+    for (int i = 0; source.size() < size; i++)
+    {
+        source += "function generated_function_" + std::to_string(i) + " (int32 first_argument, int32 second_argument) return int32 is\n";
+        source += pad + "int32 " + name + " := first_argument * " + std::to_string(i) + ";\n";
+        source += pad + "if " + name + " > second_argument and first_argument != 0 then\n";
+        source += pad + pad + name + " := (" + name + " + second_argument) << 2;\n";
+        source += pad + "fi\n";
+        source += pad + "return " + name + ";\n";
+        source += "endfunction\n\n";
+    }
+    return source;
+}
+
+void benchmark(std::shared_ptr<Lexer::SourceBuffer> source, int indent)
+{
+    const double size = double(source->size()) / (1 << 20);
+    std::cout << "input: " << std::fixed << std::setprecision(1) << size << " MB, indentation " << indent << std::endl;
+
+    const auto detected = Lexer::Scanner::detectLevel();
+    for (auto level : {Lexer::Scanner::Level::Scalar, Lexer::Scanner::Level::SSE2, Lexer::Scanner::Level::AVX2})
+    {
+        if (level > detected)
+            continue;
+        Lexer::Scanner::setLevel(level);
+        double best = 0;
+        std::size_t tokens = 0;
+        for (int run = 0; run < 3; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            Lexer::TokenStream ts(source);
+            tokens = 0;
+            while (!ts.isEmpty())
+            {
+                ts.get();
+                tokens++;
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::max(best, size / elapsed.count());
+        }
+        // Character classification alone, without building tokens.
+        double bestScan = 0;
+        std::size_t newlines = 0;
+        for (int run = 0; run < 3; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            newlines = 0;
+            for (const char *cursor = source->begin(); cursor < source->end();)
+            {
+                const char *next = Lexer::Scanner::skipWhitespace(cursor, source->end());
+                newlines += Lexer::Scanner::countNewlines(cursor, next);
+                next = Lexer::Scanner::skipIdentifier(next, source->end());
+                cursor = next == cursor ? next + 1 : next;
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            bestScan = std::max(bestScan, size / elapsed.count());
+        }
+        std::cout << std::setw(8) << Lexer::Scanner::levelToString(level) << ": lexer " << std::setw(8) << best << " MB/s (" << tokens << " tokens), "
+                  << "scan " << std::setw(8) << bestScan << " MB/s (" << newlines << " lines)" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t megabytes = argc > 1 ? std::stoul(argv[1]) : 64;
+    for (int indent : {4, 32})
+        benchmark(std::make_shared<Lexer::SourceBuffer>(generateSource(megabytes << 20, indent)), indent);
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Latency of the diagnostics of gkc --lsp after a keystroke in a large file:
+// typed in the body of a function, which only analyses that function, and
+// in its header, which analyses the whole file. The edits go through the
+// messages of the protocol, their diagnostics published to nowhere.
+// Usage: lsp_bench [lines] [keystrokes]
+#include "languageServer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+double milliseconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Functions of four lines, up to lines.
+std::string generateSource(std::size_t lines)
+{
+    std::string source;
+    for (std::size_t i = 0; i + 4 <= lines; i += 4)
+    {
+        source += "function f" + std::to_string(i / 4) + "(int32 a) return int32 is\n";
+        source += "    if a > 1 then return a * 2; fi\n"
+                  "    return a;\n"
+                  "endfunction\n";
+    }
+    return source;
+}
+
+std::string escape(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '\n')
+            escaped += "\\n";
+        else
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string insertion(int version, std::size_t line, std::size_t character, const std::string &text)
+{
+    const std::string position = "{\"line\":" + std::to_string(line) + ",\"character\":" + std::to_string(character) + "}";
+    return "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":\"file:///bench.gk\",\"version\":" +
+           std::to_string(version) + "},\"contentChanges\":[{\"range\":{\"start\":" + position + ",\"end\":" + position + "},\"text\":\"" + text + "\"}]}}";
+}
+
+// Type keystrokes characters of typed, repeated, at line and character,
+// from 0, and print the latency of each.
+void measure(const std::string &name, Ckc::LanguageServer &server, std::ostringstream &output, int &version, std::size_t line, std::size_t character, const std::string &typed, std::size_t keystrokes)
+{
+    std::vector<double> latencies;
+    for (std::size_t i = 0; i < keystrokes; i++)
+    {
+        const std::string message = insertion(++version, line, character + i, typed.substr(i % typed.size(), 1));
+        const auto start = std::chrono::steady_clock::now();
+        server.handle(message);
+        latencies.push_back(milliseconds(start));
+        output.str("");
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (double latency : latencies)
+        total += latency;
+    std::cout << std::setw(16) << std::left << name << std::right << " keystroke: mean " << std::setw(9) << total / latencies.size() << " ms, p50 "
+              << std::setw(9) << latencies[latencies.size() / 2] << " ms, max " << std::setw(9) << latencies.back() << " ms" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t lines = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const std::size_t keystrokes = argc > 2 ? std::stoul(argv[2]) : 40;
+    Lexer::LexerContext::init();
+    const std::string source = generateSource(lines);
+    std::istringstream input;
+    std::ostringstream output;
+    Ckc::LanguageServer server(input, output);
+    server.handle(R"({"jsonrpc":"2.0","id":1,"method":"initialize","params":{}})");
+
+    std::cout << std::fixed << std::setprecision(3);
+    auto start = std::chrono::steady_clock::now();
+    server.handle("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":\"file:///bench.gk\",\"version\":1,\"text\":\"" +
+                  escape(source) + "\"}}}");
+    std::cout << "open of " << lines << " lines: " << milliseconds(start) << " ms" << std::endl;
+    output.str("");
+    int version = 1;
+    // In the middle of the file, after "return a" and after the parameter a.
+    const std::size_t function = lines / 8;
+    const std::size_t parameter = ("function f" + std::to_string(function) + "(int32 a").size();
+    measure("function body", server, output, version, function * 4 + 2, 12, " + 1", keystrokes);
+    measure("function header", server, output, version, function * 4, parameter, "b", std::min<std::size_t>(keystrokes, 10));
+    const Ckc::Document *document = server.getDocument("file:///bench.gk");
+    std::cout << document->getStatistics().fullAnalyses << " full analyses, " << document->getStatistics().functionAnalyses << " of a function" << std::endl;
+    return 0;
+}
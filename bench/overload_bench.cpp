@@ -0,0 +1,56 @@
+// Type checking time of deeply nested calls to an overloaded function, where
+// only the last overload matches. It should grow linearly with the depth.
+// Usage: overload_bench [overloads] [max depth]
+#include "contextProvider.hpp"
+#include "frontend.hpp"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+const char *types[] = {"int8", "uint8", "int16", "uint16", "uint32", "int64", "uint64", "int32"};
+
+std::string generateSource(std::size_t overloads, std::size_t depth)
+{
+    std::string source;
+    for (std::size_t i = 8 - overloads; i < 8; i++)
+        source += "function g(" + std::string(types[i]) + " a) return int32 is return " + std::to_string(i) + "; endfunction\n";
+    std::string call = "x";
+    for (std::size_t i = 0; i < depth; i++)
+        call = "g(" + call + ")";
+    source += "function h(int32 x) return int32 is return " + call + "; endfunction\n";
+    return source;
+}
+
+double milliseconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t overloads = std::min<std::size_t>(argc > 1 ? std::stoul(argv[1]) : 4, 8);
+    const std::size_t maxDepth = argc > 2 ? std::stoul(argv[2]) : 256;
+    Lexer::LexerContext::init();
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << overloads << " overloads" << std::endl;
+    for (std::size_t depth = 16; depth <= maxDepth; depth *= 2)
+    {
+        // Each run declares g again, so it gets a fresh function table.
+        Context::ContextProvider::getInstance().functions.clear();
+        auto source = std::make_shared<Lexer::SourceBuffer>(generateSource(overloads, depth));
+        Lexer::TokenStream ts(source);
+        auto start = std::chrono::steady_clock::now();
+        auto result = Frontend::run(ts, 1, false);
+        const double elapsed = milliseconds(start);
+        if (result.syntaxErrors > 0 || result.typeError)
+        {
+            std::cerr << "The generated source does not compile" << std::endl;
+            return 1;
+        }
+        std::cout << "depth " << std::setw(5) << depth << ": " << std::setw(9) << elapsed << " ms, "
+                  << std::setw(7) << elapsed * 1000 / depth << " us per call" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Time of gkc --watch to compile a large file again after an edit: of the
+// body of a function, which only computes the queries of that function, and
+// of a global initializer, whose function signatures stay the same. Prints
+// the queries computed by each edit.
+// Usage: query_bench [lines]
+#include "session.hpp"
+#include "workspace.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+double milliseconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// A global and functions of four lines, up to lines.
+std::string generateSource(std::size_t lines, int limit, int factor)
+{
+    std::string source = "int64 limit := " + std::to_string(limit) + ";\n";
+    for (std::size_t i = 0; i + 4 <= lines; i += 4)
+    {
+        const std::string f = i / 4 == lines / 8 ? std::to_string(factor) : "2";
+        source += "function f" + std::to_string(i / 4) + "(int32 a) return int32 is\n";
+        source += "    if a > 1 then return a * " + f + "; fi\n"
+                  "    return a;\n"
+                  "endfunction\n";
+    }
+    return source;
+}
+
+void compile(const std::string &name, Ckc::Workspace &workspace, const std::string &source)
+{
+    workspace.resetStatistics();
+    std::ostringstream diagnostics;
+    const auto start = std::chrono::steady_clock::now();
+    workspace.setSource("bench.gk", source);
+    const bool ok = workspace.compile("bench.gk", "query_bench.o", diagnostics);
+    std::cout << std::setw(18) << std::left << name << std::right << std::setw(10) << milliseconds(start) << " ms" << (ok ? "" : " failed") << "\n";
+    for (auto &[query, statistics] : workspace.getStatistics())
+    {
+        if (statistics.computed > 0)
+            std::cout << "    " << std::setw(16) << std::left << query << std::right << std::setw(8) << statistics.computed << " computed, hit rate "
+                      << statistics.hitRate() * 100 << "%\n";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t lines = argc > 1 ? std::stoul(argv[1]) : 20000;
+    Lexer::LexerContext::init();
+    std::string error;
+    auto createTargetMachine = Ckc::hostTargetMachine(error);
+    if (!createTargetMachine)
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cout << std::fixed << std::setprecision(1);
+    Ckc::Workspace workspace(createTargetMachine);
+    compile("first compile", workspace, generateSource(lines, 10, 2));
+    compile("function body", workspace, generateSource(lines, 10, 3));
+    compile("global", workspace, generateSource(lines, 11, 3));
+    compile("unchanged", workspace, generateSource(lines, 11, 3));
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Latency and throughput of compiling tiny files with a one-shot gkc, with
+// gkc-client and a gkc --server, and with requests sent from within the
+// process, which leaves out the start of the client.
+// The one-shot and client rows need gkc and gkc-client, built by make bench.
+// Usage: server_bench [requests] [clients] [gkc] [gkc-client]
+#include "server.hpp"
+#include "session.hpp"
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/FileSystem.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+double milliseconds(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Run program in directory, return false if it does not exit with 0.
+bool run(const std::vector<std::string> &arguments, const std::string &directory)
+{
+    // Nothing is allocated in the child, the server threads may hold the malloc lock.
+    std::vector<char *> argv;
+    for (auto &argument : arguments)
+        argv.push_back(const_cast<char *>(argument.c_str()));
+    argv.push_back(nullptr);
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (chdir(directory.c_str()) == 0)
+            execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Send requests compilations from clients threads at once, compile(client, i)
+// compiling the i-th file of client. Print the latency of the requests and
+// the throughput.
+bool measure(const std::string &name, std::size_t requests, std::size_t clients, const std::function<bool(std::size_t, std::size_t)> &compile)
+{
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<bool> compiled(clients, true);
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t c = 0; c < clients; c++)
+        threads.emplace_back([&, c]()
+                             {
+                                 for (std::size_t i = c; i < requests; i += clients)
+                                 {
+                                     const auto begin = std::chrono::steady_clock::now();
+                                     compiled[c] = compile(c, i) && compiled[c];
+                                     latencies[c].push_back(milliseconds(begin));
+                                 } });
+    for (auto &thread : threads)
+        thread.join();
+    const double elapsed = milliseconds(start);
+    if (std::find(compiled.begin(), compiled.end(), false) != compiled.end())
+    {
+        std::cerr << name << ": a compilation failed" << std::endl;
+        return false;
+    }
+    std::vector<double> all;
+    for (auto &latency : latencies)
+        all.insert(all.end(), latency.begin(), latency.end());
+    std::sort(all.begin(), all.end());
+    double total = 0;
+    for (double latency : all)
+        total += latency;
+    std::cout << std::setw(22) << std::left << name << std::right << std::setw(3) << clients << " client(s): latency mean "
+              << std::setw(7) << total / all.size() << " ms, p50 " << std::setw(7) << all[all.size() / 2] << " ms, p99 "
+              << std::setw(7) << all[all.size() * 99 / 100] << " ms, " << std::setw(8) << all.size() * 1000 / elapsed << " files/s" << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t requests = argc > 1 ? std::stoul(argv[1]) : 200;
+    const std::size_t clients = argc > 2 ? std::stoul(argv[2]) : 4;
+    // Run from the directory of each client.
+    llvm::SmallString<128> gkcPath(argc > 3 ? argv[3] : "gkc");
+    llvm::SmallString<128> clientPath(argc > 4 ? argv[4] : "gkc-client");
+    llvm::sys::fs::make_absolute(gkcPath);
+    llvm::sys::fs::make_absolute(clientPath);
+    const std::string gkc = gkcPath.str().str();
+    const std::string client = clientPath.str().str();
+    llvm::SmallString<128> directory;
+    if (llvm::sys::fs::createUniqueDirectory("gkc-server-bench", directory))
+    {
+        std::cerr << "Could not create a temporary directory" << std::endl;
+        return 1;
+    }
+    Lexer::LexerContext::init();
+    const std::string source = "function f(int32 a) return int32 is\n"
+                               "    if a > 1 then return a * f(a - 1); fi\n"
+                               "    return 1;\n"
+                               "endfunction\n";
+    // A directory per client, a one-shot gkc writes output.o where it runs.
+    for (std::size_t c = 0; c < clients; c++)
+    {
+        const std::string path = (directory + "/" + std::to_string(c)).str();
+        llvm::sys::fs::create_directory(path);
+        std::ofstream(path + "/tiny.gk") << source;
+    }
+    auto clientDirectory = [&](std::size_t c)
+    { return (directory + "/" + std::to_string(c)).str(); };
+
+    std::string error;
+    auto createTargetMachine = Ckc::hostTargetMachine(error);
+    if (!createTargetMachine)
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    const std::string socketPath = (directory + "/gkc.sock").str();
+    Ckc::Server server(socketPath, createTargetMachine, std::max<std::size_t>(clients, 1));
+    if (!server.listen(error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::thread serving([&server]()
+                        { server.serve(); });
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << requests << " compilations of a " << source.size() << " byte file" << std::endl;
+    const bool binaries = llvm::sys::fs::can_execute(gkc) && llvm::sys::fs::can_execute(client);
+    if (!binaries)
+        std::cout << "No " << gkc << " or " << client << ", only the requests from within the process are measured" << std::endl;
+    bool compiled = true;
+    for (std::size_t concurrency : {std::size_t(1), clients})
+    {
+        if (binaries)
+        {
+            compiled = compiled && measure("one-shot gkc", requests, concurrency, [&](std::size_t c, std::size_t)
+                                           { return run({gkc, "-s", "tiny.gk"}, clientDirectory(c)); });
+            compiled = compiled && measure("gkc-client", requests, concurrency, [&](std::size_t c, std::size_t)
+                                           { return run({client, socketPath, "tiny.gk"}, clientDirectory(c)); });
+        }
+        compiled = compiled && measure("in-process request", requests, concurrency, [&](std::size_t c, std::size_t)
+                                       {
+                                           Ckc::Request request;
+                                           request.filename = "tiny.gk";
+                                           request.objectFilename = clientDirectory(c) + "/output.o";
+                                           request.source = source;
+                                           Ckc::Response response;
+                                           std::string error;
+                                           return Ckc::compileRemote(socketPath, request, response, error) && response.compiled; });
+    }
+    server.stop();
+    serving.join();
+    llvm::sys::fs::remove_directories(directory);
+    return compiled ? 0 : 1;
+}
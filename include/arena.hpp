@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Parser
+{
+    // Bump allocator holding the AST of a compilation.
+    // Objects are never freed one by one: reset() runs every pending destructor
+    // and rewinds the arena, keeping its first chunk for the next tree.
+    class Arena
+    {
+    private:
+        class Destructor
+        {
+        public:
+            void *object;
+            void (*destroy)(void *);
+        };
+
+        std::size_t chunkSize = defaultChunkSize;
+        std::vector<std::unique_ptr<std::byte[]>> chunks;
+        std::byte *cursor = nullptr;
+        std::byte *limit = nullptr;
+        std::size_t used = 0;
+        std::vector<Destructor> destructors;
+
+        void *allocateSlow(std::size_t size, std::size_t alignment);
+
+    public:
+        static constexpr std::size_t defaultChunkSize = 64 * 1024;
+
+        Arena() = default;
+        // Arena for small trees, like the one of a single function.
+        explicit Arena(std::size_t chunkSize) : chunkSize(chunkSize) {}
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+        ~Arena();
+
+        void *allocate(std::size_t size, std::size_t alignment)
+        {
+            std::size_t padding = -reinterpret_cast<std::uintptr_t>(cursor) & (alignment - 1);
+            if (cursor == nullptr || size + padding > std::size_t(limit - cursor))
+                return allocateSlow(size, alignment);
+            std::byte *result = cursor + padding;
+            cursor = result + size;
+            used += size + padding;
+            return result;
+        }
+
+        template <typename T, typename... Args>
+        T *create(Args &&...args)
+        {
+            T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                destructors.push_back({object, [](void *object)
+                                       { static_cast<T *>(object)->~T(); }});
+            return object;
+        }
+
+        void reset();
+        // Bytes handed out since the last reset, padding included.
+        std::size_t bytesUsed() const { return used; }
+
+        // Arena in which the parser allocates nodes, per thread.
+        static Arena &getCurrent();
+        static void setCurrent(Arena &arena);
+    };
+}
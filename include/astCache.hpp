@@ -0,0 +1,44 @@
+#pragma once
+#include "parser.hpp"
+#include "sourceBuffer.hpp"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Cache
+{
+    // On-disk copy of a type checked AST, keyed by a hash of its source.
+    // The file is a header followed by fixed size records, one per node in
+    // post-order, and the tables they index: child nodes, strings and tokens.
+    // It is written in native byte order and memory-mapped when read back.
+    // Node kinds, expression types, symbol names and token positions are
+    // kept, which is everything llvmVisitor reads.
+    class AstFile
+    {
+    private:
+        void *mapping = nullptr;
+        std::size_t length = 0;
+
+    public:
+        // Top level blocks in source order, built in the current arena. Their
+        // tokens view the strings of the mapped file.
+        std::vector<Parser::NodeIdentifier> roots;
+
+        AstFile() = default;
+        AstFile(const AstFile &) = delete;
+        AstFile &operator=(const AstFile &) = delete;
+        ~AstFile();
+
+        // Map filename and rebuild its AST. Return nullptr if the file is
+        // missing, was written for another source or format, or is corrupted.
+        static std::unique_ptr<AstFile> load(const std::string &filename, std::uint64_t sourceHash);
+    };
+
+    std::uint64_t hash(const Lexer::SourceBuffer &source);
+    // File of the AST of a source with hash in directory.
+    std::string astPath(const std::string &directory, std::uint64_t sourceHash);
+    // Write roots to filename, replacing it atomically. Return false on error.
+    bool storeAst(const std::string &filename, std::uint64_t sourceHash, const std::vector<Parser::NodeIdentifier> &roots);
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <llvm/ADT/SmallString.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Backend
+{
+    using TargetMachineFactory = std::function<std::unique_ptr<llvm::TargetMachine>()>;
+
+    // Emit M as the relocatable object filename.
+    // With more than one job the functions of M are split into jobs partitions,
+    // each one compiled on its own thread in its own LLVMContext, and the
+    // objects are merged with ld -r. Symbol names are the ones of M. Errors
+    // are printed, return false on error.
+    bool emitObject(llvm::Module &M, const TargetMachineFactory &createTargetMachine, const std::string &filename, unsigned jobs);
+
+    // Emit modules one after the other with the same target machine and code
+    // generation passes, which setting up again costs more than compiling a
+    // small module. The object is built in memory, then written. Not thread-safe.
+    class ObjectEmitter
+    {
+    private:
+        std::unique_ptr<llvm::TargetMachine> targetMachine;
+        llvm::SmallVector<char, 0> buffer;
+        llvm::raw_svector_ostream stream{buffer};
+        llvm::legacy::PassManager passes;
+        bool ready;
+
+    public:
+        explicit ObjectEmitter(const TargetMachineFactory &createTargetMachine);
+        ObjectEmitter(const ObjectEmitter &) = delete;
+        ObjectEmitter &operator=(const ObjectEmitter &) = delete;
+
+        // Emit M, whose data layout is the one of the target machine, as the
+        // relocatable object filename. Errors are printed, return false on error.
+        bool emit(llvm::Module &M, const std::string &filename);
+        // Same as emit, the object being kept in memory.
+        bool emit(llvm::Module &M, std::string &object);
+        const llvm::TargetMachine &getTargetMachine() const { return *targetMachine; }
+    };
+
+    // Merge the relocatable objects parts into filename with ld -r. Errors
+    // are printed, return false on error.
+    bool mergeObjects(const std::vector<llvm::SmallString<128>> &parts, const std::string &filename);
+
+    class CacheStatistics
+    {
+    public:
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        // Functions referring to a local symbol, compiled with the rest of the module.
+        std::size_t uncached = 0;
+    };
+
+    // Emit M as the relocatable object filename, reusing the machine code of
+    // the unchanged functions from directory.
+    // Each function is keyed by a hash of its IR, which holds the signatures
+    // of its callees and the types of the globals it uses, and of the target
+    // and code generation options. A missing function is compiled alone and
+    // stored under its key, the missing functions being compiled on up to jobs
+    // threads. The cached objects and one object for the rest of M are merged
+    // with ld -r. The bodies of M are deleted. Errors are printed, return
+    // false on error.
+    bool emitCached(llvm::Module &M, const TargetMachineFactory &createTargetMachine, const std::string &filename, const std::string &directory, unsigned jobs, CacheStatistics &statistics);
+
+    // Emit a module in parts while it is being built, so that the IR of the
+    // functions already emitted does not pile up.
+    // Once the bodies of M hold more than a threshold of instructions, they are
+    // compiled to a temporary object and turned into declarations, which later
+    // calls still refer to. finish() merges the parts with ld -r. Without ld
+    // the module is kept whole and emitted by finish(). Errors are printed.
+    class PartialEmitter
+    {
+    private:
+        llvm::Module &M;
+        std::unique_ptr<llvm::TargetMachine> targetMachine;
+        std::optional<std::string> linker;
+        std::vector<llvm::SmallString<128>> parts;
+        // Where the IR of every part is printed, if set.
+        llvm::raw_ostream *print;
+        // Functions of M counted so far, instructions of the bodies not emitted.
+        std::size_t functionsCounted = 0;
+        std::size_t instructions = 0;
+
+    public:
+        static constexpr std::size_t threshold = 1 << 16;
+
+        PartialEmitter(llvm::Module &M, const TargetMachineFactory &createTargetMachine, llvm::raw_ostream *print = nullptr);
+        PartialEmitter(const PartialEmitter &) = delete;
+        PartialEmitter &operator=(const PartialEmitter &) = delete;
+        ~PartialEmitter();
+
+        // Emit the bodies of M as a part if they are over the threshold.
+        // Return false on error.
+        bool flushIfLarge();
+        // Emit the bodies of M as a part. Return false on error.
+        bool flush();
+        // Write every part as the relocatable object filename. Return false on error.
+        bool finish(const std::string &filename);
+    };
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "symbol.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace Ckc
+{
+    // Value bound to a name at the top level of a file, after the block at index.
+    template <typename T>
+    class Binding
+    {
+    public:
+        std::size_t block;
+        T value;
+
+        bool operator==(const Binding &other) const = default;
+    };
+
+    // The values a name takes at the top level, in block order, so that a
+    // block analysed on its own sees the names as the blocks before it left them.
+    template <typename T>
+    using Bindings = std::unordered_map<Lexer::Symbol, std::vector<Binding<T>>>;
+
+    // Value bound to name by the blocks before block.
+    template <typename T>
+    std::optional<T> boundBefore(const Bindings<T> &bindings, Lexer::Symbol name, std::size_t block)
+    {
+        auto found = bindings.find(name);
+        if (found == bindings.end())
+            return std::nullopt;
+        auto after = std::partition_point(found->second.begin(), found->second.end(), [block](const Binding<T> &binding)
+                                          { return binding.block < block; });
+        if (after == found->second.begin())
+            return std::nullopt;
+        return std::prev(after)->value;
+    }
+
+    // Bind name to value after block, the blocks being bound in order.
+    // Nothing is bound for an empty or unchanged value.
+    template <typename T>
+    void addBinding(Bindings<T> &bindings, Lexer::Symbol name, std::size_t block, const std::optional<T> &value)
+    {
+        if (!value.has_value())
+            return;
+        auto &list = bindings[name];
+        if (list.empty() || !(list.back().value == value.value()))
+            list.push_back({block, value.value()});
+    }
+}
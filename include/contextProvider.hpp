@@ -7,104 +7,103 @@
 #include "llvm/IR/IRBuilder.h"
 #include "genericContext.hpp"
 #include "parser.hpp"
+#include "types.hpp"
 namespace Context
 {
     class variable
     {
     public:
-        std::string type;
-        llvm::AllocaInst *value;
+        Types::TypeId type;
+        // The alloca of a local or the global variable, and the type stored in it.
+        llvm::Value *value;
+        llvm::Type *valueType;
     };
 
     class functionType // : public genericContext<int, std::pair<std::string, std::vector<std::string>>>
     {
     public:
+        // Signature of an overload, kept after the AST of its function is released.
         class functionInfo
         {
             public:
-            std::vector<std::string> types;
-            std::string returnType;
-            Parser::NodeIdentifier node;
-            functionInfo(std::vector<std::string> types, std::string returnType, Parser::NodeIdentifier node) : types(types), returnType(returnType), node(node){};
+            std::vector<Types::TypeId> types;
+            Types::TypeId returnType;
+            // The function keyword of the declaration.
+            std::optional<Lexer::Token> token;
+            std::string symbolName;
+            functionInfo(std::vector<Types::TypeId> types, Types::TypeId returnType, std::optional<Lexer::Token> token, std::string symbolName) : types(types), returnType(returnType), token(token), symbolName(symbolName){};
         };
         std::vector<functionInfo> overloads;
 
-        std::string functionName;
-        std::optional<std::string> returnType;
-        functionType(std::string functionName, std::optional<std::string> returnType) : functionName(functionName), returnType(returnType){};
-        functionType() : functionName(""), returnType(std::nullopt) {}
-        int overloadCount = 0;
+        Lexer::Symbol functionName;
+        std::optional<Types::TypeId> returnType;
+        functionType(Lexer::Symbol functionName, std::optional<Types::TypeId> returnType) : functionName(functionName), returnType(returnType){};
+        functionType() : functionName(), returnType(std::nullopt) {}
 
-        
-        size_t getOverloadCount()
+        size_t getOverloadCount() const
         {
             return overloads.size();
         }
-        
-        bool hasOverload(std::vector<std::string> types)
-        {
-            for (auto overload : this->overloads)
-            {
-                if (compare(overload.types, types))
-                    return true;
-            }
-            return false;
-        }
 
-        std::optional<functionInfo> getDefinition(std::vector<std::string> types)
+        bool hasOverload(const std::vector<Types::TypeId> &types) const
         {
-            for (auto overload : this->overloads)
-            {
-                if (compare(overload.types, types))
-                    return overload;
-            }
-            return std::nullopt;
+            return bySignature.count(types) > 0;
         }
 
-
-        void add(std::vector<std::string> types, std::string returnType, Parser::NodeIdentifier node)
+        const functionInfo *getDefinition(const std::vector<Types::TypeId> &types) const
         {
-            // genericContext::add(0, types);
-            this->overloads.push_back({types, returnType, node});
-            // overloadCount++;
+            auto found = bySignature.find(types);
+            return found == bySignature.end() ? nullptr : &overloads[found->second];
         }
 
-        bool compare(std::vector<std::string> a, std::vector<std::string> b)
+        // Indices in overloads of the overloads taking count arguments, in declaration order.
+        const std::vector<std::size_t> &overloadsWithArity(std::size_t count) const
         {
-            return a.size() == b.size() && std::equal(std::begin(a), std::end(a), std::begin(b));
+            static const std::vector<std::size_t> noOverload;
+            auto found = byArity.find(count);
+            return found == byArity.end() ? noOverload : found->second;
         }
 
-        std::vector<functionInfo> getAllTypes()
+        void add(std::vector<Types::TypeId> types, Types::TypeId returnType, std::optional<Lexer::Token> token, std::string symbolName)
         {
-            return overloads;
+            bySignature.emplace(types, overloads.size());
+            byArity[types.size()].push_back(overloads.size());
+            this->overloads.push_back({std::move(types), returnType, token, symbolName});
         }
+
+    private:
+        // Indices in overloads, by parameter types and by parameter count.
+        std::map<std::vector<Types::TypeId>, std::size_t> bySignature;
+        std::map<std::size_t, std::vector<std::size_t>> byArity;
     };
 
     class ContextProvider
     {
     private:
-        std::vector<std::map<std::string, variable>> variables;
-        std::vector<std::map<std::string, std::string>> nameTranslation{
-            std::map<std::string, std::string>()};
+        genericContext<Lexer::Symbol, variable> variables;
+        genericContext<std::string, std::string> nameTranslation;
         std::map<std::string, llvm::BasicBlock *> namedBlocks;
 
+    public:
         ContextProvider() = default;
 
-    public:
-        static ContextProvider &getInstance()
-        {
-            static ContextProvider instance;
-            return instance;
-        }
+        // The provider of the compilation session active on the calling
+        // thread, or the one shared by the threads without a session.
+        static ContextProvider &getInstance();
+        static void setCurrent(ContextProvider &provider);
         void enterScope();
         void exitScope();
-        void addVariable(std::string name, llvm::AllocaInst *value, std::string type);
-        variable getVariable(std::string name);
+        void addVariable(Lexer::Symbol name, llvm::Value *value, llvm::Type *valueType, Types::TypeId type);
+        variable getVariable(Lexer::Symbol name);
         void addBasicBlock(std::string name, llvm::BasicBlock *block);
         void addNameTranslation(std::string name, std::string translation);
         std::optional<std::string> getNameTranslation(std::string name);
         llvm::BasicBlock *getBasicBlock(std::string name);
-        std::map<std::string, functionType> functions;
+        // Labels are local to a function: take those of the enclosing one
+        // before lowering a function and give them back after it.
+        std::map<std::string, llvm::BasicBlock *> takeBasicBlocks();
+        void restoreBasicBlocks(std::map<std::string, llvm::BasicBlock *> blocks);
+        std::map<Lexer::Symbol, functionType> functions;
 
         ~ContextProvider() = default;
     };
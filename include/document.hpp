@@ -0,0 +1,129 @@
+#pragma once
+#include "bindings.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "session.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ckc
+{
+    // Part of a document, lines and columns from 1, columns counted in bytes,
+    // the end excluded.
+    class DocumentRange
+    {
+    public:
+        int line;
+        int column;
+        int endLine;
+        int endColumn;
+    };
+
+    class DocumentDiagnostic
+    {
+    public:
+        std::string message;
+        DocumentRange range;
+    };
+
+    class DocumentStatistics
+    {
+    public:
+        // Analyses of the whole text, and of the one function an edit fell in.
+        std::size_t fullAnalyses = 0;
+        std::size_t functionAnalyses = 0;
+    };
+
+    // A file open in an editor, analysed again after each edit.
+    // The text is split in top level blocks, each keeping its AST and its
+    // diagnostics. An edit within the body of a function that holds no
+    // function nor pragma, the functions gkc -j checks on their own, only
+    // lexes, parses and checks that function again, against the names the
+    // blocks before it declare. Any other edit analyses the whole text.
+    // Blocks keep the tokens they were lexed with, numbered from where the
+    // block started then, and the lines of their diagnostics are moved by the
+    // edits made before them since.
+    // Diagnostics are the ones of gkc -j, except that a syntax error only
+    // hides the type errors of its own block, and of every block after it if
+    // the block could not be parsed at all. Pragmas are not resolved, they
+    // rename symbols and nothing checked depends on the names of symbols.
+    class Document
+    {
+    private:
+        class Block
+        {
+        public:
+            // Offset in the text, line and column of the first byte of the block.
+            std::size_t begin;
+            int line;
+            int column;
+            // Line the first byte was on when the block was lexed.
+            int lexedLine;
+            // Text of the tokens of a function analysed on its own since.
+            std::shared_ptr<Lexer::SourceBuffer> source;
+            Parser::NodeIdentifier node;
+            // Tokens of the header up to its is, for a function analysed on its own.
+            std::vector<Lexer::Token> header;
+            // The function is declared, its body may be checked.
+            bool declared = false;
+            std::vector<Lexer::Diagnostic> syntax;
+            // Errors of the block itself, or of the declaration of a function.
+            std::vector<Lexer::Diagnostic> types;
+            std::vector<Lexer::Diagnostic> body;
+        };
+
+        std::string text;
+        std::string filename;
+        // Offset of the first byte of each line.
+        std::vector<std::size_t> lineOffsets;
+        std::vector<Block> blocks;
+        // Parser kinds and variable types of the names, as the blocks declare them.
+        Bindings<Lexer::TokenType> names;
+        Bindings<Types::TypeId> variables;
+        // Blocks from this one on are not type checked.
+        std::size_t checkedBlocks = 0;
+        // The text of the last full analysis, which the tokens of the blocks
+        // not analysed since and the function table refer to.
+        std::shared_ptr<Lexer::SourceBuffer> source;
+        CompilerState state;
+        // Bytes of the arena in use after the last full analysis, the nodes
+        // of the functions analysed since are added to it.
+        std::size_t analysedBytes = 0;
+        DocumentStatistics statistics;
+
+        void indexLines();
+        // Analyse the function at index on its own if it still is such a
+        // function, or the whole text. An internal error is kept as the only
+        // diagnostic until the next edit.
+        void update(std::size_t index = SIZE_MAX);
+        void analyse();
+        // Analyse the function at index on its own, return false if the
+        // block is no longer such a function with the same header.
+        bool analyseFunction(std::size_t index);
+        void checkBody(Lexer::TokenStream &ts, Block &block, std::size_t index, const std::vector<Lexer::Symbol> &symbols);
+
+    public:
+        explicit Document(std::string text, std::string filename = "");
+        Document(const Document &) = delete;
+        Document &operator=(const Document &) = delete;
+
+        // Replace bytes [begin, end) of the text with replacement and analyse
+        // what changed.
+        void change(std::size_t begin, std::size_t end, std::string_view replacement);
+        void setText(std::string text);
+
+        const std::string &getText() const { return text; }
+        std::size_t lineCount() const { return lineOffsets.size(); }
+        // Text of the line (from 1) without its line terminator.
+        std::string_view getLine(int line) const;
+        // Offset of the byte at line and column, clamped to the text.
+        std::size_t offset(int line, int column) const;
+
+        // Diagnostics of the current text, in source order.
+        std::vector<DocumentDiagnostic> getDiagnostics() const;
+        const DocumentStatistics &getStatistics() const { return statistics; }
+    };
+}
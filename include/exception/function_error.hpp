@@ -7,10 +7,11 @@
 class function_definition_error : public std::exception
 {
     public:
-    Parser::NodeIdentifier original_declaration;
+    // The AST of the original declaration may be released, only its first token is kept.
+    std::optional<Lexer::Token> original_declaration;
     Parser::NodeIdentifier new_declaration;
     std::string msg;
-    function_definition_error(Parser::NodeIdentifier original_declaration, Parser::NodeIdentifier new_declaration) : original_declaration(original_declaration), new_declaration(new_declaration)
+    function_definition_error(std::optional<Lexer::Token> original_declaration, Parser::NodeIdentifier new_declaration) : original_declaration(original_declaration), new_declaration(new_declaration)
     {
         msg = "Function already exist";
     }
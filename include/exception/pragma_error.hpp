@@ -0,0 +1,19 @@
+#pragma once
+#include <exception>
+#include <string>
+#include "parser.hpp"
+
+// A pragma that cannot be applied, reported like a type error.
+class pragma_error : public std::exception
+{
+private:
+    std::string msg;
+
+public:
+    Parser::NodeIdentifier node;
+    pragma_error(std::string msg, Parser::NodeIdentifier node) : msg(std::move(msg)), node(node){};
+    const char *what() const throw()
+    {
+        return msg.c_str();
+    }
+};
@@ -3,6 +3,7 @@
 #include <string>
 #include "lexer.hpp"
 #include "parser.hpp"
+#include "types.hpp"
 
 class type_error : public std::exception
 {
@@ -15,6 +16,21 @@ public:
     type_error(std::string expected_type, std::string actual_type, Parser::NodeIdentifier node) : expected_type(expected_type), actual_type(actual_type), node(node){
         msg = "Type error: expected " + expected_type + " but got " + actual_type;
     };
+    type_error(Types::TypeId expected_type, Types::TypeId actual_type, Parser::NodeIdentifier node) : type_error(expected_type.str(), actual_type.str(), node){};
+    const char *what() const throw()
+    {
+        return msg.c_str();
+    }
+};
+
+class constant_error : public std::exception
+{
+private:
+    std::string msg = "Global variables must be initialized with a constant";
+
+public:
+    Parser::NodeIdentifier node;
+    constant_error(Parser::NodeIdentifier node) : node(node){};
     const char *what() const throw()
     {
         return msg.c_str();
@@ -30,7 +46,7 @@ private:
     Parser::NodeIdentifier nodeB;
     different_type_error(Parser::NodeIdentifier nodeA, Parser::NodeIdentifier nodeB) : nodeA(nodeA), nodeB(nodeB){
         // Operation between different types
-        msg = "Operation between different types: " + nodeA.get<Parser::NodeExpression>()->type + " and " + nodeB.get<Parser::NodeExpression>()->type + " (missing cast?)";
+        msg = "Operation between different types: " + nodeA.get<Parser::NodeExpression>()->type.str() + " and " + nodeB.get<Parser::NodeExpression>()->type.str() + " (missing cast?)";
     };
     const char *what() const throw()
     {
@@ -0,0 +1,56 @@
+#pragma once
+#include "parser.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace Parser
+{
+    // Struct-of-arrays copy of an AST.
+    // Node i is described by the i-th entry of every per-node array. Nodes are
+    // numbered in post-order: the children of a node always come before it, so
+    // a bottom-up pass is a single forward loop over the arrays.
+    class FlatTree
+    {
+    public:
+        using Index = std::uint32_t;
+        static constexpr Index none = UINT32_MAX;
+
+        // Per node.
+        std::vector<NodeKind> kinds;
+        // Children of node i are children[firstChild[i] .. firstChild[i] + childCount[i]).
+        std::vector<Index> firstChild;
+        std::vector<Index> childCount;
+        // Source of the node and its descendants.
+        std::vector<Lexer::Span> spans;
+        // Type of expressions, none for others.
+        std::vector<Types::TypeId> types;
+        std::vector<Index> parents;
+
+        std::vector<Index> children;
+        // Top level nodes, in source order.
+        std::vector<Index> roots;
+
+        static FlatTree build(const std::vector<NodeIdentifier> &roots);
+
+        std::size_t size() const { return kinds.size(); }
+        bool isExpression(Index node) const { return kinds[node] >= NodeKind::BinOperator && kinds[node] <= NodeKind::Cast; }
+        // Innermost expression whose span holds a position, holds telling
+        // whether a span does, none if no expression does. In post-order the
+        // first expression found holds no other one, a single sweep finds it.
+        template <typename Holds>
+        Index innermostExpression(Holds holds) const
+        {
+            for (Index node = 0; node < size(); node++)
+            {
+                if (isExpression(node) && holds(spans[node]))
+                    return node;
+            }
+            return none;
+        }
+        // Heap bytes held by the arrays.
+        std::size_t bytes() const;
+
+    private:
+        Index add(NodeIdentifier node);
+    };
+}
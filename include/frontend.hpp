@@ -0,0 +1,69 @@
+#pragma once
+#include "arena.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Frontend
+{
+    // Top level function definition whose body can be parsed and checked on
+    // its own: the body declares no function and holds no pragma, the only
+    // blocks that change the tables shared by the whole file.
+    class FunctionRange
+    {
+    public:
+        // Token indices of the function keyword, of its is and one past its endfunction.
+        std::size_t begin;
+        std::size_t body;
+        std::size_t end;
+    };
+
+    // Pre-scan of the tokens left in ts, which is not moved.
+    std::vector<FunctionRange> scanFunctions(const Lexer::TokenStream &ts);
+
+    // Run check and report the type error it throws, if any, through ts: its
+    // message and the tokens of the nodes at fault. Return false on error.
+    // Any other exception is kept in failure.
+    bool reportTypeErrors(Lexer::TokenStream &ts, std::exception_ptr &failure, const std::function<void()> &check);
+    // Same as reportTypeErrors for the clients that collect diagnostics: any
+    // other exception, even one thrown while a type error is reported, is
+    // reported as an internal error at token.
+    bool reportCheckErrors(Lexer::TokenStream &ts, const Lexer::Token &token, const std::function<void()> &check);
+
+    class Result
+    {
+    public:
+        // Top level blocks in source order, up to the first syntax error.
+        std::vector<Parser::NodeIdentifier> nodes;
+        std::size_t syntaxErrors = 0;
+        bool typeError = false;
+        // Nodes parsed on other threads live in these arenas.
+        std::vector<std::unique_ptr<Parser::Arena>> arenas;
+    };
+
+    // Parse every top level block of ts, resolve pragmas and check types.
+    // With more than one job the signatures are declared in source order, then
+    // function bodies are parsed and checked concurrently. Diagnostics are
+    // printed in source order once everything is done.
+    Result run(Lexer::TokenStream &ts, unsigned jobs, bool printAst);
+
+    // Same as run, with parsing, checking and lowering overlapped: a thread
+    // parses the blocks, a second one checks them and lower is called on the
+    // calling thread with each checked block, in source order, while the next
+    // ones are parsed. Diagnostics are printed as soon as a block is checked.
+    // lower is not called after an error. Blocks are held back while a pragma
+    // further in the file may still rename them. The nodes of the result are
+    // the blocks given to lower.
+    Result runPipeline(Lexer::TokenStream &ts, bool printAst, const std::function<void(Parser::NodeIdentifier)> &lower);
+
+    // Same as run, one block at a time in bounded memory: each checked block is
+    // given to lower, then its nodes and tokens are released. Only the
+    // signatures of the functions are kept. Blocks are held back while a
+    // pragma further in the file may still rename them. lower is not called
+    // after an error and the nodes of the result are always empty.
+    // ts should be a streaming stream.
+    Result runStreaming(Lexer::TokenStream &ts, bool printAst, const std::function<void(Parser::NodeIdentifier)> &lower);
+}
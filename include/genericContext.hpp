@@ -1,35 +1,147 @@
 #pragma once
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
 
-template <typename Index, typename Element>
+// Scoped symbol table.
+// Every visible binding lives in a single open addressing hash map, so a lookup
+// costs the same whatever the nesting depth. Shadowing a name or adding a new
+// one records what to restore in an undo log, and exiting a scope replays the
+// log down to the mark taken when the scope was entered.
+template <typename Index, typename Element, typename Hash = std::hash<Index>>
 class genericContext
 {
+private:
+    class Slot
+    {
     public:
-    std::vector<std::map<Index, Element>> contextStack;
-    void enterScope()
+        Index index;
+        Element element;
+        bool used = false;
+    };
+
+    class Undo
+    {
+    public:
+        Index index;
+        // Shadowed element, nullopt if the index was not bound before.
+        std::optional<Element> previous;
+    };
+
+    std::vector<Slot> slots = std::vector<Slot>(16);
+    std::size_t count = 0;
+    std::vector<Undo> undoLog;
+    std::vector<std::size_t> scopeMarks;
+
+    std::size_t home(const Index &index) const
     {
-        contextStack.push_back(std::map<Index, Element>());
+        // Fibonacci hashing spreads sequential ids, like the ones of symbols.
+        std::uint64_t h = static_cast<std::uint64_t>(Hash()(index)) * 0x9E3779B97F4A7C15ull;
+        return (h >> 32) & (slots.size() - 1);
     }
-    void exitScope()
+
+    // Slot holding index, or the empty slot where it would be inserted.
+    std::size_t probe(const Index &index) const
+    {
+        std::size_t i = home(index);
+        while (slots[i].used && !(slots[i].index == index))
+            i = (i + 1) & (slots.size() - 1);
+        return i;
+    }
+
+    void grow()
     {
-        contextStack.pop_back();
+        std::vector<Slot> old(slots.size() * 2);
+        std::swap(old, slots);
+        for (auto &slot : old)
+        {
+            if (slot.used)
+                slots[probe(slot.index)] = std::move(slot);
+        }
     }
-    std::optional<Element> get(Index index)
+
+    // Backward shift deletion, the table never holds tombstones.
+    void erase(std::size_t i)
     {
-        for (auto it = contextStack.rbegin(); it != contextStack.rend(); it++)
+        const std::size_t mask = slots.size() - 1;
+        for (std::size_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask)
         {
-            if (it->find(index) != it->end())
+            std::size_t h = home(slots[j].index);
+            // Move slot j to i if its home is not within (i, j].
+            if (((j - h) & mask) >= ((j - i) & mask))
             {
-                return it->at(index);
+                slots[i] = std::move(slots[j]);
+                i = j;
             }
         }
+        slots[i] = Slot();
+        count--;
+    }
+
+public:
+    void enterScope()
+    {
+        scopeMarks.push_back(undoLog.size());
+    }
+    void exitScope()
+    {
+        if (scopeMarks.empty())
+            return;
+        const std::size_t mark = scopeMarks.back();
+        scopeMarks.pop_back();
+        while (undoLog.size() > mark)
+        {
+            Undo &undo = undoLog.back();
+            std::size_t i = probe(undo.index);
+            if (undo.previous.has_value())
+                slots[i].element = std::move(undo.previous.value());
+            else
+                erase(i);
+            undoLog.pop_back();
+        }
+    }
+    // Number of scopes entered and not exited yet.
+    std::size_t depth() const
+    {
+        return scopeMarks.size();
+    }
+    const Element *find(const Index &index) const
+    {
+        const Slot &slot = slots[probe(index)];
+        return slot.used ? &slot.element : nullptr;
+    }
+    std::optional<Element> get(const Index &index) const
+    {
+        if (const Element *element = find(index))
+            return *element;
         return std::nullopt;
     }
     void add(Index index, Element element)
     {
-        contextStack.back()[index] = element;
+        if ((count + 1) * 2 > slots.size())
+            grow();
+        std::size_t i = probe(index);
+        Slot &slot = slots[i];
+        if (slot.used)
+        {
+            undoLog.push_back({index, std::move(slot.element)});
+            slot.element = std::move(element);
+            return;
+        }
+        undoLog.push_back({index, std::nullopt});
+        slot.index = std::move(index);
+        slot.element = std::move(element);
+        slot.used = true;
+        count++;
     }
-    genericContext()
+    // Forget every binding and every scope.
+    void clear()
     {
-        contextStack.push_back(std::map<Index, Element>());
+        slots = std::vector<Slot>(16);
+        count = 0;
+        undoLog.clear();
+        scopeMarks.clear();
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include "document.hpp"
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace Ckc
+{
+    // gkc --lsp: a language server for editors, speaking JSON-RPC with the
+    // headers of the Language Server Protocol on input and output. The open
+    // documents are kept and analysed again after each change, incrementally
+    // sent, and their diagnostics are published after each of them.
+    // Only the synchronization of the text and the diagnostics are supported.
+    class LanguageServer
+    {
+    private:
+        std::istream &input;
+        std::ostream &output;
+        std::map<std::string, std::unique_ptr<Document>> documents;
+        bool shutdown = false;
+
+        void send(const std::string &message);
+
+    public:
+        LanguageServer(std::istream &input, std::ostream &output);
+
+        // Handle the content of one message, return false on exit.
+        bool handle(const std::string &message);
+        // Serve until exit or the end of input, return the exit status of gkc.
+        int run();
+
+        // The document open at uri, nullptr if it is not.
+        const Document *getDocument(const std::string &uri) const;
+    };
+}
@@ -1,12 +1,21 @@
 #pragma once
 #include <string>
+#include <string_view>
+#include <array>
+#include <cstdint>
+#include <algorithm>
 #include <istream>
+#include <iostream>
 #include <optional>
 #include <map>
 #include <vector>
 #include <optional>
 #include <fstream>
+#include <memory>
 #include "util.hpp"
+#include "sourceBuffer.hpp"
+#include "symbol.hpp"
+#include "genericContext.hpp"
 // #include "contextProvider.hpp"
 namespace Lexer
 {
@@ -61,23 +70,20 @@ namespace Lexer
         VARIABLE_NAME
     };
 
-    template <typename K, typename V>
-#ifdef PROD
-    constexpr
-#endif
-        std::map<V, K>
-        reverseMap(std::map<K, V> const &map)
+    constexpr std::size_t tokenTypeCount = static_cast<std::size_t>(TokenType::VARIABLE_NAME) + 1;
+
+    class TokenDefinition
     {
-        std::map<V, K> rMap;
-        for (auto const &[k, v] : map)
-        {
-            rMap[v] = k;
-        }
-        return rMap;
-    }
+    public:
+        TokenType type;
+        std::string_view spelling;
+        // Binding of binary operators, lower binds tighter. -1 for other tokens.
+        int precedence = -1;
+    };
 
-    // List of tokens should not be modified after initialization
-    const static std::map<TokenType, std::string> tokenToStringMap{
+    // Every keyword and operator of the language.
+    // The keyword recognizer, tokenTypeToString and the precedences are all generated from this table.
+    constexpr TokenDefinition tokenDefinitions[]{
         // Control flow
         {TokenType::KEYWORD_IF, "if"},
         {TokenType::KEYWORD_THEN, "then"},
@@ -87,7 +93,6 @@ namespace Lexer
         {TokenType::KEYWORD_RETURN, "return"},
         {TokenType::KEYWORD_FUNCTION, "function"},
         {TokenType::KEYWORD_ENDFUNCTION, "endfunction"},
-        {TokenType::KEYWORD_FUNCTION, "partial"},
 
         // File structure
         {TokenType::TOKEN_EOF, ""},
@@ -100,40 +105,183 @@ namespace Lexer
         {TokenType::SYMBOL_NAME, "symbol_name"},
 
         // Comparison operators
-        {TokenType::OPERATOR_LT, "<"},
-        {TokenType::OPERATOR_GT, ">"},
-        {TokenType::OPERATOR_EQ, "="},
-        {TokenType::OPERATOR_LE, "<="},
-        {TokenType::OPERATOR_GE, ">="},
-        {TokenType::OPERATOR_NE, "!="},
+        {TokenType::OPERATOR_LT, "<", 40},
+        {TokenType::OPERATOR_GT, ">", 40},
+        {TokenType::OPERATOR_EQ, "=", 40},
+        {TokenType::OPERATOR_LE, "<=", 40},
+        {TokenType::OPERATOR_GE, ">=", 40},
+        {TokenType::OPERATOR_NE, "!=", 40},
 
         // Arithmetic operators
-        {TokenType::OPERATOR_MOD, "%"},
-        {TokenType::OPERATOR_ADD, "+"},
-        {TokenType::OPERATOR_SUB, "-"},
-        {TokenType::OPERATOR_MUL, "*"},
+        {TokenType::OPERATOR_MOD, "%", 10},
+        {TokenType::OPERATOR_ADD, "+", 20},
+        {TokenType::OPERATOR_SUB, "-", 20},
+        {TokenType::OPERATOR_MUL, "*", 10},
 
         // Binary operators
-        {TokenType::BINARY_OR, "|"},
+        {TokenType::BINARY_OR, "|", 60},
         {TokenType::OPERATOR_NOT, "~"},
-        {TokenType::OPERATOR_LSHIFT, "<<"},
-        {TokenType::BINARY_RSHIFT, ">>"},
-        {TokenType::BINARY_AND, "&"},
+        {TokenType::OPERATOR_LSHIFT, "<<", 30},
+        {TokenType::BINARY_RSHIFT, ">>", 30},
+        {TokenType::BINARY_AND, "&", 50},
 
         // Logical operators
-        {TokenType::LOGICAL_OR, "or"},
-        {TokenType::LOGICAL_AND, "and"},
-        {TokenType::LOGICAL_XOR, "xor"},
+        {TokenType::LOGICAL_OR, "or", 60},
+        {TokenType::LOGICAL_AND, "and", 50},
+        {TokenType::LOGICAL_XOR, "xor", 60},
         {TokenType::LOGICAL_NOT, "not"},
 
         // Misc
-        {TokenType::OPERATOR_DIV, "/"},
+        {TokenType::OPERATOR_DIV, "/", 10},
         {TokenType::OPERATOR_ASSIGN, ":="},
         {TokenType::PARENTHESIS_OPEN, "("},
         {TokenType::KEYWORD_HASHTAG, "#"},
         {TokenType::PARENTHESIS_CLOSE, ")"},
+
+        // Builtin types
+        {TokenType::TYPE, "uint8"},
+        {TokenType::TYPE, "uint16"},
+        {TokenType::TYPE, "uint32"},
+        {TokenType::TYPE, "uint64"},
+        {TokenType::TYPE, "int8"},
+        {TokenType::TYPE, "int16"},
+        {TokenType::TYPE, "int32"},
+        {TokenType::TYPE, "int64"},
+        {TokenType::TYPE, "bool"},
+    };
+
+    constexpr std::array<int, 6> precedenceList{
+        10,
+        20,
+        30,
+        40,
+        50,
+        60,
     };
-    const static std::map<std::string, TokenType> stringToTokenMap = reverseMap(tokenToStringMap);
+
+    namespace TokenTable
+    {
+        constexpr std::uint32_t hash(std::string_view spelling, std::uint32_t seed)
+        {
+            std::uint32_t h = 2166136261u ^ seed;
+            for (char c : spelling)
+            {
+                h ^= static_cast<unsigned char>(c);
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+        constexpr std::size_t slotCount = 256;
+        constexpr std::size_t maxSpellingLength = []()
+        {
+            std::size_t length = 0;
+            for (const auto &definition : tokenDefinitions)
+                length = std::max(length, definition.spelling.size());
+            return length;
+        }();
+
+        // First seed for which every spelling lands in its own slot.
+        constexpr std::uint32_t seed = []()
+        {
+            for (std::uint32_t seed = 0;; seed++)
+            {
+                bool used[slotCount]{};
+                bool collision = false;
+                for (const auto &definition : tokenDefinitions)
+                {
+                    auto slot = hash(definition.spelling, seed) % slotCount;
+                    collision = collision || used[slot];
+                    used[slot] = true;
+                }
+                if (!collision)
+                    return seed;
+            }
+        }();
+
+        // Index + 1 in tokenDefinitions of the spelling hashed to each slot, 0 if the slot is empty.
+        constexpr std::array<std::uint8_t, slotCount> slots = []()
+        {
+            std::array<std::uint8_t, slotCount> slots{};
+            for (std::size_t i = 0; i < std::size(tokenDefinitions); i++)
+                slots[hash(tokenDefinitions[i].spelling, seed) % slotCount] = i + 1;
+            return slots;
+        }();
+
+        constexpr std::array<int, tokenTypeCount> spellingCounts = []()
+        {
+            std::array<int, tokenTypeCount> counts{};
+            for (const auto &definition : tokenDefinitions)
+                counts[static_cast<std::size_t>(definition.type)]++;
+            return counts;
+        }();
+
+        // Token types spelled in a single way, like operators. Not TYPE.
+        constexpr std::array<bool, tokenTypeCount> hasSpelling = []()
+        {
+            std::array<bool, tokenTypeCount> hasSpelling{};
+            for (std::size_t i = 0; i < tokenTypeCount; i++)
+                hasSpelling[i] = spellingCounts[i] == 1;
+            return hasSpelling;
+        }();
+
+        // Indexed by token type, only meaningful where hasSpelling is set.
+        constexpr std::array<std::string_view, tokenTypeCount> spellings = []()
+        {
+            std::array<std::string_view, tokenTypeCount> spellings{};
+            for (const auto &definition : tokenDefinitions)
+                spellings[static_cast<std::size_t>(definition.type)] = definition.spelling;
+            return spellings;
+        }();
+
+        constexpr std::array<int, tokenTypeCount> precedences = []()
+        {
+            std::array<int, tokenTypeCount> precedences{};
+            precedences.fill(-1);
+            for (const auto &definition : tokenDefinitions)
+                precedences[static_cast<std::size_t>(definition.type)] = definition.precedence;
+            return precedences;
+        }();
+
+        constexpr std::uint64_t mask(std::initializer_list<TokenType> types)
+        {
+            std::uint64_t mask = 0;
+            for (auto type : types)
+                mask |= std::uint64_t(1) << static_cast<std::size_t>(type);
+            return mask;
+        }
+        static_assert(tokenTypeCount <= 64, "token classes are stored in a 64 bits mask");
+
+        constexpr std::uint64_t endMultiBlock = mask({TokenType::KEYWORD_ELSE, TokenType::KEYWORD_FI, TokenType::KEYWORD_ENDFUNCTION, TokenType::TOKEN_EOF});
+        constexpr std::uint64_t endExpression = mask({TokenType::TOKEN_EOF, TokenType::SEMICOLON, TokenType::KEYWORD_THEN, TokenType::PARENTHESIS_CLOSE});
+        constexpr std::uint64_t unaryOperator = mask({TokenType::OPERATOR_NOT, TokenType::LOGICAL_NOT, TokenType::OPERATOR_SUB});
+        constexpr std::uint64_t booleanOperator = mask({TokenType::LOGICAL_AND, TokenType::LOGICAL_OR, TokenType::LOGICAL_XOR, TokenType::LOGICAL_NOT});
+        constexpr std::uint64_t comparisonOperator = mask({TokenType::OPERATOR_LT, TokenType::OPERATOR_GT, TokenType::OPERATOR_EQ, TokenType::OPERATOR_LE, TokenType::OPERATOR_GE, TokenType::OPERATOR_NE});
+
+        constexpr bool isIn(std::uint64_t mask, TokenType type)
+        {
+            return (mask >> static_cast<std::size_t>(type)) & 1;
+        }
+    }
+
+    // Return the type of a keyword or operator, nullopt for any other spelling.
+    constexpr std::optional<TokenType> findKeyword(std::string_view spelling)
+    {
+        if (spelling.size() > TokenTable::maxSpellingLength)
+            return std::nullopt;
+        auto slot = TokenTable::slots[TokenTable::hash(spelling, TokenTable::seed) % TokenTable::slotCount];
+        if (slot == 0 || tokenDefinitions[slot - 1].spelling != spelling)
+            return std::nullopt;
+        return tokenDefinitions[slot - 1].type;
+    }
+
+    constexpr int getPrecedence(TokenType type) { return TokenTable::precedences[static_cast<std::size_t>(type)]; }
+    constexpr bool isEndMultiBlock(TokenType type) { return TokenTable::isIn(TokenTable::endMultiBlock, type); }
+    constexpr bool isEndExpression(TokenType type) { return TokenTable::isIn(TokenTable::endExpression, type); }
+    constexpr bool isUnaryOperator(TokenType type) { return TokenTable::isIn(TokenTable::unaryOperator, type); }
+    constexpr bool isBooleanOperator(TokenType type) { return TokenTable::isIn(TokenTable::booleanOperator, type); }
+    constexpr bool isComparisonOperator(TokenType type) { return TokenTable::isIn(TokenTable::comparisonOperator, type); }
+
     enum class ModifierType
     {
         Named
@@ -144,94 +292,134 @@ namespace Lexer
     };
 
     std::string tokenTypeToString(TokenType type);
-    std::string getCurrentLine(std::istream &input);
     std::ostream &operator<<(std::ostream &os, TokenType const &tok);
 
-    static std::map<TokenType, int> tokenPrecedence{
-        {TokenType::OPERATOR_MUL, 10},
-        {TokenType::OPERATOR_DIV, 10},
-        {TokenType::OPERATOR_MOD, 10},
-        {TokenType::OPERATOR_ADD, 20},
-        {TokenType::OPERATOR_SUB, 20},
-        {TokenType::OPERATOR_LSHIFT, 30},
-        {TokenType::BINARY_RSHIFT, 30},
-        {TokenType::OPERATOR_LT, 40},
-        {TokenType::OPERATOR_LE, 40},
-        {TokenType::OPERATOR_GT, 40},
-        {TokenType::OPERATOR_GE, 40},
-        {TokenType::OPERATOR_EQ, 40},
-        {TokenType::OPERATOR_NE, 40},
-        {TokenType::BINARY_AND, 50},
-        {TokenType::LOGICAL_AND, 50},
-        {TokenType::BINARY_OR, 60},
-        {TokenType::LOGICAL_OR, 60},
-        {TokenType::LOGICAL_XOR, 60}};
-    static std::vector<int> precedenceList{
-        10,
-        20,
-        30,
-        40,
-        50,
-        60,
-    };
 
+    // The value of a token is a view into the source buffer of its TokenStream,
+    // the stream must outlive every token (and node) built from it.
     class Token
     {
     public:
         TokenType type;
-        std::string value;
+        std::string_view value;
+        // Interned name of identifiers, empty for every other token.
+        Symbol symbol;
         int line;
         int column;
 
-        Token(TokenType type, std::string value, int line, int column) : type(type), value(value), line(line), column(column){};
+        Token(TokenType type, std::string_view value, int line, int column, Symbol symbol = Symbol()) : type(type), value(value), symbol(symbol), line(line), column(column){};
         Token(){};
-        bool isEndMultiBlock();
-        bool isUnaryOperator();
-        bool isEndExpression();
-        bool isBooleanOperator();
-        bool isComparisonOperator();
-        int getPrecedence();
+        bool isEndMultiBlock() const;
+        bool isUnaryOperator() const;
+        bool isEndExpression() const;
+        bool isBooleanOperator() const;
+        bool isComparisonOperator() const;
+        int getPrecedence() const;
         std::string underline(std::string color);
         bool operator==(const Token &other) const;
     };
 
+    // An error and the parts of the source it is about, for the clients that
+    // present diagnostics themselves.
+    class Diagnostic
+    {
+    public:
+        std::string message;
+        std::vector<SourceRange> ranges;
+
+        bool operator==(const Diagnostic &other) const = default;
+    };
+
+    // The whole source is lexed into a token array when the stream is built,
+    // so lookahead is an index away. A streaming stream lexes tokens when they
+    // are first looked at instead, and forgets them on discardConsumed(). Token kinds do not depend on the parser:
+    // every name is an IDENTIFIER and the parser resolves it in its own scopes.
     class TokenStream
     {
     private:
-        std::istream &input;
-        std::optional<Token> buffer = std::nullopt;
-        std::vector<std::string> lines;
-        std::string getNextToken();
+        std::shared_ptr<SourceBuffer> source;
+        // Lexing state, advanced by const lookups of a streaming stream.
+        mutable const char *cursor;
+        mutable int line = 1;
+        mutable int column = 1;
+        // Position of the first character of the source.
+        int firstLine = 1;
+        int firstColumn = 1;
+        // Ends with a TOKEN_EOF once lexed, returned again and again once every
+        // token is read.
+        mutable std::vector<Token> tokens;
+        mutable bool lexed = false;
+        bool streaming = false;
+        // Index in the whole stream of tokens[0], and end of the source pages given back.
+        std::size_t base = 0;
+        const char *discarded;
+        std::size_t position = 0;
         std::string filename = "";
+        // Where errors are printed.
+        std::ostream *diagnostics = &std::cerr;
+        // Where errors are collected instead, if set.
+        std::vector<Diagnostic> *collected = nullptr;
+        void moveHead() const;
+        std::string_view getNextToken() const;
+        Token lexToken() const;
+        // Lex until tokens[index] exists or the TOKEN_EOF is reached.
+        void lexUntil(std::size_t index) const;
+        int peekChar() const { return cursor < source->end() ? static_cast<unsigned char>(*cursor) : EOF; }
         // Context::ContextProvider &contextProvider = Context::ContextProvider::getInstance();
 
     public:
-        int line = 1;
-        int column = 1;
-        void moveHead();
-        TokenStream(std::istream &input, std::string filename) : input(input), filename(filename)
-        {
-            lines.push_back(getCurrentLine(input));
-            moveHead();
-        };
-        TokenStream(std::istream &input) : input(input)
-        {
-            lines.push_back(getCurrentLine(input));
-            moveHead();
-        };
+        // Positions are counted from line and column, where source starts in
+        // a larger file.
+        TokenStream(std::shared_ptr<SourceBuffer> source, std::string filename = "", bool streaming = false, int line = 1, int column = 1);
+        TokenStream(std::istream &input, std::string filename) : TokenStream(SourceBuffer::fromStream(input), filename){};
+        TokenStream(std::istream &input) : TokenStream(SourceBuffer::fromStream(input)){};
+        // Tokens [begin, end) of parent followed by its TOKEN_EOF, sharing its
+        // source. parent must not be streaming.
+        TokenStream(const TokenStream &parent, std::size_t begin, std::size_t end);
 
         Token get();
-        Token peek();
-        bool isEmpty();
+        // Look offset tokens ahead of the next one, TOKEN_EOF past the end.
+        const Token &peek(std::size_t offset = 0) const;
+        bool isEmpty() const;
+        // Index of the next token, seek() moves to an index returned by tell().
+        std::size_t tell() const { return base + position; }
+        void seek(std::size_t index)
+        {
+            lexUntil(index - base);
+            position = std::min(index - base, tokens.size() - 1);
+        }
+        // Streaming streams only: forget the tokens already read and give their
+        // source pages back, seek() can no longer go before tell().
+        void discardConsumed();
+        const SourceBuffer &getSource() const { return *source; }
+        void setDiagnostics(std::ostream &stream) { diagnostics = &stream; }
+        std::ostream &getDiagnostics() { return *diagnostics; }
+        // Append the errors reported through the stream to list instead of
+        // printing them, until it is set back to nullptr.
+        void collectDiagnostics(std::vector<Diagnostic> *list) { collected = list; }
+        bool collectsDiagnostics() const { return collected != nullptr; }
         std::string getLine(int line);
+        // Bytes of the source from the first character of first to the last
+        // of last, both tokens of this stream.
+        Span spanOf(const Token &first, const Token &last) const;
+        Span spanOf(const Token &token) const { return spanOf(token, token); }
+        // Position of the byte at offset of the source, numbered like the tokens.
+        SourcePosition positionOf(std::size_t offset) const;
+        SourceRange rangeOf(Span span) const;
+        SourceRange rangeOf(const Token &token) const;
         VIRTUAL void unexpectedToken(Token token, std::optional<TokenType> expected = std::nullopt);
-        void highlightMultiplesTokens(std::vector<std::pair<Token, Token>> tokens);
+        void highlightRanges(std::vector<SourceRange> ranges);
+        // Print message and highlight ranges, or collect them.
+        void reportError(const std::string &message, std::vector<SourceRange> ranges);
+        void reportError(const std::string &message, const std::vector<Span> &spans);
         void printLine(int line);
 
 
         std::vector<Token> toList();
     };
 
+    // Scopes of the names declared so far, filled by the parser to tell
+    // function names from variable names. Each thread has its own scopes.
     namespace LexerContext
     {
 
@@ -239,9 +427,9 @@ namespace Lexer
         void pushContext();
         void popContext();
         void init();
-        std::optional<TokenType> getTokenType(std::string token);
-        void addToken(std::string token, TokenType type);
-        extern std::vector<std::map<std::string, TokenType>> contextStack;
+        std::optional<TokenType> getTokenType(Symbol token);
+        void addToken(Symbol token, TokenType type);
+        extern thread_local genericContext<Symbol, TokenType> context;
     };
 
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include "lexer.hpp"
+#include "arena.hpp"
+#include "types.hpp"
 #include <optional>
 #include <memory>
 #include <unordered_set>
@@ -54,43 +56,73 @@ namespace Parser
             std::string expectedString = "";
             if (expected.has_value())
                 expectedString = "Expected " + Lexer::tokenTypeToString(expected.value());
-            return ("Unexpected token " + Lexer::tokenTypeToString(token.type) + " " + token.value + " at " + std::to_string(token.line) + ":" + std::to_string(token.column) + " " + expectedString).c_str();
+            return ("Unexpected token " + Lexer::tokenTypeToString(token.type) + " " + std::string(token.value) + " at " + std::to_string(token.line) + ":" + std::to_string(token.column) + " " + expectedString).c_str();
         }
     };
 
+    // Syntax errors reported so far, per thread, or per compilation session
+    // while one is active on the thread.
+    class SyntaxErrors
+    {
+    public:
+        bool error = false;
+        std::size_t count = 0;
+
+        static SyntaxErrors &getCurrent();
+        static void setCurrent(SyntaxErrors &errors);
+    };
     bool hasError();
-    using NodeIdentifierIndex = int;
-    class NodeIdentifier;
+    std::size_t errorCount();
 
-    extern std::map<NodeIdentifierIndex, std::shared_ptr<Node>> nodes;
+    // Concrete node classes, blocks then expressions so that every abstract
+    // class matches a contiguous range.
+    enum class NodeKind
+    {
+        MultiBlock,
+        If,
+        Function,
+        Pragma,
+        Goto,
+        Return,
+        VariableDeclaration,
+        VariableAssignment,
+        BinOperator,
+        UnaryOperator,
+        Number,
+        Text,
+        FunctionCall,
+        Cast,
+        BlockModifier,
+    };
+
+    // Handle to a node of the current arena, null by default.
     class NodeIdentifier
     {
     public:
-        NodeIdentifierIndex id;
-        NodeIdentifier(NodeIdentifierIndex id) : id(id){};
-        NodeIdentifier() : id(-1){};
+        Node *node = nullptr;
+        NodeIdentifier(Node *node) : node(node){};
+        NodeIdentifier(){};
+        // Return nullptr if the node is not a NodeType.
         template <typename NodeType = Node>
-        std::shared_ptr<NodeType> get()
+        NodeType *get() const;
+        Node *operator->() const
         {
-            if (id == -1)
-                return nullptr;
-            return std::dynamic_pointer_cast<NodeType>(nodes[id]);
-        };
-        std::shared_ptr<Node> operator->()
-        {
-            return get();
+            return node;
         }
     };
-    // NodeIdentifier addNode(std::shared_ptr<Node> node);
 
     class Node
     {
     public:
+        const NodeKind kind;
+        // Source of the node, from its first token to its last one, with the
+        // parentheses around an expression.
+        Lexer::Span span;
         std::optional<std::string> symbol_name;
-        std::optional<Lexer::Token> token;
         NodeIdentifier thisNode;
-        Node() : token(std::nullopt) {}
-        Node(Lexer::Token token) : token(token){};
+        Node(NodeKind kind) : kind(kind) {}
+        Node(NodeKind kind, Lexer::Span span) : kind(kind), span(span){};
+        static bool classof(const Node *node) { return true; }
         void setSymbolName(std::string symbol_name)
         {
             this->symbol_name = symbol_name;
@@ -105,12 +137,30 @@ namespace Parser
         virtual ~Node() = default;
     };
 
+    template <typename NodeType>
+    NodeType *NodeIdentifier::get() const
+    {
+        if (node == nullptr || !NodeType::classof(node))
+            return nullptr;
+        return static_cast<NodeType *>(node);
+    }
+
+    // Allocate a node in the current arena and return a handle to it.
+    template <typename NodeType, typename... Args>
+    NodeIdentifier addNode(Args &&...args)
+    {
+        NodeType *node = Arena::getCurrent().create<NodeType>(std::forward<Args>(args)...);
+        node->thisNode = NodeIdentifier(node);
+        return node->thisNode;
+    }
+
     class NodeExpression : public Node
     {
     public:
-        std::string type;
-        NodeExpression(){};
-        NodeExpression(Lexer::Token token) : Node(token){};
+        Types::TypeId type;
+        NodeExpression(NodeKind kind) : Node(kind){};
+        NodeExpression(NodeKind kind, Lexer::Span span) : Node(kind, span){};
+        static bool classof(const Node *node) { return node->kind >= NodeKind::BinOperator && node->kind <= NodeKind::Cast; }
         virtual void accept(Visitor &v) override
         {
             Node::enter(v);
@@ -121,9 +171,10 @@ namespace Parser
     class NodeBlockModifier : public Node
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::BlockModifier; }
         Lexer::ModifierType modifier_type;
         std::string modifier_value;
-        NodeBlockModifier(Lexer::ModifierType modifier_type, std::string modifier_value) : modifier_type(modifier_type), modifier_value(modifier_value){};
+        NodeBlockModifier(Lexer::Span span, Lexer::ModifierType modifier_type, std::string modifier_value) : Node(NodeKind::BlockModifier, span), modifier_type(modifier_type), modifier_value(modifier_value){};
         virtual void accept(Visitor &v)
         {
             Node::enter(v);
@@ -134,8 +185,9 @@ namespace Parser
     class NodeBlock : public Node
     {
     public:
-        NodeBlock(){};
-        NodeBlock(Lexer::Token token) : Node(token){};
+        NodeBlock(NodeKind kind) : Node(kind){};
+        NodeBlock(NodeKind kind, Lexer::Span span) : Node(kind, span){};
+        static bool classof(const Node *node) { return node->kind >= NodeKind::MultiBlock && node->kind <= NodeKind::VariableAssignment; }
         std::optional<NodeIdentifier> modifier;
         virtual void accept(Visitor &v)
         {
@@ -148,8 +200,13 @@ namespace Parser
     class NodeMultiBlock : public NodeBlock
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::MultiBlock; }
         std::vector<NodeIdentifier> blocks;
-        NodeMultiBlock(std::vector<NodeIdentifier> blocks) : blocks(blocks){};
+        NodeMultiBlock(std::vector<NodeIdentifier> blocks) : NodeBlock(NodeKind::MultiBlock), blocks(blocks)
+        {
+            if (!blocks.empty())
+                span = {blocks.front()->span.begin, blocks.back()->span.end};
+        };
         virtual void accept(Visitor &v)
         {
             NodeBlock::accept(v);
@@ -164,8 +221,9 @@ namespace Parser
     {
     public:
         virtual ~NodeStatement() = default;
-        NodeStatement(){};
-        NodeStatement(Lexer::Token token) : NodeBlock(token){};
+        NodeStatement(NodeKind kind) : NodeBlock(kind){};
+        NodeStatement(NodeKind kind, Lexer::Span span) : NodeBlock(kind, span){};
+        static bool classof(const Node *node) { return node->kind >= NodeKind::Goto && node->kind <= NodeKind::VariableAssignment; }
         virtual void accept(Visitor &v)
         {
             NodeBlock::accept(v);
@@ -175,12 +233,12 @@ namespace Parser
     class NodeIf : public NodeBlock
     {
     public:
-        Lexer::Token fiToken;
+        static bool classof(const Node *node) { return node->kind == NodeKind::If; }
         NodeIdentifier condition;
         NodeIdentifier thenStatement;
         std::optional<NodeIdentifier> elseStatement;
-        NodeIf(Lexer::Token token, Lexer::Token fiToken, NodeIdentifier condition, NodeIdentifier thenStatement, std::optional<NodeIdentifier> elseStatement)
-            : NodeBlock(token), fiToken(fiToken), condition(condition), thenStatement(thenStatement), elseStatement(elseStatement){};
+        NodeIf(Lexer::Span span, NodeIdentifier condition, NodeIdentifier thenStatement, std::optional<NodeIdentifier> elseStatement)
+            : NodeBlock(NodeKind::If, span), condition(condition), thenStatement(thenStatement), elseStatement(elseStatement){};
         void accept(Visitor &v) override
         {
             NodeBlock::accept(v);
@@ -191,8 +249,9 @@ namespace Parser
     class NodeGoto : public NodeStatement
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::Goto; }
         std::string label;
-        NodeGoto(std::string label) : label(label){};
+        NodeGoto(Lexer::Span span, std::string label) : NodeStatement(NodeKind::Goto, span), label(label){};
         void accept(Visitor &v) override
         {
             NodeStatement::accept(v);
@@ -203,9 +262,10 @@ namespace Parser
     class NodeReturn : public NodeStatement
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::Return; }
         std::optional<NodeIdentifier> value;
-        NodeReturn(Lexer::Token token, std::optional<NodeIdentifier> value) : NodeStatement(token), value(value){};
-        NodeReturn() = default;
+        NodeReturn(Lexer::Span span, std::optional<NodeIdentifier> value) : NodeStatement(NodeKind::Return, span), value(value){};
+        NodeReturn() : NodeStatement(NodeKind::Return){};
         void accept(Visitor &v) override
         {
             NodeStatement::accept(v);
@@ -216,10 +276,11 @@ namespace Parser
     class NodeBinOperator : public NodeExpression
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::BinOperator; }
         NodeIdentifier left;
         NodeIdentifier right;
         Lexer::TokenType op;
-        NodeBinOperator(NodeIdentifier left, NodeIdentifier right, Lexer::TokenType op) : left(left), right(right), op(op){};
+        NodeBinOperator(NodeIdentifier left, NodeIdentifier right, Lexer::TokenType op) : NodeExpression(NodeKind::BinOperator, {left->span.begin, right->span.end}), left(left), right(right), op(op){};
         virtual void accept(Visitor &v) override
         {
             NodeExpression::accept(v);
@@ -233,33 +294,22 @@ namespace Parser
 
         bool isBooleanOperator()
         {
-            std::unordered_set<Lexer::TokenType> booleanOperators{
-                Lexer::TokenType::LOGICAL_AND,
-                Lexer::TokenType::LOGICAL_OR,
-                Lexer::TokenType::LOGICAL_XOR,
-                Lexer::TokenType::LOGICAL_NOT};
-            return booleanOperators.find(op) != booleanOperators.end();
+            return Lexer::isBooleanOperator(op);
         }
 
         bool isComparisonOperator()
         {
-            std::unordered_set<Lexer::TokenType> comparisonOperators{
-                Lexer::TokenType::OPERATOR_LT,
-                Lexer::TokenType::OPERATOR_GT,
-                Lexer::TokenType::OPERATOR_EQ,
-                Lexer::TokenType::OPERATOR_LE,
-                Lexer::TokenType::OPERATOR_GE,
-                Lexer::TokenType::OPERATOR_NE};
-            return comparisonOperators.find(op) != comparisonOperators.end();
+            return Lexer::isComparisonOperator(op);
         }
     };
 
     class NodeUnaryOperator : public NodeExpression
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::UnaryOperator; }
         NodeIdentifier right;
         Lexer::TokenType op;
-        NodeUnaryOperator(Lexer::Token token, NodeIdentifier right, Lexer::TokenType op) : NodeExpression(token), right(right), op(op){};
+        NodeUnaryOperator(Lexer::Span span, NodeIdentifier right, Lexer::TokenType op) : NodeExpression(NodeKind::UnaryOperator, span), right(right), op(op){};
         virtual void accept(Visitor &v) override
         {
             NodeExpression::accept(v);
@@ -270,8 +320,9 @@ namespace Parser
     class NodeNumber : public NodeExpression
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::Number; }
         int value;
-        NodeNumber(int value, Lexer::Token token) : NodeExpression(token), value(value) {}
+        NodeNumber(int value, Lexer::Span span) : NodeExpression(NodeKind::Number, span), value(value) {}
         virtual void accept(Visitor &v) override
         {
             NodeExpression::accept(v);
@@ -282,8 +333,9 @@ namespace Parser
     class NodeText : public NodeExpression
     {
     public:
-        std::string name;
-        NodeText(std::string name, Lexer::Token token) : NodeExpression(token), name(name){};
+        static bool classof(const Node *node) { return node->kind == NodeKind::Text; }
+        Lexer::Symbol name;
+        NodeText(Lexer::Symbol name, Lexer::Span span) : NodeExpression(NodeKind::Text, span), name(name){};
         virtual void accept(Visitor &v) override
         {
             v.visitNodeText(*this);
@@ -293,10 +345,11 @@ namespace Parser
     class NodeVariableDeclaration : public NodeStatement
     {
     public:
-        std::string type;
-        std::string name;
+        static bool classof(const Node *node) { return node->kind == NodeKind::VariableDeclaration; }
+        Types::TypeId type;
+        Lexer::Symbol name;
         std::optional<NodeIdentifier> value;
-        NodeVariableDeclaration(Lexer::Token token, std::string type, std::string name, std::optional<NodeIdentifier> value) : NodeStatement(token), type(type), name(name)
+        NodeVariableDeclaration(Lexer::Span span, Types::TypeId type, Lexer::Symbol name, std::optional<NodeIdentifier> value) : NodeStatement(NodeKind::VariableDeclaration, span), type(type), name(name)
         {
             if (value.has_value())
                 this->value = std::move(value.value());
@@ -311,9 +364,10 @@ namespace Parser
     class NodeVariableAssignment : public NodeStatement
     {
     public:
-        std::string name;
+        static bool classof(const Node *node) { return node->kind == NodeKind::VariableAssignment; }
+        Lexer::Symbol name;
         NodeIdentifier value;
-        NodeVariableAssignment(Lexer::Token token, std::string name, NodeIdentifier value) : NodeStatement(token), name(name), value(value){};
+        NodeVariableAssignment(Lexer::Span span, Lexer::Symbol name, NodeIdentifier value) : NodeStatement(NodeKind::VariableAssignment, span), name(name), value(value){};
         void accept(Visitor &v) override
         {
             NodeStatement::accept(v);
@@ -324,10 +378,10 @@ namespace Parser
     class NodeFunctionCall : public NodeExpression
     {
     public:
-        std::string name;
+        static bool classof(const Node *node) { return node->kind == NodeKind::FunctionCall; }
+        Lexer::Symbol name;
         std::vector<NodeIdentifier> arguments;
-        Lexer::Token closeParen;
-        NodeFunctionCall(Lexer::Token token, std::string name, std::vector<NodeIdentifier> arguments, Lexer::Token closeParen) : NodeExpression(token), name(name), arguments(arguments), closeParen(closeParen){};
+        NodeFunctionCall(Lexer::Span span, Lexer::Symbol name, std::vector<NodeIdentifier> arguments) : NodeExpression(NodeKind::FunctionCall, span), name(name), arguments(arguments){};
         void accept(Visitor &v) override
         {
             v.visitNodeFunctionCall(*this);
@@ -337,12 +391,14 @@ namespace Parser
     class NodeFunction : public NodeBlock
     {
     public:
-        std::string name;
-        std::vector<std::pair<std::string, std::string>> arguments;
-        std::optional<std::string> returnType;
+        static bool classof(const Node *node) { return node->kind == NodeKind::Function; }
+        // The function keyword, where the overload is declared.
+        Lexer::Token functionToken;
+        Lexer::Symbol name;
+        std::vector<std::pair<Types::TypeId, Lexer::Symbol>> arguments; // <type, name>
+        std::optional<Types::TypeId> returnType;
         std::optional<NodeIdentifier> body;
-        Lexer::Token endfunctionToken;
-        NodeFunction(Lexer::Token token, std::string name, std::vector<std::pair<std::string, std::string>> arguments, std::optional<std::string> returnType, std::optional<NodeIdentifier> body, Lexer::Token endfunctionToken) : NodeBlock(token), name(name), arguments(arguments), returnType(returnType), endfunctionToken(endfunctionToken)
+        NodeFunction(Lexer::Span span, Lexer::Token functionToken, Lexer::Symbol name, std::vector<std::pair<Types::TypeId, Lexer::Symbol>> arguments, std::optional<Types::TypeId> returnType, std::optional<NodeIdentifier> body) : NodeBlock(NodeKind::Function, span), functionToken(functionToken), name(name), arguments(arguments), returnType(returnType)
         {
             // this->symbol_name = name;
             this->body = body;
@@ -358,9 +414,9 @@ namespace Parser
     class NodeCast : public NodeExpression
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::Cast; }
         NodeIdentifier value;
-        Lexer::Token closeParen;
-        NodeCast(Lexer::Token token, std::string type, NodeIdentifier value, Lexer::Token closeParen) : NodeExpression(token), value(value), closeParen(closeParen)
+        NodeCast(Lexer::Span span, Types::TypeId type, NodeIdentifier value) : NodeExpression(NodeKind::Cast, span), value(value)
         {
             this->type = type;
         };
@@ -374,10 +430,11 @@ namespace Parser
     class NodePragma : public NodeBlock
     {
     public:
+        static bool classof(const Node *node) { return node->kind == NodeKind::Pragma; }
         Lexer::TokenType pragmaType;
         std::string value;
         Lexer::Token targetObject;
-        NodePragma(Lexer::Token token, Lexer::TokenType pragmaType, std::string value, Lexer::Token targetObject) : NodeBlock(token), pragmaType(pragmaType), value(value), targetObject(targetObject){};
+        NodePragma(Lexer::Span span, Lexer::TokenType pragmaType, std::string value, Lexer::Token targetObject) : NodeBlock(NodeKind::Pragma, span), pragmaType(pragmaType), value(value), targetObject(targetObject){};
 
         void accept(Visitor &v) override
         {
@@ -386,6 +443,7 @@ namespace Parser
         };
     };
 
+    Lexer::TokenType resolve(const Lexer::Token &t);
     NodeIdentifier parseStatement(Lexer::TokenStream &ts);
     NodeIdentifier parseExpression(Lexer::TokenStream &ts);
     NodeIdentifier parseBlock(Lexer::TokenStream &ts);
@@ -393,5 +451,8 @@ namespace Parser
     NodeIdentifier parseVariableAssignment(Lexer::TokenStream &ts);
     NodeIdentifier parsePrecedence(Lexer::TokenStream &ts, int precedenceIndex = Lexer::precedenceList.size() - 1);
     NodeIdentifier parseMultiBlock(Lexer::TokenStream &ts);
+    NodeIdentifier parseFunctionHeader(Lexer::TokenStream &ts);
+    bool parseFunctionEnd(Lexer::TokenStream &ts, NodeFunction &function);
+    void synchronize(Lexer::TokenStream &ts);
 
 }
\ No newline at end of file
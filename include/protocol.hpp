@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <sys/un.h>
+
+// Messages between the compile server and its clients, over a local socket.
+// A client sends one request on a connection and reads one response. Every
+// string is sent as its 64 bit length followed by its bytes, up to 256 MiB,
+// integers are in the byte order of the host. Nothing here depends on LLVM, so the client
+// stays small and starts fast.
+namespace Ckc
+{
+    constexpr std::uint32_t protocolVersion = 1;
+
+    class Request
+    {
+    public:
+        // The options of Ckc::Options that make sense on a server, nothing is printed.
+        std::uint32_t jobs = 1;
+        bool pipeline = false;
+        bool stream = false;
+        // Paths are resolved by the server, so they should be absolute.
+        std::string cacheDirectory;
+        // Name of the source in the diagnostics.
+        std::string filename;
+        std::string objectFilename;
+        std::string source;
+    };
+
+    class Response
+    {
+    public:
+        bool compiled = false;
+        // Syntax and type errors, what gkc prints to the standard error.
+        std::string diagnostics;
+    };
+
+    // Return false if the peer closed the connection or on an I/O error.
+    bool writeRequest(int fd, const Request &request);
+    bool readRequest(int fd, Request &request);
+    bool writeResponse(int fd, const Response &response);
+    bool readResponse(int fd, Response &response);
+
+    // Address of the socket at path. Return false, error telling why, if the
+    // path does not fit.
+    bool socketAddress(const std::string &path, sockaddr_un &address, std::string &error);
+
+    // Send request to the server listening on socketPath and wait for its
+    // response. Return false, error telling why, if the server cannot be reached.
+    bool compileRemote(const std::string &socketPath, const Request &request, Response &response, std::string &error);
+}
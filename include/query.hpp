@@ -0,0 +1,227 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Demand-driven computations memoized by key. A query records the queries it
+// reads while it runs. After an input changes, a value is only computed again
+// if one of the values it read changed, and a value computed again that comes
+// out equal to the previous one does not invalidate its readers.
+// Not thread-safe: an engine and its queries are used from one thread.
+namespace Query
+{
+    // Incremented by every change of an input.
+    using Revision = std::uint64_t;
+
+    class Statistics
+    {
+    public:
+        // Values read without computing them, as nothing they read changed.
+        std::size_t reused = 0;
+        // Values computed, and those of them equal to the previous value.
+        std::size_t computed = 0;
+        std::size_t unchanged = 0;
+
+        // Share of the values read that were reused.
+        double hitRate() const
+        {
+            const std::size_t reads = reused + computed;
+            return reads == 0 ? 0 : double(reused) / double(reads);
+        }
+    };
+
+    // Memoized value of a query for one key.
+    class Slot
+    {
+    public:
+        // Revision at which the value was last known to be up to date, and
+        // revision at which it last changed.
+        Revision verifiedAt = 0;
+        Revision changedAt = 0;
+        // Slots read by the last computation, in the order they were read.
+        std::vector<Slot *> dependencies;
+        bool computing = false;
+        Statistics *statistics = nullptr;
+
+        virtual ~Slot() = default;
+        virtual bool isInput() const { return false; }
+        virtual bool hasValue() const = 0;
+        // Compute the value, return false if it equals the previous one, which is kept.
+        virtual bool compute() = 0;
+        virtual const std::string &name() const = 0;
+    };
+
+    class Engine
+    {
+    private:
+        Revision revision = 1;
+        // Slots being computed, innermost last.
+        std::vector<Slot *> active;
+        std::map<std::string, Statistics> statistics;
+
+        void update(Slot &slot);
+        void compute(Slot &slot);
+
+    public:
+        Engine() = default;
+        Engine(const Engine &) = delete;
+        Engine &operator=(const Engine &) = delete;
+
+        // Bring slot up to date, as a dependency of the slot being computed if any.
+        void read(Slot &slot);
+        // The value of input changed.
+        void changed(Slot &input);
+        Revision getRevision() const { return revision; }
+
+        // Statistics of the query name, created empty.
+        Statistics &statisticsOf(const std::string &name) { return statistics[name]; }
+        const std::map<std::string, Statistics> &getStatistics() const { return statistics; }
+        void resetStatistics();
+    };
+
+    template <typename T>
+    class IsSharedPtr : public std::false_type
+    {
+    };
+    template <typename T>
+    class IsSharedPtr<std::shared_ptr<T>> : public std::true_type
+    {
+    };
+
+    // Whether a value computed again equals the previous one: values without
+    // equality never do, shared pointers compare what they point to if they can.
+    template <typename T>
+    bool sameValue(const T &a, const T &b)
+    {
+        if constexpr (IsSharedPtr<T>::value)
+        {
+            if constexpr (std::equality_comparable<typename T::element_type>)
+                return a == b || (a != nullptr && b != nullptr && *a == *b);
+            else
+                return a == b;
+        }
+        else if constexpr (std::equality_comparable<T>)
+            return a == b;
+        else
+            return false;
+    }
+
+    // Values set from outside the engine. A key never set reads as a default value.
+    template <typename Key, typename Value, typename Hash = std::hash<Key>>
+    class Input
+    {
+    private:
+        class Entry : public Slot
+        {
+        public:
+            const Input &input;
+            Value value{};
+
+            Entry(const Input &input) : input(input) {}
+            bool isInput() const override { return true; }
+            bool hasValue() const override { return true; }
+            bool compute() override { return false; }
+            const std::string &name() const override { return input.name; }
+        };
+
+        Engine &engine;
+        std::string name;
+        std::unordered_map<Key, std::unique_ptr<Entry>, Hash> entries;
+
+        Entry &entry(const Key &key)
+        {
+            auto &found = entries[key];
+            if (found == nullptr)
+            {
+                found = std::make_unique<Entry>(*this);
+                found->statistics = &engine.statisticsOf(name);
+            }
+            return *found;
+        }
+
+    public:
+        Input(Engine &engine, std::string name) : engine(engine), name(std::move(name)) {}
+        Input(const Input &) = delete;
+        Input &operator=(const Input &) = delete;
+
+        // Change the value of key, which invalidates its readers unless it is the same.
+        void set(const Key &key, Value value)
+        {
+            Entry &slot = entry(key);
+            if (sameValue(slot.value, value))
+                return;
+            slot.value = std::move(value);
+            engine.changed(slot);
+        }
+
+        const Value &get(const Key &key)
+        {
+            Entry &slot = entry(key);
+            engine.read(slot);
+            return slot.value;
+        }
+    };
+
+    // Values computed by a function of the key and of the queries it reads.
+    // A reference returned by get() stays valid until an input changes.
+    template <typename Key, typename Value, typename Hash = std::hash<Key>>
+    class Derived
+    {
+    private:
+        class Entry : public Slot
+        {
+        public:
+            const Derived &query;
+            Key key;
+            std::optional<Value> value;
+
+            Entry(const Derived &query, Key key) : query(query), key(std::move(key)) {}
+            bool hasValue() const override { return value.has_value(); }
+            bool compute() override
+            {
+                Value next = query.function(key);
+                if (value.has_value() && sameValue(value.value(), next))
+                    return false;
+                value = std::move(next);
+                return true;
+            }
+            const std::string &name() const override { return query.name; }
+        };
+
+        Engine &engine;
+        std::string name;
+        std::function<Value(const Key &)> function;
+        // Entries are never removed, the slots of their readers point to them.
+        std::unordered_map<Key, std::unique_ptr<Entry>, Hash> entries;
+
+    public:
+        Derived(Engine &engine, std::string name, std::function<Value(const Key &)> function)
+            : engine(engine), name(std::move(name)), function(std::move(function))
+        {
+            engine.statisticsOf(this->name);
+        }
+        Derived(const Derived &) = delete;
+        Derived &operator=(const Derived &) = delete;
+
+        const Value &get(const Key &key)
+        {
+            auto &found = entries[key];
+            if (found == nullptr)
+            {
+                found = std::make_unique<Entry>(*this, key);
+                found->statistics = &engine.statisticsOf(name);
+            }
+            engine.read(*found);
+            return found->value.value();
+        }
+    };
+}
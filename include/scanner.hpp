@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+
+// Character class scanning kernels used by the lexer.
+// Every kernel works on [begin, end) and returns the same result whatever the
+// instruction set, the vectorized versions only go faster.
+namespace Lexer::Scanner
+{
+    enum class Level
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    // Best level supported by the running CPU.
+    Level detectLevel();
+    Level getLevel();
+    // Force a level, the level shall be supported by the CPU.
+    void setLevel(Level level);
+    const char *levelToString(Level level);
+
+    // Return the first character that is not a space, tab, CR or LF.
+    const char *skipWhitespace(const char *begin, const char *end);
+    // Return the first character that is not in [a-zA-Z0-9_].
+    const char *skipIdentifier(const char *begin, const char *end);
+    // Return the first double quote, or end.
+    const char *findQuote(const char *begin, const char *end);
+    std::size_t countNewlines(const char *begin, const char *end);
+}
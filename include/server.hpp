@@ -0,0 +1,70 @@
+#pragma once
+#include "backend.hpp"
+#include "protocol.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace Ckc
+{
+    class ServerStatistics
+    {
+    public:
+        std::size_t requests = 0;
+        // Requests with a syntax or type error, or whose object could not be written.
+        std::size_t failed = 0;
+        // Connections closed before a whole request was read.
+        std::size_t dropped = 0;
+        // From the connection accepted to the response ready.
+        double totalSeconds = 0;
+        double maxSeconds = 0;
+    };
+
+    // gkc --server: compiles the requests of its clients, keeping what a
+    // one-shot gkc sets up on every run, the LLVM targets, the target lookup,
+    // the memory of the arenas and the sessions themselves.
+    // Every thread of serve() accepts a connection, compiles its request in
+    // its own CompilationSession and sends the response, so up to threads
+    // requests are compiled at once. Nothing is printed to the client but the
+    // diagnostics of its source.
+    class Server
+    {
+    private:
+        std::string socketPath;
+        Backend::TargetMachineFactory createTargetMachine;
+        unsigned threads;
+        int listener = -1;
+        std::atomic<bool> stopping = false;
+        std::mutex mutex;
+        ServerStatistics statistics;
+
+        void work();
+
+    public:
+        Server(std::string socketPath, Backend::TargetMachineFactory createTargetMachine, unsigned threads);
+        Server(const Server &) = delete;
+        Server &operator=(const Server &) = delete;
+        // Removes the socket.
+        ~Server();
+
+        // Listen on socketPath, only the user running the server may connect.
+        // A stale socket left by a server that is gone is replaced. Return
+        // false, error telling why, on error or if a server already listens there.
+        bool listen(std::string &error);
+        // Serve requests until stop() is called.
+        void serve();
+        // Make serve() return once the requests being compiled are answered.
+        // May be called from any thread.
+        void stop();
+
+        ServerStatistics getStatistics();
+
+        // Serve until SIGINT or SIGTERM from a child process, started again if
+        // it crashes, an LLVM assertion failing on one request aborting the
+        // whole process. Connections wait on the socket in between, the
+        // requests being compiled by the crashed child fail. To be called from
+        // a single threaded process. Print the statistics of the last child to
+        // the standard error, return the exit status of gkc.
+        int run();
+    };
+}
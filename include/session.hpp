@@ -0,0 +1,103 @@
+#pragma once
+#include "arena.hpp"
+#include "backend.hpp"
+#include "contextProvider.hpp"
+#include "genericContext.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+// libckc: the compiler as a library, gkc being one of its clients.
+namespace Ckc
+{
+    // Target machines for the host, with a generic CPU. The LLVM targets are
+    // initialized by the first call. Empty if the host is not supported,
+    // error tells why.
+    Backend::TargetMachineFactory hostTargetMachine(std::string &error);
+
+    class Options
+    {
+    public:
+        // Threads parsing, checking and generating code.
+        unsigned jobs = 1;
+        // Overlap parsing, type checking and code generation.
+        bool pipeline = false;
+        // Compile block by block in bounded memory.
+        bool stream = false;
+        // Print the AST of every block to the standard output, then the IR of the module.
+        bool printAst = false;
+        bool printLlvm = false;
+        // Reuse the AST and the code of unchanged functions from this directory, if set.
+        std::string cacheDirectory;
+    };
+
+    // State of a compilation that used to be global: the nodes, the syntax
+    // errors and the scopes of the parser, the function table of the checker.
+    class CompilerState
+    {
+    public:
+        Parser::Arena arena;
+        Parser::SyntaxErrors syntaxErrors;
+        genericContext<Lexer::Symbol, Lexer::TokenType> scopes;
+        Context::ContextProvider contextProvider;
+
+        CompilerState() = default;
+        // State whose arena allocates chunks of chunkSize bytes.
+        explicit CompilerState(std::size_t chunkSize) : arena(chunkSize) {}
+
+        // Start from a clean state, nothing may refer to the nodes any more.
+        void reset();
+
+        // Makes the state the one of the calling thread while it lives.
+        class Activation
+        {
+        private:
+            CompilerState &state;
+            Parser::Arena &previousArena;
+            Parser::SyntaxErrors &previousErrors;
+            Context::ContextProvider &previousProvider;
+
+        public:
+            Activation(CompilerState &state);
+            Activation(const Activation &) = delete;
+            Activation &operator=(const Activation &) = delete;
+            ~Activation();
+        };
+    };
+
+    // A compiler with a state of its own. Sessions share no mutable state,
+    // independent sessions can compile on different threads at once. Symbols
+    // and type names are interned for the whole process.
+    // compile() runs on the calling thread and on the threads it starts.
+    // Every compile() starts from a clean state, so a session can be reused.
+    class CompilationSession
+    {
+    private:
+        Options options;
+        Backend::TargetMachineFactory createTargetMachine;
+        std::ostream *diagnostics = &std::cerr;
+        CompilerState state;
+        // The code generation passes of the single threaded compilations,
+        // set up by the first one.
+        std::unique_ptr<Backend::ObjectEmitter> objectEmitter;
+
+        bool run(std::shared_ptr<Lexer::SourceBuffer> source, const std::string &filename, const std::string &objectFilename);
+
+    public:
+        CompilationSession(Options options, Backend::TargetMachineFactory createTargetMachine);
+        CompilationSession(const CompilationSession &) = delete;
+        CompilationSession &operator=(const CompilationSession &) = delete;
+
+        // Options of the next compilations.
+        void setOptions(Options options) { this->options = std::move(options); }
+        // Where syntax and type errors are printed, the standard error by default.
+        void setDiagnostics(std::ostream &stream) { diagnostics = &stream; }
+
+        // Compile source, read from filename, to the relocatable object
+        // objectFilename. Return false on error.
+        bool compile(std::shared_ptr<Lexer::SourceBuffer> source, const std::string &filename, const std::string &objectFilename);
+    };
+}
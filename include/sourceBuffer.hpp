@@ -0,0 +1,84 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Lexer
+{
+    // Bytes [begin, end) of a source buffer. Offsets are 32 bits, sources
+    // are limited to 4 GiB.
+    class Span
+    {
+    public:
+        std::uint32_t begin = 0;
+        std::uint32_t end = 0;
+
+        bool empty() const { return begin == end; }
+        bool operator==(const Span &other) const = default;
+    };
+
+    // Line and column of a character, from 1.
+    class SourcePosition
+    {
+    public:
+        int line = 1;
+        int column = 1;
+
+        auto operator<=>(const SourcePosition &other) const = default;
+    };
+
+    // Characters from begin up to end, excluded.
+    class SourceRange
+    {
+    public:
+        SourcePosition begin;
+        SourcePosition end;
+
+        bool operator==(const SourceRange &other) const = default;
+    };
+
+    // Read-only view over a whole source file.
+    // Files are memory-mapped, streams are read once into an owned string.
+    class SourceBuffer
+    {
+    private:
+        const char *data = nullptr;
+        std::size_t length = 0;
+        void *mapping = nullptr;
+        std::string owned;
+        // Offset of the first character of each line, built on the first getLine
+        // or getPosition call, from whichever thread makes it.
+        std::vector<std::size_t> lineOffsets;
+        std::once_flag lineIndexBuilt;
+
+        void buildLineIndex();
+
+    public:
+        SourceBuffer(const SourceBuffer &) = delete;
+        SourceBuffer &operator=(const SourceBuffer &) = delete;
+        SourceBuffer(std::string content);
+        ~SourceBuffer();
+
+        // Map the file read-only. Return nullptr if the file cannot be opened.
+        static std::shared_ptr<SourceBuffer> fromFile(const std::string &filename);
+        static std::shared_ptr<SourceBuffer> fromStream(std::istream &input);
+
+        const char *begin() const { return data; }
+        const char *end() const { return data + length; }
+        std::size_t size() const { return length; }
+
+        // Return the text of the line (starting at 1) without its line terminator.
+        std::string_view getLine(int line);
+        // Position of the character at offset, or of the end of the buffer
+        // past it. A binary search in the line index.
+        SourcePosition getPosition(std::size_t offset);
+
+        // Give the pages of a mapped file lying within [from, to) back to the
+        // system, they are read again from the file if accessed later.
+        void dropPages(const char *from, const char *to) const;
+    };
+}
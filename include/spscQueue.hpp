@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Concurrency
+{
+    // Bounded lock-free queue between one producer thread and one consumer
+    // thread. push() waits while the queue is full and pop() while it is empty,
+    // so a fast stage never runs more than capacity items ahead of the next one.
+    template <typename T>
+    class SpscQueue
+    {
+    private:
+        std::vector<T> slots;
+        std::size_t mask;
+        // Only the consumer moves head and only the producer moves tail, keep
+        // them on different cache lines.
+        alignas(64) std::atomic<std::size_t> head = 0;
+        alignas(64) std::atomic<std::size_t> tail = 0;
+        std::atomic<bool> closed = false;
+
+    public:
+        // capacity is rounded up to a power of two.
+        explicit SpscQueue(std::size_t capacity)
+        {
+            std::size_t size = 1;
+            while (size < capacity)
+                size *= 2;
+            slots.resize(size);
+            mask = size - 1;
+        }
+        SpscQueue(const SpscQueue &) = delete;
+        SpscQueue &operator=(const SpscQueue &) = delete;
+
+        void push(T value)
+        {
+            const std::size_t position = tail.load(std::memory_order_relaxed);
+            while (position - head.load(std::memory_order_acquire) == slots.size())
+                std::this_thread::yield();
+            slots[position & mask] = std::move(value);
+            tail.store(position + 1, std::memory_order_release);
+        }
+
+        // Called by the producer once it is done, pop() then fails when the
+        // queue is empty instead of waiting.
+        void close() { closed.store(true, std::memory_order_release); }
+
+        // Return false once the queue is closed and empty.
+        bool pop(T &value)
+        {
+            const std::size_t position = head.load(std::memory_order_relaxed);
+            while (position == tail.load(std::memory_order_acquire))
+            {
+                // The pushes before close() are visible once closed is.
+                if (closed.load(std::memory_order_acquire) && position == tail.load(std::memory_order_acquire))
+                    return false;
+                std::this_thread::yield();
+            }
+            value = std::move(slots[position & mask]);
+            head.store(position + 1, std::memory_order_release);
+            return true;
+        }
+    };
+}
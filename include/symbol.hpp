@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+namespace Lexer
+{
+    // Interned identifier.
+    // Two symbols are equal if and only if their names are equal, so comparing
+    // and hashing a symbol only touches its id. Names are never released.
+    class Symbol
+    {
+    public:
+        using Id = std::uint32_t;
+        Id id = 0;
+
+        Symbol() = default;
+        Symbol(std::string_view name);
+        Symbol(const char *name) : Symbol(std::string_view(name)){};
+        Symbol(const std::string &name) : Symbol(std::string_view(name)){};
+
+        const std::string &str() const;
+        bool empty() const { return id == 0; }
+        bool operator==(const Symbol &other) const { return id == other.id; }
+        bool operator!=(const Symbol &other) const { return id != other.id; }
+        bool operator<(const Symbol &other) const { return id < other.id; }
+    };
+
+    std::ostream &operator<<(std::ostream &os, const Symbol &symbol);
+}
+
+template <>
+struct std::hash<Lexer::Symbol>
+{
+    std::size_t operator()(const Lexer::Symbol &symbol) const noexcept
+    {
+        return std::hash<Lexer::Symbol::Id>()(symbol.id);
+    }
+};
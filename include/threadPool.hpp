@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Concurrency
+{
+    // Work-stealing pool.
+    // Every worker owns a deque of tasks: it runs the newest task of its own
+    // deque and, once it is empty, steals the oldest task of another one.
+    // Tasks must not throw.
+    class ThreadPool
+    {
+    private:
+        class Queue
+        {
+        public:
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        // Queue 0 belongs to the thread calling wait(), the others to the workers.
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        std::atomic<std::size_t> nextQueue = 0;
+        // Tasks queued and not started, tasks submitted and not finished.
+        std::atomic<std::size_t> queued = 0;
+        std::atomic<std::size_t> pending = 0;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        bool stopping = false;
+
+        bool runOne(std::size_t self);
+        void work(std::size_t self);
+        void stop();
+
+    public:
+        // threads workers, the thread calling wait() helps them.
+        explicit ThreadPool(unsigned threads);
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+        ~ThreadPool();
+
+        void submit(std::function<void()> task);
+        // Return once every submitted task has run.
+        void wait();
+    };
+}
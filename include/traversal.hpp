@@ -0,0 +1,137 @@
+#pragma once
+#include "parser.hpp"
+#include <llvm/ADT/SmallVector.h>
+
+// Walks of the AST that keep their position on a heap allocated work stack
+// instead of the native one, so that the depth of a tree, like a chain of
+// thousands of additions, is only bounded by memory. The parser builds
+// expressions the same way.
+namespace Parser
+{
+    // Work stack of the walks, the first entries need no allocation.
+    template <typename T>
+    using WorkStack = llvm::SmallVector<T, 32>;
+
+    // Call f on every child of node, in source order.
+    template <typename F>
+    void forEachChild(Node &node, F f)
+    {
+        auto optional = [&](const std::optional<NodeIdentifier> &child)
+        {
+            if (child.has_value() && child->get() != nullptr)
+                f(child.value());
+        };
+        auto required = [&](NodeIdentifier child)
+        {
+            if (child.get() != nullptr)
+                f(child);
+        };
+        if (auto block = node.thisNode.get<NodeBlock>())
+            optional(block->modifier);
+        switch (node.kind)
+        {
+        case NodeKind::MultiBlock:
+            for (auto block : static_cast<NodeMultiBlock &>(node).blocks)
+                required(block);
+            break;
+        case NodeKind::If:
+        {
+            auto &nodeIf = static_cast<NodeIf &>(node);
+            required(nodeIf.condition);
+            required(nodeIf.thenStatement);
+            optional(nodeIf.elseStatement);
+            break;
+        }
+        case NodeKind::Function:
+            optional(static_cast<NodeFunction &>(node).body);
+            break;
+        case NodeKind::Return:
+            optional(static_cast<NodeReturn &>(node).value);
+            break;
+        case NodeKind::VariableDeclaration:
+            optional(static_cast<NodeVariableDeclaration &>(node).value);
+            break;
+        case NodeKind::VariableAssignment:
+            required(static_cast<NodeVariableAssignment &>(node).value);
+            break;
+        case NodeKind::BinOperator:
+            required(static_cast<NodeBinOperator &>(node).left);
+            required(static_cast<NodeBinOperator &>(node).right);
+            break;
+        case NodeKind::UnaryOperator:
+            required(static_cast<NodeUnaryOperator &>(node).right);
+            break;
+        case NodeKind::FunctionCall:
+            for (auto argument : static_cast<NodeFunctionCall &>(node).arguments)
+                required(argument);
+            break;
+        case NodeKind::Cast:
+            required(static_cast<NodeCast &>(node).value);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Call visit on every node of the tree of root, children before their
+    // parent and siblings in source order.
+    template <typename F>
+    void forEachPostOrder(NodeIdentifier root, F visit)
+    {
+        // A node is pushed a second time, marked, once its children are.
+        WorkStack<std::pair<Node *, bool>> stack;
+        WorkStack<Node *> children;
+        stack.push_back({root.get(), false});
+        while (!stack.empty())
+        {
+            auto [node, expanded] = stack.pop_back_val();
+            if (expanded)
+            {
+                visit(node->thisNode);
+                continue;
+            }
+            stack.push_back({node, true});
+            children.clear();
+            forEachChild(*node, [&](NodeIdentifier child)
+                         { children.push_back(child.get()); });
+            for (auto child = children.rbegin(); child != children.rend(); child++)
+                stack.push_back({*child, false});
+        }
+    }
+
+    // Operand index of an operator, a cast or a function call, nullptr past
+    // the last one.
+    inline Node *operandOf(Node &node, std::size_t index)
+    {
+        switch (node.kind)
+        {
+        case NodeKind::BinOperator:
+            if (index > 1)
+                return nullptr;
+            return index == 0 ? static_cast<NodeBinOperator &>(node).left.get() : static_cast<NodeBinOperator &>(node).right.get();
+        case NodeKind::UnaryOperator:
+            return index == 0 ? static_cast<NodeUnaryOperator &>(node).right.get() : nullptr;
+        case NodeKind::Cast:
+            return index == 0 ? static_cast<NodeCast &>(node).value.get() : nullptr;
+        case NodeKind::FunctionCall:
+        {
+            auto &arguments = static_cast<NodeFunctionCall &>(node).arguments;
+            return index < arguments.size() ? arguments[index].get() : nullptr;
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    // An expression of literals, operators and casts only, which the backend
+    // folds into a constant without emitting any instruction.
+    inline bool isConstantExpression(NodeIdentifier root)
+    {
+        bool constant = true;
+        forEachPostOrder(root, [&](NodeIdentifier node)
+                         {
+                             const NodeKind kind = node->kind;
+                             constant = constant && (kind == NodeKind::Number || kind == NodeKind::BinOperator || kind == NodeKind::UnaryOperator || kind == NodeKind::Cast); });
+        return constant;
+    }
+}
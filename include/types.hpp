@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace llvm
+{
+    class LLVMContext;
+    class Type;
+}
+
+namespace Types
+{
+    // Properties of a type, computed once when it is registered.
+    class TypeInfo
+    {
+    public:
+        std::string name;
+        // Bits of a value, 0 for void, literals and unknown names.
+        unsigned width = 0;
+        bool isSigned = false;
+        bool isBoolean = false;
+        // Type of integer literals until their context gives them one.
+        bool isLiteral = false;
+        bool isVoid = false;
+
+        bool isInteger() const { return width > 0 && !isBoolean; }
+    };
+
+    // Handle to a registered type, compared as an integer. Types are
+    // registered by name on first use, from any thread, like Lexer::Symbol.
+    // The empty handle stands for no type.
+    class TypeId
+    {
+    public:
+        using Id = std::uint32_t;
+        Id id = 0;
+
+        constexpr TypeId() = default;
+        explicit constexpr TypeId(Id id) : id(id){};
+        // The type called name, registered with no property if it is not a builtin.
+        static TypeId named(std::string_view name);
+
+        const TypeInfo &info() const;
+        const std::string &str() const { return info().name; }
+        // Type of values in context, nullptr for unknown names. The context
+        // keeps one instance of each type, so this is a switch on the width.
+        llvm::Type *llvmType(llvm::LLVMContext &context) const;
+
+        constexpr bool empty() const { return id == 0; }
+        constexpr bool operator==(const TypeId &other) const { return id == other.id; }
+        constexpr bool operator!=(const TypeId &other) const { return id != other.id; }
+        constexpr bool operator<(const TypeId &other) const { return id < other.id; }
+    };
+
+    std::ostream &operator<<(std::ostream &os, const TypeId &type);
+
+    // Builtins, registered in this order before any other type.
+    constexpr TypeId none{0};
+    constexpr TypeId voidType{1};
+    constexpr TypeId boolType{2};
+    constexpr TypeId number{3};
+    constexpr TypeId int8{4};
+    constexpr TypeId int16{5};
+    constexpr TypeId int32{6};
+    constexpr TypeId int64{7};
+    constexpr TypeId uint8{8};
+    constexpr TypeId uint16{9};
+    constexpr TypeId uint32{10};
+    constexpr TypeId uint64{11};
+}
+
+template <>
+struct std::hash<Types::TypeId>
+{
+    std::size_t operator()(const Types::TypeId &type) const noexcept
+    {
+        return std::hash<Types::TypeId::Id>()(type.id);
+    }
+};
@@ -0,0 +1,290 @@
+#pragma once
+#include "../parser.hpp"
+#include "../traversal.hpp"
+
+namespace visitor
+{
+    // Static replacement for Node::accept.
+    // dispatch() switches on the node kind and calls the visit methods of
+    // Derived in the same order as accept, Derived being final every call is
+    // direct. enterNode is only called when Derived sets visitsEnterNode.
+    //
+    // The operands of operators, casts and function calls are visited by
+    // dispatch itself, and their visit method is called after them. Past
+    // maxNativeDepth nested operators the walk continues from a work stack,
+    // so the depth of an expression is not bounded by the native stack.
+    // Derived is called back around the operands:
+    //   bool enterOperands(Parser::Node &node)   before, false skips the operands
+    //   void afterOperand(Parser::Node &node, std::size_t index)
+    // Function calls are visited as a whole when Derived clears visitsCallArguments.
+    template <typename Derived>
+    class Dispatcher
+    {
+    public:
+        static constexpr bool visitsEnterNode = false;
+        static constexpr bool visitsCallArguments = true;
+
+        bool enterOperands(Parser::Node &node) { return true; }
+        void afterOperand(Parser::Node &node, std::size_t index) {}
+
+        void dispatch(Parser::NodeIdentifier node)
+        {
+            dispatch(*node.get());
+        }
+
+        void dispatch(Parser::Node &node)
+        {
+            // Shallow trees are walked by recursion, which is cheaper, deeper
+            // subtrees from the work stack.
+            if (!hasOperands(node))
+                return visit(node);
+            if (depth >= maxNativeDepth)
+                return dispatchFromStack(node);
+            depth++;
+            try
+            {
+                visit(node);
+            }
+            catch (...)
+            {
+                depth--;
+                throw;
+            }
+            depth--;
+        }
+
+    private:
+        static constexpr std::size_t maxNativeDepth = 128;
+        // Operators, casts and calls being visited on the native stack.
+        std::size_t depth = 0;
+
+        class Frame
+        {
+        public:
+            Parser::Node *node;
+            // Index of the next operand to visit.
+            std::size_t next;
+        };
+        Parser::WorkStack<Frame> operators;
+
+        void dispatchFromStack(Parser::Node &root)
+        {
+            // A visit method may dispatch again, its walk stays above bottom.
+            const std::size_t bottom = operators.size();
+            try
+            {
+                if (!begin(root))
+                    return;
+                while (operators.size() > bottom)
+                {
+                    Frame &frame = operators.back();
+                    if (Parser::Node *operand = Parser::operandOf(*frame.node, frame.next))
+                    {
+                        frame.next++;
+                        if (!begin(*operand))
+                            completed();
+                        continue;
+                    }
+                    Parser::Node &node = *frame.node;
+                    operators.pop_back();
+                    leave(node);
+                    if (operators.size() > bottom)
+                        completed();
+                }
+            }
+            catch (...)
+            {
+                // The visitor may recover from an error, as type checking an
+                // argument against another overload does.
+                operators.resize(bottom);
+                throw;
+            }
+        }
+
+        bool hasOperands(Parser::Node &node)
+        {
+            switch (node.kind)
+            {
+            case Parser::NodeKind::BinOperator:
+            case Parser::NodeKind::UnaryOperator:
+            case Parser::NodeKind::Cast:
+                return true;
+            case Parser::NodeKind::FunctionCall:
+                return Derived::visitsCallArguments;
+            default:
+                return false;
+            }
+        }
+
+        // Start the visit of node from the work stack, true if its operands
+        // are to be visited first.
+        bool begin(Parser::Node &node)
+        {
+            if (!hasOperands(node))
+            {
+                visit(node);
+                return false;
+            }
+            if (node.kind != Parser::NodeKind::FunctionCall)
+                enterExpression(node);
+            if (!static_cast<Derived &>(*this).enterOperands(node))
+            {
+                leave(node);
+                return false;
+            }
+            operators.push_back({&node, 0});
+            return true;
+        }
+
+        // The operand of the operator on top of the stack was visited.
+        void completed()
+        {
+            Frame &frame = operators.back();
+            static_cast<Derived &>(*this).afterOperand(*frame.node, frame.next - 1);
+        }
+
+        // Visit the operand of index of node.
+        void operand(Parser::Node &node, Parser::NodeIdentifier operand, std::size_t index)
+        {
+            dispatch(*operand.get());
+            static_cast<Derived &>(*this).afterOperand(node, index);
+        }
+
+        void visit(Parser::Node &node)
+        {
+            Derived &v = static_cast<Derived &>(*this);
+            switch (node.kind)
+            {
+            case Parser::NodeKind::MultiBlock:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                for (auto &block : static_cast<Parser::NodeMultiBlock &>(node).blocks)
+                    dispatch(block);
+                break;
+            case Parser::NodeKind::If:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                v.visitNodeIf(static_cast<Parser::NodeIf &>(node));
+                break;
+            case Parser::NodeKind::Function:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                v.visitNodeFunction(static_cast<Parser::NodeFunction &>(node));
+                break;
+            case Parser::NodeKind::Pragma:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                v.visitNodePragma(static_cast<Parser::NodePragma &>(node));
+                break;
+            case Parser::NodeKind::Goto:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                v.visitNodeGoto(static_cast<Parser::NodeGoto &>(node));
+                break;
+            case Parser::NodeKind::Return:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                v.visitNodeReturn(static_cast<Parser::NodeReturn &>(node));
+                break;
+            case Parser::NodeKind::VariableDeclaration:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                v.visitNodeVariableDeclaration(static_cast<Parser::NodeVariableDeclaration &>(node));
+                break;
+            case Parser::NodeKind::VariableAssignment:
+                enterBlock(static_cast<Parser::NodeBlock &>(node));
+                v.visitNodeVariableAssignment(static_cast<Parser::NodeVariableAssignment &>(node));
+                break;
+            case Parser::NodeKind::BinOperator:
+            {
+                auto &binOperator = static_cast<Parser::NodeBinOperator &>(node);
+                enterExpression(node);
+                if (v.enterOperands(node))
+                {
+                    operand(node, binOperator.left, 0);
+                    operand(node, binOperator.right, 1);
+                }
+                v.visitBinOperator(binOperator);
+                break;
+            }
+            case Parser::NodeKind::UnaryOperator:
+            {
+                auto &unary = static_cast<Parser::NodeUnaryOperator &>(node);
+                enterExpression(node);
+                if (v.enterOperands(node))
+                    operand(node, unary.right, 0);
+                v.visitNodeUnaryOperator(unary);
+                break;
+            }
+            case Parser::NodeKind::Number:
+                enterExpression(node);
+                v.visitNodeNumber(static_cast<Parser::NodeNumber &>(node));
+                break;
+            case Parser::NodeKind::Cast:
+            {
+                auto &cast = static_cast<Parser::NodeCast &>(node);
+                enterExpression(node);
+                if (v.enterOperands(node))
+                    operand(node, cast.value, 0);
+                v.visitNodeCast(cast);
+                break;
+            }
+            // Text and function calls skip enterNode and visitNode, like their accept.
+            case Parser::NodeKind::Text:
+                v.visitNodeText(static_cast<Parser::NodeText &>(node));
+                break;
+            case Parser::NodeKind::FunctionCall:
+            {
+                auto &call = static_cast<Parser::NodeFunctionCall &>(node);
+                if (Derived::visitsCallArguments && v.enterOperands(node))
+                {
+                    for (std::size_t index = 0; index < call.arguments.size(); index++)
+                        operand(node, call.arguments[index], index);
+                }
+                v.visitNodeFunctionCall(call);
+                break;
+            }
+            case Parser::NodeKind::BlockModifier:
+                enter(node);
+                v.visitNodeBlockModifier(static_cast<Parser::NodeBlockModifier &>(node));
+                break;
+            }
+        }
+
+        // Finish the visit of an operator, a cast or a call whose operands
+        // were visited from the work stack.
+        void leave(Parser::Node &node)
+        {
+            Derived &v = static_cast<Derived &>(*this);
+            switch (node.kind)
+            {
+            case Parser::NodeKind::BinOperator:
+                v.visitBinOperator(static_cast<Parser::NodeBinOperator &>(node));
+                break;
+            case Parser::NodeKind::UnaryOperator:
+                v.visitNodeUnaryOperator(static_cast<Parser::NodeUnaryOperator &>(node));
+                break;
+            case Parser::NodeKind::Cast:
+                v.visitNodeCast(static_cast<Parser::NodeCast &>(node));
+                break;
+            case Parser::NodeKind::FunctionCall:
+                v.visitNodeFunctionCall(static_cast<Parser::NodeFunctionCall &>(node));
+                break;
+            default:
+                break;
+            }
+        }
+
+        void enter(Parser::Node &node)
+        {
+            if constexpr (Derived::visitsEnterNode)
+                static_cast<Derived &>(*this).enterNode(node);
+        }
+
+        void enterBlock(Parser::NodeBlock &node)
+        {
+            enter(node);
+            if (node.modifier.has_value())
+                dispatch(node.modifier.value());
+        }
+
+        void enterExpression(Parser::Node &node)
+        {
+            enter(node);
+            static_cast<Derived &>(*this).visitNode(node);
+        }
+    };
+}
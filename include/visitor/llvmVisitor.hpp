@@ -5,6 +5,7 @@
 #include <llvm/IR/LLVMContext.h>
 #include "../genericContext.hpp"
 #include "../parser.hpp"
+#include "dispatcher.hpp"
 #include "../contextProvider.hpp"
 
 using namespace llvm;
@@ -12,16 +13,19 @@ namespace visitor
 {
     void LogError(const char *Str);
 
-    class llvmVisitor : public Parser::Visitor
+    class llvmVisitor final : public Parser::Visitor, public Dispatcher<llvmVisitor>
     {
     private:
         std::shared_ptr<LLVMContext> context;
         std::shared_ptr<IRBuilder<>> Builder;
         std::shared_ptr<Module> TheModule;
-        std::string currentType;
+        // Type given to integer literals.
+        Types::TypeId currentType;
         Context::ContextProvider &contextProvider;
-        genericContext<std::string, std::function<Value *(uint64_t)>> typeWithInitialValueContext;
-        genericContext<std::string, std::function<Type *()>> typeNameContext;
+        // Values of the operands visited whose operator is not yet, and the
+        // blocks of the lazy operators whose right operand is being visited.
+        llvm::SmallVector<Value *, 16> operands;
+        llvm::SmallVector<BasicBlock *, 8> lazyBlocks;
         // genericContext<std::string, std::string> ckcToSymbolName;
 
         void enterBlock()
@@ -36,31 +40,17 @@ namespace visitor
             // ckctoSymbolName.exitScope();
         }
 
+        // Code following a return or a goto is unreachable, give it a block of
+        // its own so that every block ends with a single terminator.
+        void startUnreachableBlock()
+        {
+            Builder->SetInsertPoint(BasicBlock::Create(*context, "unreachable", Builder->GetInsertBlock()->getParent()));
+        }
+
     public:
         ~llvmVisitor() = default;
         Value *lastValue;
-        llvmVisitor(std::shared_ptr<LLVMContext> context, std::shared_ptr<IRBuilder<>> Builder, std::shared_ptr<Module> module, Context::ContextProvider &contextProvider) : context(context), Builder(Builder), TheModule(module), contextProvider(contextProvider){
-            typeWithInitialValueContext.add("uint8", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(8, val, false)); });
-            typeWithInitialValueContext.add("uint16", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(16, val, false)); });
-            typeWithInitialValueContext.add("uint32", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(32, val, false)); });
-            typeWithInitialValueContext.add("uint64", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(64, val, false)); });
-            typeWithInitialValueContext.add("int8", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(8, val, true)); });
-            typeWithInitialValueContext.add("int16", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(16, val, true)); });
-            typeWithInitialValueContext.add("int32", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(32, val, true)); });
-            typeWithInitialValueContext.add("int64", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(64, val, true)); });
-            typeWithInitialValueContext.add("", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(32, val, false)); });
-            typeWithInitialValueContext.add("bool", [&](uint64_t val){ return ConstantInt::get(*this->context, APInt(1, val, false)); });
-        
-            typeNameContext.add("uint8", [&](){return Type::getInt8Ty(*this->context);}),
-            typeNameContext.add("uint16", [&](){return Type::getInt16Ty(*this->context);}),
-            typeNameContext.add("uint32", [&](){return Type::getInt32Ty(*this->context);}),
-            typeNameContext.add("uint64", [&](){return Type::getInt64Ty(*this->context);}),
-            typeNameContext.add("int8", [&](){return Type::getInt8Ty(*this->context);}),
-            typeNameContext.add("int16", [&](){return Type::getInt16Ty(*this->context);}),
-            typeNameContext.add("int32", [&](){return Type::getInt32Ty(*this->context);}),
-            typeNameContext.add("int64", [&](){return Type::getInt64Ty(*this->context);}),
-            typeNameContext.add("bool", [&](){return Type::getInt1Ty(*this->context);});
-        };
+        llvmVisitor(std::shared_ptr<LLVMContext> context, std::shared_ptr<IRBuilder<>> Builder, std::shared_ptr<Module> module, Context::ContextProvider &contextProvider) : context(context), Builder(Builder), TheModule(module), contextProvider(contextProvider){};
         void visitNodeIf(Parser::NodeIf &node) override;
         void visitNodeGoto(Parser::NodeGoto &node) override;
         void visitBinOperator(Parser::NodeBinOperator &node) override;
@@ -75,7 +65,10 @@ namespace visitor
         void visitNodeFunction(Parser::NodeFunction &node) override;
         void visitNodeFunctionCall(Parser::NodeFunctionCall &node) override;
         void visitNodePragma(Parser::NodePragma &node) override;
+        void enterLazyRightOperand(Parser::NodeBinOperator &node);
         void visitLazyBinOperator(Parser::NodeBinOperator &node);
+        bool enterOperands(Parser::Node &node);
+        void afterOperand(Parser::Node &node, std::size_t index);
         void visitNodeCast(Parser::NodeCast &node) override;
     };
 
@@ -1,12 +1,14 @@
 #pragma once
 
 #include "parser.hpp"
+#include "dispatcher.hpp"
 
 #include "../genericContext.hpp"
+#include "../contextProvider.hpp"
 namespace visitor
 {
 
-    class pragmaVisitor : public Parser::Visitor
+    class pragmaVisitor final : public Parser::Visitor, public Dispatcher<pragmaVisitor>
     {
     public:
         void visitNodeIf(Parser::NodeIf &node) override;
@@ -26,6 +28,9 @@ namespace visitor
         void visitNodeCast(Parser::NodeCast &node) override;
 
     private:
-        genericContext<std::string, Parser::Node *> pragmaContext;
+        genericContext<Lexer::Symbol, Parser::Node *> pragmaContext;
+        // Where renamed overloads are declared, the visitor may be copied to
+        // another thread.
+        Context::ContextProvider *contextProvider = &Context::ContextProvider::getInstance();
     };
 }
\ No newline at end of file
@@ -1,13 +1,17 @@
 #pragma once
 #include "../parser.hpp"
+#include "dispatcher.hpp"
 #include <iostream>
 #include <sstream>
 namespace visitor
 {
-    class PrintVisitor : public Parser::Visitor
+    class PrintVisitor final : public Parser::Visitor, public Dispatcher<PrintVisitor>
     {
     private:
+        friend class Dispatcher<PrintVisitor>;
         int currentLine = 0;
+        // The nodes are parsed from it, their lines are looked up in its source.
+        const Lexer::TokenStream &ts;
         std::ostream &out;
         void visitNodeIf(Parser::NodeIf &node) override;
         void visitNodeGoto(Parser::NodeGoto &node) override;
@@ -25,9 +29,11 @@ namespace visitor
         void visitNodePragma(Parser::NodePragma &node) override;
         void enterNode(Parser::Node &node) override;
         void visitNodeCast(Parser::NodeCast &node) override;
+        bool enterOperands(Parser::Node &node);
+        void afterOperand(Parser::Node &node, std::size_t index);
 
     public:
-        PrintVisitor() : out(std::cout){};
-        PrintVisitor(std::ostream &out) : out(out){};
+        static constexpr bool visitsEnterNode = true;
+        explicit PrintVisitor(const Lexer::TokenStream &ts, std::ostream &out = std::cout) : ts(ts), out(out){};
     };
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "parser.hpp"
+#include "dispatcher.hpp"
 #include <iterator>
+#include <unordered_map>
 #include <vector>
 
 #include "../genericContext.hpp"
@@ -9,15 +11,49 @@
 namespace visitor
 {
 
-class typeVisitor : public Parser::Visitor
+class typeVisitor final : public Parser::Visitor, public Dispatcher<typeVisitor>
 {
     private:
         Context::ContextProvider &contextProvider = Context::ContextProvider::getInstance();
-        genericContext<std::string, std::string> variables;
-        std::optional<std::string> currentFunction;
-        std::string lastType;
-        std::string hintType;
+        genericContext<Lexer::Symbol, Types::TypeId> variables;
+        std::optional<Lexer::Symbol> currentFunction;
+        std::optional<Lexer::Token> currentFunctionToken;
+        Types::TypeId lastType;
+        Types::TypeId hintType;
+        // Hints of the binary operators whose operands are being visited.
+        std::vector<Types::TypeId> hints;
+
+        // Overload resolution visits each argument once per distinct hint: the
+        // type of an argument with a hint, nullopt when it does not type check.
+        // A call does not depend on its hint, so it is only resolved once and
+        // later visits reuse its type. Both caches are only kept while the
+        // outermost call is resolved, the nodes may be released afterwards.
+        class HintedNodeHash
+        {
+        public:
+            std::size_t operator()(const std::pair<const Parser::Node *, Types::TypeId> &key) const
+            {
+                return std::hash<const Parser::Node *>()(key.first) ^ (std::hash<Types::TypeId>()(key.second) << 1);
+            }
+        };
+        std::unordered_map<std::pair<const Parser::Node *, Types::TypeId>, std::optional<Types::TypeId>, HintedNodeHash> argumentTypes;
+        // Calls already resolved, and whether an overload matched.
+        std::unordered_map<const Parser::Node *, bool> resolvedCalls;
+        std::size_t callDepth = 0;
+        // Past this many calls resolved one inside the other, the calls nested
+        // in the arguments are resolved innermost first, so that the native
+        // stack does not grow with the nesting.
+        static constexpr std::size_t maxCallNesting = 256;
+
+        std::optional<Types::TypeId> argumentType(Parser::NodeIdentifier argument, Types::TypeId hint);
+        bool resolveCall(Parser::NodeFunctionCall &node);
+        void resolveNestedCalls(Parser::NodeFunctionCall &node);
+        void finishCall();
     public:
+        // Calls type their arguments themselves, once per candidate overload.
+        static constexpr bool visitsCallArguments = false;
+        bool enterOperands(Parser::Node &node);
+
         void visitNodeIf(Parser::NodeIf &node) override;
         void visitNodeGoto(Parser::NodeGoto &node) override;
         void visitBinOperator(Parser::NodeBinOperator &node) override;
@@ -36,6 +72,16 @@ class typeVisitor : public Parser::Visitor
         void visitBinOperatorComparison(Parser::NodeBinOperator &node);
         void visitNodeCast(Parser::NodeCast &node) override;
 
+        // Register the signature of a function in the function table.
+        void declareFunction(Parser::NodeFunction &node);
+        // Check the body of a declared function. A copy of the visitor can
+        // check a body on another thread once every signature is declared.
+        void checkFunctionBody(Parser::NodeFunction &node);
+        // Type of the variable name visible here, and a variable declared
+        // elsewhere, to check a body apart from the blocks before it.
+        std::optional<Types::TypeId> getVariableType(Lexer::Symbol name) const { return variables.get(name); }
+        void addVariable(Lexer::Symbol name, Types::TypeId type) { variables.add(name, type); }
+
 
         typeVisitor()
         {
@@ -0,0 +1,45 @@
+#pragma once
+#include "backend.hpp"
+#include "query.hpp"
+#include "types.hpp"
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+
+namespace Ckc
+{
+    // Files compiled again and again as they change, through memoized
+    // queries: the tokens of a file, the outline of its top level blocks,
+    // the signatures of its functions, then for each function that can be
+    // analysed on its own its AST, its type check, its IR and its object,
+    // and the type of an expression. After an edit only the queries whose
+    // inputs changed are computed again, an edit of a function body only
+    // those of that function. Not thread-safe.
+    class Workspace
+    {
+    private:
+        class Queries;
+        std::unique_ptr<Queries> queries;
+
+    public:
+        explicit Workspace(Backend::TargetMachineFactory createTargetMachine);
+        Workspace(const Workspace &) = delete;
+        Workspace &operator=(const Workspace &) = delete;
+        ~Workspace();
+
+        void setSource(const std::string &file, std::string text);
+
+        // Compile file to the relocatable object objectFilename, printing its
+        // syntax and type errors to diagnostics as gkc does. Return false on error.
+        bool compile(const std::string &file, const std::string &objectFilename, std::ostream &diagnostics);
+        // Type of the innermost expression at line and column of file, from
+        // 1, if the file type checks up to it.
+        std::optional<Types::TypeId> typeOf(const std::string &file, int line, int column);
+
+        // Values reused and computed by each query since the last reset.
+        const std::map<std::string, Query::Statistics> &getStatistics() const;
+        void resetStatistics();
+    };
+}
@@ -0,0 +1,50 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace Parser
+{
+    namespace
+    {
+        // Every thread parses into its own arena.
+        thread_local Arena defaultArena;
+        thread_local Arena *currentArena = nullptr;
+    }
+
+    Arena::~Arena()
+    {
+        reset();
+    }
+
+    void *Arena::allocateSlow(std::size_t size, std::size_t alignment)
+    {
+        // Objects larger than a chunk get a chunk of their own.
+        std::size_t length = std::max(chunkSize, size + alignment);
+        chunks.push_back(std::make_unique<std::byte[]>(length));
+        cursor = chunks.back().get();
+        limit = cursor + length;
+        return allocate(size, alignment);
+    }
+
+    void Arena::reset()
+    {
+        for (auto it = destructors.rbegin(); it != destructors.rend(); it++)
+            it->destroy(it->object);
+        destructors.clear();
+        if (chunks.size() > 1)
+            chunks.resize(1);
+        cursor = chunks.empty() ? nullptr : chunks.front().get();
+        limit = chunks.empty() ? nullptr : cursor + chunkSize;
+        used = 0;
+    }
+
+    Arena &Arena::getCurrent()
+    {
+        return currentArena != nullptr ? *currentArena : defaultArena;
+    }
+
+    void Arena::setCurrent(Arena &arena)
+    {
+        currentArena = &arena;
+    }
+}
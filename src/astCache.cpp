@@ -0,0 +1,655 @@
+#include "astCache.hpp"
+#include "traversal.hpp"
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/xxhash.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Cache
+{
+    namespace
+    {
+        constexpr char fileMagic[4] = {'G', 'K', 'A', 'S'};
+        // Bump on any change of the layout below or of the nodes.
+        constexpr std::uint32_t formatVersion = 2;
+        constexpr std::uint32_t none = UINT32_MAX;
+
+        class Header
+        {
+        public:
+            char magic[4];
+            std::uint32_t version;
+            std::uint64_t sourceHash;
+            // Entries of each table, in file order.
+            std::uint32_t records;
+            std::uint32_t children;
+            std::uint32_t strings;
+            std::uint32_t tokens;
+            std::uint32_t stringTable;
+            std::uint32_t roots;
+            std::uint64_t blobBytes;
+        };
+
+        // One node. Its children, strings and tokens are ranges of the tables,
+        // the meaning of each slot depends on the kind, see Writer::write.
+        class Record
+        {
+        public:
+            std::uint8_t kind;
+            std::uint8_t padding;
+            // Operator, pragma type or modifier type.
+            std::uint16_t op;
+            std::int32_t number;
+            // Span of the node in the source.
+            std::uint32_t spanBegin;
+            std::uint32_t spanEnd;
+            std::uint32_t firstChild;
+            std::uint32_t childCount;
+            std::uint32_t firstString;
+            std::uint32_t stringCount;
+            std::uint32_t firstToken;
+            std::uint32_t tokenCount;
+        };
+
+        class TokenRecord
+        {
+        public:
+            // none for an absent token.
+            std::uint32_t type;
+            std::uint32_t value;
+            std::uint32_t symbol;
+            std::int32_t line;
+            std::int32_t column;
+        };
+
+        // Bytes [offset, offset + length) of the blob ending the file.
+        class StringRecord
+        {
+        public:
+            std::uint32_t offset;
+            std::uint32_t length;
+        };
+
+        class Writer
+        {
+        public:
+            std::vector<Record> records;
+            std::vector<std::uint32_t> children;
+            std::vector<std::uint32_t> strings;
+            std::vector<TokenRecord> tokens;
+            std::vector<StringRecord> stringTable;
+            std::vector<std::uint32_t> roots;
+            std::string blob;
+            std::unordered_map<std::string, std::uint32_t> stringIds;
+
+            std::uint32_t string(std::string_view value)
+            {
+                auto [found, inserted] = stringIds.try_emplace(std::string(value), stringTable.size());
+                if (inserted)
+                {
+                    stringTable.push_back({std::uint32_t(blob.size()), std::uint32_t(value.size())});
+                    blob += value;
+                }
+                return found->second;
+            }
+
+            std::uint32_t optionalString(const std::optional<std::string> &value)
+            {
+                return value.has_value() ? string(value.value()) : none;
+            }
+
+            std::uint32_t symbol(Lexer::Symbol symbol)
+            {
+                return symbol.empty() ? none : string(symbol.str());
+            }
+
+            TokenRecord token(const std::optional<Lexer::Token> &token)
+            {
+                if (!token.has_value())
+                    return {none, none, none, 0, 0};
+                return {std::uint32_t(token->type), string(token->value), symbol(token->symbol), token->line, token->column};
+            }
+
+            // Records written whose parent is not yet. When a node is written,
+            // the records of its children are the last ones, taken in order by child.
+            std::vector<std::uint32_t> pending;
+            std::size_t nextChild = 0;
+
+            std::uint32_t child(const std::optional<Parser::NodeIdentifier> &node)
+            {
+                return node.has_value() && node->get() != nullptr ? pending[nextChild++] : none;
+            }
+
+            std::uint32_t add(Parser::NodeIdentifier root)
+            {
+                Parser::forEachPostOrder(root, [this](Parser::NodeIdentifier node)
+                                         { write(node); });
+                const std::uint32_t index = pending.back();
+                pending.pop_back();
+                return index;
+            }
+
+            // Children come before their parent. Every node starts with its
+            // symbol name, blocks with their modifier and expressions with
+            // their type.
+            void write(Parser::NodeIdentifier identifier)
+            {
+                using Parser::NodeKind;
+                Parser::Node *node = identifier.get();
+                std::size_t count = 0;
+                Parser::forEachChild(*node, [&](Parser::NodeIdentifier)
+                                     { count++; });
+                const std::size_t firstPending = pending.size() - count;
+                nextChild = firstPending;
+                Record record{};
+                record.kind = std::uint8_t(node->kind);
+                record.spanBegin = node->span.begin;
+                record.spanEnd = node->span.end;
+                std::vector<std::uint32_t> nodeChildren;
+                std::vector<std::uint32_t> nodeStrings{optionalString(node->symbol_name)};
+                std::vector<TokenRecord> nodeTokens;
+                if (auto block = identifier.get<Parser::NodeBlock>())
+                    nodeChildren.push_back(child(block->modifier));
+                if (auto expression = identifier.get<Parser::NodeExpression>())
+                    nodeStrings.push_back(string(expression->type.str()));
+
+                switch (node->kind)
+                {
+                case NodeKind::MultiBlock:
+                    for (auto block : identifier.get<Parser::NodeMultiBlock>()->blocks)
+                        nodeChildren.push_back(child(block));
+                    break;
+                case NodeKind::If:
+                {
+                    auto &nodeIf = *identifier.get<Parser::NodeIf>();
+                    nodeChildren.push_back(child(nodeIf.condition));
+                    nodeChildren.push_back(child(nodeIf.thenStatement));
+                    nodeChildren.push_back(child(nodeIf.elseStatement));
+                    break;
+                }
+                case NodeKind::Function:
+                {
+                    auto &function = *identifier.get<Parser::NodeFunction>();
+                    nodeStrings.push_back(symbol(function.name));
+                    nodeStrings.push_back(function.returnType.has_value() ? string(function.returnType->str()) : none);
+                    for (auto &argument : function.arguments)
+                    {
+                        nodeStrings.push_back(string(argument.first.str()));
+                        nodeStrings.push_back(symbol(argument.second));
+                    }
+                    nodeChildren.push_back(child(function.body));
+                    nodeTokens.push_back(token(function.functionToken));
+                    break;
+                }
+                case NodeKind::Pragma:
+                {
+                    auto &pragma = *identifier.get<Parser::NodePragma>();
+                    record.op = std::uint16_t(pragma.pragmaType);
+                    nodeStrings.push_back(string(pragma.value));
+                    nodeTokens.push_back(token(pragma.targetObject));
+                    break;
+                }
+                case NodeKind::Goto:
+                    nodeStrings.push_back(string(identifier.get<Parser::NodeGoto>()->label));
+                    break;
+                case NodeKind::Return:
+                    nodeChildren.push_back(child(identifier.get<Parser::NodeReturn>()->value));
+                    break;
+                case NodeKind::VariableDeclaration:
+                {
+                    auto &declaration = *identifier.get<Parser::NodeVariableDeclaration>();
+                    nodeStrings.push_back(string(declaration.type.str()));
+                    nodeStrings.push_back(symbol(declaration.name));
+                    nodeChildren.push_back(child(declaration.value));
+                    break;
+                }
+                case NodeKind::VariableAssignment:
+                {
+                    auto &assignment = *identifier.get<Parser::NodeVariableAssignment>();
+                    nodeStrings.push_back(symbol(assignment.name));
+                    nodeChildren.push_back(child(assignment.value));
+                    break;
+                }
+                case NodeKind::BinOperator:
+                {
+                    auto &binOperator = *identifier.get<Parser::NodeBinOperator>();
+                    record.op = std::uint16_t(binOperator.op);
+                    nodeChildren.push_back(child(binOperator.left));
+                    nodeChildren.push_back(child(binOperator.right));
+                    break;
+                }
+                case NodeKind::UnaryOperator:
+                {
+                    auto &unaryOperator = *identifier.get<Parser::NodeUnaryOperator>();
+                    record.op = std::uint16_t(unaryOperator.op);
+                    nodeChildren.push_back(child(unaryOperator.right));
+                    break;
+                }
+                case NodeKind::Number:
+                    record.number = identifier.get<Parser::NodeNumber>()->value;
+                    break;
+                case NodeKind::Text:
+                    nodeStrings.push_back(symbol(identifier.get<Parser::NodeText>()->name));
+                    break;
+                case NodeKind::FunctionCall:
+                {
+                    auto &call = *identifier.get<Parser::NodeFunctionCall>();
+                    nodeStrings.push_back(symbol(call.name));
+                    for (auto argument : call.arguments)
+                        nodeChildren.push_back(child(argument));
+                    break;
+                }
+                case NodeKind::Cast:
+                {
+                    auto &cast = *identifier.get<Parser::NodeCast>();
+                    nodeChildren.push_back(child(cast.value));
+                    break;
+                }
+                case NodeKind::BlockModifier:
+                {
+                    auto &modifier = *identifier.get<Parser::NodeBlockModifier>();
+                    record.op = std::uint16_t(modifier.modifier_type);
+                    nodeStrings.push_back(string(modifier.modifier_value));
+                    break;
+                }
+                }
+
+                record.firstChild = children.size();
+                record.childCount = nodeChildren.size();
+                children.insert(children.end(), nodeChildren.begin(), nodeChildren.end());
+                record.firstString = strings.size();
+                record.stringCount = nodeStrings.size();
+                strings.insert(strings.end(), nodeStrings.begin(), nodeStrings.end());
+                record.firstToken = tokens.size();
+                record.tokenCount = nodeTokens.size();
+                tokens.insert(tokens.end(), nodeTokens.begin(), nodeTokens.end());
+                records.push_back(record);
+                pending.resize(firstPending);
+                pending.push_back(records.size() - 1);
+            }
+        };
+
+        // Rebuild the nodes of a mapped file, checking every index against
+        // the tables so that a corrupted file is rejected instead of read out of bounds.
+        class Reader
+        {
+        private:
+            const Header *header = nullptr;
+            const Record *records;
+            const std::uint32_t *children;
+            const std::uint32_t *strings;
+            const TokenRecord *tokens;
+            const StringRecord *stringTable;
+            const std::uint32_t *roots;
+            const char *blob;
+            std::vector<Parser::NodeIdentifier> nodes;
+            // Type named by each string, once looked up.
+            std::vector<std::optional<Types::TypeId>> types;
+            // Record being read, and whether the file is sound so far.
+            const Record *record = nullptr;
+            bool ok = true;
+
+            template <typename T>
+            const T *table(const char *&cursor, const char *end, std::uint64_t count)
+            {
+                const T *result = reinterpret_cast<const T *>(cursor);
+                if (std::uint64_t(end - cursor) / sizeof(T) < count)
+                    ok = false;
+                else
+                    cursor += count * sizeof(T);
+                return result;
+            }
+
+            std::optional<Parser::NodeIdentifier> child(std::uint32_t slot)
+            {
+                if (slot >= record->childCount)
+                {
+                    ok = false;
+                    return std::nullopt;
+                }
+                const std::uint32_t index = children[record->firstChild + slot];
+                if (index == none)
+                    return std::nullopt;
+                // Post-order: children are already built.
+                if (index >= nodes.size())
+                {
+                    ok = false;
+                    return std::nullopt;
+                }
+                return nodes[index];
+            }
+
+            Parser::NodeIdentifier requiredChild(std::uint32_t slot)
+            {
+                auto result = child(slot);
+                ok = ok && result.has_value();
+                return result.value_or(Parser::NodeIdentifier());
+            }
+
+            std::optional<std::string_view> stringAt(std::uint32_t id)
+            {
+                if (id == none)
+                    return std::nullopt;
+                if (id >= header->stringTable)
+                {
+                    ok = false;
+                    return std::nullopt;
+                }
+                return std::string_view(blob + stringTable[id].offset, stringTable[id].length);
+            }
+
+            std::optional<std::string_view> string(std::uint32_t slot)
+            {
+                if (slot >= record->stringCount)
+                {
+                    ok = false;
+                    return std::nullopt;
+                }
+                return stringAt(strings[record->firstString + slot]);
+            }
+
+            std::optional<std::string> optionalText(std::uint32_t slot)
+            {
+                auto result = string(slot);
+                return result.has_value() ? std::optional<std::string>(result.value()) : std::nullopt;
+            }
+
+            // Types are stored by name, their ids depend on the order they were first seen in.
+            std::optional<Types::TypeId> optionalType(std::uint32_t slot)
+            {
+                auto result = string(slot);
+                return result.has_value() ? std::optional<Types::TypeId>(Types::TypeId::named(result.value())) : std::nullopt;
+            }
+
+            Types::TypeId type(std::uint32_t slot)
+            {
+                if (slot >= record->stringCount)
+                {
+                    ok = false;
+                    return Types::none;
+                }
+                const std::uint32_t id = strings[record->firstString + slot];
+                if (id >= header->stringTable)
+                {
+                    ok = false;
+                    return Types::none;
+                }
+                // A few names are the types of every node, look each one up once.
+                auto &type = types[id];
+                if (!type.has_value())
+                    type = Types::TypeId::named(stringAt(id).value());
+                return type.value();
+            }
+
+            std::string text(std::uint32_t slot)
+            {
+                auto result = string(slot);
+                ok = ok && result.has_value();
+                return std::string(result.value_or(""));
+            }
+
+            Lexer::Symbol symbol(std::uint32_t slot)
+            {
+                auto result = string(slot);
+                return result.has_value() ? Lexer::Symbol(result.value()) : Lexer::Symbol();
+            }
+
+            std::optional<Lexer::Token> token(std::uint32_t slot)
+            {
+                if (slot >= record->tokenCount)
+                {
+                    ok = false;
+                    return std::nullopt;
+                }
+                const TokenRecord &token = tokens[record->firstToken + slot];
+                if (token.type == none)
+                    return std::nullopt;
+                if (token.type >= Lexer::tokenTypeCount)
+                {
+                    ok = false;
+                    return std::nullopt;
+                }
+                auto value = stringAt(token.value);
+                auto name = stringAt(token.symbol);
+                ok = ok && value.has_value();
+                return Lexer::Token(Lexer::TokenType(token.type), value.value_or(""), token.line, token.column, name.has_value() ? Lexer::Symbol(name.value()) : Lexer::Symbol());
+            }
+
+            Lexer::Token requiredToken(std::uint32_t slot)
+            {
+                auto result = token(slot);
+                ok = ok && result.has_value();
+                return result.value_or(Lexer::Token(Lexer::TokenType::TOKEN_EOF, "", 0, 0));
+            }
+
+            Lexer::Span span()
+            {
+                return {record->spanBegin, record->spanEnd};
+            }
+
+            Lexer::TokenType op()
+            {
+                if (record->op >= Lexer::tokenTypeCount)
+                    ok = false;
+                return Lexer::TokenType(record->op);
+            }
+
+            Parser::NodeIdentifier build()
+            {
+                using namespace Parser;
+                switch (NodeKind(record->kind))
+                {
+                case NodeKind::MultiBlock:
+                {
+                    std::vector<NodeIdentifier> blocks;
+                    for (std::uint32_t i = 1; i < record->childCount; i++)
+                        blocks.push_back(requiredChild(i));
+                    return addNode<NodeMultiBlock>(blocks);
+                }
+                case NodeKind::If:
+                    return addNode<NodeIf>(span(), requiredChild(1), requiredChild(2), child(3));
+                case NodeKind::Function:
+                {
+                    std::vector<std::pair<Types::TypeId, Lexer::Symbol>> arguments;
+                    for (std::uint32_t i = 3; i + 1 < record->stringCount; i += 2)
+                        arguments.push_back({type(i), symbol(i + 1)});
+                    return addNode<NodeFunction>(span(), requiredToken(0), symbol(1), arguments, optionalType(2), child(1));
+                }
+                case NodeKind::Pragma:
+                    return addNode<NodePragma>(span(), op(), text(1), requiredToken(0));
+                case NodeKind::Goto:
+                    return addNode<NodeGoto>(span(), text(1));
+                case NodeKind::Return:
+                    return addNode<NodeReturn>(span(), child(1));
+                case NodeKind::VariableDeclaration:
+                    return addNode<NodeVariableDeclaration>(span(), type(1), symbol(2), child(1));
+                case NodeKind::VariableAssignment:
+                    return addNode<NodeVariableAssignment>(span(), symbol(1), requiredChild(1));
+                case NodeKind::BinOperator:
+                    return addNode<NodeBinOperator>(requiredChild(0), requiredChild(1), op());
+                case NodeKind::UnaryOperator:
+                    return addNode<NodeUnaryOperator>(span(), requiredChild(0), op());
+                case NodeKind::Number:
+                    return addNode<NodeNumber>(record->number, span());
+                case NodeKind::Text:
+                    return addNode<NodeText>(symbol(2), span());
+                case NodeKind::FunctionCall:
+                {
+                    std::vector<NodeIdentifier> arguments;
+                    for (std::uint32_t i = 0; i < record->childCount; i++)
+                        arguments.push_back(requiredChild(i));
+                    return addNode<NodeFunctionCall>(span(), symbol(2), arguments);
+                }
+                case NodeKind::Cast:
+                    return addNode<NodeCast>(span(), type(1), requiredChild(0));
+                case NodeKind::BlockModifier:
+                    if (record->op != std::uint16_t(Lexer::ModifierType::Named))
+                        ok = false;
+                    return addNode<NodeBlockModifier>(span(), Lexer::ModifierType(record->op), text(1));
+                }
+                ok = false;
+                return NodeIdentifier();
+            }
+
+        public:
+            bool read(const char *data, std::size_t length, std::uint64_t sourceHash, std::vector<Parser::NodeIdentifier> &result)
+            {
+                if (length < sizeof(Header))
+                    return false;
+                header = reinterpret_cast<const Header *>(data);
+                if (std::memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0 || header->version != formatVersion || header->sourceHash != sourceHash)
+                    return false;
+                const char *cursor = data + sizeof(Header);
+                const char *end = data + length;
+                records = table<Record>(cursor, end, header->records);
+                children = table<std::uint32_t>(cursor, end, header->children);
+                strings = table<std::uint32_t>(cursor, end, header->strings);
+                tokens = table<TokenRecord>(cursor, end, header->tokens);
+                stringTable = table<StringRecord>(cursor, end, header->stringTable);
+                roots = table<std::uint32_t>(cursor, end, header->roots);
+                blob = table<char>(cursor, end, header->blobBytes);
+                if (!ok)
+                    return false;
+                for (std::uint32_t i = 0; i < header->stringTable; i++)
+                {
+                    if (std::uint64_t(stringTable[i].offset) + stringTable[i].length > header->blobBytes)
+                        return false;
+                }
+
+                nodes.reserve(header->records);
+                types.resize(header->stringTable);
+                for (std::uint32_t i = 0; i < header->records && ok; i++)
+                {
+                    record = &records[i];
+                    if (std::uint64_t(record->firstChild) + record->childCount > header->children ||
+                        std::uint64_t(record->firstString) + record->stringCount > header->strings ||
+                        std::uint64_t(record->firstToken) + record->tokenCount > header->tokens ||
+                        record->kind > std::uint8_t(Parser::NodeKind::BlockModifier))
+                        return false;
+                    Parser::NodeIdentifier node = build();
+                    if (!ok)
+                        return false;
+                    node->symbol_name = optionalText(0);
+                    // Also for the nodes whose constructor takes it from their children.
+                    node->span = span();
+                    if (auto expression = node.get<Parser::NodeExpression>())
+                        expression->type = type(1);
+                    if (auto block = node.get<Parser::NodeBlock>())
+                        block->modifier = child(0);
+                    nodes.push_back(node);
+                }
+                for (std::uint32_t i = 0; i < header->roots && ok; i++)
+                {
+                    if (roots[i] >= nodes.size())
+                        return false;
+                    result.push_back(nodes[roots[i]]);
+                }
+                return ok;
+            }
+        };
+    }
+
+    AstFile::~AstFile()
+    {
+        if (mapping != nullptr)
+            munmap(mapping, length);
+    }
+
+    std::unique_ptr<AstFile> AstFile::load(const std::string &filename, std::uint64_t sourceHash)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+        void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+            return nullptr;
+        auto file = std::make_unique<AstFile>();
+        file->mapping = mapping;
+        file->length = st.st_size;
+        Reader reader;
+        if (!reader.read(static_cast<const char *>(mapping), st.st_size, sourceHash, file->roots))
+            return nullptr;
+        return file;
+    }
+
+    std::uint64_t hash(const Lexer::SourceBuffer &source)
+    {
+        return llvm::xxHash64(llvm::StringRef(source.begin(), source.size()));
+    }
+
+    std::string astPath(const std::string &directory, std::uint64_t sourceHash)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.ast", static_cast<unsigned long long>(sourceHash));
+        llvm::SmallString<128> path(directory);
+        llvm::sys::path::append(path, name);
+        return std::string(path);
+    }
+
+    bool storeAst(const std::string &filename, std::uint64_t sourceHash, const std::vector<Parser::NodeIdentifier> &roots)
+    {
+        Writer writer;
+        for (auto root : roots)
+        {
+            if (root.get() != nullptr)
+                writer.roots.push_back(writer.add(root));
+        }
+        if (writer.blob.size() > UINT32_MAX || writer.records.size() >= none)
+            return false;
+
+        Header header{};
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        header.version = formatVersion;
+        header.sourceHash = sourceHash;
+        header.records = writer.records.size();
+        header.children = writer.children.size();
+        header.strings = writer.strings.size();
+        header.tokens = writer.tokens.size();
+        header.stringTable = writer.stringTable.size();
+        header.roots = writer.roots.size();
+        header.blobBytes = writer.blob.size();
+
+        if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(filename)))
+            return false;
+        // Readers never see a partial file: write a temporary one next to it, then rename.
+        const std::string temporary = filename + "." + std::to_string(getpid()) + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            auto write = [&out](const void *data, std::size_t size)
+            { out.write(static_cast<const char *>(data), size); };
+            write(&header, sizeof(header));
+            write(writer.records.data(), writer.records.size() * sizeof(Record));
+            write(writer.children.data(), writer.children.size() * sizeof(std::uint32_t));
+            write(writer.strings.data(), writer.strings.size() * sizeof(std::uint32_t));
+            write(writer.tokens.data(), writer.tokens.size() * sizeof(TokenRecord));
+            write(writer.stringTable.data(), writer.stringTable.size() * sizeof(StringRecord));
+            write(writer.roots.data(), writer.roots.size() * sizeof(std::uint32_t));
+            write(writer.blob.data(), writer.blob.size());
+            if (!out)
+            {
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+        if (std::rename(temporary.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+}
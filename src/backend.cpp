@@ -0,0 +1,467 @@
+#include "backend.hpp"
+#include "threadPool.hpp"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/CodeGen/ParallelCG.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/ModuleSlotTracker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Backend
+{
+    namespace
+    {
+        bool emitSingle(llvm::Module &M, llvm::TargetMachine &targetMachine, const std::string &filename)
+        {
+            std::error_code EC;
+            llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::OF_None);
+            if (EC)
+            {
+                llvm::errs() << "Could not open file: " << EC.message();
+                return false;
+            }
+
+            llvm::legacy::PassManager pass;
+            if (targetMachine.addPassesToEmitFile(pass, dest, nullptr, llvm::CGFT_ObjectFile))
+            {
+                llvm::errs() << "TargetMachine can't emit a file of this type";
+                return false;
+            }
+            pass.run(M);
+            dest.flush();
+            return true;
+        }
+
+        // Merge parts into the relocatable object filename.
+        bool link(const std::string &linker, const std::vector<llvm::SmallString<128>> &parts, const std::string &filename)
+        {
+            std::vector<llvm::StringRef> arguments{linker, "-r", "-o", filename};
+            for (auto &part : parts)
+                arguments.push_back(part);
+            // One part per function does not fit on a command line.
+            llvm::SmallString<128> responseFile;
+            std::string responseArgument;
+            if (!llvm::sys::commandLineFitsWithinSystemLimits(linker, arguments))
+            {
+                int fd;
+                if (auto EC = llvm::sys::fs::createTemporaryFile("gkc-link", "rsp", fd, responseFile))
+                {
+                    llvm::errs() << "Could not create a temporary file: " << EC.message();
+                    return false;
+                }
+                llvm::raw_fd_ostream response(fd, true);
+                for (auto &part : parts)
+                {
+                    response << '"';
+                    for (char c : part)
+                        response << (c == '"' || c == '\\' ? "\\" : "") << c;
+                    response << "\"\n";
+                }
+                responseArgument = "@" + std::string(responseFile);
+                arguments.resize(4);
+                arguments.push_back(responseArgument);
+            }
+            std::string message;
+            const int status = llvm::sys::ExecuteAndWait(linker, arguments, llvm::None, {}, 0, 0, &message);
+            if (!responseFile.empty())
+                llvm::sys::fs::remove(responseFile);
+            if (status != 0)
+            {
+                llvm::errs() << "Could not merge the objects with " << linker << ": " << message;
+                return false;
+            }
+            return true;
+        }
+
+        // Bump when the way a function is compiled alone changes.
+        constexpr char objectFormat[] = "gkc-object-1";
+
+        // Add the globals F refers to, through constants too, to globals.
+        // Return false if one of them is local to the module.
+        bool referencedGlobals(const llvm::Function &F, llvm::SmallPtrSetImpl<const llvm::GlobalValue *> &globals)
+        {
+            llvm::SmallPtrSet<const llvm::Constant *, 32> seen;
+            std::vector<const llvm::Constant *> pending;
+            for (auto &instruction : llvm::instructions(F))
+            {
+                for (auto &operand : instruction.operands())
+                {
+                    if (auto constant = llvm::dyn_cast<llvm::Constant>(operand); constant != nullptr && seen.insert(constant).second)
+                        pending.push_back(constant);
+                }
+            }
+            while (!pending.empty())
+            {
+                const llvm::Constant *constant = pending.back();
+                pending.pop_back();
+                if (auto global = llvm::dyn_cast<llvm::GlobalValue>(constant))
+                {
+                    if (global->hasLocalLinkage())
+                        return false;
+                    globals.insert(global);
+                    continue;
+                }
+                for (auto &operand : constant->operands())
+                {
+                    if (auto child = llvm::dyn_cast<llvm::Constant>(operand); child != nullptr && seen.insert(child).second)
+                        pending.push_back(child);
+                }
+            }
+            return true;
+        }
+
+        // Module holding a copy of F and declarations of the globals it uses.
+        std::unique_ptr<llvm::Module> extractFunction(const llvm::Function &F, const llvm::SmallPtrSetImpl<const llvm::GlobalValue *> &globals)
+        {
+            const llvm::Module &M = *F.getParent();
+            auto part = std::make_unique<llvm::Module>(F.getName(), F.getContext());
+            part->setDataLayout(M.getDataLayout());
+            part->setTargetTriple(M.getTargetTriple());
+            llvm::ValueToValueMapTy VMap;
+            auto copy = llvm::Function::Create(F.getFunctionType(), F.getLinkage(), F.getName(), part.get());
+            copy->copyAttributesFrom(&F);
+            VMap[&F] = copy;
+            for (auto global : globals)
+            {
+                if (global == &F)
+                    continue;
+                if (auto function = llvm::dyn_cast<llvm::Function>(global))
+                {
+                    auto declaration = llvm::Function::Create(function->getFunctionType(), llvm::GlobalValue::ExternalLinkage, function->getName(), part.get());
+                    declaration->copyAttributesFrom(function);
+                    VMap[function] = declaration;
+                }
+                else if (auto variable = llvm::dyn_cast<llvm::GlobalVariable>(global))
+                    VMap[variable] = new llvm::GlobalVariable(*part, variable->getValueType(), variable->isConstant(), llvm::GlobalValue::ExternalLinkage, nullptr, variable->getName());
+                else
+                    return nullptr;
+            }
+            auto argument = copy->arg_begin();
+            for (auto &original : F.args())
+                VMap[&original] = &*argument++;
+            llvm::SmallVector<llvm::ReturnInst *, 8> returns;
+            llvm::CloneFunctionInto(copy, &F, VMap, llvm::CloneFunctionChangeType::DifferentModule, returns);
+            // The empty list of compile units added by the cloning makes reading
+            // the part back from bitcode warn about missing debug info.
+            if (auto units = part->getNamedMetadata("llvm.dbg.cu"); units != nullptr && units->getNumOperands() == 0)
+                part->eraseNamedMetadata(units);
+            return part;
+        }
+
+        // Compile part as the cached object path.
+        // Written aside then renamed, a concurrent build never links a partial object.
+        bool emitCachedPart(llvm::Module &part, llvm::TargetMachine &targetMachine, const llvm::SmallString<128> &path)
+        {
+            llvm::SmallString<128> temporary;
+            if (auto EC = llvm::sys::fs::createUniqueFile(llvm::Twine(path) + "-%%%%%%.tmp", temporary))
+            {
+                llvm::errs() << "Could not create a temporary file: " << EC.message();
+                return false;
+            }
+            if (!emitSingle(part, targetMachine, std::string(temporary)) || llvm::sys::fs::rename(temporary, path))
+            {
+                llvm::sys::fs::remove(temporary);
+                return false;
+            }
+            return true;
+        }
+
+        // A function missing from the cache, as bitcode to be compiled on
+        // another thread in its own LLVMContext.
+        class CacheMiss
+        {
+        public:
+            llvm::SmallString<128> path;
+            llvm::SmallVector<char, 0> bitcode;
+        };
+
+        // Compile misses on threads threads, each with its own target machine.
+        bool emitCacheMisses(const std::vector<CacheMiss> &misses, const TargetMachineFactory &createTargetMachine, unsigned threads)
+        {
+            std::atomic<bool> failed = false;
+            Concurrency::ThreadPool pool(threads - 1);
+            for (unsigned first = 0; first < threads; first++)
+            {
+                pool.submit([&, first]()
+                            {
+                                llvm::LLVMContext context;
+                                auto targetMachine = createTargetMachine();
+                                for (std::size_t i = first; i < misses.size() && !failed; i += threads)
+                                {
+                                    auto part = llvm::parseBitcodeFile(llvm::MemoryBufferRef(llvm::StringRef(misses[i].bitcode.data(), misses[i].bitcode.size()), misses[i].path), context);
+                                    if (!part)
+                                    {
+                                        llvm::errs() << "Could not read back " << misses[i].path << ": " << llvm::toString(part.takeError());
+                                        failed = true;
+                                    }
+                                    else if (!emitCachedPart(**part, *targetMachine, misses[i].path))
+                                        failed = true;
+                                } });
+            }
+            pool.wait();
+            return !failed;
+        }
+    }
+
+    ObjectEmitter::ObjectEmitter(const TargetMachineFactory &createTargetMachine) : targetMachine(createTargetMachine())
+    {
+        ready = !targetMachine->addPassesToEmitFile(passes, stream, nullptr, llvm::CGFT_ObjectFile);
+    }
+
+    bool ObjectEmitter::emit(llvm::Module &M, std::string &object)
+    {
+        if (!ready)
+        {
+            llvm::errs() << "TargetMachine can't emit a file of this type";
+            return false;
+        }
+        buffer.clear();
+        passes.run(M);
+        object.assign(buffer.data(), buffer.size());
+        return true;
+    }
+
+    bool ObjectEmitter::emit(llvm::Module &M, const std::string &filename)
+    {
+        if (!ready)
+        {
+            llvm::errs() << "TargetMachine can't emit a file of this type";
+            return false;
+        }
+        buffer.clear();
+        passes.run(M);
+        std::error_code EC;
+        llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::OF_None);
+        if (EC)
+        {
+            llvm::errs() << "Could not open file: " << EC.message();
+            return false;
+        }
+        dest << llvm::StringRef(buffer.data(), buffer.size());
+        return true;
+    }
+
+    bool mergeObjects(const std::vector<llvm::SmallString<128>> &parts, const std::string &filename)
+    {
+        auto linker = llvm::sys::findProgramByName("ld");
+        if (!linker)
+        {
+            llvm::errs() << "Could not find ld to merge the objects";
+            return false;
+        }
+        return link(*linker, parts, filename);
+    }
+
+    bool emitObject(llvm::Module &M, const TargetMachineFactory &createTargetMachine, const std::string &filename, unsigned jobs)
+    {
+        // No more partitions than function bodies, nor than the machine runs at once.
+        const auto bodies = std::count_if(M.begin(), M.end(), [](const llvm::Function &function)
+                                          { return !function.isDeclaration(); });
+        jobs = std::min<std::size_t>({jobs, std::size_t(bodies), std::max(1u, std::thread::hardware_concurrency())});
+        auto linker = llvm::sys::findProgramByName("ld");
+        if (jobs <= 1 || !linker)
+            return emitSingle(M, *createTargetMachine(), filename);
+
+        std::vector<llvm::SmallString<128>> parts(jobs);
+        std::vector<std::unique_ptr<llvm::raw_fd_ostream>> streams;
+        auto removeParts = [&parts]()
+        {
+            for (auto &part : parts)
+            {
+                if (!part.empty())
+                    llvm::sys::fs::remove(part);
+            }
+        };
+        for (auto &part : parts)
+        {
+            int fd;
+            if (auto EC = llvm::sys::fs::createTemporaryFile("gkc-part", "o", fd, part))
+            {
+                llvm::errs() << "Could not create a temporary file: " << EC.message();
+                removeParts();
+                return false;
+            }
+            streams.push_back(std::make_unique<llvm::raw_fd_ostream>(fd, true));
+        }
+
+        // Locals stay in the partition of their users, so no symbol is renamed.
+        std::vector<llvm::raw_pwrite_stream *> outputs;
+        for (auto &stream : streams)
+            outputs.push_back(stream.get());
+        llvm::splitCodeGen(M, outputs, {}, createTargetMachine, llvm::CGFT_ObjectFile, true);
+        streams.clear();
+
+        const bool linked = link(*linker, parts, filename);
+        removeParts();
+        return linked;
+    }
+
+    bool emitCached(llvm::Module &M, const TargetMachineFactory &createTargetMachine, const std::string &filename, const std::string &directory, unsigned jobs, CacheStatistics &statistics)
+    {
+        auto targetMachine = createTargetMachine();
+        auto linker = llvm::sys::findProgramByName("ld");
+        if (!linker)
+            return emitSingle(M, *targetMachine, filename);
+        if (auto EC = llvm::sys::fs::create_directories(directory))
+        {
+            llvm::errs() << "Could not create " << directory << ": " << EC.message();
+            return false;
+        }
+
+        // Everything besides the IR of a function that changes its machine code.
+        std::string target;
+        llvm::raw_string_ostream(target) << objectFormat << '\n'
+                                         << M.getDataLayoutStr() << '\n'
+                                         << targetMachine->getTargetTriple().str() << '\n'
+                                         << targetMachine->getTargetCPU() << '\n'
+                                         << targetMachine->getTargetFeatureString() << '\n'
+                                         << int(targetMachine->getOptLevel()) << '\n';
+        // Numbering the globals once, not once per printed function.
+        llvm::ModuleSlotTracker slots(&M);
+        std::vector<llvm::SmallString<128>> parts(1);
+        // With a single job the misses are compiled as they are found.
+        std::vector<CacheMiss> misses;
+        for (auto &F : M)
+        {
+            if (F.isDeclaration())
+                continue;
+            llvm::SmallPtrSet<const llvm::GlobalValue *, 16> globals;
+            if (F.hasLocalLinkage() || !referencedGlobals(F, globals))
+            {
+                statistics.uncached++;
+                continue;
+            }
+            std::string key = target;
+            llvm::raw_string_ostream keyStream(key);
+            static_cast<const llvm::Value &>(F).print(keyStream, slots);
+            keyStream.flush();
+            char name[32];
+            std::snprintf(name, sizeof(name), "%016llx.o", static_cast<unsigned long long>(llvm::xxHash64(key)));
+            llvm::SmallString<128> path(directory);
+            llvm::sys::path::append(path, name);
+
+            if (llvm::sys::fs::exists(path))
+                statistics.hits++;
+            else
+            {
+                auto part = extractFunction(F, globals);
+                if (part == nullptr)
+                {
+                    statistics.uncached++;
+                    continue;
+                }
+                if (jobs <= 1)
+                {
+                    if (!emitCachedPart(*part, *targetMachine, path))
+                        return false;
+                }
+                else
+                {
+                    auto &miss = misses.emplace_back();
+                    miss.path = path;
+                    llvm::raw_svector_ostream bitcode(miss.bitcode);
+                    llvm::WriteBitcodeToFile(*part, bitcode);
+                }
+                statistics.misses++;
+            }
+            parts.push_back(path);
+            F.deleteBody();
+        }
+
+        if (!misses.empty())
+        {
+            // No more threads than misses, nor than the machine runs at once.
+            const unsigned threads = std::min<std::size_t>({jobs, misses.size(), std::max(1u, std::thread::hardware_concurrency())});
+            if (!emitCacheMisses(misses, createTargetMachine, threads))
+                return false;
+        }
+
+        // The globals and the functions that could not be cached.
+        if (auto EC = llvm::sys::fs::createTemporaryFile("gkc-part", "o", parts[0]))
+        {
+            llvm::errs() << "Could not create a temporary file: " << EC.message();
+            return false;
+        }
+        const bool linked = emitSingle(M, *targetMachine, std::string(parts[0])) && link(*linker, parts, filename);
+        llvm::sys::fs::remove(parts[0]);
+        return linked;
+    }
+
+    PartialEmitter::PartialEmitter(llvm::Module &M, const TargetMachineFactory &createTargetMachine, llvm::raw_ostream *print) : M(M), targetMachine(createTargetMachine()), print(print)
+    {
+        if (auto found = llvm::sys::findProgramByName("ld"))
+            linker = *found;
+    }
+
+    PartialEmitter::~PartialEmitter()
+    {
+        for (auto &part : parts)
+            llvm::sys::fs::remove(part);
+    }
+
+    bool PartialEmitter::flushIfLarge()
+    {
+        // Functions are only ever appended to M, count the new ones.
+        auto function = M.getFunctionList().rbegin();
+        for (; functionsCounted < M.size(); functionsCounted++, function++)
+            instructions += function->getInstructionCount();
+        if (!linker || instructions <= threshold)
+            return true;
+        return flush();
+    }
+
+    bool PartialEmitter::flush()
+    {
+        if (print != nullptr)
+            M.print(*print, nullptr);
+        auto &part = parts.emplace_back();
+        if (auto EC = llvm::sys::fs::createTemporaryFile("gkc-part", "o", part))
+        {
+            llvm::errs() << "Could not create a temporary file: " << EC.message();
+            parts.pop_back();
+            return false;
+        }
+        if (!emitSingle(M, *targetMachine, std::string(part)))
+            return false;
+        instructions = 0;
+        for (auto &function : M)
+        {
+            if (!function.isDeclaration())
+                function.deleteBody();
+        }
+        // Later parts refer to the globals defined in this one.
+        for (auto &global : M.globals())
+        {
+            if (!global.isDeclaration() && !global.hasLocalLinkage())
+                global.setInitializer(nullptr);
+        }
+        return true;
+    }
+
+    bool PartialEmitter::finish(const std::string &filename)
+    {
+        if (parts.empty())
+        {
+            if (print != nullptr)
+                M.print(*print, nullptr);
+            return emitSingle(M, *targetMachine, filename);
+        }
+        const bool bodiesLeft = std::any_of(M.begin(), M.end(), [](const llvm::Function &function)
+                                            { return !function.isDeclaration(); }) ||
+                                std::any_of(M.global_begin(), M.global_end(), [](const llvm::GlobalVariable &global)
+                                            { return !global.isDeclaration(); });
+        if (bodiesLeft && !flush())
+            return false;
+        return link(*linker, parts, filename);
+    }
+}
@@ -0,0 +1,100 @@
+// gkc-client: compiles a file on a gkc --server, without starting a compiler.
+#include "protocol.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <getopt.h>
+#include <unistd.h>
+
+// The server does not share the working directory of the client.
+std::string absolute(const std::string &path)
+{
+    if (path.empty() || path[0] == '/')
+        return path;
+    char directory[4096];
+    if (getcwd(directory, sizeof(directory)) == nullptr)
+        return path;
+    return std::string(directory) + "/" + path;
+}
+
+int main(int argc, char **argv)
+{
+    const std::string usage = "Usage: " + std::string(argv[0]) + " SOCKET [options] file\n"
+                                                                 "Compile file to output.o on the gkc --server listening on SOCKET.\n"
+                                                                 "Options:\n"
+                                                                 "  -s, --silent        Accepted for gkc compatibility, nothing is printed but errors\n"
+                                                                 "  -o FILE             Write the object to FILE\n"
+                                                                 "  -j, --jobs N        Compile on N threads\n"
+                                                                 "  --pipeline          Overlap parsing, type checking and code generation\n"
+                                                                 "  --stream            Compile block by block in bounded memory\n"
+                                                                 "  --cache-dir DIR     Reuse the AST and the code of unchanged functions from DIR\n"
+                                                                 "  -h, --help          Print this help message\n";
+    int pipeline = 0;
+    int stream = 0;
+    Ckc::Request request;
+    request.objectFilename = "output.o";
+    static struct option long_options[] = {
+        {"silent", no_argument, nullptr, 's'},
+        {"help", no_argument, nullptr, 'h'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"pipeline", no_argument, &pipeline, 1},
+        {"stream", no_argument, &stream, 1},
+        {"cache-dir", required_argument, nullptr, 'c'},
+        {0, 0, 0, 0}};
+    int c;
+    while ((c = getopt_long(argc, argv, "sho:j:", long_options, nullptr)) != -1)
+    {
+        switch (c)
+        {
+        case 0:
+        case 's':
+            break;
+        case 'h':
+            std::cout << usage;
+            return 0;
+        case 'o':
+            request.objectFilename = optarg;
+            break;
+        case 'j':
+            request.jobs = std::max(1, std::atoi(optarg));
+            break;
+        case 'c':
+            request.cacheDirectory = absolute(optarg);
+            break;
+        default:
+            std::cout << usage;
+            return 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        std::cout << usage;
+        return 1;
+    }
+    const std::string socketPath = argv[optind];
+    request.filename = argv[optind + 1];
+    std::ifstream file(request.filename, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "File not found: " << request.filename << std::endl;
+        return 1;
+    }
+    std::ostringstream source;
+    source << file.rdbuf();
+    request.source = source.str();
+    request.pipeline = pipeline;
+    request.stream = stream;
+    request.objectFilename = absolute(request.objectFilename);
+
+    Ckc::Response response;
+    std::string error;
+    if (!Ckc::compileRemote(socketPath, request, response, error))
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cerr << response.diagnostics;
+    return response.compiled ? 0 : 1;
+}
@@ -1,22 +1,35 @@
 #include "contextProvider.hpp"
 #include "llvm/IR/IRBuilder.h"
+#include <utility>
 
 namespace Context
 {
+    namespace
+    {
+        thread_local ContextProvider *currentProvider = nullptr;
+    }
+
+    ContextProvider &ContextProvider::getInstance()
+    {
+        static ContextProvider shared;
+        return currentProvider != nullptr ? *currentProvider : shared;
+    }
+
+    void ContextProvider::setCurrent(ContextProvider &provider)
+    {
+        currentProvider = &provider;
+    }
 
-    void ContextProvider::addVariable(std::string name, llvm::AllocaInst *value, std::string type)
+    void ContextProvider::addVariable(Lexer::Symbol name, llvm::Value *value, llvm::Type *valueType, Types::TypeId type)
     {
-        variables.back()[name] = variable{type, value};
+        variables.add(name, variable{type, value, valueType});
     }
 
-    variable ContextProvider::getVariable(std::string name)
+    variable ContextProvider::getVariable(Lexer::Symbol name)
     {
-        for (auto it = variables.rbegin(); it != variables.rend(); ++it)
-        {
-            if (it->find(name) != it->end())
-                return it->at(name);
-        }
-        return variable{"", nullptr};
+        if (const variable *found = variables.find(name))
+            return *found;
+        return variable{Types::none, nullptr, nullptr};
     }
 
     void ContextProvider::addBasicBlock(std::string name, llvm::BasicBlock *block)
@@ -29,30 +42,35 @@ namespace Context
         return namedBlocks[name];
     }
 
+    std::map<std::string, llvm::BasicBlock *> ContextProvider::takeBasicBlocks()
+    {
+        return std::exchange(namedBlocks, {});
+    }
+
+    void ContextProvider::restoreBasicBlocks(std::map<std::string, llvm::BasicBlock *> blocks)
+    {
+        namedBlocks = std::move(blocks);
+    }
+
     void ContextProvider::enterScope()
     {
-        variables.push_back(std::map<std::string, variable>());
-        nameTranslation.push_back(std::map<std::string, std::string>());
+        variables.enterScope();
+        nameTranslation.enterScope();
     }
 
     void ContextProvider::exitScope()
     {
-        variables.pop_back();
-        nameTranslation.pop_back();
+        variables.exitScope();
+        nameTranslation.exitScope();
     }
 
     void ContextProvider::addNameTranslation(std::string name, std::string translation)
     {
-        nameTranslation.back()[name] = translation;
+        nameTranslation.add(name, translation);
     }
     std::optional<std::string> ContextProvider::getNameTranslation(std::string name)
     {
-        for (auto it = nameTranslation.rbegin(); it != nameTranslation.rend(); ++it)
-        {
-            if (it->find(name) != it->end())
-                return it->at(name);
-        }
-        return std::nullopt;
+        return nameTranslation.get(name);
     }
 
 }
\ No newline at end of file
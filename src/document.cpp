@@ -0,0 +1,312 @@
+#include "document.hpp"
+#include "frontend.hpp"
+#include "visitor/typeVisitor.hpp"
+#include <algorithm>
+#include <iterator>
+
+namespace Ckc
+{
+    namespace
+    {
+        // Bytes of nodes of replaced functions left in the arena, on top of
+        // the size of the last full analysis, before the next edit analyses
+        // the whole text again to release them.
+        constexpr std::size_t garbageLimit = std::size_t(1) << 20;
+    }
+
+    Document::Document(std::string text, std::string filename) : text(std::move(text)), filename(std::move(filename))
+    {
+        indexLines();
+        update();
+    }
+
+    void Document::setText(std::string text)
+    {
+        this->text = std::move(text);
+        indexLines();
+        update();
+    }
+
+    void Document::indexLines()
+    {
+        lineOffsets.assign(1, 0);
+        for (std::size_t i = 0; i < text.size(); i++)
+        {
+            if (text[i] == '\n')
+                lineOffsets.push_back(i + 1);
+        }
+    }
+
+    std::string_view Document::getLine(int line) const
+    {
+        if (line < 1 || std::size_t(line) > lineOffsets.size())
+            return "";
+        const std::size_t start = lineOffsets[line - 1];
+        std::size_t stop = std::size_t(line) < lineOffsets.size() ? lineOffsets[line] - 1 : text.size();
+        while (stop > start && text[stop - 1] == '\r')
+            stop--;
+        return std::string_view(text).substr(start, stop - start);
+    }
+
+    std::size_t Document::offset(int line, int column) const
+    {
+        if (line < 1)
+            return 0;
+        if (std::size_t(line) > lineOffsets.size())
+            return text.size();
+        const std::size_t start = lineOffsets[line - 1];
+        const std::size_t stop = std::size_t(line) < lineOffsets.size() ? lineOffsets[line] - 1 : text.size();
+        return start + std::min<std::size_t>(std::max(column, 1) - 1, stop - start);
+    }
+
+    void Document::change(std::size_t begin, std::size_t end, std::string_view replacement)
+    {
+        end = std::min(end, text.size());
+        begin = std::min(begin, end);
+        // The blocks the edit touches: the one it starts in, the one before
+        // if it starts where a block starts, as its last token may grow, and
+        // every block starting on a line the edit reaches, as their columns move.
+        std::size_t first = 0;
+        std::size_t last = 0;
+        if (!blocks.empty())
+        {
+            auto found = std::upper_bound(blocks.begin(), blocks.end(), begin, [](std::size_t offset, const Block &block)
+                                          { return offset < block.begin; });
+            first = std::distance(blocks.begin(), found) - 1;
+            if (first > 0 && blocks[first].begin == begin)
+                first--;
+            last = first;
+            while (last + 1 < blocks.size() && lineOffsets[blocks[last + 1].line - 1] <= end)
+                last++;
+        }
+
+        const std::ptrdiff_t delta = std::ptrdiff_t(replacement.size()) - std::ptrdiff_t(end - begin);
+        const int lines = std::count(replacement.begin(), replacement.end(), '\n') - std::count(text.begin() + begin, text.begin() + end, '\n');
+        text.replace(begin, end - begin, replacement);
+        // Line starts within the replaced bytes are gone, those after them move.
+        auto removed = std::upper_bound(lineOffsets.begin(), lineOffsets.end(), begin);
+        auto kept = std::upper_bound(removed, lineOffsets.end(), end);
+        for (auto offset = kept; offset != lineOffsets.end(); offset++)
+            *offset += delta;
+        std::vector<std::size_t> added;
+        for (std::size_t i = 0; i < replacement.size(); i++)
+        {
+            if (replacement[i] == '\n')
+                added.push_back(begin + i + 1);
+        }
+        lineOffsets.insert(lineOffsets.erase(removed, kept), added.begin(), added.end());
+        for (std::size_t i = last + 1; i < blocks.size(); i++)
+        {
+            blocks[i].begin += delta;
+            blocks[i].line += lines;
+        }
+
+        const bool local = !blocks.empty() && first == last && !blocks[first].header.empty() && state.arena.bytesUsed() <= 2 * analysedBytes + garbageLimit;
+        update(local ? first : SIZE_MAX);
+    }
+
+    void Document::update(std::size_t index)
+    {
+        try
+        {
+            if (index < blocks.size() && analyseFunction(index))
+                return;
+            analyse();
+        }
+        catch (const std::exception &exception)
+        {
+            // A single block over the whole text, which the next edit analyses again.
+            blocks.assign(1, Block{});
+            Block &block = blocks.front();
+            block.begin = 0;
+            block.line = block.lexedLine = block.column = 1;
+            block.syntax.push_back({"Internal compiler error: " + std::string(exception.what()), {{{1, 1}, {1, 1}}}});
+            checkedBlocks = 0;
+        }
+    }
+
+    void Document::analyse()
+    {
+        statistics.fullAnalyses++;
+        blocks.clear();
+        names.clear();
+        variables.clear();
+        checkedBlocks = SIZE_MAX;
+        state.reset();
+        CompilerState::Activation activation(state);
+        source = std::make_shared<Lexer::SourceBuffer>(text);
+        Lexer::TokenStream ts(source, filename);
+        const auto ranges = Frontend::scanFunctions(ts);
+        std::size_t nextRange = 0;
+        // Declares the functions and checks every block but their bodies, in source order.
+        visitor::typeVisitor typeVisitor;
+        std::vector<Lexer::Symbol> symbols;
+        while (!ts.isEmpty())
+        {
+            const std::size_t index = blocks.size();
+            const std::size_t start = ts.tell();
+            const Lexer::Token first = ts.peek();
+            Block &block = blocks.emplace_back();
+            // The first block starts with the text, the others with their first token.
+            block.begin = index == 0 ? 0 : first.value.data() - source->begin();
+            block.line = block.lexedLine = index == 0 ? 1 : first.line;
+            block.column = index == 0 ? 1 : first.column;
+            ts.collectDiagnostics(&block.syntax);
+
+            while (nextRange < ranges.size() && ranges[nextRange].begin < start)
+                nextRange++;
+            bool parsed = false;
+            if (nextRange < ranges.size() && ranges[nextRange].begin == start)
+            {
+                const std::size_t body = ranges[nextRange].body;
+                for (std::size_t i = start; i <= body; i++)
+                    block.header.push_back(ts.peek(i - start));
+                block.node = Parser::parseFunctionHeader(ts);
+                auto *function = block.node.get<Parser::NodeFunction>();
+                if (function != nullptr && ts.tell() == body)
+                {
+                    // As gkc -j, a syntax error in the body does not reach past its end.
+                    Lexer::TokenStream bodyTokens(ts, body, ranges[nextRange].end);
+                    parsed = Parser::parseFunctionEnd(bodyTokens, *function);
+                    ts.seek(ranges[nextRange].end);
+                }
+                else
+                {
+                    // Not the shape the pre-scan expected, like any other block.
+                    block.header.clear();
+                    if (function != nullptr && !Parser::parseFunctionEnd(ts, *function))
+                        block.node = Parser::NodeIdentifier();
+                }
+            }
+            else
+                block.node = Parser::parseBlock(ts);
+            if (block.node.get() == nullptr)
+                Parser::synchronize(ts);
+            // The blocks after one whose declarations may be missing are not checked.
+            if (block.node.get() == nullptr || (block.header.empty() && !block.syntax.empty()))
+                checkedBlocks = std::min(checkedBlocks, index + 1);
+
+            ts.collectDiagnostics(&block.types);
+            if (index < checkedBlocks && !block.header.empty())
+                block.declared = Frontend::reportCheckErrors(ts, first, [&]()
+                                                             { typeVisitor.declareFunction(*block.node.get<Parser::NodeFunction>()); });
+            else if (index < checkedBlocks && block.node.get() != nullptr && block.syntax.empty())
+                Frontend::reportCheckErrors(ts, first, [&]()
+                                            { typeVisitor.dispatch(block.node); });
+
+            // What the block declared, for the blocks analysed on their own later.
+            const std::size_t end = ts.tell();
+            symbols.clear();
+            ts.seek(start);
+            for (std::size_t i = start; i < end; i++)
+            {
+                if (!ts.peek(i - start).symbol.empty())
+                    symbols.push_back(ts.peek(i - start).symbol);
+            }
+            ts.seek(end);
+            for (auto symbol : symbols)
+            {
+                addBinding(names, symbol, index, Lexer::LexerContext::getTokenType(symbol));
+                addBinding(variables, symbol, index, typeVisitor.getVariableType(symbol));
+            }
+
+            if (parsed && block.declared && block.syntax.empty())
+                checkBody(ts, block, index, symbols);
+        }
+        ts.collectDiagnostics(nullptr);
+        analysedBytes = state.arena.bytesUsed();
+    }
+
+    bool Document::analyseFunction(std::size_t index)
+    {
+        Block &block = blocks[index];
+        const std::size_t end = index + 1 < blocks.size() ? blocks[index + 1].begin : text.size();
+        auto blockSource = std::make_shared<Lexer::SourceBuffer>(text.substr(block.begin, end - block.begin));
+        // Numbered like the tokens of the other blocks, which the function
+        // table compares its declarations with.
+        Lexer::TokenStream ts(blockSource, filename, false, block.lexedLine, block.column);
+        std::vector<Lexer::Diagnostic> syntax;
+        ts.collectDiagnostics(&syntax);
+        std::size_t count = 0;
+        while (ts.peek(count).type != Lexer::TokenType::TOKEN_EOF)
+            count++;
+        const auto ranges = Frontend::scanFunctions(ts);
+        if (ranges.size() != 1 || ranges[0].begin != 0 || ranges[0].end != count || ranges[0].body + 1 != block.header.size())
+            return false;
+        for (std::size_t i = 0; i < block.header.size(); i++)
+        {
+            if (!(ts.peek(i) == block.header[i]))
+                return false;
+        }
+        std::vector<Lexer::Symbol> symbols;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            if (!ts.peek(i).symbol.empty())
+                symbols.push_back(ts.peek(i).symbol);
+        }
+
+        CompilerState::Activation activation(state);
+        // The scopes of the parser as they were before the function.
+        Lexer::LexerContext::context.clear();
+        for (auto symbol : symbols)
+        {
+            if (auto kind = boundBefore(names, symbol, index); kind.has_value() && !Lexer::LexerContext::getTokenType(symbol).has_value())
+                Lexer::LexerContext::addToken(symbol, kind.value());
+        }
+        auto node = Parser::parseFunctionHeader(ts);
+        auto *function = node.get<Parser::NodeFunction>();
+        if (function == nullptr || ts.tell() != ranges[0].body)
+            return false;
+        const bool parsed = Parser::parseFunctionEnd(ts, *function);
+
+        statistics.functionAnalyses++;
+        block.source = std::move(blockSource);
+        block.node = node;
+        block.syntax = std::move(syntax);
+        block.body.clear();
+        if (parsed && block.declared && block.syntax.empty() && index < checkedBlocks)
+            checkBody(ts, block, index, symbols);
+        ts.collectDiagnostics(nullptr);
+        return true;
+    }
+
+    void Document::checkBody(Lexer::TokenStream &ts, Block &block, std::size_t index, const std::vector<Lexer::Symbol> &symbols)
+    {
+        // The global variables as they were before the function, the
+        // function table holds every signature and hides those declared after it.
+        visitor::typeVisitor checker;
+        for (auto symbol : symbols)
+        {
+            if (auto type = boundBefore(variables, symbol, index); type.has_value() && !checker.getVariableType(symbol).has_value())
+                checker.addVariable(symbol, type.value());
+        }
+        auto &function = *block.node.get<Parser::NodeFunction>();
+        ts.collectDiagnostics(&block.body);
+        Frontend::reportCheckErrors(ts, block.header.front(), [&]()
+                                    { checker.checkFunctionBody(function); });
+    }
+
+    std::vector<DocumentDiagnostic> Document::getDiagnostics() const
+    {
+        std::vector<DocumentDiagnostic> diagnostics;
+        for (std::size_t i = 0; i < blocks.size(); i++)
+        {
+            const Block &block = blocks[i];
+            const int moved = block.line - block.lexedLine;
+            auto add = [&](const std::vector<Lexer::Diagnostic> &list)
+            {
+                for (auto &diagnostic : list)
+                {
+                    for (auto &range : diagnostic.ranges)
+                        diagnostics.push_back({diagnostic.message, {range.begin.line + moved, range.begin.column, range.end.line + moved, range.end.column}});
+                }
+            };
+            add(block.syntax);
+            if (i >= checkedBlocks || !block.syntax.empty())
+                continue;
+            add(block.types);
+            add(block.body);
+        }
+        return diagnostics;
+    }
+}
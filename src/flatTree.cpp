@@ -0,0 +1,60 @@
+#include "flatTree.hpp"
+#include "traversal.hpp"
+
+namespace Parser
+{
+    namespace
+    {
+        template <typename T>
+        std::size_t capacityBytes(const std::vector<T> &v)
+        {
+            return v.capacity() * sizeof(T);
+        }
+    }
+
+    FlatTree FlatTree::build(const std::vector<NodeIdentifier> &roots)
+    {
+        FlatTree tree;
+        for (auto root : roots)
+        {
+            if (root.get() != nullptr)
+                tree.roots.push_back(tree.add(root));
+        }
+        return tree;
+    }
+
+    FlatTree::Index FlatTree::add(NodeIdentifier root)
+    {
+        // Indices of the nodes added whose parent is not yet, the children of
+        // a node are the last ones when it is added.
+        WorkStack<Index> pending;
+        auto append = [&](NodeIdentifier identifier)
+        {
+            Node *node = identifier.get();
+            std::size_t count = 0;
+            forEachChild(*node, [&](NodeIdentifier)
+                         { count++; });
+            const Index index = kinds.size();
+            kinds.push_back(node->kind);
+            firstChild.push_back(children.size());
+            childCount.push_back(count);
+            children.insert(children.end(), pending.end() - count, pending.end());
+            spans.push_back(node->span);
+            auto expression = identifier.get<NodeExpression>();
+            types.push_back(expression != nullptr ? expression->type : Types::none);
+            parents.push_back(none);
+            for (auto child = pending.end() - count; child != pending.end(); child++)
+                parents[*child] = index;
+            pending.resize(pending.size() - count);
+            pending.push_back(index);
+        };
+        forEachPostOrder(root, append);
+        return pending.back();
+    }
+
+    std::size_t FlatTree::bytes() const
+    {
+        return capacityBytes(kinds) + capacityBytes(firstChild) + capacityBytes(childCount) + capacityBytes(spans) +
+               capacityBytes(types) + capacityBytes(parents) + capacityBytes(children) + capacityBytes(roots);
+    }
+}
@@ -0,0 +1,573 @@
+#include "frontend.hpp"
+#include "spscQueue.hpp"
+#include "threadPool.hpp"
+#include "visitor/pragmaVisitor.hpp"
+#include "visitor/printVisitor.hpp"
+#include "visitor/typeVisitor.hpp"
+#include "exception/type_error.hpp"
+#include "exception/function_error.hpp"
+#include "exception/pragma_error.hpp"
+#include "colors.hpp"
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace Frontend
+{
+    std::vector<FunctionRange> scanFunctions(const Lexer::TokenStream &ts)
+    {
+        std::vector<FunctionRange> ranges;
+        auto type = [&ts](std::size_t i)
+        { return ts.peek(i).type; };
+        // End of the header of the function at i: its is, or its semicolon for a declaration.
+        auto headerEnd = [&type](std::size_t i)
+        {
+            while (type(i) != Lexer::TokenType::KEYWORD_IS && type(i) != Lexer::TokenType::SEMICOLON && type(i) != Lexer::TokenType::TOKEN_EOF)
+                i++;
+            return i;
+        };
+
+        // Nesting of if and function bodies.
+        std::size_t depth = 0;
+        for (std::size_t i = 0; type(i) != Lexer::TokenType::TOKEN_EOF; i++)
+        {
+            switch (type(i))
+            {
+            case Lexer::TokenType::KEYWORD_IF:
+                depth++;
+                break;
+            case Lexer::TokenType::KEYWORD_FI:
+            case Lexer::TokenType::KEYWORD_ENDFUNCTION:
+                if (depth > 0)
+                    depth--;
+                break;
+            case Lexer::TokenType::KEYWORD_FUNCTION:
+            {
+                const std::size_t body = headerEnd(i);
+                if (type(body) != Lexer::TokenType::KEYWORD_IS)
+                {
+                    i = body;
+                    break;
+                }
+                if (depth > 0)
+                {
+                    depth++;
+                    i = body;
+                    break;
+                }
+                // Find the endfunction, the body is independent if nothing
+                // in it touches the global tables.
+                bool independent = true;
+                std::size_t inner = 0;
+                std::size_t j = body + 1;
+                for (; type(j) != Lexer::TokenType::TOKEN_EOF; j++)
+                {
+                    if (type(j) == Lexer::TokenType::KEYWORD_PRAGMA)
+                        independent = false;
+                    else if (type(j) == Lexer::TokenType::KEYWORD_FUNCTION)
+                    {
+                        independent = false;
+                        j = headerEnd(j);
+                        if (type(j) == Lexer::TokenType::KEYWORD_IS)
+                            inner++;
+                    }
+                    else if (type(j) == Lexer::TokenType::KEYWORD_ENDFUNCTION && inner-- == 0)
+                        break;
+                }
+                if (type(j) == Lexer::TokenType::TOKEN_EOF)
+                    return ranges;
+                if (independent)
+                    ranges.push_back({ts.tell() + i, ts.tell() + body, ts.tell() + j + 1});
+                i = j;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        return ranges;
+    }
+
+    bool reportTypeErrors(Lexer::TokenStream &ts, std::exception_ptr &failure, const std::function<void()> &check)
+    {
+        std::ostream &out = ts.getDiagnostics();
+        try
+        {
+            check();
+            return true;
+        }
+        catch (type_error &e)
+        {
+            ts.reportError(e.what(), {e.node->span});
+        }
+        catch (constant_error &e)
+        {
+            ts.reportError(e.what(), {e.node->span});
+        }
+        catch (different_type_error &e)
+        {
+            ts.reportError(e.what(), {e.nodeA->span, e.nodeB->span});
+        }
+        catch (pragma_error &e)
+        {
+            ts.reportError(e.what(), {e.node->span});
+        }
+        catch (function_definition_error &e)
+        {
+            const Lexer::Token &declaration = e.new_declaration.get<Parser::NodeFunction>()->functionToken;
+            if (ts.collectsDiagnostics())
+            {
+                ts.reportError(e.what(), {ts.rangeOf(declaration)});
+                return false;
+            }
+            out << ERROR_MESSAGE " " << std::string(e.what()) << std::endl;
+            out << "Original declaration is here:" << std::endl;
+            ts.printLine(e.original_declaration.value().line);
+            out << "New declaration is here:" << std::endl;
+            ts.printLine(declaration.line);
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+        return false;
+    }
+
+    bool reportCheckErrors(Lexer::TokenStream &ts, const Lexer::Token &token, const std::function<void()> &check)
+    {
+        std::exception_ptr failure;
+        bool checked = false;
+        try
+        {
+            checked = reportTypeErrors(ts, failure, check);
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+        if (!failure)
+            return checked;
+        std::string message = "Internal compiler error";
+        try
+        {
+            std::rethrow_exception(failure);
+        }
+        catch (const std::exception &exception)
+        {
+            message += ": " + std::string(exception.what());
+        }
+        catch (...)
+        {
+        }
+        ts.reportError(message, {ts.rangeOf(token)});
+        return false;
+    }
+
+    namespace
+    {
+        // One top level block and its diagnostics.
+        class Unit
+        {
+        public:
+            Parser::NodeIdentifier node;
+            std::ostringstream syntax;
+            std::ostringstream types;
+            std::size_t syntaxErrors = 0;
+            bool typeError = false;
+            // Checking a body after a syntax error may fail in ways a
+            // sequential parse never reaches.
+            std::exception_ptr failure;
+
+            // Set for a function whose body is parsed by a task: the tokens
+            // of the body, the parser scopes and the visitors as they were
+            // after its header.
+            std::optional<FunctionRange> range;
+            std::optional<genericContext<Lexer::Symbol, Lexer::TokenType>> scope;
+            std::optional<visitor::pragmaVisitor> pragmaVisitor;
+            std::optional<visitor::typeVisitor> typeVisitor;
+        };
+
+        // Parse the header of the function at range and skip its body.
+        void parseHeader(Lexer::TokenStream &ts, const FunctionRange &range, Unit &unit)
+        {
+            unit.node = Parser::parseFunctionHeader(ts);
+            if (unit.node.get() == nullptr)
+                return;
+            if (ts.tell() != range.body)
+            {
+                // Not the shape the pre-scan expected, parse it here.
+                if (!Parser::parseFunctionEnd(ts, *unit.node.get<Parser::NodeFunction>()))
+                    unit.node = Parser::NodeIdentifier();
+                return;
+            }
+            unit.range = range;
+            // The scope of the parameters is still open.
+            unit.scope = Lexer::LexerContext::context;
+            Lexer::LexerContext::popContext();
+            ts.seek(range.end);
+        }
+
+        void parseBody(const Lexer::TokenStream &ts, Unit &unit, Parser::Arena &arena)
+        {
+            Parser::Arena::setCurrent(arena);
+            Lexer::LexerContext::context = std::move(unit.scope.value());
+            Lexer::TokenStream body(ts, unit.range->body, unit.range->end);
+            body.setDiagnostics(unit.syntax);
+            const std::size_t errors = Parser::errorCount();
+            auto &function = *unit.node.get<Parser::NodeFunction>();
+            const bool parsed = Parser::parseFunctionEnd(body, function);
+            unit.syntaxErrors += Parser::errorCount() - errors;
+            if (!parsed)
+                unit.node = Parser::NodeIdentifier();
+            if (unit.syntaxErrors > 0 || !unit.typeVisitor.has_value())
+                return;
+            body.setDiagnostics(unit.types);
+            unit.typeError = !reportTypeErrors(body, unit.failure, [&]()
+                                               {
+                                                   unit.pragmaVisitor->dispatch(unit.node);
+                                                   unit.typeVisitor->checkFunctionBody(function); });
+        }
+    }
+
+    Result run(Lexer::TokenStream &ts, unsigned jobs, bool printAst)
+    {
+        Result result;
+        visitor::pragmaVisitor pragmaVisitor;
+        visitor::typeVisitor typeVisitor;
+        const auto ranges = jobs > 1 ? scanFunctions(ts) : std::vector<FunctionRange>();
+        std::size_t nextRange = 0;
+        // Units are not moved once the tasks hold them.
+        std::deque<Unit> units;
+        std::ostream &diagnostics = ts.getDiagnostics();
+
+        // The blocks of a unit, all but a deferred function body.
+        auto check = [&](Unit &unit)
+        {
+            ts.setDiagnostics(unit.types);
+            if (!unit.range.has_value())
+            {
+                unit.typeError = !reportTypeErrors(ts, unit.failure, [&]()
+                                                   {
+                                                       pragmaVisitor.dispatch(unit.node);
+                                                       typeVisitor.dispatch(unit.node); });
+                return;
+            }
+            unit.typeError = !reportTypeErrors(ts, unit.failure, [&]()
+                                               {
+                                                   pragmaVisitor.dispatch(unit.node);
+                                                   typeVisitor.declareFunction(*unit.node.get<Parser::NodeFunction>()); });
+            if (unit.typeError)
+                return;
+            unit.pragmaVisitor.emplace(pragmaVisitor);
+            unit.typeVisitor.emplace(typeVisitor);
+        };
+
+        // Diagnostics in source order. After a syntax error only syntax errors
+        // are reported, like a sequential parse.
+        auto report = [&](Unit &unit)
+        {
+            diagnostics << unit.syntax.str();
+            result.syntaxErrors += unit.syntaxErrors;
+            if (result.syntaxErrors > 0 || unit.node.get() == nullptr)
+                return;
+            if (printAst)
+            {
+                visitor::PrintVisitor pv(ts);
+                pv.dispatch(unit.node);
+                std::cout << std::endl;
+            }
+            diagnostics << unit.types.str();
+            if (unit.failure)
+                std::rethrow_exception(unit.failure);
+            result.typeError = result.typeError || unit.typeError;
+            result.nodes.push_back(unit.node);
+        };
+
+        // Sequential pass: every block but the deferred function bodies.
+        while (!ts.isEmpty())
+        {
+            while (nextRange < ranges.size() && ranges[nextRange].begin < ts.tell())
+                nextRange++;
+            Unit &unit = units.emplace_back();
+            ts.setDiagnostics(unit.syntax);
+            const std::size_t errors = Parser::errorCount();
+            if (nextRange < ranges.size() && ranges[nextRange].begin == ts.tell())
+                parseHeader(ts, ranges[nextRange], unit);
+            else
+                unit.node = Parser::parseBlock(ts);
+            unit.syntaxErrors = Parser::errorCount() - errors;
+            // Keep parsing to report every syntax error of the file.
+            if (unit.node.get() == nullptr)
+                Parser::synchronize(ts);
+            // Blocks after a syntax error may refer to names it did not declare.
+            else if (!Parser::hasError())
+                check(unit);
+            ts.setDiagnostics(diagnostics);
+            // Without deferred bodies a unit is complete once checked, its
+            // diagnostics are not held until the end of the file.
+            if (ranges.empty())
+            {
+                report(unit);
+                units.pop_back();
+            }
+        }
+        if (ranges.empty())
+            return result;
+
+        // Function bodies, each task in its own arena.
+        {
+            // No more threads than function bodies, nor than the machine runs at once.
+            const unsigned threads = std::min<std::size_t>({jobs, ranges.size() + 1, std::max(1u, std::thread::hardware_concurrency())});
+            Concurrency::ThreadPool pool(threads - 1);
+            for (auto &unit : units)
+            {
+                if (!unit.range.has_value() || unit.node.get() == nullptr)
+                    continue;
+                Parser::Arena &arena = *result.arenas.emplace_back(std::make_unique<Parser::Arena>());
+                pool.submit([&ts, &unit, &arena]()
+                            {
+                                // The thread calling wait() runs tasks too, leave its state as it was.
+                                Parser::Arena &previousArena = Parser::Arena::getCurrent();
+                                auto previousScope = std::move(Lexer::LexerContext::context);
+                                parseBody(ts, unit, arena);
+                                Lexer::LexerContext::context = std::move(previousScope);
+                                Parser::Arena::setCurrent(previousArena); });
+            }
+            pool.wait();
+        }
+
+        for (auto &unit : units)
+            report(unit);
+        return result;
+    }
+
+    namespace
+    {
+        // A block on its way from the parsing stage to the checking stage.
+        class ParsedBlock
+        {
+        public:
+            Parser::NodeIdentifier node;
+            std::string syntax;
+            std::size_t syntaxErrors = 0;
+            // Index of the token following the block.
+            std::size_t end = 0;
+        };
+
+        // Blocks a stage may run ahead of the next one.
+        constexpr std::size_t pipelineDepth = 64;
+    }
+
+    Result runPipeline(Lexer::TokenStream &ts, bool printAst, const std::function<void(Parser::NodeIdentifier)> &lower)
+    {
+        Result result;
+        std::ostream &diagnostics = ts.getDiagnostics();
+        // A pragma renames a block found before it, which must not be lowered
+        // until the pragma is resolved.
+        std::optional<std::size_t> lastPragma;
+        for (std::size_t i = 0; ts.peek(i).type != Lexer::TokenType::TOKEN_EOF; i++)
+        {
+            if (ts.peek(i).type == Lexer::TokenType::KEYWORD_PRAGMA)
+                lastPragma = ts.tell() + i;
+        }
+        Concurrency::SpscQueue<ParsedBlock> parsed(pipelineDepth);
+        Concurrency::SpscQueue<Parser::NodeIdentifier> checked(pipelineDepth);
+        // Type errors are highlighted through a stream of its own, ts belongs
+        // to the parsing thread.
+        Lexer::TokenStream view(ts, 0, 0);
+        Parser::Arena &arena = *result.arenas.emplace_back(std::make_unique<Parser::Arena>());
+        auto scope = Lexer::LexerContext::context;
+
+        std::thread parser([&]()
+                           {
+                               Parser::Arena::setCurrent(arena);
+                               Lexer::LexerContext::context = std::move(scope);
+                               while (!ts.isEmpty())
+                               {
+                                   ParsedBlock block;
+                                   std::ostringstream syntax;
+                                   ts.setDiagnostics(syntax);
+                                   const std::size_t errors = Parser::errorCount();
+                                   block.node = Parser::parseBlock(ts);
+                                   block.syntaxErrors = Parser::errorCount() - errors;
+                                   // Keep parsing to report every syntax error of the file.
+                                   if (block.node.get() == nullptr)
+                                       Parser::synchronize(ts);
+                                   block.syntax = syntax.str();
+                                   block.end = ts.tell();
+                                   parsed.push(std::move(block));
+                               }
+                               ts.setDiagnostics(diagnostics);
+                               scope = std::move(Lexer::LexerContext::context);
+                               parsed.close(); });
+
+        std::exception_ptr failure;
+        Context::ContextProvider &contextProvider = Context::ContextProvider::getInstance();
+        std::thread checker([&]()
+                            {
+                                // The function table of the calling thread.
+                                Context::ContextProvider::setCurrent(contextProvider);
+                                visitor::pragmaVisitor pragmaVisitor;
+                                visitor::typeVisitor typeVisitor;
+                                std::vector<Parser::NodeIdentifier> held;
+                                auto release = [&]()
+                                {
+                                    const bool lowering = result.syntaxErrors == 0 && !result.typeError && !failure;
+                                    for (auto node : held)
+                                    {
+                                        if (printAst)
+                                        {
+                                            visitor::PrintVisitor pv(ts);
+                                            pv.dispatch(node);
+                                            std::cout << std::endl;
+                                        }
+                                        if (lowering)
+                                            checked.push(node);
+                                    }
+                                    held.clear();
+                                };
+                                ParsedBlock block;
+                                while (parsed.pop(block))
+                                {
+                                    // Let the parser finish after a failure.
+                                    if (failure)
+                                        continue;
+                                    diagnostics << block.syntax;
+                                    result.syntaxErrors += block.syntaxErrors;
+                                    // Blocks after a syntax error may refer to names it did not declare.
+                                    if (result.syntaxErrors > 0 || block.node.get() == nullptr)
+                                    {
+                                        release();
+                                        continue;
+                                    }
+                                    const bool typed = reportTypeErrors(view, failure, [&]()
+                                                                        {
+                                                                            pragmaVisitor.dispatch(block.node);
+                                                                            typeVisitor.dispatch(block.node); });
+                                    result.typeError = result.typeError || !typed;
+                                    held.push_back(block.node);
+                                    if (!lastPragma.has_value() || block.end > lastPragma.value() || failure)
+                                        release();
+                                }
+                                release();
+                                checked.close(); });
+
+        // Lowering runs on this thread, the LLVM context of lower is not shared.
+        std::exception_ptr loweringFailure;
+        Parser::NodeIdentifier node;
+        while (checked.pop(node))
+        {
+            if (loweringFailure)
+                continue;
+            try
+            {
+                lower(node);
+                result.nodes.push_back(node);
+            }
+            catch (...)
+            {
+                loweringFailure = std::current_exception();
+            }
+        }
+        parser.join();
+        checker.join();
+        Lexer::LexerContext::context = std::move(scope);
+        if (failure)
+            std::rethrow_exception(failure);
+        if (loweringFailure)
+            std::rethrow_exception(loweringFailure);
+        return result;
+    }
+
+    namespace
+    {
+        bool isIdentifierChar(char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        // Start of the last pragma keyword of source, a byte search that keeps
+        // the source from being lexed ahead. Words inside strings match too,
+        // which only holds blocks back longer.
+        std::optional<const char *> findLastPragma(const Lexer::SourceBuffer &source)
+        {
+            const std::string_view text(source.begin(), source.size());
+            const std::string_view keyword = "pragma";
+            for (std::size_t found = text.rfind(keyword); found != std::string_view::npos; found = found == 0 ? std::string_view::npos : text.rfind(keyword, found - 1))
+            {
+                const std::size_t after = found + keyword.size();
+                if ((found == 0 || !isIdentifierChar(text[found - 1])) && (after == text.size() || !isIdentifierChar(text[after])))
+                    return source.begin() + found;
+            }
+            return std::nullopt;
+        }
+    }
+
+    Result runStreaming(Lexer::TokenStream &ts, bool printAst, const std::function<void(Parser::NodeIdentifier)> &lower)
+    {
+        Result result;
+        visitor::pragmaVisitor pragmaVisitor;
+        visitor::typeVisitor typeVisitor;
+        const auto lastPragma = findLastPragma(ts.getSource());
+        // Every block since the last release lives in this arena.
+        Parser::Arena arena;
+        Parser::Arena &previousArena = Parser::Arena::getCurrent();
+        Parser::Arena::setCurrent(arena);
+        std::vector<Parser::NodeIdentifier> held;
+        std::exception_ptr failure;
+        auto release = [&]()
+        {
+            const bool lowering = result.syntaxErrors == 0 && !result.typeError && !failure;
+            for (auto node : held)
+            {
+                if (printAst)
+                {
+                    visitor::PrintVisitor pv(ts);
+                    pv.dispatch(node);
+                    std::cout << std::endl;
+                }
+                if (lowering)
+                    lower(node);
+            }
+            held.clear();
+            arena.reset();
+            // Past the last pragma, nothing looks the released nodes up.
+            pragmaVisitor = visitor::pragmaVisitor();
+            ts.discardConsumed();
+        };
+
+        while (!ts.isEmpty())
+        {
+            const std::size_t errors = Parser::errorCount();
+            auto node = Parser::parseBlock(ts);
+            result.syntaxErrors += Parser::errorCount() - errors;
+            if (node.get() == nullptr)
+                Parser::synchronize(ts);
+            // Blocks after a syntax error may refer to names it did not declare.
+            if (result.syntaxErrors > 0 || node.get() == nullptr)
+            {
+                release();
+                continue;
+            }
+            const bool typed = reportTypeErrors(ts, failure, [&]()
+                                                {
+                                                    pragmaVisitor.dispatch(node);
+                                                    typeVisitor.dispatch(node); });
+            result.typeError = result.typeError || !typed;
+            held.push_back(node);
+            if (failure)
+                break;
+            if (!lastPragma.has_value() || ts.peek().value.data() > lastPragma.value())
+                release();
+        }
+        release();
+        Parser::Arena::setCurrent(previousArena);
+        if (failure)
+            std::rethrow_exception(failure);
+        return result;
+    }
+}
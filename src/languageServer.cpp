@@ -0,0 +1,221 @@
+#include "languageServer.hpp"
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <cstdlib>
+#include <string_view>
+
+namespace Ckc
+{
+    namespace
+    {
+        // JSON-RPC error codes.
+        constexpr int parseError = -32700;
+        constexpr int invalidRequest = -32600;
+        constexpr int methodNotFound = -32601;
+
+        std::string serialize(const llvm::json::Value &value)
+        {
+            std::string text;
+            llvm::raw_string_ostream stream(text);
+            stream << value;
+            return stream.str();
+        }
+
+        // Columns of the protocol count UTF-16 code units.
+        int utf16Length(std::string_view text)
+        {
+            int units = 0;
+            for (unsigned char c : text)
+            {
+                if ((c & 0xC0) != 0x80)
+                    units += c >= 0xF0 ? 2 : 1;
+            }
+            return units;
+        }
+
+        // Bytes of text taken by its first units UTF-16 code units.
+        std::size_t utf8Length(std::string_view text, std::int64_t units)
+        {
+            std::size_t i = 0;
+            while (i < text.size() && units > 0)
+            {
+                const unsigned char c = text[i];
+                units -= c >= 0xF0 ? 2 : 1;
+                i += c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+            }
+            return std::min(i, text.size());
+        }
+
+        // Offset in document of a position of the protocol, lines and columns from 0.
+        std::size_t offset(const Document &document, const llvm::json::Object *position)
+        {
+            const std::int64_t line = position == nullptr ? 0 : position->getInteger("line").getValueOr(0);
+            const std::int64_t character = position == nullptr ? 0 : position->getInteger("character").getValueOr(0);
+            if (line < 0)
+                return 0;
+            if (std::size_t(line) >= document.lineCount())
+                return document.getText().size();
+            return document.offset(line + 1, utf8Length(document.getLine(line + 1), character) + 1);
+        }
+
+        llvm::json::Value position(const Document &document, int line, int column)
+        {
+            const std::string_view text = document.getLine(line);
+            return llvm::json::Object{{"line", line - 1}, {"character", utf16Length(text.substr(0, std::min<std::size_t>(column - 1, text.size())))}};
+        }
+
+        llvm::json::Value response(const llvm::json::Value &id, llvm::json::Value result)
+        {
+            return llvm::json::Object{{"jsonrpc", "2.0"}, {"id", id}, {"result", std::move(result)}};
+        }
+
+        llvm::json::Value error(const llvm::json::Value &id, int code, const std::string &message)
+        {
+            return llvm::json::Object{{"jsonrpc", "2.0"}, {"id", id}, {"error", llvm::json::Object{{"code", code}, {"message", message}}}};
+        }
+
+        llvm::json::Value publishDiagnostics(const std::string &uri, const Document *document, llvm::Optional<std::int64_t> version)
+        {
+            llvm::json::Array diagnostics;
+            if (document != nullptr)
+            {
+                for (auto &diagnostic : document->getDiagnostics())
+                {
+                    const DocumentRange &range = diagnostic.range;
+                    diagnostics.push_back(llvm::json::Object{
+                        {"range", llvm::json::Object{{"start", position(*document, range.line, range.column)}, {"end", position(*document, range.endLine, range.endColumn)}}},
+                        {"severity", 1},
+                        {"source", "gkc"},
+                        {"message", diagnostic.message}});
+                }
+            }
+            llvm::json::Object params{{"uri", uri}, {"diagnostics", std::move(diagnostics)}};
+            if (version.hasValue())
+                params["version"] = version.getValue();
+            return llvm::json::Object{{"jsonrpc", "2.0"}, {"method", "textDocument/publishDiagnostics"}, {"params", std::move(params)}};
+        }
+    }
+
+    LanguageServer::LanguageServer(std::istream &input, std::ostream &output) : input(input), output(output)
+    {
+    }
+
+    void LanguageServer::send(const std::string &message)
+    {
+        output << "Content-Length: " << message.size() << "\r\n\r\n"
+               << message << std::flush;
+    }
+
+    const Document *LanguageServer::getDocument(const std::string &uri) const
+    {
+        auto found = documents.find(uri);
+        return found == documents.end() ? nullptr : found->second.get();
+    }
+
+    bool LanguageServer::handle(const std::string &message)
+    {
+        auto parsed = llvm::json::parse(message);
+        if (!parsed)
+        {
+            llvm::consumeError(parsed.takeError());
+            send(serialize(error(nullptr, parseError, "Invalid JSON")));
+            return true;
+        }
+        const llvm::json::Object *request = parsed->getAsObject();
+        const llvm::json::Value *id = request == nullptr ? nullptr : request->get("id");
+        auto method = request == nullptr ? llvm::None : request->getString("method");
+        if (!method.hasValue())
+        {
+            // A response to a request of the server, which sends none.
+            if (request == nullptr || id == nullptr)
+                send(serialize(error(nullptr, invalidRequest, "Not a request")));
+            return true;
+        }
+        const llvm::json::Object *params = request->getObject("params");
+        const llvm::json::Object *textDocument = params == nullptr ? nullptr : params->getObject("textDocument");
+        const std::string uri = textDocument == nullptr ? "" : textDocument->getString("uri").getValueOr("").str();
+        const auto version = textDocument == nullptr ? llvm::None : textDocument->getInteger("version");
+
+        if (*method == "exit")
+            return false;
+        if (shutdown)
+        {
+            if (id != nullptr)
+                send(serialize(error(*id, invalidRequest, "The server is shut down")));
+        }
+        else if (*method == "initialize" && id != nullptr)
+        {
+            // Changes are sent as the edited ranges.
+            llvm::json::Object synchronization{{"openClose", true}, {"change", 2}};
+            send(serialize(response(*id, llvm::json::Object{{"capabilities", llvm::json::Object{{"textDocumentSync", std::move(synchronization)}}},
+                                                            {"serverInfo", llvm::json::Object{{"name", "gkc"}}}})));
+        }
+        else if (*method == "shutdown" && id != nullptr)
+        {
+            shutdown = true;
+            send(serialize(response(*id, nullptr)));
+        }
+        else if (*method == "textDocument/didOpen" && textDocument != nullptr)
+        {
+            const std::string text = textDocument->getString("text").getValueOr("").str();
+            documents[uri] = std::make_unique<Document>(text, uri);
+            send(serialize(publishDiagnostics(uri, documents[uri].get(), version)));
+        }
+        else if (*method == "textDocument/didChange" && documents.count(uri) > 0)
+        {
+            Document &document = *documents[uri];
+            const llvm::json::Array *changes = params->getArray("contentChanges");
+            for (std::size_t i = 0; changes != nullptr && i < changes->size(); i++)
+            {
+                const llvm::json::Object *change = (*changes)[i].getAsObject();
+                if (change == nullptr)
+                    continue;
+                const std::string text = change->getString("text").getValueOr("").str();
+                const llvm::json::Object *range = change->getObject("range");
+                if (range == nullptr)
+                    document.setText(text);
+                else
+                    document.change(offset(document, range->getObject("start")), offset(document, range->getObject("end")), text);
+            }
+            send(serialize(publishDiagnostics(uri, &document, version)));
+        }
+        else if (*method == "textDocument/didClose")
+        {
+            documents.erase(uri);
+            send(serialize(publishDiagnostics(uri, nullptr, llvm::None)));
+        }
+        else if (id != nullptr)
+            send(serialize(error(*id, methodNotFound, "Unsupported method " + method->str())));
+        return true;
+    }
+
+    int LanguageServer::run()
+    {
+        const std::string contentLength = "Content-Length:";
+        std::string line;
+        std::size_t length = 0;
+        bool sized = false;
+        while (std::getline(input, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.compare(0, contentLength.size(), contentLength) == 0)
+            {
+                length = std::strtoull(line.c_str() + contentLength.size(), nullptr, 10);
+                sized = true;
+                continue;
+            }
+            // The headers end with an empty line.
+            if (!line.empty() || !sized)
+                continue;
+            std::string message(length, '\0');
+            if (!input.read(message.data(), length))
+                break;
+            sized = false;
+            if (!handle(message))
+                return shutdown ? 0 : 1;
+        }
+        return shutdown ? 0 : 1;
+    }
+}
@@ -1,8 +1,8 @@
 #include <string>
 #include <map>
 #include "lexer.hpp"
+#include "scanner.hpp"
 #include <algorithm>
-#include <unordered_set>
 #include <iostream>
 #include <iomanip>
 #include <llvm/Support/raw_ostream.h>
@@ -11,10 +11,9 @@ namespace Lexer
 {
     std::string tokenTypeToString(TokenType type)
     {
-        auto it = tokenToStringMap.find(type);
-        if (it != tokenToStringMap.end())
+        if (TokenTable::hasSpelling[static_cast<std::size_t>(type)])
         {
-            return it->second;
+            return std::string(TokenTable::spellings[static_cast<std::size_t>(type)]);
         }
         switch (type)
         {
@@ -34,33 +33,17 @@ namespace Lexer
         return os << tokenTypeToString(tok);
     }
 
-    static std::map<std::string, TokenType> typeToken{
-        {"uint8", TokenType::TYPE},
-        {"uint16", TokenType::TYPE},
-        {"uint32", TokenType::TYPE},
-        {"uint64", TokenType::TYPE},
-        {"int8", TokenType::TYPE},
-        {"int16", TokenType::TYPE},
-        {"int32", TokenType::TYPE},
-        {"int64", TokenType::TYPE},
-        {"bool", TokenType::TYPE}
-    };
-
-    bool isNumber(const std::string &str)
+    bool isNumber(std::string_view str)
     {
-        std::string::const_iterator start = str.begin();
+        auto start = str.begin();
         if (*start == '-')
             start++;
         return std::all_of(start, str.end(), ::isdigit);
     }
 
-    int Token::getPrecedence()
+    int Token::getPrecedence() const
     {
-        if (tokenPrecedence.find(type) != tokenPrecedence.end())
-        {
-            return tokenPrecedence.at(type);
-        }
-        return -1;
+        return Lexer::getPrecedence(type);
     }
 
     bool Token::operator==(const Token &other) const
@@ -68,174 +51,219 @@ namespace Lexer
         return type == other.type && value == other.value && line == other.line && column == other.column;
     }
 
-    std::string getCurrentLine(std::istream &input)
-    {
-        int current = input.tellg();
-        std::string line;
-        std::getline(input, line);
-        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-        input.seekg(current);
-        return line;
-    }
-    void TokenStream::moveHead()
+    void TokenStream::moveHead() const
     {
-        int c = input.peek();
-        while (c != EOF && (c == ' ' || c == '\t' || c == '\n' || c == '\r'))
+        const char *start = cursor;
+        cursor = Scanner::skipWhitespace(cursor, source->end());
+        std::size_t newlines = Scanner::countNewlines(start, cursor);
+        if (newlines == 0)
         {
-            input.get();
-            if (c == '\n')
-            {
-                lines.push_back(getCurrentLine(input));
-                line++;
-                column = 0;
-            }
-            column++;
-            c = input.peek();
+            column += cursor - start;
+            return;
         }
+        line += newlines;
+        // Columns restart after the last newline of the run.
+        const char *lineStart = cursor;
+        while (lineStart[-1] != '\n')
+            lineStart--;
+        column = cursor - lineStart + 1;
     }
 
     // Get the next token and move the head at the beginning of the next token
-    std::string TokenStream::getNextToken()
+    std::string_view TokenStream::getNextToken() const
     {
-        std::string token;
-        char c = input.peek();
+        const char *start = cursor;
+        const char *end = source->end();
+        int c = peekChar();
         // Parse a string
         if (c == '"')
         {
-            bool escape = true; // Start with true to escape the first "
-            while (c != EOF && (escape || c != '"'))
-            {
-                token += input.get();
-                column++;
-                c = input.peek();
-                escape = c == '\\';
-            }
-            if (c == '"')
-            {
-                token += input.get();
-                column++;
-            }
+            // The opening quote is always part of the string, look for the closing one.
+            cursor = Scanner::findQuote(cursor + 1, end);
+            if (cursor < end)
+                cursor++;
+            column += cursor - start;
+            std::string_view token(start, cursor - start);
             moveHead();
             return token;
         }
         // Parse an identifier
         if (std::isalnum(c) || c == '_')
         {
-            while ((std::isalnum(c) || c == '_') && c != EOF)
-            {
-                token += input.get();
-                column++;
-                c = input.peek();
-            }
+            cursor = Scanner::skipIdentifier(cursor, end);
+            column += cursor - start;
+            std::string_view token(start, cursor - start);
             moveHead();
             return token;
         }
         // Special case for parenthesis
         if (c == '(' || c == ')')
         {
-            token += input.get();
+            cursor++;
             column++;
+            std::string_view token(start, cursor - start);
             moveHead();
             return token;
         }
-        while (!std::isalnum(c) && c != ' ' && c != '\r' && c != '\n' && c != EOF)
-        {
-            token += input.get();
-            column++;
-            c = input.peek();
-        }
+        while (cursor < end && !std::isalnum(static_cast<unsigned char>(*cursor)) && *cursor != ' ' && *cursor != '\r' && *cursor != '\n')
+            cursor++;
+        column += cursor - start;
+        std::string_view token(start, cursor - start);
         moveHead();
         return token;
     }
 
-    Token TokenStream::get()
+    Token TokenStream::lexToken() const
     {
-        if (buffer.has_value())
-        {
-            Token t = buffer.value();
-            buffer.reset();
-            return t;
-        }
         int currentLine = line;
         int currentColumn = column;
-        std::string token = getNextToken();
+        std::string_view token = getNextToken();
         Lexer::TokenType type = TokenType::IDENTIFIER;
+        Symbol symbol;
         if (token.starts_with('"') && token.ends_with('"'))
         {
             type = TokenType::STRING;
         }
-        else if (stringToTokenMap.find(token) != stringToTokenMap.end())
-        {
-            type = stringToTokenMap.at(token);
-        }
-        else if (LexerContext::getTokenType(token).has_value())
+        else if (auto keyword = findKeyword(token))
         {
-            type = LexerContext::getTokenType(token).value();
+            type = keyword.value();
         }
         else if (isNumber(token))
         {
             type = TokenType::NUMBER;
         }
-        return Token(type, token, currentLine, currentColumn);
+        else
+        {
+            symbol = Symbol(token);
+        }
+        return Token(type, token, currentLine, currentColumn, symbol);
     }
 
-    Token TokenStream::peek()
+    TokenStream::TokenStream(std::shared_ptr<SourceBuffer> source, std::string filename, bool streaming, int line, int column) : source(source), cursor(source->begin()), line(line), column(column), firstLine(line), firstColumn(column), streaming(streaming), discarded(source->begin()), filename(filename)
     {
-        if (buffer.has_value())
+        moveHead();
+        if (streaming)
+            return;
+        // Roughly one token every 8 bytes of source.
+        tokens.reserve(source->size() / 8 + 1);
+        lexUntil(SIZE_MAX);
+    }
+
+    void TokenStream::lexUntil(std::size_t index) const
+    {
+        while (!lexed && tokens.size() <= index)
         {
-            return buffer.value();
+            // The token lexed at the end of the source is the TOKEN_EOF.
+            lexed = cursor >= source->end();
+            tokens.push_back(lexToken());
         }
-        buffer = get();
-        return buffer.value();
     }
 
-    bool TokenStream::isEmpty()
+    Token TokenStream::get()
+    {
+        if (position + 1 >= tokens.size())
+            lexUntil(position + 1);
+        if (position + 1 < tokens.size())
+            return tokens[position++];
+        return tokens.back();
+    }
+
+    const Token &TokenStream::peek(std::size_t offset) const
+    {
+        if (position + offset >= tokens.size())
+            lexUntil(position + offset);
+        return tokens[std::min(position + offset, tokens.size() - 1)];
+    }
+
+    bool TokenStream::isEmpty() const
+    {
+        if (position + 1 >= tokens.size())
+            lexUntil(position + 1);
+        return position + 1 >= tokens.size();
+    }
+
+    void TokenStream::discardConsumed()
     {
-        return input.eof() || input.peek() == EOF;
+        if (!streaming || position == 0)
+            return;
+        tokens.erase(tokens.begin(), tokens.begin() + position);
+        base += position;
+        position = 0;
+        // Tokens still held view the source from the next one on.
+        const char *kept = tokens.empty() ? cursor : tokens.front().value.data();
+        source->dropPages(discarded, kept);
+        discarded = std::max(discarded, kept);
     }
 
-    bool Token::isEndMultiBlock()
+    TokenStream::TokenStream(const TokenStream &parent, std::size_t begin, std::size_t end) : source(parent.source), cursor(parent.source->end()), firstLine(parent.firstLine), firstColumn(parent.firstColumn), lexed(true), discarded(parent.source->begin()), filename(parent.filename), diagnostics(parent.diagnostics), collected(parent.collected)
     {
-        std::unordered_set<TokenType> endMultiBlock{
-            TokenType::KEYWORD_ELSE,
-            TokenType::KEYWORD_FI,
-            TokenType::KEYWORD_ENDFUNCTION,
-            TokenType::TOKEN_EOF};
-        return endMultiBlock.find(type) != endMultiBlock.end();
+        end = std::min(end, parent.tokens.size() - 1);
+        tokens.reserve(end - std::min(begin, end) + 1);
+        tokens.insert(tokens.end(), parent.tokens.begin() + std::min(begin, end), parent.tokens.begin() + end);
+        tokens.push_back(parent.tokens.back());
     }
 
-    bool Token::isEndExpression()
+    bool Token::isEndMultiBlock() const
     {
-        std::unordered_set<TokenType> endExpression{
-            TokenType::TOKEN_EOF,
-            TokenType::SEMICOLON,
-            TokenType::KEYWORD_THEN,
-            TokenType::PARENTHESIS_CLOSE};
-        return endExpression.find(type) != endExpression.end();
+        return Lexer::isEndMultiBlock(type);
+    }
+
+    bool Token::isEndExpression() const
+    {
+        return Lexer::isEndExpression(type);
     }
 
     std::string TokenStream::getLine(int line)
     {
-        if (line - 1 < int(lines.size()))
-        {
-            return lines[line - 1];
-        }
-        return "";
+        return std::string(source->getLine(line));
+    }
+
+    Span TokenStream::spanOf(const Token &first, const Token &last) const
+    {
+        return {std::uint32_t(first.value.data() - source->begin()), std::uint32_t(last.value.data() + last.value.size() - source->begin())};
+    }
+
+    SourcePosition TokenStream::positionOf(std::size_t offset) const
+    {
+        SourcePosition position = source->getPosition(offset);
+        // Only the first line starts at firstColumn.
+        if (position.line == 1)
+            position.column += firstColumn - 1;
+        position.line += firstLine - 1;
+        return position;
+    }
+
+    SourceRange TokenStream::rangeOf(Span span) const
+    {
+        return {positionOf(span.begin), positionOf(span.end)};
+    }
+
+    SourceRange TokenStream::rangeOf(const Token &token) const
+    {
+        return {{token.line, token.column}, {token.line, token.column + int(token.value.size())}};
     }
 #define RESET_COL "\033[0m"
 #define RED_COL "\033[31m"
     void TokenStream::unexpectedToken(Token t, std::optional<TokenType> expected)
     {
-        std::cerr << RED_COL << "[ERROR] " << RESET_COL << "Unexpected token: " << t.value;
+        if (collected != nullptr)
+        {
+            std::string message = "Unexpected token: " + std::string(t.value);
+            if (expected.has_value())
+                message += ", expected: " + Lexer::tokenTypeToString(expected.value());
+            collected->push_back({message, {rangeOf(t)}});
+            return;
+        }
+        *diagnostics << RED_COL << "[ERROR] " << RESET_COL << "Unexpected token: " << t.value;
         if (expected.has_value())
         {
-            std::cerr << ", expected: " << Lexer::tokenTypeToString(expected.value());
+            *diagnostics << ", expected: " << Lexer::tokenTypeToString(expected.value());
         }
-        std::cerr << std::endl;
-        std::cerr << filename << ":" << t.line << ":" << t.column << std::endl;
-        std::cerr << std::setfill(' ') << std::setw(4) << t.line << std::left << std::setw(5) << " |" << getLine(t.line) << std::endl;
-        std::cerr << std::setw(t.column - 1 + 9) << "" << RED_COL << std::setw(t.value.size()) << std::setfill('^') << "" << RESET_COL << std::setfill(' ') << std::endl;
-        std::cerr << std::setfill(' ') << std::right;
+        *diagnostics << std::endl;
+        *diagnostics << filename << ":" << t.line << ":" << t.column << std::endl;
+        *diagnostics << std::setfill(' ') << std::setw(4) << t.line << std::left << std::setw(5) << " |" << getLine(t.line) << std::endl;
+        *diagnostics << std::setw(t.column - 1 + 9) << "" << RED_COL << std::setw(t.value.size()) << std::setfill('^') << "" << RESET_COL << std::setfill(' ') << std::endl;
+        *diagnostics << std::setfill(' ') << std::right;
     }
 
     std::string Token::underline(std::string color)
@@ -269,147 +297,113 @@ namespace Lexer
     //     }
     // }
 
-    std::string getWave(std::pair<Token, Token> token)
+    void TokenStream::highlightRanges(std::vector<SourceRange> ranges)
     {
-        if (token.first == token.second)
-            return std::string(token.first.value.size(), '^');
-        return std::string((token.second.column  - token.first.column) + token.second.value.size(), '^');
-    }
-
-    void TokenStream::highlightMultiplesTokens(std::vector<std::pair<Token, Token>> tokens)
-    {
-        // Sort the tokens by line then column
-        std::sort(tokens.begin(), tokens.end(), [](std::pair<Token, Token> a, std::pair<Token, Token> b) {
-            if (a.first.line == b.first.line)
-            {
-                return a.first.column < b.first.column;
-            }
-            return a.first.line < b.first.line;
-        });
-        // Find the first and last line
-        int firstLine = tokens[0].first.line;
-        int lastLine = tokens.back().second.line;
-        std::cerr << filename << ":" << firstLine << ":" << tokens[0].first.column << std::endl;
-        // Print the lines
+        std::sort(ranges.begin(), ranges.end(), [](const SourceRange &a, const SourceRange &b)
+                  { return a.begin < b.begin; });
+        const int firstLine = ranges.front().begin.line;
+        int lastLine = firstLine;
+        for (auto &range : ranges)
+            lastLine = std::max(lastLine, range.end.column > 1 ? range.end.line : range.end.line - 1);
+        *diagnostics << filename << ":" << firstLine << ":" << ranges.front().begin.column << std::endl;
         for (int i = firstLine; i <= lastLine; i++)
         {
-            std::cerr << std::setfill(' ') << std::setw(4) << i << std::left << std::setw(5) << " |" << std::right;
-            std::cerr << getLine(i) << std::endl;
-            int offset = -(int(4 + 5 + sizeof(" |") - 3));
-            while (tokens.size() > 0 && tokens.front().first.line == i)
+            const std::string text = getLine(i);
+            *diagnostics << std::setfill(' ') << std::setw(4) << i << std::left << std::setw(5) << " |" << std::right;
+            *diagnostics << text << std::endl;
+            // Column of the next character printed, the text starts after a
+            // margin of 9 characters.
+            int printed = 1 - 9;
+            for (auto &range : ranges)
             {
-                std::string wave = getWave(tokens.front());
-                std::cerr << std::string(tokens.front().first.column - 1 - offset, ' ') << RED_COL << wave << RESET_COL;
-                offset += wave.size() + tokens.front().first.column - 1 - offset;
-                tokens.erase(tokens.begin());
+                if (range.begin.line > i || range.end.line < i)
+                    continue;
+                // The lines after the first one are underlined from their
+                // first non blank character.
+                int begin = range.begin.line == i ? range.begin.column : int(text.find_first_not_of(" \t")) + 1;
+                int end = range.end.line == i ? range.end.column : int(text.size()) + 1;
+                if (begin == 0 || (range.begin.line < i && end == 1))
+                    continue;
+                begin = std::max(begin, printed);
+                end = std::max(end, begin + 1);
+                *diagnostics << std::string(begin - printed, ' ') << RED_COL << std::string(end - begin, '^') << RESET_COL;
+                printed = end;
             }
-            std::cerr << std::endl;
+            *diagnostics << std::endl;
+        }
+    }
 
+    void TokenStream::reportError(const std::string &message, std::vector<SourceRange> ranges)
+    {
+        if (collected != nullptr)
+        {
+            collected->push_back({message, std::move(ranges)});
+            return;
         }
+        *diagnostics << RED_COL << "[ERROR]" << RESET_COL << " " << message << std::endl;
+        highlightRanges(std::move(ranges));
+    }
+
+    void TokenStream::reportError(const std::string &message, const std::vector<Span> &spans)
+    {
+        std::vector<SourceRange> ranges;
+        for (auto span : spans)
+            ranges.push_back(rangeOf(span));
+        reportError(message, std::move(ranges));
     }
 
     void TokenStream::printLine(int line)
     {
-        std::cerr << filename << ":" << line << ":" << std::endl;
-        std::cerr << std::setfill(' ') << std::setw(4) << line << std::left << std::setw(5) << " |" << getLine(line) << std::endl;
+        *diagnostics << filename << ":" << line << ":" << std::endl;
+        *diagnostics << std::setfill(' ') << std::setw(4) << line << std::left << std::setw(5) << " |" << getLine(line) << std::endl;
     }
     
     std::vector<Token> TokenStream::toList()
     {
-        std::vector<Token> tokens;
-        while (!isEmpty())
-        {
-            tokens.push_back(get());
-        }
-        return tokens;
+        lexUntil(SIZE_MAX);
+        std::vector<Token> list(tokens.begin() + position, tokens.end() - 1);
+        position = tokens.size() - 1;
+        return list;
     }
 
-    bool Token::isUnaryOperator()
+    bool Token::isUnaryOperator() const
     {
-        std::unordered_set<TokenType> unaryOperators{
-            TokenType::OPERATOR_NOT,
-            TokenType::LOGICAL_NOT,
-            TokenType::OPERATOR_SUB};
-        return unaryOperators.find(type) != unaryOperators.end();
+        return Lexer::isUnaryOperator(type);
     }
 
-    bool Token::isBooleanOperator()
+    bool Token::isBooleanOperator() const
     {
-        std::unordered_set<TokenType> booleanOperators{
-            TokenType::LOGICAL_AND,
-            TokenType::LOGICAL_OR,
-            TokenType::LOGICAL_XOR,
-            TokenType::LOGICAL_NOT};
-        return booleanOperators.find(type) != booleanOperators.end();
+        return Lexer::isBooleanOperator(type);
     }
 
-    bool Token::isComparisonOperator()
+    bool Token::isComparisonOperator() const
     {
-        std::unordered_set<TokenType> comparisonOperators{
-            TokenType::OPERATOR_LT,
-            TokenType::OPERATOR_GT,
-            TokenType::OPERATOR_EQ,
-            TokenType::OPERATOR_LE,
-            TokenType::OPERATOR_GE,
-            TokenType::OPERATOR_NE};
-        return comparisonOperators.find(type) != comparisonOperators.end();
+        return Lexer::isComparisonOperator(type);
     }
 
-    // std::vector<std::map<std::string, TokenType>> LexerContext::contextStack = std::vector<std::map<std::string, TokenType>>
-    // {
-    //     std::m
-    // };
-    // Initialize the context stack with the global context with at least one map
-    std::vector<std::map<std::string, TokenType>> LexerContext::contextStack = std::vector<std::map<std::string, TokenType>>{
-        std::map<std::string, TokenType>{
-            {"uint8", TokenType::TYPE},
-            {"uint16", TokenType::TYPE},
-            {"uint32", TokenType::TYPE},
-            {"uint64", TokenType::TYPE},
-            {"int8", TokenType::TYPE},
-            {"int16", TokenType::TYPE},
-            {"int32", TokenType::TYPE},
-            {"int64", TokenType::TYPE},
-            {"bool", TokenType::TYPE}}};
+    thread_local genericContext<Symbol, TokenType> LexerContext::context;
 
     void LexerContext::init()
     {
-        LexerContext::contextStack = std::vector<std::map<std::string, TokenType>>{
-            std::map<std::string, TokenType>{
-                {"uint8", TokenType::TYPE},
-                {"uint16", TokenType::TYPE},
-                {"uint32", TokenType::TYPE},
-                {"uint64", TokenType::TYPE},
-                {"int8", TokenType::TYPE},
-                {"int16", TokenType::TYPE},
-                {"int32", TokenType::TYPE},
-                {"int64", TokenType::TYPE},
-                {"bool", TokenType::TYPE}}};
+        LexerContext::context.clear();
     }
 
     void LexerContext::pushContext()
     {
-        LexerContext::contextStack.push_back(std::map<std::string, TokenType>());
+        LexerContext::context.enterScope();
     }
     void LexerContext::popContext()
     {
-        LexerContext::contextStack.pop_back();
+        LexerContext::context.exitScope();
     }
-    std::optional<TokenType> LexerContext::getTokenType(std::string token)
+    std::optional<TokenType> LexerContext::getTokenType(Symbol token)
     {
-        for (auto it = LexerContext::contextStack.rbegin(); it != LexerContext::contextStack.rend(); it++)
-        {
-            if (it->find(token) != it->end())
-            {
-                return it->at(token);
-            }
-        }
-        return std::nullopt;
+        return LexerContext::context.get(token);
     }
 
-    void LexerContext::addToken(std::string token, TokenType type)
+    void LexerContext::addToken(Symbol token, TokenType type)
     {
-        LexerContext::contextStack.back()[token] = type;
+        LexerContext::context.add(token, type);
     }
 
 }
\ No newline at end of file
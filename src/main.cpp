@@ -3,26 +3,16 @@
 #include <fstream>
 
 #include <llvm/Support/raw_ostream.h>
-#include "parser.hpp"
-#include "visitor/printVisitor.hpp"
-#include "visitor/llvmVisitor.hpp"
-#include "visitor/pragmaVisitor.hpp"
-#include "visitor/typeVisitor.hpp"
-#include "visitor/rangeVisitor.hpp"
-#include "exception/type_error.hpp"
-#include "exception/function_error.hpp"
+#include "languageServer.hpp"
+#include "server.hpp"
+#include "session.hpp"
+#include "workspace.hpp"
 
-#include <llvm/IR/LLVMContext.h>
-#include <llvm/IR/IRBuilder.h>
-#include <llvm/IR/Module.h>
-
-#include <llvm/Support/TargetSelect.h>
-#include <llvm/Support/TargetRegistry.h>
-#include <llvm/Support/FileSystem.h>
-#include <llvm/Target/TargetOptions.h>
-#include <llvm/Target/TargetMachine.h>
-#include <llvm/IR/LegacyPassManager.h>
+#include <chrono>
+#include <filesystem>
 #include <getopt.h>
+#include <sstream>
+#include <thread>
 
 #include "colors.hpp"
 
@@ -33,20 +23,43 @@ int main(int argc, char **argv)
                                                                  "Options:\n"
                                                                  "  -s, --silent        Do not print AST\n"
                                                                  "  --print-llvm        Print LLVM IR\n"
+                                                                 "  -j, --jobs N        Compile on N threads\n"
+                                                                 "  --pipeline          Overlap parsing, type checking and code generation\n"
+                                                                 "  --stream            Compile block by block in bounded memory\n"
+                                                                 "  --cache-dir DIR     Reuse the AST and the code of unchanged functions from DIR\n"
+                                                                 "  --server SOCKET     Compile the requests of gkc-client on SOCKET until interrupted,\n"
+                                                                 "                      -j N of them at once, one per hardware thread by default\n"
+                                                                 "  --lsp               Run a language server on the standard input and output\n"
+                                                                 "  --watch             Compile again each time the file changes, until interrupted\n"
                                                                  "  -h, --help          Print this help message\n";
     int silent = 0;
     int print_llvm = 0;
-    std::istream *input = nullptr;
+    int pipeline = 0;
+    int stream = 0;
+    int lsp = 0;
+    int watch = 0;
+    unsigned jobs = 1;
+    std::string cacheDirectory = "";
+    std::string socketPath = "";
+    bool jobsSet = false;
+    std::shared_ptr<Lexer::SourceBuffer> input = nullptr;
     std::string inputFileName = "";
     static struct option long_options[] = {
         {"silent", no_argument, &silent, 's'},
         {"print-llvm", no_argument, &print_llvm, 1},
         {"help", no_argument, nullptr, 'h'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"pipeline", no_argument, &pipeline, 1},
+        {"stream", no_argument, &stream, 1},
+        {"cache-dir", required_argument, nullptr, 'c'},
+        {"server", required_argument, nullptr, 'S'},
+        {"lsp", no_argument, &lsp, 1},
+        {"watch", no_argument, &watch, 1},
         {0, 0, 0, 0}};
     int c;
     for (int i = 0; optind + i < argc; i += optind)
     {
-        while ((c = getopt_long(argc - i, argv + i, "sh", long_options, nullptr)) != -1)
+        while ((c = getopt_long(argc - i, argv + i, "shj:", long_options, nullptr)) != -1)
         {
             switch (c)
             {
@@ -60,6 +73,16 @@ int main(int argc, char **argv)
             case 'h':
                 std::cout << usage;
                 return 0;
+            case 'j':
+                jobs = std::max(1, std::atoi(optarg));
+                jobsSet = true;
+                break;
+            case 'c':
+                cacheDirectory = optarg;
+                break;
+            case 'S':
+                socketPath = optarg;
+                break;
             default:
                 std::cout << usage;
                 return 1;
@@ -67,10 +90,9 @@ int main(int argc, char **argv)
         }
         if (optind + i < argc)
         {
-            delete input;
-            input = new std::ifstream(argv[optind + i]);
+            input = Lexer::SourceBuffer::fromFile(argv[optind + i]);
             inputFileName = argv[optind + i];
-            if (input->fail())
+            if (input == nullptr)
             {
                 std::cout << "File not found: " << argv[optind + i] << std::endl;
                 return 1;
@@ -78,166 +100,76 @@ int main(int argc, char **argv)
         }
     }
 
-    if (input == nullptr)
+    if (lsp)
     {
-        delete input;
-        errs() << "No input file\n";
-        return 1;
+        Ckc::LanguageServer server(std::cin, std::cout);
+        return server.run();
     }
-    auto TargetTriple = sys::getDefaultTargetTriple();
-
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
 
-    std::string Error;
-    auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
-
-    if (!Target)
+    if (input == nullptr && socketPath.empty())
     {
-        errs() << Error;
+        errs() << "No input file\n";
         return 1;
     }
-
-    auto CPU = "generic";
-    auto Features = "";
-
-    TargetOptions opt;
-    auto RM = Optional<llvm::Reloc::Model>();
-    auto TargetMachine = std::shared_ptr<llvm::TargetMachine>(Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM));
-
-    // if (!file.is_open())
-    // {
-    //     std::cout << "Could not open file: " << input << std::endl;
-    //     return 1;
-    // }
-    if (input == nullptr)
+    std::string Error;
+    auto createTargetMachine = Ckc::hostTargetMachine(Error);
+    if (!createTargetMachine)
     {
-        std::cout << "No input file" << std::endl;
+        errs() << Error;
         return 1;
     }
-    Lexer::TokenStream ts(*input, inputFileName);
-    auto contextProvider = Context::ContextProvider::getInstance();
-
-    auto Context = std::make_shared<LLVMContext>();
-    auto Mod = std::make_shared<Module>("my cool jit", *Context);
-    Mod->setDataLayout(TargetMachine->createDataLayout());
-    Mod->setTargetTriple(TargetTriple);
-    // Create a new builder for the module.
-    auto Builder = std::make_shared<IRBuilder<>>(*Context);
-    // auto function = Function::Create(FunctionType::get(Type::getInt32Ty(*Context), false), Function::ExternalLinkage, "main", Mod.get());
-    // auto entry = BasicBlock::Create(*Context, "entry", function);
 
-    // Builder->SetInsertPoint(entry);
-    visitor::llvmVisitor lv{Context, Builder, Mod, contextProvider};
-    visitor::pragmaVisitor pragmaVisitor;
-    visitor::typeVisitor typeVisitor;
-    std::vector<Parser::NodeIdentifier> nodes;
-    bool error = false;
-    while (!ts.isEmpty())
+    if (!socketPath.empty())
     {
-        Parser::NodeIdentifier nodeMain = Parser::NodeIdentifier();
-        try
+        Ckc::Server server(socketPath, createTargetMachine, jobsSet ? jobs : std::max(1u, std::thread::hardware_concurrency()));
+        if (!server.listen(Error))
         {
-            nodeMain = Parser::parseBlock(ts);
+            errs() << Error << "\n";
+            return 1;
         }
-        catch (const std::exception &e)
-        {
-            std::cout << e.what() << std::endl;
-            break;
-        }
-        if (nodeMain.get() == nullptr)
-            break;
-        visitor::PrintVisitor pv;
-        if (!silent)
-        {
-            nodeMain.get()->accept(pv);
-            std::cout << std::endl;
-        }
-        nodeMain.get()->accept(pragmaVisitor);
-        try
-        {
-            nodeMain->accept(typeVisitor);
-        }
-        catch (type_error &e)
-        {
-            error = true;
-            std::cerr << ERROR_MESSAGE " " << std::string(e.what()) << std::endl;
-            visitor::rangeVisitor rv;
-            e.node->accept(rv);
-            ts.highlightMultiplesTokens(std::vector<std::pair<Lexer::Token, Lexer::Token>>{{rv.firstToken.value(), rv.lastToken.value()}});
-        }
-        catch (different_type_error &e)
-        {
-            error = true;
-            std::cerr << ERROR_MESSAGE " " << std::string(e.what()) << std::endl;
-            std::vector<std::pair<Lexer::Token, Lexer::Token>> tokens;
-            visitor::rangeVisitor rv;
-            e.nodeA->accept(rv);
-            tokens.push_back({rv.firstToken.value(), rv.lastToken.value()});
-            rv = visitor::rangeVisitor();
-            e.nodeB->accept(rv);
-            tokens.push_back({rv.firstToken.value(), rv.lastToken.value()});
-            ts.highlightMultiplesTokens(tokens);
-        }
-        catch (function_definition_error &e)
-        {
-            error = true;
-            std::cerr << ERROR_MESSAGE " " << std::string(e.what()) << std::endl;
-            visitor::rangeVisitor rv;
-            e.original_declaration->accept(rv);
-            std::cerr << "Original declaration is here:" << std::endl;
-            ts.printLine(rv.firstToken.value().line);
-            rv = visitor::rangeVisitor();
-            e.new_declaration->accept(rv);
-            std::cerr << "New declaration is here:" << std::endl;
-            ts.printLine(rv.firstToken.value().line);
-
-            
-        }
-        
-        nodes.push_back(nodeMain);
-    }
-    delete input;
-    if (Parser::hasError())
-    {
-        std::cerr << "Error parsing file\n";
-        return 1;
-    }
-    if (error)
-        return 1;
-    for (auto &node : nodes)
-    {
-        node.get()->accept(lv);
+        return server.run();
     }
 
-    // Builder->CreateUnreachable();
-    if (print_llvm)
-        Mod->print(llvm::outs(), nullptr);
-
-    auto Filename = "output.o";
-    std::error_code EC;
-    raw_fd_ostream dest(Filename, EC, sys::fs::OF_None);
-
-    if (EC)
+    if (watch)
     {
-        errs() << "Could not open file: " << EC.message();
-        return 1;
-    }
-
-    legacy::PassManager pass;
-    auto FileType = CGFT_ObjectFile;
-
-    if (TargetMachine->addPassesToEmitFile(pass, dest, nullptr, FileType))
-    {
-        errs() << "TargetMachine can't emit a file of this type";
-        return 1;
+        // Only the queries of what changed since the last compilation run again.
+        Ckc::Workspace workspace(createTargetMachine);
+        std::error_code error;
+        std::filesystem::file_time_type compiled;
+        while (true)
+        {
+            const auto modified = std::filesystem::last_write_time(inputFileName, error);
+            if (error || modified == compiled)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                continue;
+            }
+            compiled = modified;
+            std::ifstream file(inputFileName, std::ios::binary);
+            std::ostringstream text;
+            text << file.rdbuf();
+            const auto start = std::chrono::steady_clock::now();
+            workspace.resetStatistics();
+            workspace.setSource(inputFileName, text.str());
+            const bool ok = workspace.compile(inputFileName, "output.o", std::cerr);
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            std::cerr << (ok ? "Compiled " : "Failed to compile ") << inputFileName << " in " << elapsed.count() << " ms\n";
+            for (auto &[name, statistics] : workspace.getStatistics())
+            {
+                if (statistics.reused + statistics.computed > 0)
+                    std::cerr << "  " << name << ": " << statistics.reused << " reused, " << statistics.computed << " computed ("
+                              << statistics.unchanged << " unchanged), hit rate " << int(statistics.hitRate() * 100) << "%\n";
+            }
+        }
     }
 
-    pass.run(*Mod);
-    dest.flush();
-
-    return 0;
+    Ckc::Options options;
+    options.jobs = jobs;
+    options.pipeline = pipeline;
+    options.stream = stream;
+    options.printAst = !silent;
+    options.printLlvm = print_llvm;
+    options.cacheDirectory = cacheDirectory;
+    Ckc::CompilationSession session(options, createTargetMachine);
+    return session.compile(input, inputFileName, "output.o") ? 0 : 1;
 }
\ No newline at end of file
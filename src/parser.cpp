@@ -1,58 +1,132 @@
 #include "parser.hpp"
+#include "traversal.hpp"
 #include <map>
 #include <string>
 #include <cassert>
+#include <charconv>
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <iostream>
 #include <iomanip>
-#include <set>
-static bool parserError = false;
 namespace Parser
 {
-    std::map<NodeIdentifierIndex, std::shared_ptr<Node>> nodes;
+    namespace
+    {
+        // Per thread, each parsing task counts its own errors.
+        thread_local SyntaxErrors defaultErrors;
+        thread_local SyntaxErrors *currentErrors = nullptr;
+    }
+
+    SyntaxErrors &SyntaxErrors::getCurrent()
+    {
+        return currentErrors != nullptr ? *currentErrors : defaultErrors;
+    }
 
-    NodeIdentifier addNode(std::shared_ptr<Node> node)
+    void SyntaxErrors::setCurrent(SyntaxErrors &errors)
     {
-        static NodeIdentifierIndex id = 0;
-        nodes[id] = node;
-        auto identifier = NodeIdentifier{id++};
-        node->thisNode = identifier;
-        return identifier;
+        currentErrors = &errors;
     }
 
     bool hasError()
     {
-        return parserError;
+        return SyntaxErrors::getCurrent().error;
+    }
+
+    std::size_t errorCount()
+    {
+        return SyntaxErrors::getCurrent().count;
+    }
+
+    // The lexer reports every name as an IDENTIFIER, resolve it against the
+    // names declared so far. Other tokens are returned unchanged.
+    Lexer::TokenType resolve(const Lexer::Token &t)
+    {
+        if (t.type != Lexer::TokenType::IDENTIFIER)
+            return t.type;
+        return Lexer::LexerContext::getTokenType(t.symbol).value_or(Lexer::TokenType::IDENTIFIER);
+    }
+
+    // Record a syntax error and report it.
+    void reportError(const Lexer::Token &t, Lexer::TokenStream &ts, std::optional<Lexer::TokenType> expected = std::nullopt)
+    {
+        SyntaxErrors &errors = SyntaxErrors::getCurrent();
+        errors.error = true;
+        errors.count++;
+        ts.unexpectedToken(t, expected);
+    }
+
+    void reportError(const std::string &message, const Lexer::Token &t, Lexer::TokenStream &ts)
+    {
+        SyntaxErrors &errors = SyntaxErrors::getCurrent();
+        errors.error = true;
+        errors.count++;
+        ts.reportError(message, std::vector<Lexer::Span>{ts.spanOf(t)});
     }
 
 #define CHECK_TOKEN_AND_RETURN(t, reference, ts) \
     {                                            \
         if (!checkToken(t, reference, ts))       \
-            return NodeIdentifier(-1);           \
+            return NodeIdentifier();             \
     }
 
-    // Check if the token is the expected one.
-    // Return true if token is the expected or if a recovery occured.
+#define EXPECT_TOKEN_AND_RETURN(reference, ts) \
+    {                                          \
+        if (!expectToken(reference, ts))       \
+            return NodeIdentifier();           \
+    }
+
+    // Return NodeIdentifier() from the calling parse function if node failed.
+    // The error was reported where it occured, callers only unwind up to the
+    // synchronization point.
+#define CHECK_NODE_AND_RETURN(node)     \
+    {                                   \
+        if ((node).get() == nullptr)    \
+            return NodeIdentifier();    \
+    }
+
+    // Check if the token is the expected one, report an error otherwise.
     bool checkToken(const Lexer::Token &t, Lexer::TokenType reference, Lexer::TokenStream &ts)
     {
         if (t.type == reference)
             return true;
-        parserError = true;
-        ts.unexpectedToken(t, reference);
-        throw std::runtime_error("Unexpected token");
-        // while (ts.peek().type != Lexer::TokenType::TOKEN_EOF && ts.get().type != reference)
-        //     continue;
-        // return ts.peek().type != Lexer::TokenType::TOKEN_EOF;
+        reportError(t, ts, reference);
+        return false;
     }
 
-    // Check if the token is in the expected set.
-    bool checkToken(const Lexer::Token &t, std::set<Lexer::TokenType> reference, Lexer::TokenStream &ts)
+    // Consume the next token if it is the expected one. A wrong token is left
+    // in the stream, it may be where the synchronization stops.
+    bool expectToken(Lexer::TokenType reference, Lexer::TokenStream &ts)
     {
-        if (reference.find(t.type) != reference.end())
-            return true;
-        parserError = true;
-        ts.unexpectedToken(t);
-        throw std::runtime_error("Unexpected token");
+        if (!checkToken(ts.peek(), reference, ts))
+            return false;
+        ts.get();
+        return true;
+    }
+
+    // Skip the tokens of a block that failed to parse.
+    // Stop after the next semicolon or before a token that starts a block or
+    // ends a multiblock, so parsing resumes on the next statement.
+    void synchronize(Lexer::TokenStream &ts)
+    {
+        while (true)
+        {
+            switch (ts.peek().type)
+            {
+            case Lexer::TokenType::SEMICOLON:
+                ts.get();
+                return;
+            case Lexer::TokenType::KEYWORD_IF:
+            case Lexer::TokenType::KEYWORD_FUNCTION:
+            case Lexer::TokenType::KEYWORD_PRAGMA:
+            case Lexer::TokenType::KEYWORD_HASHTAG:
+                return;
+            default:
+                if (ts.peek().isEndMultiBlock())
+                    return;
+                ts.get();
+            }
+        }
     }
 
     NodeIdentifier parseMultiBlock(Lexer::TokenStream &ts)
@@ -61,104 +135,138 @@ namespace Parser
         Lexer::LexerContext::pushContext();
         while (!ts.peek().isEndMultiBlock())
         {
-            try
-            {
-                blocks.push_back(parseBlock(ts));
-            }
-            catch (const std::exception &e)
-            {
-                while (!ts.peek().isEndMultiBlock())
-                    ts.get();
-            }
+            auto block = parseBlock(ts);
+            if (block.get() == nullptr)
+                synchronize(ts);
+            else
+                blocks.push_back(block);
         }
         Lexer::LexerContext::popContext();
-        auto multiBlock = std::make_shared<NodeMultiBlock>(blocks);
-        return addNode(multiBlock);
+        return addNode<NodeMultiBlock>(blocks);
     }
 
     NodeIdentifier parseIf(const Lexer::Token &t, Lexer::TokenStream &ts)
     {
         auto condition = parsePrecedence(ts);
-        checkToken(ts.get(), Lexer::TokenType::KEYWORD_THEN, ts);
+        CHECK_NODE_AND_RETURN(condition);
+        EXPECT_TOKEN_AND_RETURN(Lexer::TokenType::KEYWORD_THEN, ts);
         auto thenStatement = parseMultiBlock(ts);
-        auto fiToken = ts.get();
         std::optional<NodeIdentifier> elseStatement = std::nullopt;
-        if (fiToken.value == "else")
+        if (ts.peek().type == Lexer::TokenType::KEYWORD_ELSE)
         {
+            ts.get();
             elseStatement = parseMultiBlock(ts);
-            fiToken = ts.get();
         }
-        checkToken(fiToken, Lexer::TokenType::KEYWORD_FI, ts);
-        auto node = std::make_shared<NodeIf>(t, fiToken, condition, thenStatement, elseStatement);
-        return addNode(node);
+        CHECK_TOKEN_AND_RETURN(ts.peek(), Lexer::TokenType::KEYWORD_FI, ts);
+        return addNode<NodeIf>(ts.spanOf(t, ts.get()), condition, thenStatement, elseStatement);
     }
 
-    // Parse a function call.
-    // ts shall be at the function name.
-    NodeIdentifier parseFunction(Lexer::TokenStream &ts)
+    // Parse the parameters and the optional return type of a function, the
+    // parameters are added to the current scope.
+    bool parseSignature(Lexer::TokenStream &ts, std::vector<std::pair<Types::TypeId, Lexer::Symbol>> &parameters, std::optional<Types::TypeId> &returnType)
     {
-        auto tokenFunction = ts.get();
-        // Parse the function name.
-        CHECK_TOKEN_AND_RETURN(ts.peek(), std::set<Lexer::TokenType>({Lexer::TokenType::IDENTIFIER, Lexer::TokenType::FUNCTION_NAME}) , ts);
-        const std::string name = ts.get().value;
-        Lexer::LexerContext::addToken(name, Lexer::TokenType::FUNCTION_NAME);
-        Lexer::LexerContext::pushContext();
-
-        // Parse the parameters.
-        CHECK_TOKEN_AND_RETURN(ts.get(), Lexer::TokenType::PARENTHESIS_OPEN, ts);
-        std::vector<std::pair<std::string, std::string>> parameters; // <type, name>
+        if (!expectToken(Lexer::TokenType::PARENTHESIS_OPEN, ts))
+            return false;
         while (!ts.isEmpty() && ts.peek().type != Lexer::TokenType::PARENTHESIS_CLOSE)
         {
-            checkToken(ts.peek(), Lexer::TokenType::TYPE, ts);
-            const std::string type = ts.get().value;
-            checkToken(ts.peek(), Lexer::TokenType::IDENTIFIER, ts);
-            const std::string identifier = ts.get().value;
+            if (!checkToken(ts.peek(), Lexer::TokenType::TYPE, ts))
+                return false;
+            const Types::TypeId type = Types::TypeId::named(ts.get().value);
+            if (!checkToken(ts.peek(), Lexer::TokenType::IDENTIFIER, ts))
+                return false;
+            const Lexer::Symbol identifier = ts.get().symbol;
             Lexer::LexerContext::addToken(identifier, Lexer::TokenType::VARIABLE_NAME);
             parameters.push_back({type, identifier});
             if (ts.peek().type == Lexer::TokenType::COMMA)
                 ts.get();
-            else
-                checkToken(ts.peek(), Lexer::TokenType::PARENTHESIS_CLOSE, ts);
+            else if (!checkToken(ts.peek(), Lexer::TokenType::PARENTHESIS_CLOSE, ts))
+                return false;
         }
-        CHECK_TOKEN_AND_RETURN(ts.get(), Lexer::TokenType::PARENTHESIS_CLOSE, ts);
+        if (!expectToken(Lexer::TokenType::PARENTHESIS_CLOSE, ts))
+            return false;
 
-        // Optional return type.
-        std::optional<std::string> returnType = std::nullopt;
         if (ts.peek().type == Lexer::TokenType::KEYWORD_RETURN)
         {
             ts.get();
-            CHECK_TOKEN_AND_RETURN(ts.peek(), Lexer::TokenType::TYPE, ts);
-            returnType = ts.get().value;
+            if (!checkToken(ts.peek(), Lexer::TokenType::TYPE, ts))
+                return false;
+            returnType = Types::TypeId::named(ts.get().value);
+        }
+        return true;
+    }
+
+    // Parse a function up to its body: name, parameters and return type.
+    // ts shall be at the function keyword. On success the scope of the
+    // parameters is left open for parseFunctionEnd.
+    NodeIdentifier parseFunctionHeader(Lexer::TokenStream &ts)
+    {
+        auto tokenFunction = ts.get();
+        // Parse the function name.
+        CHECK_TOKEN_AND_RETURN(ts.peek(), Lexer::TokenType::IDENTIFIER, ts);
+        const Lexer::Symbol name = ts.get().symbol;
+        Lexer::LexerContext::addToken(name, Lexer::TokenType::FUNCTION_NAME);
+
+        Lexer::LexerContext::pushContext();
+        std::vector<std::pair<Types::TypeId, Lexer::Symbol>> parameters; // <type, name>
+        std::optional<Types::TypeId> returnType = std::nullopt;
+        if (!parseSignature(ts, parameters, returnType))
+        {
+            // Skip to the body and parse it anyway, so its endfunction is not
+            // reported again and its own errors are.
+            while (ts.peek().type != Lexer::TokenType::KEYWORD_IS && ts.peek().type != Lexer::TokenType::SEMICOLON && !ts.peek().isEndMultiBlock())
+                ts.get();
+            if (ts.peek().type == Lexer::TokenType::KEYWORD_IS)
+            {
+                ts.get();
+                parseMultiBlock(ts);
+                if (ts.peek().type == Lexer::TokenType::KEYWORD_ENDFUNCTION)
+                    ts.get();
+            }
+            Lexer::LexerContext::popContext();
+            return NodeIdentifier();
         }
+        // parseFunctionEnd extends the span to the end of the function.
+        return addNode<NodeFunction>(ts.spanOf(tokenFunction), tokenFunction, name, parameters, returnType, std::nullopt);
+    }
 
-        Lexer::Token tokenEndFunction;
-        // Check for the function body.
-        std::optional<NodeIdentifier> body = std::nullopt;
+    // Parse the body of function, or the semicolon of a declaration, and close
+    // the scope opened by parseFunctionHeader.
+    bool parseFunctionEnd(Lexer::TokenStream &ts, NodeFunction &function)
+    {
         if (ts.peek().type == Lexer::TokenType::KEYWORD_IS)
         {
             ts.get();
-            body = parseMultiBlock(ts);
+            auto body = parseMultiBlock(ts);
             Lexer::LexerContext::popContext();
-            tokenEndFunction = ts.get();
-            CHECK_TOKEN_AND_RETURN(tokenEndFunction, Lexer::TokenType::KEYWORD_ENDFUNCTION, ts);
-            if (body.value().get() == nullptr)
-                return NodeIdentifier(-1);
+            if (!checkToken(ts.peek(), Lexer::TokenType::KEYWORD_ENDFUNCTION, ts))
+                return false;
+            function.body = body;
         }
         else
         {
-            tokenEndFunction = ts.get();
-            CHECK_TOKEN_AND_RETURN(tokenEndFunction, Lexer::TokenType::SEMICOLON, ts);
+            Lexer::LexerContext::popContext();
+            if (!checkToken(ts.peek(), Lexer::TokenType::SEMICOLON, ts))
+                return false;
         }
+        function.span.end = ts.spanOf(ts.get()).end;
+        return true;
+    }
 
-        // Create the function.
-        auto node = std::make_shared<NodeFunction>(tokenFunction, name, parameters, returnType, std::move(body), tokenEndFunction);
-        return addNode(node);
+    // Parse a function definition or declaration.
+    // ts shall be at the function keyword.
+    NodeIdentifier parseFunction(Lexer::TokenStream &ts)
+    {
+        auto function = parseFunctionHeader(ts);
+        CHECK_NODE_AND_RETURN(function);
+        if (!parseFunctionEnd(ts, *function.get<NodeFunction>()))
+            return NodeIdentifier();
+        return function;
     }
 
     NodeIdentifier parseGoto(const Lexer::Token &t, Lexer::TokenStream &ts)
     {
-        auto node = std::make_shared<NodeGoto>(ts.get().value);
-        return addNode(node);
+        const auto label = ts.get();
+        return addNode<NodeGoto>(ts.spanOf(t, label), std::string(label.value));
     }
 
     NodeIdentifier parseReturn(Lexer::TokenStream &ts)
@@ -167,31 +275,36 @@ namespace Parser
         if (ts.peek().type == Lexer::TokenType::SEMICOLON)
         {
             ts.get();
-            auto node = std::make_shared<NodeReturn>(returnToken, std::nullopt);
-            return addNode(node);
+            return addNode<NodeReturn>(ts.spanOf(returnToken), std::nullopt);
         }
-        auto node = std::make_shared<NodeReturn>(returnToken, parseExpression(ts));
-        return addNode(node);
+        auto value = parseExpression(ts);
+        CHECK_NODE_AND_RETURN(value);
+        return addNode<NodeReturn>(Lexer::Span{ts.spanOf(returnToken).begin, value->span.end}, value);
     }
 
-    NodeIdentifier parseNumber(const Lexer::Token &t)
+    NodeIdentifier parseNumber(const Lexer::Token &t, Lexer::TokenStream &ts)
     {
-        int value = std::stoi(t.value);
-        auto node = std::make_shared<NodeNumber>(value, t);
-        return addNode(node);
+        std::int64_t value = 0;
+        const char *end = t.value.data() + t.value.size();
+        auto [last, error] = std::from_chars(t.value.data(), end, value);
+        if (error != std::errc() || last != end || value > std::numeric_limits<int>::max())
+        {
+            reportError("Number out of range: " + std::string(t.value), t, ts);
+            return NodeIdentifier();
+        }
+        return addNode<NodeNumber>(static_cast<int>(value), ts.spanOf(t));
     }
 
-    NodeIdentifier parseIdentifier(const Lexer::Token &t)
+    NodeIdentifier parseIdentifier(const Lexer::Token &t, Lexer::TokenStream &ts)
     {
-        auto node = std::make_shared<NodeText>(t.value, t);
-        return addNode(node);
+        return addNode<NodeText>(t.symbol, ts.spanOf(t));
     }
 
     NodeIdentifier parseStatement(Lexer::TokenStream &ts)
     {
-        const Lexer::Token t = ts.peek();
+        const Lexer::Token &t = ts.peek();
         NodeIdentifier statement;
-        switch (t.type)
+        switch (resolve(t))
         {
         case Lexer::TokenType::KEYWORD_GOTO:
             statement = parseGoto(ts.get(), ts);
@@ -208,38 +321,36 @@ namespace Parser
         case Lexer::TokenType::TOKEN_EOF:
             return statement;
         default:
-            ts.unexpectedToken(ts.get());
-            break;
+            reportError(ts.get(), ts);
+            return NodeIdentifier();
         }
-        checkToken(ts.get(), Lexer::TokenType::SEMICOLON, ts);
+        CHECK_NODE_AND_RETURN(statement);
+        EXPECT_TOKEN_AND_RETURN(Lexer::TokenType::SEMICOLON, ts);
         return statement;
     }
 
-    NodeIdentifier parseBlockModifier(Lexer::TokenStream &ts)
+    NodeIdentifier parseBlockModifier(const Lexer::Token &hashtag, Lexer::TokenStream &ts)
     {
-        auto node = std::make_shared<NodeBlockModifier>(Lexer::ModifierType::Named, ts.get().value);
-        return addNode(node);
+        const auto name = ts.get();
+        return addNode<NodeBlockModifier>(ts.spanOf(hashtag, name), Lexer::ModifierType::Named, std::string(name.value));
     }
 
     NodeIdentifier parsePragma(Lexer::TokenStream &ts)
     {
         auto pragmaToken = ts.get();
         auto targetObject = ts.get();
-        if (targetObject.type == Lexer::TokenType::IDENTIFIER)
-        {
-            ts.unexpectedToken(targetObject);
-        }
+        if (resolve(targetObject) == Lexer::TokenType::IDENTIFIER)
+            reportError(targetObject, ts);
         const Lexer::Token pragmaType = ts.get();
-        CHECK_TOKEN_AND_RETURN(ts.get(), Lexer::TokenType::KEYWORD_IS, ts);
+        EXPECT_TOKEN_AND_RETURN(Lexer::TokenType::KEYWORD_IS, ts);
         const auto value = ts.get();
-        std::string pragmaValue = value.value;
+        std::string pragmaValue(value.value);
         if (value.type == Lexer::TokenType::STRING)
         {
             pragmaValue = value.value.substr(1, value.value.size() - 2);
         }
-        CHECK_TOKEN_AND_RETURN(ts.get(), Lexer::TokenType::SEMICOLON, ts);
-        auto node = std::make_shared<NodePragma>(pragmaToken, pragmaType.type, pragmaValue, targetObject);
-        return addNode(node);
+        EXPECT_TOKEN_AND_RETURN(Lexer::TokenType::SEMICOLON, ts);
+        return addNode<NodePragma>(ts.spanOf(pragmaToken, value), pragmaType.type, pragmaValue, targetObject);
     }
 
     NodeIdentifier parseBlock(Lexer::TokenStream &ts)
@@ -248,8 +359,7 @@ namespace Parser
         std::optional<NodeIdentifier> modifier = std::nullopt;
         if (t.type == Lexer::TokenType::KEYWORD_HASHTAG)
         {
-            ts.get();
-            modifier = parseBlockModifier(ts);
+            modifier = parseBlockModifier(ts.get(), ts);
         }
         t = ts.peek();
         NodeIdentifier block;
@@ -269,61 +379,11 @@ namespace Parser
             break;
         }
         if (block.get() == nullptr)
-            return NodeIdentifier(-1);
+            return NodeIdentifier();
         block.get<NodeBlock>()->modifier = modifier;
         return block;
     }
 
-    NodeIdentifier parseFunctionCall(Lexer::TokenStream &ts)
-    {
-        auto functionToken = ts.get();
-        const std::string name = functionToken.value;
-        checkToken(ts.get(), Lexer::TokenType::PARENTHESIS_OPEN, ts);
-        std::vector<NodeIdentifier> parameters;
-        while (ts.peek().type != Lexer::TokenType::PARENTHESIS_CLOSE)
-        {
-            parameters.push_back(parsePrecedence(ts));
-            if (ts.peek().type == Lexer::TokenType::COMMA)
-                ts.get();
-            else
-                checkToken(ts.peek(), Lexer::TokenType::PARENTHESIS_CLOSE, ts);
-        }
-        auto closeParen = ts.get();
-        checkToken(closeParen, Lexer::TokenType::PARENTHESIS_CLOSE, ts);
-        auto node = std::make_shared<NodeFunctionCall>(functionToken, name, std::move(parameters), closeParen);
-        return addNode(node);
-    }
-
-    NodeIdentifier parseCast(Lexer::TokenStream &ts)
-    {
-        auto typeToken = ts.get();
-        const std::string type = typeToken.value;
-
-        checkToken(ts.get(), Lexer::TokenType::PARENTHESIS_OPEN, ts);
-        NodeIdentifier expression = parseExpression(ts);
-        auto closeParen = ts.get();
-        checkToken(closeParen, Lexer::TokenType::PARENTHESIS_CLOSE, ts);
-
-        auto node = std::make_shared<NodeCast>(typeToken, type, expression, closeParen);
-        return addNode(node);
-    }
-
-    NodeIdentifier parseTerm(Lexer::TokenStream &ts)
-    {
-        Lexer::Token t = ts.peek();
-        if (t.type == Lexer::TokenType::NUMBER)
-        {
-            return parseNumber(ts.get());
-        }
-        if (t.type == Lexer::TokenType::FUNCTION_NAME)
-        {
-            return parseFunctionCall(ts);
-        }
-        if (ts.peek().type == Lexer::TokenType::TYPE)
-            return parseCast(ts);
-        return parseIdentifier(ts.get());
-    }
-
     // NodeIdentifier parseMul(Lexer::TokenStream &ts)
     // {
     //     Lexer::Token t = ts.peek();
@@ -342,73 +402,178 @@ namespace Parser
     //     return term;
     // }
 
-    NodeIdentifier parseUnary(Lexer::TokenStream &ts)
+    // Parse an expression, NodeIdentifier() if it is invalid. The error is
+    // already reported, the caller recovers with synchronize.
+    NodeIdentifier parseExpression(Lexer::TokenStream &ts)
     {
-        auto token = ts.get();
-        auto op = token.type;
-        NodeIdentifier right = parsePrecedence(ts);
-        auto node = std::make_shared<NodeUnaryOperator>(token, right, op);
-        return addNode(node);
+        return parsePrecedence(ts);
     }
 
-    NodeIdentifier parseExpression(Lexer::TokenStream &ts)
+    // Index in precedenceList of the level of each binary operator, -1 for other tokens.
+    constexpr std::array<int, Lexer::tokenTypeCount> binaryLevels = []()
     {
-        try
-        {
-            return parsePrecedence(ts);
-        }
-        catch (const std::exception &e)
+        std::array<int, Lexer::tokenTypeCount> levels{};
+        for (std::size_t type = 0; type < Lexer::tokenTypeCount; type++)
         {
-            // Try to recover on expression.
-            while (!ts.peek().isEndExpression() && !ts.peek().isEndMultiBlock())
-                ts.get();
-            // If we reach an endMultiBlock token we need to recover earlier.
-            if (ts.peek().isEndMultiBlock())
-                throw e;
-            return NodeIdentifier(-1);
+            levels[type] = -1;
+            for (std::size_t level = 0; level < Lexer::precedenceList.size(); level++)
+            {
+                if (Lexer::getPrecedence(static_cast<Lexer::TokenType>(type)) == Lexer::precedenceList[level])
+                    levels[type] = level;
+            }
         }
-    }
+        return levels;
+    }();
 
-    NodeIdentifier parseParenthesis(Lexer::TokenStream &ts)
+    // An expression being parsed, waiting for the operand parsed after it.
+    class ExpressionFrame
     {
-        checkToken(ts.get(), Lexer::TokenType::PARENTHESIS_OPEN, ts);
-        NodeIdentifier expression = parseExpression(ts);
-        checkToken(ts.get(), Lexer::TokenType::PARENTHESIS_CLOSE, ts);
-        return expression;
-    }
+    public:
+        enum class Kind
+        {
+            // Binary operators up to the level precedenceIndex, the left
+            // operand and its operator once parsed.
+            Binary,
+            Unary,
+            Parenthesis,
+            Call,
+            Cast,
+        };
+        Kind kind;
+        int precedenceIndex = 0;
+        NodeIdentifier left;
+        Lexer::TokenType op = Lexer::TokenType::TOKEN_EOF;
+        // First token of a unary operator, a parenthesis, a call or a cast.
+        Lexer::Token token;
+        Types::TypeId type;
+        std::vector<NodeIdentifier> arguments;
 
-    // Parse expressions.
+        static ExpressionFrame binary(int precedenceIndex)
+        {
+            ExpressionFrame frame(Kind::Binary);
+            frame.precedenceIndex = precedenceIndex;
+            return frame;
+        }
+        ExpressionFrame(Kind kind) : kind(kind){};
+        ExpressionFrame(Kind kind, Lexer::Token token) : kind(kind), token(token){};
+    };
+
+    // Parse expressions made of binary operators up to the level precedenceIndex.
+    // Precedence climbing: levels are left associative, except the first one
+    // (* / %) which is right associative. A unary operator applies to the whole
+    // expression on its right.
+    // The expressions waiting for an operand are kept on a work stack rather
+    // than in recursive calls, so that nesting is only bounded by memory.
     NodeIdentifier parsePrecedence(Lexer::TokenStream &ts, int precedenceIndex)
     {
         assert(precedenceIndex >= 0 && std::size_t(precedenceIndex) < Lexer::precedenceList.size());
-        const int precedence = Lexer::precedenceList[precedenceIndex];
-
-        if (ts.peek().isUnaryOperator())
-            return parseUnary(ts);
-
-        NodeIdentifier left;
-        if (ts.peek().type == Lexer::TokenType::PARENTHESIS_OPEN && precedenceIndex == 0)
-        {
-            left = parseParenthesis(ts);
-        }
-        else if (precedenceIndex > 0)
-        {
-            left = parsePrecedence(ts, precedenceIndex - 1);
-        }
-        else
-        {
-            left = parseTerm(ts);
-        }
-        Lexer::Token t = ts.peek();
-        while (t.getPrecedence() == precedence)
+        const int lowest = Lexer::precedenceList.size() - 1;
+        WorkStack<ExpressionFrame> stack;
+        stack.push_back(ExpressionFrame::binary(precedenceIndex));
+        // The operand just parsed, for the frame on top of the stack.
+        NodeIdentifier operand;
+        while (true)
         {
-            auto op = ts.get().type;
-            NodeIdentifier right = parsePrecedence(ts, precedenceIndex > 0 ? precedenceIndex - 1 : 0);
-            auto node = std::make_shared<NodeBinOperator>(std::move(left), std::move(right), op);
-            left = addNode(node);
-            t = ts.peek();
+            if (operand.get() == nullptr)
+            {
+                // Prefix: a leaf, or the start of an expression around an operand.
+                const Lexer::Token &t = ts.peek();
+                if (t.isUnaryOperator())
+                {
+                    stack.push_back(ExpressionFrame(ExpressionFrame::Kind::Unary, ts.get()));
+                    stack.push_back(ExpressionFrame::binary(lowest));
+                    continue;
+                }
+                switch (resolve(t))
+                {
+                case Lexer::TokenType::PARENTHESIS_OPEN:
+                    stack.push_back(ExpressionFrame(ExpressionFrame::Kind::Parenthesis, ts.get()));
+                    stack.push_back(ExpressionFrame::binary(lowest));
+                    continue;
+                case Lexer::TokenType::NUMBER:
+                    operand = parseNumber(ts.get(), ts);
+                    CHECK_NODE_AND_RETURN(operand);
+                    break;
+                case Lexer::TokenType::FUNCTION_NAME:
+                    stack.push_back(ExpressionFrame(ExpressionFrame::Kind::Call, ts.get()));
+                    EXPECT_TOKEN_AND_RETURN(Lexer::TokenType::PARENTHESIS_OPEN, ts);
+                    break;
+                case Lexer::TokenType::TYPE:
+                {
+                    ExpressionFrame cast(ExpressionFrame::Kind::Cast, ts.get());
+                    cast.type = Types::TypeId::named(cast.token.value);
+                    stack.push_back(std::move(cast));
+                    EXPECT_TOKEN_AND_RETURN(Lexer::TokenType::PARENTHESIS_OPEN, ts);
+                    stack.push_back(ExpressionFrame::binary(lowest));
+                    continue;
+                }
+                default:
+                    // A missing operand, leave the token to the synchronization.
+                    if (t.isEndExpression() || t.isEndMultiBlock())
+                    {
+                        reportError(t, ts);
+                        return NodeIdentifier();
+                    }
+                    operand = parseIdentifier(ts.get(), ts);
+                    break;
+                }
+            }
+
+            ExpressionFrame &top = stack.back();
+            switch (top.kind)
+            {
+            case ExpressionFrame::Kind::Binary:
+            {
+                top.left = top.left.get() == nullptr ? operand : addNode<NodeBinOperator>(std::move(top.left), std::move(operand), top.op);
+                operand = NodeIdentifier();
+                const int level = binaryLevels[static_cast<std::size_t>(ts.peek().type)];
+                if (level >= 0 && level <= top.precedenceIndex)
+                {
+                    top.op = ts.get().type;
+                    stack.push_back(ExpressionFrame::binary(level > 0 ? level - 1 : 0));
+                    continue;
+                }
+                operand = top.left;
+                stack.pop_back();
+                if (stack.empty())
+                    return operand;
+                continue;
+            }
+            case ExpressionFrame::Kind::Unary:
+                operand = addNode<NodeUnaryOperator>(Lexer::Span{ts.spanOf(top.token).begin, operand->span.end}, operand, top.token.type);
+                stack.pop_back();
+                continue;
+            case ExpressionFrame::Kind::Parenthesis:
+                CHECK_TOKEN_AND_RETURN(ts.peek(), Lexer::TokenType::PARENTHESIS_CLOSE, ts);
+                operand->span = ts.spanOf(top.token, ts.get());
+                stack.pop_back();
+                continue;
+            case ExpressionFrame::Kind::Call:
+                // Reached right after the parenthesis, then after each argument.
+                if (operand.get() != nullptr)
+                {
+                    top.arguments.push_back(operand);
+                    if (ts.peek().type == Lexer::TokenType::COMMA)
+                        ts.get();
+                    else
+                        CHECK_TOKEN_AND_RETURN(ts.peek(), Lexer::TokenType::PARENTHESIS_CLOSE, ts);
+                }
+                if (ts.peek().type != Lexer::TokenType::PARENTHESIS_CLOSE)
+                {
+                    operand = NodeIdentifier();
+                    stack.push_back(ExpressionFrame::binary(lowest));
+                    continue;
+                }
+                operand = addNode<NodeFunctionCall>(ts.spanOf(top.token, ts.get()), top.token.symbol, std::move(top.arguments));
+                stack.pop_back();
+                continue;
+            case ExpressionFrame::Kind::Cast:
+                CHECK_TOKEN_AND_RETURN(ts.peek(), Lexer::TokenType::PARENTHESIS_CLOSE, ts);
+                operand = addNode<NodeCast>(ts.spanOf(top.token, ts.get()), top.type, operand);
+                stack.pop_back();
+                continue;
+            }
         }
-        return left;
     }
 
     // NodeIdentifier parseExpression(Lexer::TokenStream &ts)
@@ -427,28 +592,30 @@ namespace Parser
     NodeIdentifier parseVariableDeclaration(Lexer::TokenStream &ts)
     {
         auto typeToken = ts.get();
-        const std::string type = typeToken.value;
-        const std::string identifier = ts.get().value;
-        const std::string equal = ts.peek().value;
+        const Types::TypeId type = Types::TypeId::named(typeToken.value);
+        const auto identifierToken = ts.get();
+        const Lexer::Symbol identifier = identifierToken.symbol;
+        Lexer::Span span = ts.spanOf(typeToken, identifierToken);
         std::optional<NodeIdentifier> expression = std::nullopt;
-        if (equal == Lexer::tokenTypeToString(Lexer::TokenType::OPERATOR_ASSIGN))
+        if (ts.peek().type == Lexer::TokenType::OPERATOR_ASSIGN)
         {
             ts.get();
             expression = parseExpression(ts);
+            CHECK_NODE_AND_RETURN(expression.value());
+            span.end = expression.value()->span.end;
         }
         Lexer::LexerContext::addToken(identifier, Lexer::TokenType::VARIABLE_NAME);
-        auto node = std::make_shared<NodeVariableDeclaration>(typeToken, type, identifier, std::move(expression));
-        return addNode(node);
+        return addNode<NodeVariableDeclaration>(span, type, identifier, std::move(expression));
     }
 
     NodeIdentifier parseVariableAssignment(Lexer::TokenStream &ts)
     {
         auto identifierToken = ts.get();
-        const std::string identifier = identifierToken.value;
-        checkToken(ts.get(), Lexer::TokenType::OPERATOR_ASSIGN, ts);
+        const Lexer::Symbol identifier = identifierToken.symbol;
+        EXPECT_TOKEN_AND_RETURN(Lexer::TokenType::OPERATOR_ASSIGN, ts);
         NodeIdentifier expression = parseExpression(ts);
-        auto node = std::make_shared<NodeVariableAssignment>(identifierToken, identifier, std::move(expression));
-        return addNode(node);
+        CHECK_NODE_AND_RETURN(expression);
+        return addNode<NodeVariableAssignment>(Lexer::Span{ts.spanOf(identifierToken).begin, expression->span.end}, identifier, std::move(expression));
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "protocol.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Ckc
+{
+    namespace
+    {
+        // Longer strings are taken for a corrupted message.
+        constexpr std::uint64_t maxLength = std::uint64_t(1) << 28;
+
+        bool writeAll(int fd, const char *data, std::size_t size)
+        {
+            while (size > 0)
+            {
+                // No SIGPIPE if the peer is gone.
+                const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                    return false;
+                data += written;
+                size -= written;
+            }
+            return true;
+        }
+
+        bool readAll(int fd, char *data, std::size_t size)
+        {
+            while (size > 0)
+            {
+                const ssize_t received = recv(fd, data, size, 0);
+                if (received < 0 && errno == EINTR)
+                    continue;
+                if (received <= 0)
+                    return false;
+                data += received;
+                size -= received;
+            }
+            return true;
+        }
+
+        // A message is built whole and sent with as few calls as possible.
+        class Writer
+        {
+        public:
+            std::string buffer;
+
+            template <typename T>
+            void integer(T value) { buffer.append(reinterpret_cast<const char *>(&value), sizeof(value)); }
+            void string(const std::string &value)
+            {
+                integer<std::uint64_t>(value.size());
+                buffer += value;
+            }
+        };
+
+        template <typename T>
+        bool readInteger(int fd, T &value) { return readAll(fd, reinterpret_cast<char *>(&value), sizeof(value)); }
+
+        bool readString(int fd, std::string &value)
+        {
+            std::uint64_t length;
+            if (!readInteger(fd, length) || length > maxLength)
+                return false;
+            value.resize(length);
+            return readAll(fd, value.data(), length);
+        }
+    }
+
+    bool writeRequest(int fd, const Request &request)
+    {
+        Writer writer;
+        writer.integer(protocolVersion);
+        writer.integer(request.jobs);
+        writer.integer<std::uint8_t>(request.pipeline);
+        writer.integer<std::uint8_t>(request.stream);
+        writer.string(request.cacheDirectory);
+        writer.string(request.filename);
+        writer.string(request.objectFilename);
+        writer.string(request.source);
+        return writeAll(fd, writer.buffer.data(), writer.buffer.size());
+    }
+
+    bool readRequest(int fd, Request &request)
+    {
+        std::uint32_t version;
+        std::uint8_t pipeline, stream;
+        if (!readInteger(fd, version) || version != protocolVersion)
+            return false;
+        if (!readInteger(fd, request.jobs) || !readInteger(fd, pipeline) || !readInteger(fd, stream))
+            return false;
+        request.pipeline = pipeline;
+        request.stream = stream;
+        return readString(fd, request.cacheDirectory) && readString(fd, request.filename) && readString(fd, request.objectFilename) && readString(fd, request.source);
+    }
+
+    bool writeResponse(int fd, const Response &response)
+    {
+        Writer writer;
+        writer.integer<std::uint8_t>(response.compiled);
+        writer.string(response.diagnostics);
+        return writeAll(fd, writer.buffer.data(), writer.buffer.size());
+    }
+
+    bool readResponse(int fd, Response &response)
+    {
+        std::uint8_t compiled;
+        if (!readInteger(fd, compiled))
+            return false;
+        response.compiled = compiled;
+        return readString(fd, response.diagnostics);
+    }
+
+    bool socketAddress(const std::string &path, sockaddr_un &address, std::string &error)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            error = "Invalid socket path: " + path;
+            return false;
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    bool compileRemote(const std::string &socketPath, const Request &request, Response &response, std::string &error)
+    {
+        sockaddr_un address;
+        if (!socketAddress(socketPath, address, error))
+            return false;
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            error = std::string("Could not create a socket: ") + std::strerror(errno);
+            return false;
+        }
+        bool done = false;
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+            error = "Could not connect to " + socketPath + ": " + std::strerror(errno);
+        else if (!writeRequest(fd, request) || !readResponse(fd, response))
+            error = "The server at " + socketPath + " closed the connection";
+        else
+            done = true;
+        close(fd);
+        return done;
+    }
+}
@@ -0,0 +1,93 @@
+#include "query.hpp"
+#include <stdexcept>
+
+namespace Query
+{
+    void Engine::read(Slot &slot)
+    {
+        if (!active.empty())
+            active.back()->dependencies.push_back(&slot);
+        update(slot);
+    }
+
+    void Engine::changed(Slot &input)
+    {
+        if (!active.empty())
+            throw std::logic_error("Input " + input.name() + " changed while " + active.back()->name() + " is computed");
+        revision++;
+        input.changedAt = revision;
+        input.verifiedAt = revision;
+    }
+
+    void Engine::update(Slot &slot)
+    {
+        if (slot.isInput() || slot.verifiedAt == revision)
+            return;
+        if (slot.computing)
+            throw std::logic_error("Query " + slot.name() + " depends on itself");
+        if (slot.hasValue())
+        {
+            // The value stands if none of the values it was computed from
+            // changed since, the first change found is enough to compute it again.
+            bool stale = false;
+            for (std::size_t i = 0; i < slot.dependencies.size() && !stale; i++)
+            {
+                Slot &dependency = *slot.dependencies[i];
+                slot.computing = true;
+                try
+                {
+                    update(dependency);
+                }
+                catch (...)
+                {
+                    slot.computing = false;
+                    throw;
+                }
+                slot.computing = false;
+                stale = dependency.changedAt > slot.verifiedAt;
+            }
+            if (!stale)
+            {
+                slot.verifiedAt = revision;
+                slot.statistics->reused++;
+                return;
+            }
+        }
+        compute(slot);
+    }
+
+    void Engine::compute(Slot &slot)
+    {
+        // On failure the slot is left as it was, to be computed again by the next read.
+        std::vector<Slot *> previous = std::move(slot.dependencies);
+        slot.dependencies.clear();
+        slot.computing = true;
+        active.push_back(&slot);
+        bool changed;
+        try
+        {
+            changed = slot.compute();
+        }
+        catch (...)
+        {
+            active.pop_back();
+            slot.computing = false;
+            slot.dependencies = std::move(previous);
+            throw;
+        }
+        active.pop_back();
+        slot.computing = false;
+        slot.verifiedAt = revision;
+        slot.statistics->computed++;
+        if (changed)
+            slot.changedAt = revision;
+        else
+            slot.statistics->unchanged++;
+    }
+
+    void Engine::resetStatistics()
+    {
+        for (auto &[name, queryStatistics] : statistics)
+            queryStatistics = Statistics();
+    }
+}
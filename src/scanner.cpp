@@ -0,0 +1,288 @@
+#include "scanner.hpp"
+#if defined(__x86_64__) || defined(__SSE2__)
+#define SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Lexer::Scanner
+{
+    namespace
+    {
+        inline bool isWhitespace(unsigned char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        // Same as std::isalnum(c) || c == '_' in the "C" locale.
+        inline bool isIdentifier(unsigned char c)
+        {
+            return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+        }
+
+        const char *scalarSkipWhitespace(const char *begin, const char *end)
+        {
+            while (begin < end && isWhitespace(*begin))
+                begin++;
+            return begin;
+        }
+
+        const char *scalarSkipIdentifier(const char *begin, const char *end)
+        {
+            while (begin < end && isIdentifier(*begin))
+                begin++;
+            return begin;
+        }
+
+        const char *scalarFindQuote(const char *begin, const char *end)
+        {
+            while (begin < end && *begin != '"')
+                begin++;
+            return begin;
+        }
+
+        std::size_t scalarCountNewlines(const char *begin, const char *end)
+        {
+            std::size_t count = 0;
+            for (; begin < end; begin++)
+                count += *begin == '\n';
+            return count;
+        }
+
+#ifdef SCANNER_X86
+        // Most runs in source code are a few characters long, the vector loops only
+        // pay off once a run is longer than this prefix scanned one byte at a time.
+        constexpr std::ptrdiff_t scalarPrefix = 8;
+
+#define SCALAR_PREFIX(predicate)                                          \
+    {                                                                     \
+        const char *limit = end - begin > scalarPrefix ? begin + scalarPrefix : end; \
+        while (begin < limit && (predicate))                              \
+            begin++;                                                      \
+        if (begin < limit || begin == end)                                \
+            return begin;                                                 \
+    }
+
+        // Bytes above 0x7f are negative for the signed comparisons, so they never match.
+        inline __m128i whitespaceMask(__m128i c)
+        {
+            __m128i space = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\t')));
+            __m128i newline = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(c, _mm_set1_epi8('\r')));
+            return _mm_or_si128(space, newline);
+        }
+
+        inline __m128i identifierMask(__m128i c)
+        {
+            __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+            __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+            __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+            return _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+        }
+
+        const char *sse2SkipWhitespace(const char *begin, const char *end)
+        {
+            SCALAR_PREFIX(isWhitespace(*begin));
+            for (; end - begin >= 16; begin += 16)
+            {
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+                unsigned mask = ~_mm_movemask_epi8(whitespaceMask(c)) & 0xFFFF;
+                if (mask != 0)
+                    return begin + __builtin_ctz(mask);
+            }
+            return scalarSkipWhitespace(begin, end);
+        }
+
+        const char *sse2SkipIdentifier(const char *begin, const char *end)
+        {
+            SCALAR_PREFIX(isIdentifier(*begin));
+            for (; end - begin >= 16; begin += 16)
+            {
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+                unsigned mask = ~_mm_movemask_epi8(identifierMask(c)) & 0xFFFF;
+                if (mask != 0)
+                    return begin + __builtin_ctz(mask);
+            }
+            return scalarSkipIdentifier(begin, end);
+        }
+
+        const char *sse2FindQuote(const char *begin, const char *end)
+        {
+            SCALAR_PREFIX(*begin != '"');
+            for (; end - begin >= 16; begin += 16)
+            {
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+                unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('"')));
+                if (mask != 0)
+                    return begin + __builtin_ctz(mask);
+            }
+            return scalarFindQuote(begin, end);
+        }
+
+        std::size_t sse2CountNewlines(const char *begin, const char *end)
+        {
+            if (end - begin <= scalarPrefix)
+                return scalarCountNewlines(begin, end);
+            std::size_t count = 0;
+            for (; end - begin >= 16; begin += 16)
+            {
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+                count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))));
+            }
+            return count + scalarCountNewlines(begin, end);
+        }
+
+#define AVX2 __attribute__((target("avx2")))
+        AVX2 inline __m256i whitespaceMask256(__m256i c)
+        {
+            __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\t')));
+            __m256i newline = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r')));
+            return _mm256_or_si256(space, newline);
+        }
+
+        AVX2 inline __m256i identifierMask256(__m256i c)
+        {
+            __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+            __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+            __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+            return _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+        }
+
+        AVX2 const char *avx2SkipWhitespace(const char *begin, const char *end)
+        {
+            SCALAR_PREFIX(isWhitespace(*begin));
+            for (; end - begin >= 32; begin += 32)
+            {
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+                unsigned mask = ~unsigned(_mm256_movemask_epi8(whitespaceMask256(c)));
+                if (mask != 0)
+                    return begin + __builtin_ctz(mask);
+            }
+            return sse2SkipWhitespace(begin, end);
+        }
+
+        AVX2 const char *avx2SkipIdentifier(const char *begin, const char *end)
+        {
+            SCALAR_PREFIX(isIdentifier(*begin));
+            for (; end - begin >= 32; begin += 32)
+            {
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+                unsigned mask = ~unsigned(_mm256_movemask_epi8(identifierMask256(c)));
+                if (mask != 0)
+                    return begin + __builtin_ctz(mask);
+            }
+            return sse2SkipIdentifier(begin, end);
+        }
+
+        AVX2 const char *avx2FindQuote(const char *begin, const char *end)
+        {
+            SCALAR_PREFIX(*begin != '"');
+            for (; end - begin >= 32; begin += 32)
+            {
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+                unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('"')));
+                if (mask != 0)
+                    return begin + __builtin_ctz(mask);
+            }
+            return sse2FindQuote(begin, end);
+        }
+
+        AVX2 std::size_t avx2CountNewlines(const char *begin, const char *end)
+        {
+            if (end - begin <= scalarPrefix)
+                return scalarCountNewlines(begin, end);
+            std::size_t count = 0;
+            for (; end - begin >= 32; begin += 32)
+            {
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+                count += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))));
+            }
+            return count + sse2CountNewlines(begin, end);
+        }
+#undef AVX2
+#undef SCALAR_PREFIX
+#endif
+
+        class Kernels
+        {
+        public:
+            const char *(*skipWhitespace)(const char *, const char *);
+            const char *(*skipIdentifier)(const char *, const char *);
+            const char *(*findQuote)(const char *, const char *);
+            std::size_t (*countNewlines)(const char *, const char *);
+        };
+
+        Kernels kernelsFor(Level level)
+        {
+            switch (level)
+            {
+#ifdef SCANNER_X86
+            case Level::AVX2:
+                return {avx2SkipWhitespace, avx2SkipIdentifier, avx2FindQuote, avx2CountNewlines};
+            case Level::SSE2:
+                return {sse2SkipWhitespace, sse2SkipIdentifier, sse2FindQuote, sse2CountNewlines};
+#endif
+            default:
+                return {scalarSkipWhitespace, scalarSkipIdentifier, scalarFindQuote, scalarCountNewlines};
+            }
+        }
+
+        Level currentLevel = detectLevel();
+        Kernels kernels = kernelsFor(currentLevel);
+    }
+
+    Level detectLevel()
+    {
+#ifdef SCANNER_X86
+        // Needed since the level is detected during static initialization.
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Level::AVX2;
+        return Level::SSE2;
+#else
+        return Level::Scalar;
+#endif
+    }
+
+    Level getLevel()
+    {
+        return currentLevel;
+    }
+
+    void setLevel(Level level)
+    {
+        currentLevel = level;
+        kernels = kernelsFor(level);
+    }
+
+    const char *levelToString(Level level)
+    {
+        switch (level)
+        {
+        case Level::AVX2:
+            return "avx2";
+        case Level::SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+        }
+    }
+
+    const char *skipWhitespace(const char *begin, const char *end)
+    {
+        return kernels.skipWhitespace(begin, end);
+    }
+
+    const char *skipIdentifier(const char *begin, const char *end)
+    {
+        return kernels.skipIdentifier(begin, end);
+    }
+
+    const char *findQuote(const char *begin, const char *end)
+    {
+        return kernels.findQuote(begin, end);
+    }
+
+    std::size_t countNewlines(const char *begin, const char *end)
+    {
+        return kernels.countNewlines(begin, end);
+    }
+}
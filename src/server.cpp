@@ -0,0 +1,235 @@
+#include "server.hpp"
+#include "session.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace Ckc
+{
+    Server::Server(std::string socketPath, Backend::TargetMachineFactory createTargetMachine, unsigned threads)
+        : socketPath(std::move(socketPath)), createTargetMachine(std::move(createTargetMachine)), threads(std::max(1u, threads))
+    {
+    }
+
+    Server::~Server()
+    {
+        if (listener >= 0)
+        {
+            close(listener);
+            unlink(socketPath.c_str());
+        }
+    }
+
+    bool Server::listen(std::string &error)
+    {
+        sockaddr_un address;
+        if (!socketAddress(socketPath, address, error))
+            return false;
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0)
+        {
+            error = std::string("Could not create a socket: ") + std::strerror(errno);
+            return false;
+        }
+        auto fail = [&](const std::string &message)
+        {
+            error = message + ": " + std::strerror(errno);
+            close(listener);
+            listener = -1;
+            return false;
+        };
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            if (errno != EADDRINUSE)
+                return fail("Could not bind " + socketPath);
+            // Nobody answers on a socket left by a server that crashed.
+            const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            const bool alive = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+            if (probe >= 0)
+                close(probe);
+            if (alive)
+            {
+                errno = EADDRINUSE;
+                return fail("A server already listens on " + socketPath);
+            }
+            unlink(socketPath.c_str());
+            if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+                return fail("Could not bind " + socketPath);
+        }
+        // The server writes objects wherever it is asked to.
+        if (chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) < 0 || ::listen(listener, SOMAXCONN) < 0)
+        {
+            unlink(socketPath.c_str());
+            return fail("Could not listen on " + socketPath);
+        }
+        return true;
+    }
+
+    void Server::serve()
+    {
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threads; i++)
+            workers.emplace_back([this]()
+                                 { work(); });
+        work();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    void Server::stop()
+    {
+        stopping = true;
+        // Wakes up the threads waiting in accept().
+        if (listener >= 0)
+            shutdown(listener, SHUT_RDWR);
+    }
+
+    ServerStatistics Server::getStatistics()
+    {
+        std::lock_guard lock(mutex);
+        return statistics;
+    }
+
+    void Server::work()
+    {
+        // Kept from one request to the next, with the memory of its arena.
+        CompilationSession session(Options(), createTargetMachine);
+        while (!stopping)
+        {
+            const int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connection < 0)
+            {
+                if (stopping)
+                    break;
+                // Out of descriptors or memory, better luck once a request is answered.
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            // A client that stops sending does not hold a thread for long.
+            timeval timeout{10, 0};
+            setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            Request request;
+            bool received = false;
+            // A length the memory cannot hold drops the request, not the server.
+            try
+            {
+                received = readRequest(connection, request);
+            }
+            catch (const std::bad_alloc &)
+            {
+            }
+            if (!received)
+            {
+                // Counted before the client sees the connection closed.
+                {
+                    std::lock_guard lock(mutex);
+                    statistics.dropped++;
+                }
+                close(connection);
+                continue;
+            }
+            Options options;
+            // No more threads than the server was given, whatever the client asks.
+            options.jobs = std::clamp<std::uint32_t>(request.jobs, 1, threads);
+            options.pipeline = request.pipeline;
+            options.stream = request.stream;
+            options.cacheDirectory = request.cacheDirectory;
+            session.setOptions(options);
+            std::ostringstream diagnostics;
+            session.setDiagnostics(diagnostics);
+
+            Response response;
+            // A compiler bug fails the request, not the server.
+            try
+            {
+                response.compiled = session.compile(std::make_shared<Lexer::SourceBuffer>(std::move(request.source)), request.filename, request.objectFilename);
+            }
+            catch (const std::exception &exception)
+            {
+                diagnostics << "Internal compiler error: " << exception.what() << "\n";
+            }
+            response.diagnostics = diagnostics.str();
+            // Counted before the client has its response.
+            {
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                std::lock_guard lock(mutex);
+                statistics.requests++;
+                statistics.failed += !response.compiled;
+                statistics.totalSeconds += elapsed.count();
+                statistics.maxSeconds = std::max(statistics.maxSeconds, elapsed.count());
+            }
+            writeResponse(connection, response);
+            close(connection);
+        }
+    }
+
+    int Server::run()
+    {
+        // Taken by sigwait(), the child inherits the mask.
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &signals, nullptr);
+        while (true)
+        {
+            // The targets are already initialized in the child.
+            const pid_t child = fork();
+            if (child < 0)
+            {
+                std::cerr << "Could not start the server: " << std::strerror(errno) << std::endl;
+                return 1;
+            }
+            if (child == 0)
+            {
+                std::thread waiter([this]()
+                                   {
+                                       sigset_t stopping;
+                                       sigemptyset(&stopping);
+                                       sigaddset(&stopping, SIGINT);
+                                       sigaddset(&stopping, SIGTERM);
+                                       int signal;
+                                       sigwait(&stopping, &signal);
+                                       stop(); });
+                serve();
+                waiter.join();
+                auto served = getStatistics();
+                std::cerr << "Served " << served.requests << " request(s), " << served.failed << " failed, " << served.dropped << " dropped";
+                if (served.requests > 0)
+                    std::cerr << std::fixed << std::setprecision(2) << ", latency mean " << served.totalSeconds * 1000 / served.requests
+                              << " ms, max " << served.maxSeconds * 1000 << " ms";
+                std::cerr << std::endl;
+                // The socket belongs to the parent.
+                _exit(0);
+            }
+            int signal;
+            sigwait(&signals, &signal);
+            if (signal != SIGCHLD)
+                kill(child, SIGTERM);
+            int status;
+            while (waitpid(child, &status, 0) < 0 && errno == EINTR)
+                ;
+            if (signal != SIGCHLD || !WIFSIGNALED(status))
+                return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+            std::cerr << "The server crashed: " << strsignal(WTERMSIG(status)) << ", starting it again" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#include "session.hpp"
+#include "astCache.hpp"
+#include "frontend.hpp"
+#include "visitor/llvmVisitor.hpp"
+#include "visitor/printVisitor.hpp"
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace Ckc
+{
+    Backend::TargetMachineFactory hostTargetMachine(std::string &error)
+    {
+        static std::once_flag initialized;
+        std::call_once(initialized, []()
+                       {
+                           llvm::InitializeAllTargetInfos();
+                           llvm::InitializeAllTargets();
+                           llvm::InitializeAllTargetMCs();
+                           llvm::InitializeAllAsmParsers();
+                           llvm::InitializeAllAsmPrinters(); });
+        const std::string triple = llvm::sys::getDefaultTargetTriple();
+        const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+        if (target == nullptr)
+            return nullptr;
+        return [target, triple]()
+        { return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(triple, "generic", "", llvm::TargetOptions(), llvm::Optional<llvm::Reloc::Model>())); };
+    }
+
+    void CompilerState::reset()
+    {
+        arena.reset();
+        syntaxErrors = Parser::SyntaxErrors();
+        scopes.clear();
+        contextProvider = Context::ContextProvider();
+    }
+
+    CompilerState::Activation::Activation(CompilerState &state)
+        : state(state), previousArena(Parser::Arena::getCurrent()), previousErrors(Parser::SyntaxErrors::getCurrent()),
+          previousProvider(Context::ContextProvider::getInstance())
+    {
+        Parser::Arena::setCurrent(state.arena);
+        Parser::SyntaxErrors::setCurrent(state.syntaxErrors);
+        Context::ContextProvider::setCurrent(state.contextProvider);
+        std::swap(Lexer::LexerContext::context, state.scopes);
+    }
+
+    CompilerState::Activation::~Activation()
+    {
+        std::swap(Lexer::LexerContext::context, state.scopes);
+        Context::ContextProvider::setCurrent(previousProvider);
+        Parser::SyntaxErrors::setCurrent(previousErrors);
+        Parser::Arena::setCurrent(previousArena);
+    }
+
+    CompilationSession::CompilationSession(Options options, Backend::TargetMachineFactory createTargetMachine)
+        : options(std::move(options)), createTargetMachine(std::move(createTargetMachine))
+    {
+    }
+
+    bool CompilationSession::compile(std::shared_ptr<Lexer::SourceBuffer> source, const std::string &filename, const std::string &objectFilename)
+    {
+        // Nothing refers to the nodes of the previous compilation any more.
+        state.reset();
+        CompilerState::Activation activation(state);
+        return run(std::move(source), filename, objectFilename);
+    }
+
+    bool CompilationSession::run(std::shared_ptr<Lexer::SourceBuffer> source, const std::string &filename, const std::string &objectFilename)
+    {
+        // The cache holds the AST of the whole file, which the pipelined and
+        // streamed modes never have at once.
+        const bool useCache = !options.cacheDirectory.empty() && !options.stream && !options.pipeline;
+        std::uint64_t sourceHash = 0;
+        std::unique_ptr<Cache::AstFile> cached;
+        if (useCache)
+        {
+            sourceHash = Cache::hash(*source);
+            cached = Cache::AstFile::load(Cache::astPath(options.cacheDirectory, sourceHash), sourceHash);
+        }
+        // On a cache hit the source is not lexed at all.
+        Lexer::TokenStream ts(source, filename, options.stream || cached != nullptr);
+        ts.setDiagnostics(*diagnostics);
+
+        auto targetMachine = createTargetMachine();
+        auto context = std::make_shared<llvm::LLVMContext>();
+        auto module = std::make_shared<llvm::Module>("my cool jit", *context);
+        module->setDataLayout(targetMachine->createDataLayout());
+        module->setTargetTriple(targetMachine->getTargetTriple().str());
+        auto builder = std::make_shared<llvm::IRBuilder<>>(*context);
+        // Variables and labels of the code generator, the function table is the checker's.
+        Context::ContextProvider lowering;
+        visitor::llvmVisitor lv{context, builder, module, lowering};
+
+        // With --stream the object is emitted in parts while the file is read.
+        std::optional<Backend::PartialEmitter> emitter;
+        bool emitted = true;
+        Frontend::Result frontend;
+        if (options.stream)
+        {
+            emitter.emplace(*module, createTargetMachine, options.printLlvm ? &llvm::outs() : nullptr);
+            frontend = Frontend::runStreaming(ts, options.printAst, [&](Parser::NodeIdentifier node)
+                                              {
+                                                  lv.dispatch(node);
+                                                  emitted = emitted && emitter->flushIfLarge(); });
+        }
+        else if (options.pipeline)
+            frontend = Frontend::runPipeline(ts, options.printAst, [&lv](Parser::NodeIdentifier node)
+                                             { lv.dispatch(node); });
+        else if (cached != nullptr)
+        {
+            frontend.nodes = cached->roots;
+            for (auto &node : frontend.nodes)
+            {
+                if (!options.printAst)
+                    break;
+                visitor::PrintVisitor pv(ts);
+                pv.dispatch(node);
+                std::cout << std::endl;
+            }
+        }
+        else
+            frontend = Frontend::run(ts, options.jobs, options.printAst);
+        if (frontend.syntaxErrors > 0)
+        {
+            *diagnostics << "Error parsing file: " << frontend.syntaxErrors << " syntax error(s)\n";
+            return false;
+        }
+        if (frontend.typeError)
+            return false;
+        if (useCache && cached == nullptr && !Cache::storeAst(Cache::astPath(options.cacheDirectory, sourceHash), sourceHash, frontend.nodes))
+            *diagnostics << "Could not write the AST to " << options.cacheDirectory << "\n";
+        if (options.stream)
+            return emitted && emitter->finish(objectFilename);
+        if (!options.pipeline)
+        {
+            for (auto &node : frontend.nodes)
+                lv.dispatch(node);
+        }
+
+        if (options.printLlvm)
+            module->print(llvm::outs(), nullptr);
+
+        if (!options.cacheDirectory.empty())
+        {
+            Backend::CacheStatistics statistics;
+            const bool cachedEmit = Backend::emitCached(*module, createTargetMachine, objectFilename, options.cacheDirectory, options.jobs, statistics);
+            *diagnostics << "Object cache: " << statistics.hits << " hit(s), " << statistics.misses << " miss(es), " << statistics.uncached << " not cached\n";
+            return cachedEmit;
+        }
+        if (options.jobs > 1)
+            return Backend::emitObject(*module, createTargetMachine, objectFilename, options.jobs);
+        if (objectEmitter == nullptr)
+            objectEmitter = std::make_unique<Backend::ObjectEmitter>(createTargetMachine);
+        return objectEmitter->emit(*module, objectFilename);
+    }
+}
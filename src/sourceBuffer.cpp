@@ -0,0 +1,104 @@
+#include "sourceBuffer.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Lexer
+{
+    SourceBuffer::SourceBuffer(std::string content) : owned(std::move(content))
+    {
+        data = owned.data();
+        length = owned.size();
+    }
+
+    SourceBuffer::~SourceBuffer()
+    {
+        if (mapping != nullptr)
+            munmap(mapping, length);
+    }
+
+    std::shared_ptr<SourceBuffer> SourceBuffer::fromFile(const std::string &filename)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+            return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        {
+            close(fd);
+            return nullptr;
+        }
+        auto buffer = std::make_shared<SourceBuffer>(std::string());
+        // mmap refuses empty mappings, an empty file is simply an empty buffer.
+        if (st.st_size > 0)
+        {
+            void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close(fd);
+                return nullptr;
+            }
+            madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+            buffer->mapping = mapping;
+            buffer->data = static_cast<const char *>(mapping);
+            buffer->length = st.st_size;
+        }
+        close(fd);
+        return buffer;
+    }
+
+    void SourceBuffer::dropPages(const char *from, const char *to) const
+    {
+        if (mapping == nullptr)
+            return;
+        static const std::uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+        const std::uintptr_t first = (reinterpret_cast<std::uintptr_t>(from) + pageSize - 1) & ~(pageSize - 1);
+        const std::uintptr_t last = reinterpret_cast<std::uintptr_t>(to) & ~(pageSize - 1);
+        if (first < last)
+            madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+    }
+
+    std::shared_ptr<SourceBuffer> SourceBuffer::fromStream(std::istream &input)
+    {
+        std::string content{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+        return std::make_shared<SourceBuffer>(std::move(content));
+    }
+
+    void SourceBuffer::buildLineIndex()
+    {
+        lineOffsets.push_back(0);
+        for (std::size_t i = 0; i < length; i++)
+        {
+            if (data[i] == '\n')
+                lineOffsets.push_back(i + 1);
+        }
+    }
+
+    std::string_view SourceBuffer::getLine(int line)
+    {
+        std::call_once(lineIndexBuilt, [this]()
+                       { buildLineIndex(); });
+        if (line < 1 || std::size_t(line) > lineOffsets.size())
+            return "";
+        std::size_t start = lineOffsets[line - 1];
+        std::size_t stop = std::size_t(line) < lineOffsets.size() ? lineOffsets[line] - 1 : length;
+        while (stop > start && data[stop - 1] == '\r')
+            stop--;
+        return std::string_view(data + start, stop - start);
+    }
+
+    SourcePosition SourceBuffer::getPosition(std::size_t offset)
+    {
+        std::call_once(lineIndexBuilt, [this]()
+                       { buildLineIndex(); });
+        offset = std::min(offset, length);
+        // The last line starting at or before offset.
+        auto next = std::upper_bound(lineOffsets.begin(), lineOffsets.end(), offset);
+        const std::size_t line = next - lineOffsets.begin();
+        return {int(line), int(offset - lineOffsets[line - 1]) + 1};
+    }
+}
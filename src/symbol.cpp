@@ -0,0 +1,63 @@
+#include "symbol.hpp"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace Lexer
+{
+    namespace
+    {
+        // The deque never moves its elements, so the keys of the maps can view them.
+        // Symbols may be created and read from several threads: the shared
+        // table is locked, and each thread keeps the names it already interned
+        // so that lexing a known name takes no lock.
+        class Interner
+        {
+        public:
+            std::shared_mutex mutex;
+            std::deque<std::string> names{""};
+            std::unordered_map<std::string_view, Symbol::Id> ids{{names.front(), 0}};
+
+            static Interner &getInstance()
+            {
+                static Interner instance;
+                return instance;
+            }
+        };
+
+        thread_local std::unordered_map<std::string_view, Symbol::Id> knownIds;
+    }
+
+    Symbol::Symbol(std::string_view name)
+    {
+        auto known = knownIds.find(name);
+        if (known != knownIds.end())
+        {
+            id = known->second;
+            return;
+        }
+        Interner &interner = Interner::getInstance();
+        std::unique_lock lock(interner.mutex);
+        auto it = interner.ids.find(name);
+        if (it == interner.ids.end())
+        {
+            const Id newId = interner.names.size();
+            it = interner.ids.emplace(interner.names.emplace_back(name), newId).first;
+        }
+        id = it->second;
+        knownIds.emplace(it->first, id);
+    }
+
+    const std::string &Symbol::str() const
+    {
+        Interner &interner = Interner::getInstance();
+        std::shared_lock lock(interner.mutex);
+        return interner.names[id];
+    }
+
+    std::ostream &operator<<(std::ostream &os, const Symbol &symbol)
+    {
+        return os << symbol.str();
+    }
+}
@@ -0,0 +1,112 @@
+#include "threadPool.hpp"
+
+namespace Concurrency
+{
+    ThreadPool::ThreadPool(unsigned threads)
+    {
+        for (unsigned i = 0; i <= threads; i++)
+            queues.push_back(std::make_unique<Queue>());
+        try
+        {
+            for (unsigned i = 1; i <= threads; i++)
+                this->threads.emplace_back([this, i]()
+                                           { work(i); });
+        }
+        catch (...)
+        {
+            // The destructor does not run, join the workers already started.
+            stop();
+            throw;
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        stop();
+    }
+
+    void ThreadPool::stop()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    void ThreadPool::submit(std::function<void()> task)
+    {
+        Queue &queue = *queues[nextQueue++ % queues.size()];
+        {
+            std::lock_guard lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        pending++;
+        queued++;
+        // Taking the lock orders the notification after a worker's check of queued.
+        {
+            std::lock_guard lock(mutex);
+        }
+        wake.notify_one();
+    }
+
+    bool ThreadPool::runOne(std::size_t self)
+    {
+        std::function<void()> task;
+        for (std::size_t i = 0; i < queues.size() && !task; i++)
+        {
+            Queue &queue = *queues[(self + i) % queues.size()];
+            std::lock_guard lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+            if (i == 0)
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        if (!task)
+            return false;
+        queued--;
+        task();
+        if (--pending == 0)
+        {
+            std::lock_guard lock(mutex);
+            done.notify_all();
+        }
+        return true;
+    }
+
+    void ThreadPool::work(std::size_t self)
+    {
+        while (true)
+        {
+            if (runOne(self))
+                continue;
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [this]()
+                      { return stopping || queued > 0; });
+            if (stopping && queued == 0)
+                return;
+        }
+    }
+
+    void ThreadPool::wait()
+    {
+        while (pending > 0)
+        {
+            if (runOne(0))
+                continue;
+            std::unique_lock lock(mutex);
+            done.wait(lock, [this]()
+                      { return pending == 0 || queued > 0; });
+        }
+    }
+}
@@ -0,0 +1,97 @@
+#include "types.hpp"
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Type.h>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace Types
+{
+    namespace
+    {
+        // Indexed by id, they never change and are read without a lock.
+        const TypeInfo builtins[] = {
+            {.name = ""},
+            {.name = "void", .isVoid = true},
+            {.name = "bool", .width = 1, .isBoolean = true},
+            {.name = "number", .isLiteral = true},
+            {.name = "int8", .width = 8, .isSigned = true},
+            {.name = "int16", .width = 16, .isSigned = true},
+            {.name = "int32", .width = 32, .isSigned = true},
+            {.name = "int64", .width = 64, .isSigned = true},
+            {.name = "uint8", .width = 8},
+            {.name = "uint16", .width = 16},
+            {.name = "uint32", .width = 32},
+            {.name = "uint64", .width = 64},
+        };
+        constexpr TypeId::Id builtinCount = std::size(builtins);
+        static_assert(uint64.id + 1 == builtinCount);
+
+        // Types registered after the builtins, locked like the symbol table.
+        // The deque never moves its elements, so the keys of the maps can view them.
+        class Registry
+        {
+        public:
+            std::shared_mutex mutex;
+            std::deque<TypeInfo> types;
+            std::unordered_map<std::string_view, TypeId::Id> ids;
+
+            Registry()
+            {
+                for (TypeId::Id id = 0; id < builtinCount; id++)
+                    ids.emplace(builtins[id].name, id);
+            }
+
+            static Registry &getInstance()
+            {
+                static Registry instance;
+                return instance;
+            }
+        };
+
+        thread_local std::unordered_map<std::string_view, TypeId::Id> knownIds;
+    }
+
+    TypeId TypeId::named(std::string_view name)
+    {
+        auto known = knownIds.find(name);
+        if (known != knownIds.end())
+            return TypeId(known->second);
+        Registry &registry = Registry::getInstance();
+        std::unique_lock lock(registry.mutex);
+        auto it = registry.ids.find(name);
+        if (it == registry.ids.end())
+        {
+            const Id newId = builtinCount + registry.types.size();
+            it = registry.ids.emplace(registry.types.emplace_back(TypeInfo{.name = std::string(name)}).name, newId).first;
+        }
+        knownIds.emplace(it->first, it->second);
+        return TypeId(it->second);
+    }
+
+    const TypeInfo &TypeId::info() const
+    {
+        if (id < builtinCount)
+            return builtins[id];
+        Registry &registry = Registry::getInstance();
+        std::shared_lock lock(registry.mutex);
+        return registry.types[id - builtinCount];
+    }
+
+    llvm::Type *TypeId::llvmType(llvm::LLVMContext &context) const
+    {
+        const TypeInfo &type = info();
+        if (type.isVoid)
+            return llvm::Type::getVoidTy(context);
+        if (type.width == 0)
+            return nullptr;
+        return llvm::IntegerType::get(context, type.width);
+    }
+
+    std::ostream &operator<<(std::ostream &os, const TypeId &type)
+    {
+        return os << type.str();
+    }
+}
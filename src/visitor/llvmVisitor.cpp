@@ -1,5 +1,4 @@
 #include "visitor/llvmVisitor.hpp"
-#include <set>
 using namespace llvm;
 namespace visitor
 {
@@ -11,7 +10,7 @@ namespace visitor
 
     void llvmVisitor::visitNodeIf(Parser::NodeIf &node)
     {
-        node.condition.get()->accept(*this);
+        dispatch(node.condition);
         Value *condV = lastValue;
         BasicBlock *thenBB = BasicBlock::Create(*context, "then", Builder->GetInsertBlock()->getParent());
         BasicBlock *elseBB = BasicBlock::Create(*context, "else");
@@ -19,7 +18,7 @@ namespace visitor
         Builder->CreateCondBr(condV, thenBB, elseBB);
         Builder->SetInsertPoint(thenBB);
         enterBlock();
-        node.thenStatement.get()->accept(*this);
+        dispatch(node.thenStatement);
         exitBlock();
         Builder->CreateBr(mergeBB);
         Builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(elseBB);
@@ -27,7 +26,7 @@ namespace visitor
         if (node.elseStatement.has_value())
         {
             enterBlock();
-            node.elseStatement.value().get()->accept(*this);
+            dispatch(node.elseStatement.value());
             exitBlock();
         }
 
@@ -45,14 +44,43 @@ namespace visitor
             contextProvider.addBasicBlock(node.label, block);
         }
         Builder->CreateBr(block);
+        startUnreachableBlock();
     }
+    bool llvmVisitor::enterOperands(Parser::Node &node)
+    {
+        switch (node.kind)
+        {
+        case Parser::NodeKind::Cast:
+            currentType = static_cast<Parser::NodeCast &>(node).type;
+            return true;
+        case Parser::NodeKind::FunctionCall:
+            // visitNodeFunctionCall reports the unknown function.
+            return TheModule->getFunction(node.symbol_name.value()) != nullptr;
+        default:
+            return true;
+        }
+    }
+
+    void llvmVisitor::afterOperand(Parser::Node &node, std::size_t index)
+    {
+        if (node.kind == Parser::NodeKind::FunctionCall)
+        {
+            operands.push_back(lastValue);
+            return;
+        }
+        if (node.kind != Parser::NodeKind::BinOperator || index != 0)
+            return;
+        auto &binOperator = static_cast<Parser::NodeBinOperator &>(node);
+        if (binOperator.isLazyOperator())
+            return enterLazyRightOperand(binOperator);
+        operands.push_back(lastValue);
+    }
+
     void llvmVisitor::visitBinOperator(Parser::NodeBinOperator &node)
     {
         if (node.isLazyOperator())
             return visitLazyBinOperator(node);
-        node.left.get()->accept(*this);
-        Value *left = lastValue;
-        node.right.get()->accept(*this);
+        Value *left = operands.pop_back_val();
         Value *right = lastValue;
         lastValue = nullptr;
         switch (node.op)
@@ -109,99 +137,81 @@ namespace visitor
         }
     }
 
-    void llvmVisitor::visitLazyBinOperator(Parser::NodeBinOperator &node)
+    // The right operand of a lazy operator is only evaluated when the left
+    // one does not decide the result: branch to its block or to the merge.
+    void llvmVisitor::enterLazyRightOperand(Parser::NodeBinOperator &node)
     {
-        switch (node.op)
-        {
-        case Lexer::TokenType::LOGICAL_AND:
-        {
-            // Get left value
-            node.left.get()->accept(*this);
-            Value *left = Builder->CreateICmpNE(lastValue, ConstantInt::get(*context, APInt(1, 0, false)), "lefttmp");
-            // Create block for right value
-            BasicBlock *leftBlock = BasicBlock::Create(*context, "left", Builder->GetInsertBlock()->getParent());
-            BasicBlock *rightBlock = BasicBlock::Create(*context, "right");
-            BasicBlock *mergeBlock = BasicBlock::Create(*context, "merge");
+        Value *left = Builder->CreateICmpNE(lastValue, ConstantInt::get(*context, APInt(1, 0, false)), "lefttmp");
+        BasicBlock *leftBlock = BasicBlock::Create(*context, "left", Builder->GetInsertBlock()->getParent());
+        BasicBlock *rightBlock = BasicBlock::Create(*context, "right");
+        BasicBlock *mergeBlock = BasicBlock::Create(*context, "merge");
 
+        if (node.op == Lexer::TokenType::LOGICAL_AND)
             Builder->CreateCondBr(left, rightBlock, leftBlock);
-            Builder->SetInsertPoint(leftBlock);
-            Builder->CreateBr(mergeBlock);
-
-            // Create block for right value
-            Builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(rightBlock);
-            Builder->SetInsertPoint(rightBlock);
-            node.right.get()->accept(*this);
-            Value *right = Builder->CreateICmpNE(lastValue, ConstantInt::get(*context, APInt(1, 0, false)), "righttmp");
-            Builder->CreateBr(mergeBlock);
-            Builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(mergeBlock);
-            Builder->SetInsertPoint(mergeBlock);
-
-            PHINode *PN = Builder->CreatePHI(Type::getInt1Ty(*context), 2, "iftmp");
-            PN->addIncoming(left, leftBlock);
-            PN->addIncoming(right, rightBlock);
-            lastValue = PN;
-        }
-        break;
-        case Lexer::TokenType::LOGICAL_OR:
-        {
-            // Get left value
-            node.left.get()->accept(*this);
-            Value *left = Builder->CreateICmpNE(lastValue, ConstantInt::get(*context, APInt(1, 0, false)), "lefttmp");
-            // Create block for right value
-            BasicBlock *leftBlock = BasicBlock::Create(*context, "left", Builder->GetInsertBlock()->getParent());
-            BasicBlock *rightBlock = BasicBlock::Create(*context, "right");
-            BasicBlock *mergeBlock = BasicBlock::Create(*context, "merge");
-
+        else
             Builder->CreateCondBr(left, leftBlock, rightBlock);
-            Builder->SetInsertPoint(leftBlock);
-            Builder->CreateBr(mergeBlock);
+        Builder->SetInsertPoint(leftBlock);
+        Builder->CreateBr(mergeBlock);
 
-            // Create block for right value
-            Builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(rightBlock);
-            Builder->SetInsertPoint(rightBlock);
-            node.right.get()->accept(*this);
-            Value *right = Builder->CreateICmpNE(lastValue, ConstantInt::get(*context, APInt(1, 0, false)), "righttmp");
-            Builder->CreateBr(mergeBlock);
-            Builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(mergeBlock);
-            Builder->SetInsertPoint(mergeBlock);
+        Builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(rightBlock);
+        Builder->SetInsertPoint(rightBlock);
+        operands.push_back(left);
+        lazyBlocks.push_back(leftBlock);
+        lazyBlocks.push_back(rightBlock);
+        lazyBlocks.push_back(mergeBlock);
+    }
 
-            PHINode *PN = Builder->CreatePHI(Type::getInt1Ty(*context), 2, "iftmp");
-            PN->addIncoming(left, leftBlock);
-            PN->addIncoming(right, rightBlock);
-            lastValue = PN;
-        }
-        break;
-        default:
-            LogError("Unknown binary operator");
-            break;
-        }
+    void llvmVisitor::visitLazyBinOperator(Parser::NodeBinOperator &node)
+    {
+        BasicBlock *mergeBlock = lazyBlocks.pop_back_val();
+        BasicBlock *rightBlock = lazyBlocks.pop_back_val();
+        BasicBlock *leftBlock = lazyBlocks.pop_back_val();
+        Value *left = operands.pop_back_val();
+        Value *right = Builder->CreateICmpNE(lastValue, ConstantInt::get(*context, APInt(1, 0, false)), "righttmp");
+        Builder->CreateBr(mergeBlock);
+        Builder->GetInsertBlock()->getParent()->getBasicBlockList().push_back(mergeBlock);
+        Builder->SetInsertPoint(mergeBlock);
+
+        PHINode *PN = Builder->CreatePHI(Type::getInt1Ty(*context), 2, "iftmp");
+        PN->addIncoming(left, leftBlock);
+        PN->addIncoming(right, rightBlock);
+        lastValue = PN;
     }
 
     void llvmVisitor::visitNode(Parser::Node &node){};
     void llvmVisitor::visitNodeNumber(Parser::NodeNumber &node)
     {
-        lastValue = typeWithInitialValueContext.get(currentType).value()(node.value);
+        // Literals of no known type are 32 bits wide.
+        const Types::TypeInfo &type = currentType.info();
+        lastValue = ConstantInt::get(IntegerType::get(*context, type.width > 0 ? type.width : 32), node.value, type.isSigned);
     };
     void llvmVisitor::visitNodeVariableDeclaration(Parser::NodeVariableDeclaration &node)
     {
         currentType = node.type;
-        std::map<std::string, llvm::Type *> typeMap{
-            {"uint8", Type::getInt8Ty(*context)},
-            {"uint16", Type::getInt16Ty(*context)},
-            {"uint32", Type::getInt32Ty(*context)},
-            {"uint64", Type::getInt64Ty(*context)},
-            {"int8", Type::getInt8Ty(*context)},
-            {"int16", Type::getInt16Ty(*context)},
-            {"int32", Type::getInt32Ty(*context)},
-            {"int64", Type::getInt64Ty(*context)},
-            {"bool", Type::getInt1Ty(*context)}};
-        //
+        llvm::Type *type = node.type.llvmType(*context);
+        // Outside of any function the variable is a global, initialized with a constant.
+        if (Builder->GetInsertBlock() == nullptr)
+        {
+            Constant *initializer = Constant::getNullValue(type);
+            // The type checker rejects other initializers, they would need an insert point.
+            if (node.value.has_value() && Parser::isConstantExpression(node.value.value()))
+            {
+                dispatch(node.value.value());
+                if (auto constant = dyn_cast<Constant>(lastValue))
+                    initializer = constant;
+            }
+            else if (node.value.has_value())
+                LogError("Global variables must be initialized with a constant");
+            auto global = new GlobalVariable(*TheModule, type, false, GlobalValue::ExternalLinkage, initializer, node.symbol_name.value_or(node.name.str()));
+            contextProvider.addVariable(node.name, global, type, node.type);
+            return;
+        }
         // auto *block = Builder->GetInsertBlock();
-        auto *alloca = Builder->CreateAlloca(typeMap[node.type], 0, node.name);
-        contextProvider.addVariable(node.name, alloca, node.type);
+        auto *alloca = Builder->CreateAlloca(type, 0, node.name.str());
+        contextProvider.addVariable(node.name, alloca, type, node.type);
         if (!node.value.has_value())
             return;
-        node.value.value().get()->accept(*this);
+        dispatch(node.value.value());
         Builder->CreateStore(lastValue, alloca);
     };
     void llvmVisitor::visitNodeVariableAssignment(Parser::NodeVariableAssignment &node)
@@ -213,7 +223,7 @@ namespace visitor
             return;
         }
         currentType = variable.type;
-        node.value.get()->accept(*this);
+        dispatch(node.value);
         Builder->CreateStore(lastValue, variable.value);
     }
     void llvmVisitor::visitNodeBlockModifier(Parser::NodeBlockModifier &node)
@@ -238,13 +248,13 @@ namespace visitor
     void llvmVisitor::visitNodeText(Parser::NodeText &node)
     {
 
-        auto alloca = contextProvider.getVariable(node.name).value;
-        if (alloca == nullptr)
+        auto variable = contextProvider.getVariable(node.name);
+        if (variable.value == nullptr)
         {
             LogError("Unknown variable name");
             return;
         }
-        lastValue = Builder->CreateLoad(alloca->getAllocatedType(), alloca, node.name.c_str());
+        lastValue = Builder->CreateLoad(variable.valueType, variable.value, node.name.str());
     }
 
     void llvmVisitor::visitNodeReturn(Parser::NodeReturn &node)
@@ -252,16 +262,17 @@ namespace visitor
         if (!node.value.has_value())
         {
             Builder->CreateRetVoid();
+            startUnreachableBlock();
             return;
         }
         currentType = node.value.value().get<Parser::NodeExpression>()->type;
-        node.value.value()->accept(*this);
+        dispatch(node.value.value());
         Builder->CreateRet(lastValue);
+        startUnreachableBlock();
     }
 
     void llvmVisitor::visitNodeUnaryOperator(Parser::NodeUnaryOperator &node)
     {
-        node.right.get()->accept(*this);
         switch (node.op)
         {
         case Lexer::TokenType::OPERATOR_NOT:
@@ -285,48 +296,28 @@ namespace visitor
     void llvmVisitor::visitNodeFunction(Parser::NodeFunction &node)
     {
         lastValue = nullptr;
-        std::map<std::string, std::function<llvm::Type *()>> typeMap{
-            {"uint8", [&]()
-             { return llvm::Type::getInt8Ty(*context); }},
-            {"uint16", [&]()
-             { return llvm::Type::getInt16Ty(*context); }},
-            {"uint32", [&]()
-             { return llvm::Type::getInt32Ty(*context); }},
-            {"uint64", [&]()
-             { return llvm::Type::getInt64Ty(*context); }},
-            {"int8", [&]()
-             { return llvm::Type::getInt8Ty(*context); }},
-            {"int16", [&]()
-             { return llvm::Type::getInt16Ty(*context); }},
-            {"int32", [&]()
-             { return llvm::Type::getInt32Ty(*context); }},
-            {"int64", [&]()
-             { return llvm::Type::getInt64Ty(*context); }},
-            {"void", [&]()
-             { return llvm::Type::getVoidTy(*context); }},
-            {"bool", [&]()
-             { return llvm::Type::getInt1Ty(*context); }}};
         std::vector<Type *> args;
         for (auto &arg : node.arguments)
-        {
-            args.push_back(typeMap[arg.first]());
-        }
-        auto funcType = FunctionType::get(typeMap[node.returnType.value_or("void")](), args, false);
+            args.push_back(arg.first.llvmType(*context));
+        auto funcType = FunctionType::get(node.returnType.value_or(Types::voidType).llvmType(*context), args, false);
         auto Function = Function::Create(funcType, Function::ExternalLinkage, node.symbol_name.value(), TheModule.get());
         // contextProvider.addNameTranslation(node.name, node.symbol_name);
         // Set names for all arguments.
         int i = 0;
         for (auto &arg : Function->args())
         {
-            arg.setName(node.arguments[i].second);
+            arg.setName(node.arguments[i].second.str());
             i++;
         }
         if (!node.body.has_value())
             return;
+        // Insertion goes back to the enclosing function, if any, once the body is lowered.
+        BasicBlock *outer = Builder->GetInsertBlock();
         // Create a new basic block to start insertion into.
         BasicBlock *BB = BasicBlock::Create(*context, "entry", Function);
         Builder->SetInsertPoint(BB);
 
+        auto outerLabels = contextProvider.takeBasicBlocks();
         // Create allocas for all arguments
         contextProvider.enterScope();
         i = 0;
@@ -334,17 +325,23 @@ namespace visitor
         {
             auto *alloca = Builder->CreateAlloca(arg.getType(), 0, arg.getName());
             Builder->CreateStore(&arg, alloca);
-            contextProvider.addVariable(arg.getName(), alloca, node.arguments[i].first);
+            contextProvider.addVariable(node.arguments[i].second, alloca, arg.getType(), node.arguments[i].first);
             i++;
         }
-        node.body.value().get()->accept(*this);
+        dispatch(node.body.value());
         contextProvider.exitScope();
+        contextProvider.restoreBasicBlocks(std::move(outerLabels));
         if (!node.returnType.has_value())
         {
             Builder->CreateRetVoid();
+            startUnreachableBlock();
         }
         // No code should reach this point.
         Builder->CreateUnreachable();
+        if (outer != nullptr)
+            Builder->SetInsertPoint(outer);
+        else
+            Builder->ClearInsertionPoint();
     }
     void llvmVisitor::visitNodeFunctionCall(Parser::NodeFunctionCall &node)
     {
@@ -354,12 +351,8 @@ namespace visitor
             LogError("Unknown function referenced");
             return;
         }
-        std::vector<Value *> args;
-        for (auto &arg : node.arguments)
-        {
-            arg.get()->accept(*this);
-            args.push_back(lastValue);
-        }
+        std::vector<Value *> args(operands.end() - node.arguments.size(), operands.end());
+        operands.truncate(operands.size() - node.arguments.size());
         lastValue = Builder->CreateCall(callee, args, "calltmp");
     }
 
@@ -369,12 +362,9 @@ namespace visitor
 
     void llvmVisitor::visitNodeCast(Parser::NodeCast &node)
     {
-        currentType = node.type;
-        node.value->accept(*this);
-        llvm::Type *type = typeNameContext.get(node.type).value()();
+        llvm::Type *type = node.type.llvmType(*context);
 
-        std::set<std::string> signedType{"int8", "int16", "int32", "int64"};
-        if (signedType.find(node.type) != signedType.end())
+        if (node.type.info().isSigned)
             lastValue = Builder->CreateCast(Instruction::CastOps::SExt, lastValue, type);
         else
             lastValue = Builder->CreateCast(Instruction::CastOps::Trunc, lastValue, type);
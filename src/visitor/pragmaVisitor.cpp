@@ -1,17 +1,30 @@
 #include "visitor/pragmaVisitor.hpp"
-#include <iostream>
+#include "contextProvider.hpp"
+#include "exception/pragma_error.hpp"
 
 namespace visitor
 {
+    // Calls checked from now on use the new name of an overload already declared.
+    static void renameOverload(std::map<Lexer::Symbol, Context::functionType> &functions, Parser::NodeFunction &function, const std::string &symbolName)
+    {
+        auto found = functions.find(function.name);
+        if (found == functions.end())
+            return;
+        for (auto &overload : found->second.overloads)
+        {
+            if (overload.token.has_value() && overload.token.value() == function.functionToken)
+                overload.symbolName = symbolName;
+        }
+    }
 
     void pragmaVisitor::visitNodeIf(Parser::NodeIf &node)
     {
         pragmaContext.enterScope();
-        node.thenStatement.get()->accept(*this);
+        dispatch(node.thenStatement);
         pragmaContext.exitScope();
         pragmaContext.enterScope();
         if (node.elseStatement.has_value())
-            node.elseStatement.value().get()->accept(*this);
+            dispatch(node.elseStatement.value());
         pragmaContext.exitScope();
     }
 
@@ -36,7 +49,7 @@ namespace visitor
         pragmaContext.add(node.name, &node);
         pragmaContext.enterScope();
         if (node.body.has_value())
-            node.body.value().get()->accept(*this);
+            dispatch(node.body.value());
         pragmaContext.exitScope();
     }
 
@@ -45,21 +58,19 @@ namespace visitor
     void pragmaVisitor::visitNodePragma(Parser::NodePragma &node)
     {
         // Check if target object exists
-        auto targetObjectNode = pragmaContext.get(node.targetObject.value);
+        auto targetObjectNode = pragmaContext.get(node.targetObject.symbol);
         if (!targetObjectNode.has_value())
-        {
-            std::cerr << "Error: pragma target object " << node.targetObject.value << " does not exist" << std::endl;
-            exit(1);
-        }
+            throw pragma_error("Pragma target object " + std::string(node.targetObject.value) + " does not exist", node.thisNode);
 
         switch (node.pragmaType)
         {
         case Lexer::TokenType::SYMBOL_NAME:
             targetObjectNode.value()->setSymbolName(node.value);
+            if (Parser::NodeFunction::classof(targetObjectNode.value()))
+                renameOverload(contextProvider->functions, *static_cast<Parser::NodeFunction *>(targetObjectNode.value()), node.value);
             break;
         default:
-            std::cerr << "Error: pragma type " << Lexer::tokenTypeToString(node.pragmaType) << " not implemented" << std::endl;
-            exit(1);
+            throw pragma_error("Pragma type " + Lexer::tokenTypeToString(node.pragmaType) + " not implemented", node.thisNode);
         }
     }
     void pragmaVisitor::visitNodeCast(Parser::NodeCast &node) {};
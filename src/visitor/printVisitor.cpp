@@ -4,11 +4,12 @@ namespace visitor
 {
     void PrintVisitor::enterNode(Parser::Node &node)
     {
-        if (!node.token.has_value())
+        if (node.span.empty())
             return;
-        if (node.token.value().line != currentLine)
+        const int line = ts.positionOf(node.span.begin).line;
+        if (line != currentLine)
         {
-            currentLine = node.token.value().line;
+            currentLine = line;
             out << std::endl;
             out << std::right << std::setfill(' ') << std::setw(4) << currentLine << std::left << std::setw(5) << " |" ;
         }
@@ -17,15 +18,15 @@ namespace visitor
     void PrintVisitor::visitNodeIf(Parser::NodeIf &node)
     {
         if (node.modifier.has_value())
-            node.modifier.value().get()->accept(*this);
+            dispatch(node.modifier.value());
         out << "if ";
-        node.condition.get()->accept(*this);
+        dispatch(node.condition);
         out << " then ";
-        node.thenStatement.get()->accept(*this);
+        dispatch(node.thenStatement);
         if (node.elseStatement)
         {
             out << " else ";
-            node.elseStatement.value().get()->accept(*this);
+            dispatch(node.elseStatement.value());
         }
         out << " fi";
     }
@@ -33,21 +34,43 @@ namespace visitor
     {
         out << "goto " << node.label;
     }
-    void PrintVisitor::visitBinOperator(Parser::NodeBinOperator &node)
+    bool PrintVisitor::enterOperands(Parser::Node &node)
     {
-        out << "(";
-        node.left.get()->accept(*this);
-        out << " " << Lexer::tokenTypeToString(node.op) << " ";
-        node.right.get()->accept(*this);
-        out << ")";
+        switch (node.kind)
+        {
+        case Parser::NodeKind::BinOperator:
+            out << "(";
+            break;
+        case Parser::NodeKind::UnaryOperator:
+            out << Lexer::tokenTypeToString(static_cast<Parser::NodeUnaryOperator &>(node).op) << " ";
+            break;
+        case Parser::NodeKind::FunctionCall:
+            out << static_cast<Parser::NodeFunctionCall &>(node).name << "(";
+            break;
+        case Parser::NodeKind::Cast:
+            out << static_cast<Parser::NodeCast &>(node).type << "(";
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    void PrintVisitor::afterOperand(Parser::Node &node, std::size_t index)
+    {
+        if (node.kind == Parser::NodeKind::BinOperator && index == 0)
+            out << " " << Lexer::tokenTypeToString(static_cast<Parser::NodeBinOperator &>(node).op) << " ";
+        else if (node.kind == Parser::NodeKind::FunctionCall && index + 1 < static_cast<Parser::NodeFunctionCall &>(node).arguments.size())
+            out << ", ";
     }
 
-    void PrintVisitor::visitNodeUnaryOperator(Parser::NodeUnaryOperator &node)
+    void PrintVisitor::visitBinOperator(Parser::NodeBinOperator &node)
     {
-        out << Lexer::tokenTypeToString(node.op) << " ";
-        node.right.get()->accept(*this);
+        out << ")";
     }
 
+    void PrintVisitor::visitNodeUnaryOperator(Parser::NodeUnaryOperator &node) {}
+
     void PrintVisitor::visitNode(Parser::Node &node)
     {
         // out << node.value;
@@ -59,21 +82,21 @@ namespace visitor
     void PrintVisitor::visitNodeVariableDeclaration(Parser::NodeVariableDeclaration &node)
     {
         if (node.modifier.has_value())
-            node.modifier.value().get()->accept(*this);
+            dispatch(node.modifier.value());
         out << node.type << " " << node.name;
         if (node.value)
         {
             out << " = ";
-            node.value.value().get()->accept(*this);
+            dispatch(node.value.value());
         }
     }
 
     void PrintVisitor::visitNodeVariableAssignment(Parser::NodeVariableAssignment &node)
     {
         if (node.modifier.has_value())
-            node.modifier.value().get()->accept(*this);
+            dispatch(node.modifier.value());
         out << node.name << " = ";
-        node.value.get()->accept(*this);
+        dispatch(node.value);
     }
     void PrintVisitor::visitNodeBlockModifier(Parser::NodeBlockModifier &node)
     {
@@ -89,7 +112,7 @@ namespace visitor
     {
         out << "return ";
         if (node.value.has_value())
-            node.value.value()->accept(*this);
+            dispatch(node.value.value());
     }
 
     void PrintVisitor::visitNodeFunction(Parser::NodeFunction &node)
@@ -106,20 +129,11 @@ namespace visitor
         if (node.returnType.has_value())
             out << " return " << node.returnType.value();
         if (node.body.has_value())
-            node.body.value().get()->accept(*this);
+            dispatch(node.body.value());
     }
 
     void PrintVisitor::visitNodeFunctionCall(Parser::NodeFunctionCall &node)
     {
-        out << node.name << "(";
-        for (ssize_t i = 0; i < ssize_t(node.arguments.size() - 1); i++)
-        {
-            node.arguments[i].get()->accept(*this);
-            out << ", ";
-        }
-        if (node.arguments.size() > 0)
-            (node.arguments.end() - 1)->get()->accept(*this);
-
         out << ")";
     }
 
@@ -131,8 +145,6 @@ namespace visitor
 
     void PrintVisitor::visitNodeCast(Parser::NodeCast &node)
     {
-        out << node.type << "(";
-        node.value->accept(*this);
         out << ")";
     }
 
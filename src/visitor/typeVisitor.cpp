@@ -4,29 +4,27 @@
 namespace visitor
 {
 
-    std::optional<std::string> resolve_collision(std::string typeA, std::string typeB, std::string default_type)
+    std::optional<Types::TypeId> resolve_collision(Types::TypeId typeA, Types::TypeId typeB)
     {
         if (typeA == typeB)
             return typeA;
-        if (typeA == "number" && typeB == "number")
-            return default_type;
-        if (typeA == "number")
+        if (typeA == Types::number)
             return typeB;
-        if (typeB == "number")
+        if (typeB == Types::number)
             return typeA;
         return std::nullopt;
     }
     void typeVisitor::visitNodeIf(Parser::NodeIf &node)
     {
-        hintType = "bool";
-        node.condition->accept(*this);
-        hintType = "";
-        if (lastType != "bool")
-            throw type_error("bool", lastType, node.thisNode);
-        node.thenStatement->accept(*this);
+        hintType = Types::boolType;
+        dispatch(node.condition);
+        hintType = Types::none;
+        if (lastType != Types::boolType)
+            throw type_error(Types::boolType, lastType, node.condition);
+        dispatch(node.thenStatement);
         if (node.elseStatement.has_value())
-            node.elseStatement.value()->accept(*this);
-        lastType = "";
+            dispatch(node.elseStatement.value());
+        lastType = Types::none;
     }
     void typeVisitor::visitNodeGoto(Parser::NodeGoto &node)
     {
@@ -34,44 +32,63 @@ namespace visitor
 
     void typeVisitor::visitBinOperatorBoolean(Parser::NodeBinOperator &node)
     {
-        std::string leftType = node.left.get<Parser::NodeExpression>()->type;
-        std::string rightType = node.right.get<Parser::NodeExpression>()->type;
-        if (!resolve_collision(leftType, "bool", "bool").has_value() || !resolve_collision(rightType, "bool", "bool").has_value())
+        Types::TypeId leftType = node.left.get<Parser::NodeExpression>()->type;
+        Types::TypeId rightType = node.right.get<Parser::NodeExpression>()->type;
+        if (!resolve_collision(leftType, Types::boolType).has_value() || !resolve_collision(rightType, Types::boolType).has_value())
             throw different_type_error(node.left, node.right);
-        node.type = "bool";
-        lastType = "bool";
+        node.type = Types::boolType;
+        lastType = Types::boolType;
     }
 
     void typeVisitor::visitBinOperatorComparison(Parser::NodeBinOperator &node)
     {
-        std::string leftType = node.left.get<Parser::NodeExpression>()->type;
-        std::string rightType = node.right.get<Parser::NodeExpression>()->type;
-        if (!resolve_collision(leftType, rightType, "number").has_value())
+        Types::TypeId leftType = node.left.get<Parser::NodeExpression>()->type;
+        Types::TypeId rightType = node.right.get<Parser::NodeExpression>()->type;
+        if (!resolve_collision(leftType, rightType).has_value())
             throw different_type_error(node.left, node.right);
-        node.type = "bool";
-        lastType = "bool";
+        node.type = Types::boolType;
+        lastType = Types::boolType;
+    }
+
+    bool typeVisitor::enterOperands(Parser::Node &node)
+    {
+        switch (node.kind)
+        {
+        case Parser::NodeKind::BinOperator:
+            hints.push_back(hintType);
+            hintType = Types::number;
+            break;
+        case Parser::NodeKind::UnaryOperator:
+            if (Lexer::isBooleanOperator(static_cast<Parser::NodeUnaryOperator &>(node).op))
+                hintType = Types::boolType;
+            break;
+        case Parser::NodeKind::Cast:
+            hintType = Types::number;
+            break;
+        default:
+            break;
+        }
+        return true;
     }
 
     void typeVisitor::visitBinOperator(Parser::NodeBinOperator &node)
     {
-        std::string hint = hintType;
-        hintType = "number";
-        node.left->accept(*this);
-        node.right->accept(*this);
+        Types::TypeId hint = hints.back();
+        hints.pop_back();
         if (node.isBooleanOperator())
             return visitBinOperatorBoolean(node);
         if (node.isComparisonOperator())
             return visitBinOperatorComparison(node);
 
-        std::string leftType = node.left.get<Parser::NodeExpression>()->type;
-        std::string rightType = node.right.get<Parser::NodeExpression>()->type;
+        Types::TypeId leftType = node.left.get<Parser::NodeExpression>()->type;
+        Types::TypeId rightType = node.right.get<Parser::NodeExpression>()->type;
 
         // Check if left and righ types are compatible
-        auto type = resolve_collision(leftType, rightType, "number");
+        auto type = resolve_collision(leftType, rightType);
         if (!type.has_value())
             throw different_type_error(node.left, node.right);
         // Check if hint is compatible with left and right types
-        auto expressionType = resolve_collision(type.value(), hint, "number");
+        auto expressionType = resolve_collision(type.value(), hint);
         if (!expressionType.has_value())
             throw type_error(hint, type.value(), node.thisNode);
 
@@ -83,7 +100,7 @@ namespace visitor
 
     void typeVisitor::visitNodeNumber(Parser::NodeNumber &node)
     {
-        lastType = resolve_collision("number", hintType, "number").value();
+        lastType = resolve_collision(Types::number, hintType).value();
         node.type = lastType;
     }
 
@@ -91,19 +108,29 @@ namespace visitor
     {
         if (node.value.has_value())
         {
+            // On error the variable is declared all the same, the blocks
+            // checked after a global use it.
+            if (!currentFunction.has_value() && !Parser::isConstantExpression(node.value.value()))
+            {
+                variables.add(node.name, node.type);
+                throw constant_error(node.value.value());
+            }
             hintType = node.type;
-            node.value.value()->accept(*this);
+            dispatch(node.value.value());
             if (node.type != lastType)
+            {
+                variables.add(node.name, node.type);
                 throw type_error(node.type, lastType, node.thisNode);
+            }
         }
         variables.add(node.name, node.type);
-        lastType = "";
+        lastType = Types::none;
     }
     void typeVisitor::visitNodeVariableAssignment(Parser::NodeVariableAssignment &node)
     {
-        std::string type = variables.get(node.name).value();
+        Types::TypeId type = variables.get(node.name).value();
         hintType = type;
-        node.value->accept(*this);
+        dispatch(node.value);
         if (type != lastType)
             throw type_error(type, lastType, node.thisNode);
     }
@@ -121,33 +148,30 @@ namespace visitor
         if (function.returnType.has_value())
         {
             hintType = function.returnType.value();
-            node.value.value()->accept(*this);
+            dispatch(node.value.value());
             if (function.returnType.value() != lastType)
                 throw type_error(function.returnType.value(), lastType, node.value.value());
         }
         else
         {
             if (node.value.has_value())
-                throw type_error("void", lastType, node.value.value());
+                throw type_error(Types::voidType, lastType, node.value.value());
         }
-        lastType = "";
-        hintType = "";
+        lastType = Types::none;
+        hintType = Types::none;
     }
     void typeVisitor::visitNodeUnaryOperator(Parser::NodeUnaryOperator &node)
     {
-        if (node.token.value().isBooleanOperator())
+        if (Lexer::isBooleanOperator(node.op))
         {
-            hintType = "bool";
-            node.right->accept(*this);
-            if (lastType != "bool")
-                throw type_error("bool", lastType, node.thisNode);
-            lastType = "bool";
+            if (lastType != Types::boolType)
+                throw type_error(Types::boolType, lastType, node.thisNode);
+            lastType = Types::boolType;
             return;
         }
-        node.right->accept(*this);
-        std::string type = lastType;
-        std::string hint = hintType;
-        auto nodeType = resolve_collision(type, hint, "number");
+        Types::TypeId type = lastType;
+        Types::TypeId hint = hintType;
+        auto nodeType = resolve_collision(type, hint);
         if (!nodeType.has_value())
             throw type_error(hint, type, node.thisNode);
         lastType = nodeType.value();
@@ -155,7 +179,12 @@ namespace visitor
     }
     void typeVisitor::visitNodeFunction(Parser::NodeFunction &node)
     {
+        declareFunction(node);
+        checkFunctionBody(node);
+    }
 
+    void typeVisitor::declareFunction(Parser::NodeFunction &node)
+    {
         // Register function
         if (contextProvider.functions.find(node.name) == contextProvider.functions.end())
         {
@@ -166,62 +195,170 @@ namespace visitor
         if (contextProvider.functions[node.name].returnType != node.returnType)
             throw type_error(contextProvider.functions[node.name].returnType.value(), node.returnType.value(), node.thisNode);
 
-        std::vector<std::string> types;
-        variables.enterScope();
+        std::vector<Types::TypeId> types;
         for (auto &arg : node.arguments)
-        {
             types.push_back(arg.first);
-            variables.add(arg.second, arg.first);
-        }
         if (!node.symbol_name.has_value() && contextProvider.functions[node.name].getOverloadCount() == 0)
-            node.symbol_name = node.name;
+            node.symbol_name = node.name.str();
         else if (!node.symbol_name.has_value())
-            node.symbol_name = node.name + "_" + std::to_string(contextProvider.functions[node.name].getOverloadCount());
-        if (contextProvider.functions[node.name].hasOverload(types))
-            throw function_definition_error(contextProvider.functions[node.name].getDefinition(types).value().node, node.thisNode);
-        contextProvider.functions[node.name].add(types,node.returnType.value(), node.thisNode);
+            node.symbol_name = node.name.str() + "_" + std::to_string(contextProvider.functions[node.name].getOverloadCount());
+        if (auto definition = contextProvider.functions[node.name].getDefinition(types))
+            throw function_definition_error(definition->token, node.thisNode);
+        contextProvider.functions[node.name].add(types, node.returnType.value(), node.functionToken, node.symbol_name.value());
+    }
 
+    void typeVisitor::checkFunctionBody(Parser::NodeFunction &node)
+    {
+        const std::size_t depth = variables.depth();
+        variables.enterScope();
+        for (auto &arg : node.arguments)
+            variables.add(arg.second, arg.first);
         currentFunction = node.name;
-        if (node.body.has_value())
-            node.body.value()->accept(*this);
-        variables.exitScope();
-        currentFunction = std::nullopt;
+        currentFunctionToken = node.functionToken;
+        auto leave = [this, depth]()
+        {
+            while (variables.depth() > depth)
+                variables.exitScope();
+            currentFunction = std::nullopt;
+            currentFunctionToken = std::nullopt;
+        };
+        // The blocks checked after a type error do not see its locals.
+        try
+        {
+            if (node.body.has_value())
+                dispatch(node.body.value());
+        }
+        catch (...)
+        {
+            leave();
+            throw;
+        }
+        leave();
+    }
+
+    // Overloads declared after the function being checked are not visible
+    // from it, even when every signature was collected beforehand.
+    bool declaredAfter(const Context::functionType::functionInfo &overload, const std::optional<Lexer::Token> &function)
+    {
+        if (!function.has_value() || !overload.token.has_value())
+            return false;
+        const Lexer::Token &token = overload.token.value();
+        return token.line > function->line || (token.line == function->line && token.column > function->column);
     }
+
     void typeVisitor::visitNodeFunctionCall(Parser::NodeFunctionCall &node)
     {
-        auto function = contextProvider.functions[node.name];
-        std::vector<std::string> argumentsTypes;
+        auto resolved = resolvedCalls.find(node.thisNode.get());
+        if (resolved != resolvedCalls.end())
+        {
+            if (!resolved->second)
+                throw type_error("function", "no matching function call", node.thisNode);
+            lastType = node.type;
+            return;
+        }
+
+        callDepth++;
+        bool matched;
+        try
+        {
+            if (callDepth == maxCallNesting)
+                resolveNestedCalls(node);
+            matched = resolveCall(node);
+        }
+        catch (...)
+        {
+            finishCall();
+            throw;
+        }
+        finishCall();
+        if (!matched)
+            throw type_error("function", "no matching function call", node.thisNode);
+    }
+
+    void typeVisitor::finishCall()
+    {
+        if (--callDepth > 0)
+            return;
+        argumentTypes.clear();
+        resolvedCalls.clear();
+    }
 
-        // Search for corresponding overloaded function
-        for (auto parameter : function.getAllTypes())
+    void typeVisitor::resolveNestedCalls(Parser::NodeFunctionCall &node)
+    {
+        // Innermost first: the arguments of a call are then visited down to
+        // its nested calls only, which are already resolved.
+        for (auto argument : node.arguments)
         {
-            int i = 0;
-            bool found = true;
-            for (auto &arg : node.arguments)
-            {
-                
-                hintType = parameter.types[i];
-                try
-                {
-                    arg->accept(*this);
-                    found = found && (lastType == parameter.types[i]);
-                } catch (type_error &e)
-                {
-                    found = false;
-                }
-                if (!found)
-                    break;
-                
-            }
-            if (found)
+            Parser::forEachPostOrder(argument, [&](Parser::NodeIdentifier nested)
+                                     {
+                auto call = nested.get<Parser::NodeFunctionCall>();
+                if (call != nullptr && !resolvedCalls.count(call))
+                    resolveCall(*call); });
+        }
+    }
+
+    std::optional<Types::TypeId> typeVisitor::argumentType(Parser::NodeIdentifier argument, Types::TypeId hint)
+    {
+        auto [entry, inserted] = argumentTypes.try_emplace({argument.get(), hint});
+        // A reference stays valid when nested calls grow the table.
+        auto &type = entry->second;
+        if (!inserted)
+            return type;
+        hintType = hint;
+        const std::size_t pendingHints = hints.size();
+        try
+        {
+            dispatch(argument);
+            type = lastType;
+        }
+        catch (type_error &e)
+        {
+            hints.resize(pendingHints);
+            type = std::nullopt;
+        }
+        return type;
+    }
+
+    bool typeVisitor::resolveCall(Parser::NodeFunctionCall &node)
+    {
+        // Only read the function table, bodies may be checked concurrently.
+        auto found = contextProvider.functions.find(node.name);
+        if (found == contextProvider.functions.end())
+            return false;
+        const auto &function = found->second;
+
+        // The first overload declared before that takes the argument types.
+        const Context::functionType::functionInfo *match = nullptr;
+        for (std::size_t index : function.overloadsWithArity(node.arguments.size()))
+        {
+            const auto &overload = function.overloads[index];
+            if (declaredAfter(overload, currentFunctionToken))
+                continue;
+            bool matches = true;
+            for (std::size_t i = 0; matches && i < node.arguments.size(); i++)
+                matches = argumentType(node.arguments[i], overload.types[i]) == overload.types[i];
+            if (matches)
             {
-                lastType = function.returnType.value_or("void");
-                node.type = lastType;
-                node.setSymbolName(parameter.node->symbol_name.value());
-                return;
+                match = &overload;
+                break;
             }
         }
-        throw type_error("function", "no matching function call", node.thisNode);
+        resolvedCalls[node.thisNode.get()] = match != nullptr;
+        if (match == nullptr)
+            return false;
+
+        // The arguments may have been typed last with the hints of another
+        // overload, type them again with the chosen ones. Nested calls are
+        // already resolved, so this stops at them.
+        for (std::size_t i = 0; i < node.arguments.size(); i++)
+        {
+            hintType = match->types[i];
+            dispatch(node.arguments[i]);
+        }
+        lastType = function.returnType.value_or(Types::voidType);
+        node.type = lastType;
+        node.setSymbolName(match->symbolName);
+        return true;
     }
     void typeVisitor::visitNodePragma(Parser::NodePragma &node)
     {
@@ -229,8 +366,6 @@ namespace visitor
 
     void typeVisitor::visitNodeCast(Parser::NodeCast &node)
     {
-        hintType = "number";
-        node.value->accept(*this);
         lastType = node.type;
     }
 
@@ -0,0 +1,780 @@
+#include "workspace.hpp"
+#include "bindings.hpp"
+#include "flatTree.hpp"
+#include "frontend.hpp"
+#include "session.hpp"
+#include "traversal.hpp"
+#include "visitor/llvmVisitor.hpp"
+#include "visitor/pragmaVisitor.hpp"
+#include "visitor/typeVisitor.hpp"
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace Ckc
+{
+    namespace
+    {
+        // Functions are small, their nodes take chunks of this size.
+        constexpr std::size_t functionChunkSize = 4 * 1024;
+
+        // Function of a file whose body is analysed on its own, by its rank
+        // among the ranges of Frontend::scanFunctions.
+        class FunctionKey
+        {
+        public:
+            std::string file;
+            std::size_t index;
+
+            bool operator==(const FunctionKey &other) const = default;
+        };
+
+        class FunctionKeyHash
+        {
+        public:
+            std::size_t operator()(const FunctionKey &key) const
+            {
+                return std::hash<std::string>()(key.file) ^ (std::hash<std::size_t>()(key.index) * 0x9e3779b97f4a7c15);
+            }
+        };
+
+        class Location
+        {
+        public:
+            std::string file;
+            int line;
+            int column;
+
+            bool operator==(const Location &other) const = default;
+        };
+
+        class LocationHash
+        {
+        public:
+            std::size_t operator()(const Location &location) const
+            {
+                return std::hash<std::string>()(location.file) ^ (std::hash<int>()(location.line) * 0x9e3779b97f4a7c15) ^ std::hash<int>()(location.column);
+            }
+        };
+
+        // The tokens of a file and its functions that can be analysed on their own.
+        class Lexed
+        {
+        public:
+            std::shared_ptr<Lexer::SourceBuffer> source;
+            std::unique_ptr<Lexer::TokenStream> tokens;
+            std::vector<Frontend::FunctionRange> ranges;
+        };
+
+        // A top level block of the outline.
+        class OutlineItem
+        {
+        public:
+            Parser::NodeIdentifier node;
+            // Index of the function whose body is left to the queries of the function.
+            std::optional<std::size_t> function;
+            Lexer::Token first;
+            std::vector<Lexer::Diagnostic> syntax;
+            std::vector<Lexer::Diagnostic> types;
+            bool declared = false;
+        };
+
+        // The top level blocks of a file, the bodies of its independent
+        // functions blanked out, parsed and checked in order as gkc -j does.
+        class Outline
+        {
+        public:
+            CompilerState state;
+            std::shared_ptr<Lexer::SourceBuffer> source;
+            std::vector<OutlineItem> items;
+            // The items from the first syntax error on are not checked.
+            std::size_t checkedItems = SIZE_MAX;
+            // Item of each independent function.
+            std::vector<std::size_t> functionItems;
+            // Kind of the names and type of the global variables after each
+            // item, and the symbol of the global variables.
+            Bindings<Lexer::TokenType> names;
+            Bindings<Types::TypeId> variables;
+            Bindings<std::string> globalNames;
+        };
+
+        class Signature
+        {
+        public:
+            Lexer::Symbol name;
+            std::vector<Types::TypeId> types;
+            Types::TypeId returnType;
+            std::string symbolName;
+            // Position of the function keyword, the checker hides the overloads declared after a function.
+            int line;
+            int column;
+
+            bool operator==(const Signature &other) const = default;
+        };
+
+        // The function table of a file for its function bodies.
+        class FunctionTable
+        {
+        public:
+            Context::ContextProvider provider;
+            std::vector<Signature> signatures;
+            std::unordered_map<std::string, std::size_t> bySymbol;
+            std::map<std::pair<int, int>, std::size_t> byPosition;
+        };
+
+        class FunctionText
+        {
+        public:
+            std::string text;
+            // Position of the function keyword in the file.
+            int line;
+            int column;
+            // Identifiers of the function, sorted.
+            std::vector<Lexer::Symbol> symbols;
+
+            bool operator==(const FunctionText &other) const = default;
+        };
+
+        class Global
+        {
+        public:
+            Lexer::Symbol name;
+            Types::TypeId type;
+            std::string symbolName;
+
+            bool operator==(const Global &other) const = default;
+        };
+
+        // What a function body sees of the blocks before it.
+        class FunctionScope
+        {
+        public:
+            // Declared, and no syntax error before its header.
+            bool checked = false;
+            std::vector<std::pair<Lexer::Symbol, Lexer::TokenType>> names;
+            std::vector<Global> globals;
+
+            bool operator==(const FunctionScope &other) const = default;
+        };
+
+        class FunctionAst
+        {
+        public:
+            CompilerState state{functionChunkSize};
+            std::shared_ptr<Lexer::SourceBuffer> source;
+            // Null after a syntax error.
+            Parser::NodeIdentifier node;
+            std::vector<Lexer::Diagnostic> syntax;
+        };
+
+        class Checked
+        {
+        public:
+            bool ok = false;
+            std::vector<Lexer::Diagnostic> diagnostics;
+            // The text the tokens of the diagnostics point to.
+            std::shared_ptr<Lexer::SourceBuffer> source;
+
+            bool operator==(const Checked &other) const { return ok == other.ok && diagnostics == other.diagnostics; }
+        };
+
+        class FunctionIr
+        {
+        public:
+            std::shared_ptr<llvm::Module> module;
+            std::string text;
+
+            bool operator==(const FunctionIr &other) const { return text == other.text; }
+        };
+
+        // Lexer::Token of the declaration of signature in the function table.
+        Lexer::Token functionToken(const Signature &signature)
+        {
+            return Lexer::Token(Lexer::TokenType::KEYWORD_FUNCTION, "function", signature.line, signature.column);
+        }
+
+        // Type of the innermost expression of tree, parsed from ts, at position.
+        std::optional<Types::TypeId> findExpressionType(const Parser::FlatTree &tree, const Lexer::TokenStream &ts, Lexer::SourcePosition position)
+        {
+            const auto found = tree.innermostExpression([&](Lexer::Span span)
+                                                        { return ts.positionOf(span.begin) <= position && position < ts.positionOf(span.end); });
+            if (found == Parser::FlatTree::none)
+                return std::nullopt;
+            return tree.types[found];
+        }
+    }
+
+    class Workspace::Queries
+    {
+    public:
+        Query::Engine engine;
+        Backend::TargetMachineFactory createTargetMachine;
+        std::unique_ptr<Backend::ObjectEmitter> emitter;
+        // Where the objects are written, named by their hash.
+        llvm::SmallString<128> directory;
+        std::unordered_set<std::string> written;
+
+        Query::Input<std::string, std::string> source{engine, "source"};
+        Query::Derived<std::string, std::shared_ptr<const Lexed>> tokens{engine, "tokens", [this](const std::string &file)
+                                                                         { return computeTokens(file); }};
+        Query::Derived<std::string, std::string> outlineText{engine, "outline text", [this](const std::string &file)
+                                                             { return computeOutlineText(file); }};
+        Query::Derived<std::string, std::shared_ptr<const Outline>> outline{engine, "outline", [this](const std::string &file)
+                                                                            { return computeOutline(file); }};
+        Query::Derived<std::string, std::vector<Signature>> signatures{engine, "signatures", [this](const std::string &file)
+                                                                       { return computeSignatures(file); }};
+        Query::Derived<std::string, std::shared_ptr<FunctionTable>> functionTable{engine, "function table", [this](const std::string &file)
+                                                                                  { return computeFunctionTable(file); }};
+        Query::Derived<std::string, std::string> outlineObject{engine, "outline object", [this](const std::string &file)
+                                                               { return computeOutlineObject(file); }};
+        Query::Derived<FunctionKey, FunctionText, FunctionKeyHash> functionText{engine, "function text", [this](const FunctionKey &key)
+                                                                                { return computeFunctionText(key); }};
+        Query::Derived<FunctionKey, std::optional<Signature>, FunctionKeyHash> signature{engine, "signature", [this](const FunctionKey &key)
+                                                                                         { return computeSignature(key); }};
+        Query::Derived<FunctionKey, FunctionScope, FunctionKeyHash> scope{engine, "scope", [this](const FunctionKey &key)
+                                                                          { return computeScope(key); }};
+        Query::Derived<FunctionKey, std::shared_ptr<const FunctionAst>, FunctionKeyHash> ast{engine, "ast", [this](const FunctionKey &key)
+                                                                                              { return computeAst(key); }};
+        Query::Derived<FunctionKey, Checked, FunctionKeyHash> check{engine, "check", [this](const FunctionKey &key)
+                                                                    { return computeCheck(key); }};
+        Query::Derived<FunctionKey, FunctionIr, FunctionKeyHash> ir{engine, "ir", [this](const FunctionKey &key)
+                                                                    { return computeIr(key); }};
+        Query::Derived<FunctionKey, std::string, FunctionKeyHash> object{engine, "object", [this](const FunctionKey &key)
+                                                                         { return computeObject(key); }};
+        Query::Derived<FunctionKey, std::shared_ptr<const Parser::FlatTree>, FunctionKeyHash> flatTree{engine, "flat tree", [this](const FunctionKey &key)
+                                                                                                       { return computeFlatTree(key); }};
+        Query::Derived<Location, std::optional<Types::TypeId>, LocationHash> expressionType{engine, "expression type", [this](const Location &location)
+                                                                                            { return computeExpressionType(location); }};
+
+        Queries(Backend::TargetMachineFactory createTargetMachine) : createTargetMachine(std::move(createTargetMachine)) {}
+        ~Queries();
+
+        Backend::ObjectEmitter &getEmitter()
+        {
+            if (emitter == nullptr)
+                emitter = std::make_unique<Backend::ObjectEmitter>(createTargetMachine);
+            return *emitter;
+        }
+
+        // New module for the target of the emitter, in a context of its own
+        // that lives as long as the module.
+        std::shared_ptr<llvm::Module> createModule(const std::string &name)
+        {
+            auto context = std::make_shared<llvm::LLVMContext>();
+            std::shared_ptr<llvm::Module> module(new llvm::Module(name, *context), [context](llvm::Module *module)
+                                                 { delete module; });
+            const llvm::TargetMachine &targetMachine = getEmitter().getTargetMachine();
+            module->setDataLayout(targetMachine.createDataLayout());
+            module->setTargetTriple(targetMachine.getTargetTriple().str());
+            return module;
+        }
+
+        std::string emit(llvm::Module &module)
+        {
+            std::string object;
+            if (!getEmitter().emit(module, object))
+                throw std::runtime_error("Could not emit " + module.getName().str());
+            return object;
+        }
+
+        std::shared_ptr<const Lexed> computeTokens(const std::string &file);
+        std::string computeOutlineText(const std::string &file);
+        std::shared_ptr<const Outline> computeOutline(const std::string &file);
+        std::vector<Signature> computeSignatures(const std::string &file);
+        std::shared_ptr<FunctionTable> computeFunctionTable(const std::string &file);
+        std::string computeOutlineObject(const std::string &file);
+        FunctionText computeFunctionText(const FunctionKey &key);
+        std::optional<Signature> computeSignature(const FunctionKey &key);
+        FunctionScope computeScope(const FunctionKey &key);
+        std::shared_ptr<const FunctionAst> computeAst(const FunctionKey &key);
+        Checked computeCheck(const FunctionKey &key);
+        FunctionIr computeIr(const FunctionKey &key);
+        std::string computeObject(const FunctionKey &key);
+        std::shared_ptr<const Parser::FlatTree> computeFlatTree(const FunctionKey &key);
+        std::optional<Types::TypeId> computeExpressionType(const Location &location);
+
+        // Path of object in directory, written unless an object with the same content was.
+        bool store(const std::string &object, llvm::SmallString<128> &path);
+    };
+
+    Workspace::Queries::~Queries()
+    {
+        for (auto &path : written)
+            llvm::sys::fs::remove(path);
+        if (!directory.empty())
+            llvm::sys::fs::remove(directory);
+    }
+
+    std::shared_ptr<const Lexed> Workspace::Queries::computeTokens(const std::string &file)
+    {
+        auto lexed = std::make_shared<Lexed>();
+        lexed->source = std::make_shared<Lexer::SourceBuffer>(source.get(file));
+        lexed->tokens = std::make_unique<Lexer::TokenStream>(lexed->source, file);
+        lexed->ranges = Frontend::scanFunctions(*lexed->tokens);
+        return lexed;
+    }
+
+    std::string Workspace::Queries::computeOutlineText(const std::string &file)
+    {
+        // The lines and columns of what is left are the ones of the file.
+        auto lexed = tokens.get(file);
+        std::string text(lexed->source->begin(), lexed->source->size());
+        for (auto &range : lexed->ranges)
+        {
+            const Lexer::Token &is = lexed->tokens->peek(range.body);
+            const Lexer::Token &endfunction = lexed->tokens->peek(range.end - 1);
+            const std::size_t begin = is.value.data() + is.value.size() - lexed->source->begin();
+            const std::size_t end = endfunction.value.data() - lexed->source->begin();
+            for (std::size_t i = begin; i < end; i++)
+            {
+                if (text[i] != '\n' && text[i] != '\r')
+                    text[i] = ' ';
+            }
+        }
+        return text;
+    }
+
+    std::shared_ptr<const Outline> Workspace::Queries::computeOutline(const std::string &file)
+    {
+        auto outline = std::make_shared<Outline>();
+        outline->source = std::make_shared<Lexer::SourceBuffer>(outlineText.get(file));
+        CompilerState::Activation activation(outline->state);
+        Lexer::TokenStream ts(outline->source, file);
+        const auto ranges = Frontend::scanFunctions(ts);
+        std::size_t nextRange = 0;
+        visitor::pragmaVisitor pragmaVisitor;
+        visitor::typeVisitor typeVisitor;
+        std::vector<Lexer::Symbol> symbols;
+        while (!ts.isEmpty())
+        {
+            const std::size_t index = outline->items.size();
+            const std::size_t start = ts.tell();
+            OutlineItem &item = outline->items.emplace_back();
+            item.first = ts.peek();
+            ts.collectDiagnostics(&item.syntax);
+            while (nextRange < ranges.size() && ranges[nextRange].begin < start)
+                nextRange++;
+            if (nextRange < ranges.size() && ranges[nextRange].begin == start)
+            {
+                item.node = Parser::parseFunctionHeader(ts);
+                auto *function = item.node.get<Parser::NodeFunction>();
+                if (function != nullptr && ts.tell() == ranges[nextRange].body)
+                {
+                    // The scope of the parameters is still open, the body was blanked out.
+                    Lexer::LexerContext::popContext();
+                    ts.seek(ranges[nextRange].end);
+                    item.function = outline->functionItems.size();
+                    outline->functionItems.push_back(index);
+                }
+                else if (function != nullptr && !Parser::parseFunctionEnd(ts, *function))
+                    item.node = Parser::NodeIdentifier();
+            }
+            else
+                item.node = Parser::parseBlock(ts);
+            if (item.node.get() == nullptr)
+                Parser::synchronize(ts);
+            // Blocks after a syntax error may refer to names it did not declare.
+            if (item.node.get() == nullptr || !item.syntax.empty())
+                outline->checkedItems = std::min(outline->checkedItems, index);
+
+            ts.collectDiagnostics(&item.types);
+            if (index < outline->checkedItems)
+            {
+                if (item.function.has_value())
+                    item.declared = Frontend::reportCheckErrors(ts, item.first, [&]()
+                                                                {
+                                                                    pragmaVisitor.dispatch(item.node);
+                                                                    typeVisitor.declareFunction(*item.node.get<Parser::NodeFunction>()); });
+                else
+                    Frontend::reportCheckErrors(ts, item.first, [&]()
+                                                {
+                                                    pragmaVisitor.dispatch(item.node);
+                                                    typeVisitor.dispatch(item.node); });
+            }
+
+            const std::size_t end = ts.tell();
+            symbols.clear();
+            ts.seek(start);
+            for (std::size_t i = start; i < end; i++)
+            {
+                if (!ts.peek(i - start).symbol.empty())
+                    symbols.push_back(ts.peek(i - start).symbol);
+            }
+            ts.seek(end);
+            for (auto symbol : symbols)
+            {
+                addBinding(outline->names, symbol, index, Lexer::LexerContext::getTokenType(symbol));
+                addBinding(outline->variables, symbol, index, typeVisitor.getVariableType(symbol));
+            }
+        }
+        ts.collectDiagnostics(nullptr);
+        // Symbols of the global variables, once every pragma renamed them.
+        for (std::size_t i = 0; i < outline->items.size(); i++)
+        {
+            if (auto *variable = outline->items[i].node.get<Parser::NodeVariableDeclaration>())
+                addBinding(outline->globalNames, variable->name, i, std::optional<std::string>(variable->symbol_name.value_or(variable->name.str())));
+        }
+        return outline;
+    }
+
+    std::vector<Signature> Workspace::Queries::computeSignatures(const std::string &file)
+    {
+        auto outline = this->outline.get(file);
+        std::vector<Signature> signatures;
+        for (auto &[name, function] : outline->state.contextProvider.functions)
+        {
+            for (auto &overload : function.overloads)
+            {
+                const Lexer::Token token = overload.token.value_or(Lexer::Token());
+                signatures.push_back({name, overload.types, overload.returnType, overload.symbolName, token.line, token.column});
+            }
+        }
+        return signatures;
+    }
+
+    std::shared_ptr<FunctionTable> Workspace::Queries::computeFunctionTable(const std::string &file)
+    {
+        auto table = std::make_shared<FunctionTable>();
+        table->signatures = signatures.get(file);
+        for (std::size_t i = 0; i < table->signatures.size(); i++)
+        {
+            const Signature &signature = table->signatures[i];
+            auto &function = table->provider.functions[signature.name];
+            function.functionName = signature.name;
+            function.returnType = signature.returnType;
+            function.add(signature.types, signature.returnType, functionToken(signature), signature.symbolName);
+            table->bySymbol[signature.symbolName] = i;
+            table->byPosition[{signature.line, signature.column}] = i;
+        }
+        return table;
+    }
+
+    std::string Workspace::Queries::computeOutlineObject(const std::string &file)
+    {
+        // The globals, the declarations of the independent functions and the other functions.
+        auto outline = this->outline.get(file);
+        auto module = createModule(file);
+        std::shared_ptr<llvm::LLVMContext> context(module, &module->getContext());
+        auto builder = std::make_shared<llvm::IRBuilder<>>(*context);
+        Context::ContextProvider lowering;
+        visitor::llvmVisitor lv{context, builder, module, lowering};
+        for (auto &item : outline->items)
+            lv.dispatch(item.node);
+        return emit(*module);
+    }
+
+    FunctionText Workspace::Queries::computeFunctionText(const FunctionKey &key)
+    {
+        auto lexed = tokens.get(key.file);
+        FunctionText text{"", 1, 1, {}};
+        if (key.index >= lexed->ranges.size())
+            return text;
+        const Frontend::FunctionRange &range = lexed->ranges[key.index];
+        const Lexer::Token &first = lexed->tokens->peek(range.begin);
+        const Lexer::Token &last = lexed->tokens->peek(range.end - 1);
+        text.text.assign(first.value.data(), last.value.data() + last.value.size());
+        text.line = first.line;
+        text.column = first.column;
+        for (std::size_t i = range.begin; i < range.end; i++)
+        {
+            if (!lexed->tokens->peek(i).symbol.empty())
+                text.symbols.push_back(lexed->tokens->peek(i).symbol);
+        }
+        std::sort(text.symbols.begin(), text.symbols.end());
+        text.symbols.erase(std::unique(text.symbols.begin(), text.symbols.end()), text.symbols.end());
+        return text;
+    }
+
+    std::optional<Signature> Workspace::Queries::computeSignature(const FunctionKey &key)
+    {
+        const FunctionText &text = functionText.get(key);
+        auto table = functionTable.get(key.file);
+        auto found = table->byPosition.find({text.line, text.column});
+        if (found == table->byPosition.end())
+            return std::nullopt;
+        return table->signatures[found->second];
+    }
+
+    FunctionScope Workspace::Queries::computeScope(const FunctionKey &key)
+    {
+        auto outline = this->outline.get(key.file);
+        const FunctionText &text = functionText.get(key);
+        FunctionScope scope;
+        if (key.index >= outline->functionItems.size())
+            return scope;
+        const std::size_t item = outline->functionItems[key.index];
+        scope.checked = item < outline->checkedItems && outline->items[item].declared;
+        for (auto symbol : text.symbols)
+        {
+            if (auto kind = boundBefore(outline->names, symbol, item))
+                scope.names.push_back({symbol, kind.value()});
+            auto type = boundBefore(outline->variables, symbol, item);
+            auto symbolName = boundBefore(outline->globalNames, symbol, item);
+            if (type.has_value())
+                scope.globals.push_back({symbol, type.value(), symbolName.value_or(symbol.str())});
+        }
+        return scope;
+    }
+
+    std::shared_ptr<const FunctionAst> Workspace::Queries::computeAst(const FunctionKey &key)
+    {
+        const FunctionText &text = functionText.get(key);
+        const FunctionScope &scope = this->scope.get(key);
+        const std::optional<Signature> &signature = this->signature.get(key);
+        auto ast = std::make_shared<FunctionAst>();
+        ast->source = std::make_shared<Lexer::SourceBuffer>(text.text);
+        CompilerState::Activation activation(ast->state);
+        // Numbered like the tokens of the file, which the function table compares its declarations with.
+        Lexer::TokenStream ts(ast->source, key.file, false, text.line, text.column);
+        ts.collectDiagnostics(&ast->syntax);
+        // The scopes of the parser as they were before the function.
+        Lexer::LexerContext::context.clear();
+        for (auto &[symbol, kind] : scope.names)
+            Lexer::LexerContext::addToken(symbol, kind);
+        auto node = Parser::parseFunctionHeader(ts);
+        auto *function = node.get<Parser::NodeFunction>();
+        if (function != nullptr && Parser::parseFunctionEnd(ts, *function))
+        {
+            ast->node = node;
+            if (signature.has_value())
+                function->symbol_name = signature->symbolName;
+        }
+        ts.collectDiagnostics(nullptr);
+        return ast;
+    }
+
+    Checked Workspace::Queries::computeCheck(const FunctionKey &key)
+    {
+        auto ast = this->ast.get(key);
+        const FunctionScope &scope = this->scope.get(key);
+        Checked checked;
+        checked.source = ast->source;
+        auto *function = ast->node.get<Parser::NodeFunction>();
+        if (function == nullptr || !scope.checked)
+            return checked;
+        auto table = functionTable.get(key.file);
+        const FunctionText &text = functionText.get(key);
+        Context::ContextProvider &previous = Context::ContextProvider::getInstance();
+        Context::ContextProvider::setCurrent(table->provider);
+        visitor::typeVisitor checker;
+        for (auto &global : scope.globals)
+            checker.addVariable(global.name, global.type);
+        Lexer::TokenStream ts(ast->source, key.file, true, text.line, text.column);
+        ts.collectDiagnostics(&checked.diagnostics);
+        checked.ok = Frontend::reportCheckErrors(ts, function->functionToken, [&]()
+                                                 { checker.checkFunctionBody(*function); });
+        Context::ContextProvider::setCurrent(previous);
+        return checked;
+    }
+
+    FunctionIr Workspace::Queries::computeIr(const FunctionKey &key)
+    {
+        // The types and the callees of the AST are the ones the last check set.
+        const Checked &checked = check.get(key);
+        auto ast = this->ast.get(key);
+        const FunctionScope &scope = this->scope.get(key);
+        const std::optional<Signature> &signature = this->signature.get(key);
+        auto table = functionTable.get(key.file);
+        FunctionIr ir;
+        if (!checked.ok || !signature.has_value())
+            return ir;
+        ir.module = createModule(signature->symbolName);
+        llvm::LLVMContext &context = ir.module->getContext();
+        // The callees and the globals are defined by the other objects of the file.
+        Parser::forEachPostOrder(ast->node, [&](Parser::NodeIdentifier node)
+                                 {
+                                     auto *call = node.get<Parser::NodeFunctionCall>();
+                                     if (call == nullptr || !call->symbol_name.has_value() || call->symbol_name.value() == signature->symbolName || ir.module->getFunction(call->symbol_name.value()) != nullptr)
+                                         return;
+                                     auto found = table->bySymbol.find(call->symbol_name.value());
+                                     if (found == table->bySymbol.end())
+                                         return;
+                                     const Signature &callee = table->signatures[found->second];
+                                     std::vector<llvm::Type *> parameters;
+                                     for (auto type : callee.types)
+                                         parameters.push_back(type.llvmType(context));
+                                     llvm::Function::Create(llvm::FunctionType::get(callee.returnType.llvmType(context), parameters, false), llvm::Function::ExternalLinkage, callee.symbolName, ir.module.get()); });
+        Context::ContextProvider lowering;
+        for (auto &global : scope.globals)
+        {
+            llvm::Type *type = global.type.llvmType(context);
+            auto variable = new llvm::GlobalVariable(*ir.module, type, false, llvm::GlobalValue::ExternalLinkage, nullptr, global.symbolName);
+            lowering.addVariable(global.name, variable, type, global.type);
+        }
+        auto builder = std::make_shared<llvm::IRBuilder<>>(context);
+        visitor::llvmVisitor lv{std::shared_ptr<llvm::LLVMContext>(ir.module, &context), builder, ir.module, lowering};
+        lv.dispatch(ast->node);
+        llvm::raw_string_ostream stream(ir.text);
+        ir.module->print(stream, nullptr);
+        stream.flush();
+        return ir;
+    }
+
+    std::string Workspace::Queries::computeObject(const FunctionKey &key)
+    {
+        const FunctionIr &ir = this->ir.get(key);
+        if (ir.module == nullptr)
+            return "";
+        // Code generation changes the module, which the IR query keeps.
+        auto module = llvm::CloneModule(*ir.module);
+        return emit(*module);
+    }
+
+    std::shared_ptr<const Parser::FlatTree> Workspace::Queries::computeFlatTree(const FunctionKey &key)
+    {
+        // The types of the AST are the ones the last check set. Checking again
+        // after a callee changed may give other types and the same diagnostics.
+        const Checked &checked = check.get(key);
+        auto ast = this->ast.get(key);
+        functionTable.get(key.file);
+        if (!checked.ok)
+            return nullptr;
+        return std::make_shared<const Parser::FlatTree>(Parser::FlatTree::build({ast->node}));
+    }
+
+    std::optional<Types::TypeId> Workspace::Queries::computeExpressionType(const Location &location)
+    {
+        auto lexed = tokens.get(location.file);
+        auto outline = this->outline.get(location.file);
+        auto before = [](const Lexer::Token &token, int line, int column)
+        { return token.line < line || (token.line == line && token.column <= column); };
+        for (std::size_t i = 0; i < lexed->ranges.size() && i < outline->functionItems.size(); i++)
+        {
+            const Lexer::Token &first = lexed->tokens->peek(lexed->ranges[i].begin);
+            const Lexer::Token &last = lexed->tokens->peek(lexed->ranges[i].end - 1);
+            if (!before(first, location.line, location.column) || before(last, location.line, location.column - int(last.value.size())))
+                continue;
+            const FunctionKey key{location.file, i};
+            auto tree = flatTree.get(key);
+            if (tree == nullptr)
+                return std::nullopt;
+            const FunctionText &text = functionText.get(key);
+            Lexer::TokenStream ts(ast.get(key)->source, location.file, true, text.line, text.column);
+            return findExpressionType(*tree, ts, {location.line, location.column});
+        }
+        // The items checked without a type error, in source order.
+        std::vector<Parser::NodeIdentifier> checked;
+        for (std::size_t i = 0; i < outline->items.size() && i < outline->checkedItems && outline->items[i].types.empty(); i++)
+            checked.push_back(outline->items[i].node);
+        Lexer::TokenStream ts(outline->source, location.file, true);
+        return findExpressionType(Parser::FlatTree::build(checked), ts, {location.line, location.column});
+    }
+
+    bool Workspace::Queries::store(const std::string &object, llvm::SmallString<128> &path)
+    {
+        if (directory.empty())
+        {
+            if (auto EC = llvm::sys::fs::createUniqueDirectory("gkc-workspace", directory))
+            {
+                llvm::errs() << "Could not create a temporary directory: " << EC.message();
+                directory.clear();
+                return false;
+            }
+        }
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.o", static_cast<unsigned long long>(llvm::xxHash64(object)));
+        path = directory;
+        llvm::sys::path::append(path, name);
+        if (written.count(std::string(path)) > 0)
+            return true;
+        std::error_code EC;
+        llvm::raw_fd_ostream stream(path, EC, llvm::sys::fs::OF_None);
+        if (EC)
+        {
+            llvm::errs() << "Could not open file: " << EC.message();
+            return false;
+        }
+        stream << object;
+        written.insert(std::string(path));
+        return true;
+    }
+
+    Workspace::Workspace(Backend::TargetMachineFactory createTargetMachine) : queries(std::make_unique<Queries>(std::move(createTargetMachine)))
+    {
+    }
+
+    Workspace::~Workspace() = default;
+
+    void Workspace::setSource(const std::string &file, std::string text)
+    {
+        queries->source.set(file, std::move(text));
+    }
+
+    bool Workspace::compile(const std::string &file, const std::string &objectFilename, std::ostream &diagnostics)
+    {
+        auto outline = queries->outline.get(file);
+        // Diagnostics are highlighted in the text of the file.
+        Lexer::TokenStream printer(queries->tokens.get(file)->source, file, true);
+        printer.setDiagnostics(diagnostics);
+        auto print = [&printer](const std::vector<Lexer::Diagnostic> &list)
+        {
+            for (auto &diagnostic : list)
+                printer.reportError(diagnostic.message, diagnostic.ranges);
+        };
+
+        // After a syntax error only syntax errors are reported.
+        std::size_t syntaxErrors = 0;
+        for (auto &item : outline->items)
+        {
+            print(item.syntax);
+            syntaxErrors += item.syntax.size();
+            if (!item.function.has_value())
+                continue;
+            auto ast = queries->ast.get({file, item.function.value()});
+            print(ast->syntax);
+            syntaxErrors += ast->syntax.size();
+        }
+        if (syntaxErrors > 0)
+        {
+            diagnostics << "Error parsing file: " << syntaxErrors << " syntax error(s)\n";
+            return false;
+        }
+        bool typeError = false;
+        for (auto &item : outline->items)
+        {
+            print(item.types);
+            typeError = typeError || !item.types.empty();
+            if (!item.function.has_value() || !item.declared)
+                continue;
+            const Checked &checked = queries->check.get({file, item.function.value()});
+            print(checked.diagnostics);
+            typeError = typeError || !checked.ok;
+        }
+        if (typeError)
+            return false;
+
+        std::vector<llvm::SmallString<128>> parts(1);
+        if (!queries->store(queries->outlineObject.get(file), parts[0]))
+            return false;
+        for (std::size_t i = 0; i < outline->functionItems.size(); i++)
+        {
+            if (!queries->store(queries->object.get({file, i}), parts.emplace_back()))
+                return false;
+        }
+        return Backend::mergeObjects(parts, objectFilename);
+    }
+
+    std::optional<Types::TypeId> Workspace::typeOf(const std::string &file, int line, int column)
+    {
+        return queries->expressionType.get({file, line, column});
+    }
+
+    const std::map<std::string, Query::Statistics> &Workspace::getStatistics() const
+    {
+        return queries->engine.getStatistics();
+    }
+
+    void Workspace::resetStatistics()
+    {
+        queries->engine.resetStatistics();
+    }
+}
@@ -0,0 +1,194 @@
+#include "backend.hpp"
+#include "frontend.hpp"
+#include "session.hpp"
+#include "visitor/llvmVisitor.hpp"
+#include <llvm/ADT/Twine.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Program.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+#include <sstream>
+
+class BackendTest : public ::testing::Test {
+ protected:
+  llvm::SmallString<128> directory;
+  Backend::TargetMachineFactory createTargetMachine;
+  void SetUp() override {
+    Lexer::LexerContext::init();
+    llvm::sys::fs::createUniqueDirectory("gkc-backend-test", directory);
+    std::string error;
+    createTargetMachine = Ckc::hostTargetMachine(error);
+    ASSERT_TRUE(createTargetMachine) << error;
+  }
+  void TearDown() override {
+    llvm::sys::fs::remove_directories(directory);
+  }
+  std::string path(const std::string &name) {
+    return (directory + "/" + name).str();
+  }
+  // Link object into an executable and return its exit status, -1 on error.
+  int run(const std::string &object) {
+    auto compiler = llvm::sys::findProgramByName("cc");
+    if (!compiler)
+      return -1;
+    const std::string executable = object + ".out";
+    if (llvm::sys::ExecuteAndWait(*compiler, {*compiler, object, "-o", executable}) != 0)
+      return -1;
+    return llvm::sys::ExecuteAndWait(executable, {executable});
+  }
+  // Module of text as gkc lowers it, nullptr on a syntax or type error.
+  std::shared_ptr<llvm::Module> lower(const std::string &text) {
+    Ckc::CompilerState state;
+    Ckc::CompilerState::Activation activation(state);
+    Lexer::TokenStream ts(std::make_shared<Lexer::SourceBuffer>(text), "backend.gk");
+    auto result = Frontend::run(ts, 1, false);
+    if (result.syntaxErrors > 0 || result.typeError)
+      return nullptr;
+    auto targetMachine = createTargetMachine();
+    auto module = std::make_shared<llvm::Module>("backend.gk", *context);
+    module->setDataLayout(targetMachine->createDataLayout());
+    module->setTargetTriple(targetMachine->getTargetTriple().str());
+    Context::ContextProvider lowering;
+    visitor::llvmVisitor lv{context, std::make_shared<llvm::IRBuilder<>>(*context), module, lowering};
+    for (auto &node : result.nodes)
+      lv.dispatch(node);
+    return module;
+  }
+  // Names of the global symbols object defines.
+  std::set<std::string> definedSymbols(const std::string &object) {
+    std::set<std::string> names;
+    auto file = llvm::object::ObjectFile::createObjectFile(object);
+    if (!file) {
+      ADD_FAILURE() << llvm::toString(file.takeError());
+      return names;
+    }
+    for (auto &symbol : file->getBinary()->symbols()) {
+      auto flags = symbol.getFlags();
+      auto name = symbol.getName();
+      if (flags && name && (*flags & llvm::object::SymbolRef::SF_Global) && !(*flags & llvm::object::SymbolRef::SF_Undefined))
+        names.insert(name->str());
+      else if (!flags || !name)
+        ADD_FAILURE() << "unreadable symbol in " << object;
+    }
+    return names;
+  }
+  // The module of text emitted with one job and with jobs jobs define the same symbols.
+  void expectSameSymbols(const std::string &text, unsigned jobs, const std::set<std::string> &expected) {
+    const std::string single = path("single.o");
+    const std::string split = path("split" + std::to_string(jobs) + ".o");
+    auto module = lower(text);
+    ASSERT_NE(module, nullptr);
+    ASSERT_TRUE(Backend::emitObject(*module, createTargetMachine, single, 1));
+    module = lower(text);
+    ASSERT_TRUE(Backend::emitObject(*module, createTargetMachine, split, jobs));
+    EXPECT_EQ(definedSymbols(single), expected);
+    EXPECT_EQ(definedSymbols(split), expected);
+  }
+
+  std::shared_ptr<llvm::LLVMContext> context = std::make_shared<llvm::LLVMContext>();
+};
+
+namespace
+{
+    std::string program(int constant)
+    {
+        return "function ba(int32 a) return int32 is return a + " + std::to_string(constant) + "; endfunction\n"
+               "function bb(int32 b) return int32 is return ba(b) * 2; endfunction\n"
+               "function main() return int32 is return bb(20); endfunction\n";
+    }
+}
+
+TEST_F(BackendTest, cachedFunctionsAreReused)
+{
+    if (!llvm::sys::findProgramByName("ld"))
+        GTEST_SKIP() << "the cached objects are merged with ld";
+    for (unsigned jobs : {1u, 2u})
+    {
+        Ckc::Options options;
+        options.jobs = jobs;
+        options.cacheDirectory = path("cache" + std::to_string(jobs));
+        Ckc::CompilationSession session(options, createTargetMachine);
+        std::ostringstream diagnostics;
+        session.setDiagnostics(diagnostics);
+        const std::string object = path("cached" + std::to_string(jobs) + ".o");
+        auto compile = [&](int constant)
+        {
+            diagnostics.str("");
+            EXPECT_TRUE(session.compile(std::make_shared<Lexer::SourceBuffer>(program(constant)), "cached.gk", object));
+            return diagnostics.str();
+        };
+
+        EXPECT_EQ(compile(1), "Object cache: 0 hit(s), 3 miss(es), 0 not cached\n");
+        EXPECT_EQ(run(object), 42);
+        EXPECT_EQ(compile(1), "Object cache: 3 hit(s), 0 miss(es), 0 not cached\n");
+        EXPECT_EQ(run(object), 42);
+        // Only the edited function is compiled again.
+        EXPECT_EQ(compile(2), "Object cache: 2 hit(s), 1 miss(es), 0 not cached\n");
+        EXPECT_EQ(run(object), 44);
+    }
+}
+
+TEST_F(BackendTest, partitionsDefineTheSameSymbols)
+{
+    const std::string text = "int32 pg := 5;\n"
+                             "function pa(int32 a) return int32 is return a + pg; endfunction\n"
+                             "function pb(int32 b) return int32 is return pa(b) * 2; endfunction\n"
+                             "function pc() return int32; pragma pc symbol_name is pd;\n"
+                             "function pe(int32 e) return int32 is return pb(e) - 1; endfunction\n"
+                             "function main() return int32 is return pe(1) + pa(0); endfunction\n";
+    expectSameSymbols(text, 4, {"pg", "pa", "pb", "pe", "main"});
+    auto module = lower(text);
+    ASSERT_NE(module, nullptr);
+    ASSERT_TRUE(Backend::emitObject(*module, createTargetMachine, path("run.o"), 4));
+    EXPECT_EQ(run(path("run.o")), 16);
+}
+
+TEST_F(BackendTest, singleBodyIsNotSplit)
+{
+    expectSameSymbols("function sa() return int32; function main() return int32 is return 3; endfunction\n", 4, {"main"});
+}
+
+TEST_F(BackendTest, withoutLdTheModuleIsEmittedWhole)
+{
+    // A PATH where no ld is found.
+    const char *previous = std::getenv("PATH");
+    const std::string saved = previous != nullptr ? previous : "";
+    setenv("PATH", std::string(directory).c_str(), 1);
+    expectSameSymbols("function na() return int32 is return 1; endfunction\n"
+                      "function main() return int32 is return na() + 1; endfunction\n",
+                      4, {"na", "main"});
+    setenv("PATH", saved.c_str(), 1);
+}
+
+TEST_F(BackendTest, codeAfterATerminatorGetsItsOwnBlock)
+{
+    // splitCodeGen reads every partition back from bitcode, which rejects a
+    // block holding more than one terminator.
+    auto module = lower("function ua(int32 a) return int32 is\n"
+                        "    goto done;\n"
+                        "    a := a + 1;\n"
+                        "    # done return a;\n"
+                        "    return a + 2;\n"
+                        "endfunction\n"
+                        "function main() return int32 is if ua(4) > 3 then return 7; fi return 9; endfunction\n");
+    ASSERT_NE(module, nullptr);
+    std::string errors;
+    llvm::raw_string_ostream stream(errors);
+    EXPECT_FALSE(llvm::verifyModule(*module, &stream)) << stream.str();
+    for (auto &function : *module)
+    {
+        for (auto &block : function)
+        {
+            EXPECT_EQ(std::count_if(block.begin(), block.end(), [](const llvm::Instruction &instruction)
+                                    { return instruction.isTerminator(); }),
+                      1)
+                << function.getName().str() << " " << block.getName().str();
+        }
+    }
+    ASSERT_TRUE(Backend::emitObject(*module, createTargetMachine, path("unreachable.o"), 2));
+    EXPECT_EQ(run(path("unreachable.o")), 7);
+}
@@ -0,0 +1,88 @@
+#include "astCache.hpp"
+#include "flatTree.hpp"
+#include "frontend.hpp"
+#include "visitor/printVisitor.hpp"
+#include <llvm/Support/FileSystem.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+
+class CacheTest : public ::testing::Test {
+ protected:
+  llvm::SmallString<128> directory;
+  void SetUp() override {
+    Lexer::LexerContext::init();
+    llvm::sys::fs::createUniqueDirectory("gkc-cache-test", directory);
+  }
+  void TearDown() override {
+    llvm::sys::fs::remove_directories(directory);
+  }
+};
+
+std::string print(const Lexer::TokenStream &ts, const std::vector<Parser::NodeIdentifier> &roots)
+{
+    std::ostringstream out;
+    for (auto root : roots)
+    {
+        visitor::PrintVisitor pv(ts, out);
+        pv.dispatch(root);
+    }
+    return out.str();
+}
+
+TEST_F(CacheTest, roundTrip)
+{
+    auto source = std::make_shared<Lexer::SourceBuffer>(std::string(
+        "int32 cg := 4;\n"
+        "function cc(int32 a) return int32 is return a; endfunction\n"
+        "function ca(int32 a, bool b) return int32 is\n"
+        "    if b and a > 0 then return cc(a - 1); else goto done; fi\n"
+        "    # done int32 x := int32(cg) * -a;\n"
+        "    return x;\n"
+        "endfunction\n"
+        "pragma ca symbol_name is renamed;\n"));
+    Lexer::TokenStream ts(source, "cache.gk");
+    auto result = Frontend::run(ts, 1, false);
+    ASSERT_EQ(result.syntaxErrors, 0u);
+    ASSERT_FALSE(result.typeError);
+
+    const auto hash = Cache::hash(*source);
+    const auto path = Cache::astPath(std::string(directory), hash);
+    ASSERT_TRUE(Cache::storeAst(path, hash, result.nodes));
+    auto file = Cache::AstFile::load(path, hash);
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(file->roots.size(), result.nodes.size());
+    EXPECT_EQ(print(ts, file->roots), print(ts, result.nodes));
+
+    auto before = Parser::FlatTree::build(result.nodes);
+    auto after = Parser::FlatTree::build(file->roots);
+    ASSERT_EQ(after.kinds, before.kinds);
+    ASSERT_EQ(after.spans, before.spans);
+    auto function = file->roots[2].get<Parser::NodeFunction>();
+    ASSERT_NE(function, nullptr);
+    EXPECT_EQ(function->symbol_name, result.nodes[2]->symbol_name);
+    EXPECT_EQ(function->arguments, result.nodes[2].get<Parser::NodeFunction>()->arguments);
+    EXPECT_EQ(ts.positionOf(function->span.end).line, 7);
+    EXPECT_EQ(function->functionToken.value, "function");
+}
+
+TEST_F(CacheTest, rejectsStaleAndCorrupted)
+{
+    auto source = std::make_shared<Lexer::SourceBuffer>(std::string("function cb() return int32 is return 1 + 2; endfunction\n"));
+    Lexer::TokenStream ts(source);
+    auto result = Frontend::run(ts, 1, false);
+    const auto hash = Cache::hash(*source);
+    const auto path = Cache::astPath(std::string(directory), hash);
+    ASSERT_TRUE(Cache::storeAst(path, hash, result.nodes));
+    EXPECT_EQ(Cache::AstFile::load(path, hash + 1), nullptr);
+    EXPECT_EQ(Cache::AstFile::load(path + ".missing", hash), nullptr);
+
+    // Every truncation is rejected instead of read out of bounds.
+    std::ifstream in(path, std::ios::binary);
+    const std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    for (std::size_t length = 1; length < bytes.size(); length += 7)
+    {
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), length);
+        EXPECT_EQ(Cache::AstFile::load(path, hash), nullptr) << length;
+    }
+}
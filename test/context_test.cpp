@@ -0,0 +1,42 @@
+#include "genericContext.hpp"
+#include "symbol.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(ContextTest, shadowing)
+{
+    genericContext<std::string, int> context;
+    context.add("a", 1);
+    context.enterScope();
+    context.add("a", 2);
+    context.add("b", 3);
+    context.add("a", 4);
+    ASSERT_EQ(context.get("a"), 4);
+    ASSERT_EQ(context.get("b"), 3);
+    context.exitScope();
+    ASSERT_EQ(context.get("a"), 1);
+    ASSERT_EQ(context.get("b"), std::nullopt);
+    ASSERT_EQ(context.depth(), 0u);
+}
+
+TEST(ContextTest, deepNesting)
+{
+    genericContext<Lexer::Symbol, int> context;
+    const int depth = 1000;
+    for (int i = 0; i < depth; i++)
+    {
+        context.enterScope();
+        context.add("v" + std::to_string(i), i);
+        context.add("shared", i);
+    }
+    for (int i = 0; i < depth; i++)
+        ASSERT_EQ(context.get("v" + std::to_string(i)), i);
+    for (int i = depth - 1; i >= 0; i--)
+    {
+        ASSERT_EQ(context.get("shared"), i);
+        ASSERT_EQ(context.get("v" + std::to_string(i)), i);
+        context.exitScope();
+        ASSERT_EQ(context.get("v" + std::to_string(i)), std::nullopt);
+    }
+    ASSERT_EQ(context.get("shared"), std::nullopt);
+}
@@ -0,0 +1,158 @@
+#include "document.hpp"
+#include "languageServer.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <sstream>
+
+namespace
+{
+    std::string describe(const std::vector<Ckc::DocumentDiagnostic> &diagnostics)
+    {
+        std::ostringstream text;
+        for (auto &diagnostic : diagnostics)
+            text << diagnostic.range.line << ":" << diagnostic.range.column << "-" << diagnostic.range.endLine << ":" << diagnostic.range.endColumn << " " << diagnostic.message << "\n";
+        return text.str();
+    }
+
+    // The diagnostics of document, and of the same text analysed from scratch.
+    void expectSameAsFullAnalysis(const Ckc::Document &document)
+    {
+        Ckc::Document fresh(document.getText());
+        EXPECT_EQ(describe(document.getDiagnostics()), describe(fresh.getDiagnostics())) << document.getText();
+    }
+
+    void replace(Ckc::Document &document, const std::string &from, const std::string &to)
+    {
+        const std::size_t at = document.getText().find(from);
+        ASSERT_NE(at, std::string::npos) << from;
+        document.change(at, at + from.size(), to);
+    }
+
+    const std::string program = "int64 limit := 10;\n"
+                                "function twice(int32 a) return int32 is\n"
+                                "    return a * 2;\n"
+                                "endfunction\n"
+                                "function clamp(int64 a) return int64 is\n"
+                                "    if a > limit then return limit; fi\n"
+                                "    return a;\n"
+                                "endfunction\n"
+                                "function main() return int32 is\n"
+                                "    int32 x := 1;\n"
+                                "    return twice(x);\n"
+                                "endfunction\n";
+}
+
+TEST(DocumentTest, bodyEditOnlyAnalysesItsFunction)
+{
+    Lexer::LexerContext::init();
+    Ckc::Document document(program);
+    EXPECT_EQ(describe(document.getDiagnostics()), "");
+    const auto full = document.getStatistics().fullAnalyses;
+
+    // limit is an int64, the global declared before the function.
+    replace(document, "return twice(x);", "return limit;");
+    EXPECT_EQ(describe(document.getDiagnostics()), "11:12-11:17 Type error: expected int32 but got int64\n");
+    expectSameAsFullAnalysis(document);
+    replace(document, "x := 1;\n    return limit;", "x := 1;\n    int64 y := clamp(limit);\n    return x;");
+    EXPECT_EQ(describe(document.getDiagnostics()), "");
+    replace(document, "return a * 2;", "return a * ;");
+    EXPECT_EQ(describe(document.getDiagnostics()), "3:16-3:17 Unexpected token: ;\n");
+    expectSameAsFullAnalysis(document);
+    EXPECT_EQ(document.getStatistics().fullAnalyses, full);
+    EXPECT_EQ(document.getStatistics().functionAnalyses, 3u);
+}
+
+TEST(DocumentTest, diagnosticsFollowTheLinesAddedBeforeThem)
+{
+    Lexer::LexerContext::init();
+    Ckc::Document document(program);
+    replace(document, "return twice(x);", "return twice(x) = 1;");
+    EXPECT_EQ(describe(document.getDiagnostics()), "11:12-11:24 Type error: expected int32 but got bool\n");
+    replace(document, "return a * 2;", "int32 b := a;\n\n    return b * 2;");
+    EXPECT_EQ(describe(document.getDiagnostics()), "13:12-13:24 Type error: expected int32 but got bool\n");
+    expectSameAsFullAnalysis(document);
+    replace(document, "int32 b := a;\n\n    return b * 2;", "return a * 2;");
+    EXPECT_EQ(describe(document.getDiagnostics()), "11:12-11:24 Type error: expected int32 but got bool\n");
+    expectSameAsFullAnalysis(document);
+}
+
+TEST(DocumentTest, otherEditsAnalyseEverything)
+{
+    Lexer::LexerContext::init();
+    Ckc::Document document(program);
+    const auto full = document.getStatistics().fullAnalyses;
+    // twice now returns an int64.
+    replace(document, "function twice(int32 a) return int32", "function twice(int32 a) return int64");
+    EXPECT_EQ(document.getStatistics().fullAnalyses, full + 1);
+    EXPECT_EQ(describe(document.getDiagnostics()), "3:12-3:17 Type error: expected int64 but got int32\n11:12-11:20 Type error: expected int32 but got int64\n");
+    replace(document, "int64 limit := 10;", "int64 limit := ;");
+    EXPECT_EQ(document.getStatistics().fullAnalyses, full + 2);
+    EXPECT_EQ(describe(document.getDiagnostics()), "1:16-1:17 Unexpected token: ;\n");
+    expectSameAsFullAnalysis(document);
+}
+
+TEST(DocumentTest, randomEditsMatchAFullAnalysis)
+{
+    Lexer::LexerContext::init();
+    std::mt19937 random(7);
+    const std::vector<std::string> statements = {"int32 y := 1;", "a := a + 1;", "return limit;", "if a > 1 then return a; fi", "int64 z := f0(limit);", "return f1(a);", "a := ;", "return a = 1;"};
+    std::string text = "int64 limit := 10;\n";
+    for (int f = 0; f < 12; f++)
+    {
+        const std::string type = f % 2 == 0 ? "int32" : "int64";
+        text += "function f" + std::to_string(f) + "(" + type + " a) return " + type + " is\n";
+        for (int s = 0; s < 3; s++)
+            text += "    " + statements[random() % statements.size()] + "\n";
+        text += "    return a;\nendfunction\n";
+    }
+    Ckc::Document document(text);
+    for (int edit = 0; edit < 300; edit++)
+    {
+        const std::string &current = document.getText();
+        const std::size_t begin = random() % current.size();
+        const std::size_t end = std::min(current.size(), begin + random() % 3);
+        std::string replacement;
+        if (random() % 2 == 0)
+            replacement = random() % 4 == 0 ? "\n" : statements[random() % statements.size()];
+        document.change(begin, end, replacement);
+        expectSameAsFullAnalysis(document);
+        if (HasFailure())
+            return;
+    }
+    EXPECT_GT(document.getStatistics().functionAnalyses, 0u);
+}
+
+TEST(DocumentTest, overflowingLiteralIsASyntaxError)
+{
+    Lexer::LexerContext::init();
+    Ckc::Document document(program);
+    replace(document, "return a * 2;", "return a * 99999999999;");
+    EXPECT_EQ(describe(document.getDiagnostics()), "3:16-3:27 Number out of range: 99999999999\n");
+    expectSameAsFullAnalysis(document);
+    replace(document, "99999999999", "2");
+    EXPECT_EQ(describe(document.getDiagnostics()), "");
+    EXPECT_EQ(document.getStatistics().functionAnalyses, 2u);
+}
+
+TEST(DocumentTest, languageServerPublishesDiagnostics)
+{
+    Lexer::LexerContext::init();
+    std::istringstream input;
+    std::ostringstream output;
+    Ckc::LanguageServer server(input, output);
+    EXPECT_TRUE(server.handle(R"({"jsonrpc":"2.0","id":1,"method":"initialize","params":{}})"));
+    EXPECT_NE(output.str().find(R"("textDocumentSync":{"change":2,"openClose":true})"), std::string::npos) << output.str();
+    output.str("");
+    EXPECT_TRUE(server.handle(R"({"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"file:///a.kc","version":1,"text":"function f() return int32 is\n    return 1;\nendfunction\n"}}})"));
+    EXPECT_NE(output.str().find(R"("diagnostics":[])"), std::string::npos) << output.str();
+    output.str("");
+    // "1" becomes "1 = 1".
+    EXPECT_TRUE(server.handle(R"({"jsonrpc":"2.0","method":"textDocument/didChange","params":{"textDocument":{"uri":"file:///a.kc","version":2},"contentChanges":[{"range":{"start":{"line":1,"character":12},"end":{"line":1,"character":12}},"text":" = 1"}]}})"));
+    EXPECT_NE(output.str().find(R"("range":{"end":{"character":16,"line":1},"start":{"character":11,"line":1}})"), std::string::npos) << output.str();
+    EXPECT_NE(output.str().find("Type error: expected int32 but got bool"), std::string::npos);
+    EXPECT_EQ(server.getDocument("file:///a.kc")->getText(), "function f() return int32 is\n    return 1 = 1;\nendfunction\n");
+    output.str("");
+    EXPECT_TRUE(server.handle(R"({"jsonrpc":"2.0","id":2,"method":"shutdown"})"));
+    EXPECT_NE(output.str().find(R"("id":2,"jsonrpc":"2.0","result":null)"), std::string::npos) << output.str();
+    EXPECT_FALSE(server.handle(R"({"jsonrpc":"2.0","method":"exit"})"));
+}
@@ -0,0 +1,158 @@
+#include "frontend.hpp"
+#include "contextProvider.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+
+class FrontendTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Lexer::LexerContext::init();
+  }
+};
+
+TEST_F(FrontendTest, scanFunctions)
+{
+    // Only the first body is independent: a declaration has no body and the
+    // last body holds a pragma.
+    auto stream = std::stringstream("int32 g := 1; function sa() return int32 is if g > 0 then return 1; fi return 0; endfunction "
+                                    "function sb() return int32; function sc() return int32 is pragma sb symbol_name is x; return 1; endfunction");
+    Lexer::TokenStream ts(stream);
+    auto ranges = Frontend::scanFunctions(ts);
+    ASSERT_EQ(ranges.size(), 1u);
+    EXPECT_EQ(ranges[0].begin, 5u);
+    EXPECT_EQ(ranges[0].body, 11u);
+    EXPECT_EQ(ranges[0].end, 25u);
+    EXPECT_EQ(ts.tell(), 0u);
+}
+
+TEST_F(FrontendTest, parallelBodies)
+{
+    auto stream = std::stringstream("function pa(int32 a) return int32 is return a; endfunction\n"
+                                    "function pb(int32 b) return int32 is return pa(b) + 1; endfunction\n"
+                                    "function pc() return int32 is return pb(2); endfunction\n");
+    Lexer::TokenStream ts(stream);
+    auto result = Frontend::run(ts, 3, false);
+    EXPECT_EQ(result.syntaxErrors, 0u);
+    EXPECT_FALSE(result.typeError);
+    ASSERT_EQ(result.nodes.size(), 3u);
+    for (auto node : result.nodes)
+        EXPECT_TRUE(node.get<Parser::NodeFunction>()->body.has_value());
+}
+
+TEST_F(FrontendTest, diagnosticsInSourceOrder)
+{
+    auto stream = std::stringstream("function pd() return int32 is return (1; endfunction\n"
+                                    "function pe() return int32 is return 1; endfunction\n"
+                                    "function pf() return int32 is int32 x := ; return 1; endfunction\n");
+    Lexer::TokenStream ts(stream, "order.kc");
+    std::ostringstream diagnostics;
+    ts.setDiagnostics(diagnostics);
+    auto result = Frontend::run(ts, 3, false);
+    EXPECT_EQ(result.syntaxErrors, 2u);
+    EXPECT_TRUE(result.nodes.empty());
+    const std::string text = diagnostics.str();
+    ASSERT_NE(text.find("order.kc:1:"), std::string::npos);
+    ASSERT_NE(text.find("order.kc:3:"), std::string::npos);
+    EXPECT_LT(text.find("order.kc:1:"), text.find("order.kc:3:"));
+}
+
+TEST_F(FrontendTest, pragmaErrorsKeepEarlierDiagnostics)
+{
+    const std::string source = "function pg() return int32 is return (1; endfunction\n"
+                               "function ph() return int32 is return 1; endfunction\n"
+                               "pragma ph bogus is \"x\";\n";
+    for (unsigned jobs : {1u, 2u})
+    {
+        auto stream = std::stringstream(source);
+        Lexer::TokenStream ts(stream, "pragma.kc");
+        std::ostringstream diagnostics;
+        ts.setDiagnostics(diagnostics);
+        auto result = Frontend::run(ts, jobs, false);
+        EXPECT_EQ(result.syntaxErrors, 1u);
+        EXPECT_NE(diagnostics.str().find("pragma.kc:1:"), std::string::npos) << diagnostics.str();
+    }
+
+    // Without the syntax error the pragma error is reported, in every mode.
+    for (unsigned jobs : {1u, 2u})
+    {
+        // The syntax errors above are not this file's.
+        Parser::SyntaxErrors &previous = Parser::SyntaxErrors::getCurrent();
+        Parser::SyntaxErrors errors;
+        Parser::SyntaxErrors::setCurrent(errors);
+        auto stream = std::stringstream(source.substr(source.find('\n') + 1));
+        Lexer::TokenStream ts(stream, "pragma.kc");
+        std::ostringstream diagnostics;
+        ts.setDiagnostics(diagnostics);
+        auto result = Frontend::run(ts, jobs, false);
+        EXPECT_EQ(result.syntaxErrors, 0u);
+        EXPECT_TRUE(result.typeError);
+        EXPECT_NE(diagnostics.str().find("Pragma type IDENTIFIER not implemented"), std::string::npos) << diagnostics.str();
+        EXPECT_NE(diagnostics.str().find("pragma.kc:2:1"), std::string::npos) << diagnostics.str();
+        Parser::SyntaxErrors::setCurrent(previous);
+    }
+}
+
+TEST_F(FrontendTest, nonConstantGlobalsFailTheCompile)
+{
+    const std::string source = "function sa(int32 a) return int32 is return a; endfunction\n"
+                               "int32 sb := sa(1);\n"
+                               "int32 sc := sb;\n"
+                               "function sd() return int32 is return sb + sc; endfunction\n";
+    for (unsigned jobs : {1u, 2u})
+    {
+        // The syntax errors of the tests before are not this file's.
+        Parser::SyntaxErrors &previous = Parser::SyntaxErrors::getCurrent();
+        Parser::SyntaxErrors errors;
+        Parser::SyntaxErrors::setCurrent(errors);
+        auto stream = std::stringstream(source);
+        Lexer::TokenStream ts(stream, "global.kc");
+        std::ostringstream diagnostics;
+        ts.setDiagnostics(diagnostics);
+        auto result = Frontend::run(ts, jobs, false);
+        EXPECT_EQ(result.syntaxErrors, 0u);
+        EXPECT_TRUE(result.typeError);
+        const std::string text = diagnostics.str();
+        EXPECT_NE(text.find("global.kc:2:13"), std::string::npos) << text;
+        EXPECT_NE(text.find("global.kc:3:13"), std::string::npos) << text;
+        Parser::SyntaxErrors::setCurrent(previous);
+    }
+}
+
+TEST_F(FrontendTest, pipelineLowersInOrder)
+{
+    auto stream = std::stringstream("function qa(int32 a) return int32 is return a; endfunction\n"
+                                    "function qb() return int32; pragma qb symbol_name is qc;\n"
+                                    "function qd() return int32 is return qa(2); endfunction\n");
+    Lexer::TokenStream ts(stream);
+    std::vector<std::string> lowered;
+    auto result = Frontend::runPipeline(ts, false, [&lowered](Parser::NodeIdentifier node)
+                                        {
+                                            if (auto function = node.get<Parser::NodeFunction>())
+                                                lowered.push_back(function->symbol_name.value_or(function->name.str())); });
+    EXPECT_EQ(result.syntaxErrors, 0u);
+    EXPECT_FALSE(result.typeError);
+    // qb is lowered once the pragma renamed it.
+    EXPECT_EQ(lowered, (std::vector<std::string>{"qa", "qc", "qd"}));
+    EXPECT_EQ(result.nodes.size(), 4u);
+}
+
+TEST_F(FrontendTest, streamingReleasesBlocks)
+{
+    auto stream = std::stringstream("function ra(int32 a) return int32 is return a; endfunction\n"
+                                    "function rb() return int32; pragma rb symbol_name is rc;\n"
+                                    "function rd() return int32 is return ra(2) + rb(); endfunction\n");
+    Lexer::TokenStream ts(Lexer::SourceBuffer::fromStream(stream), "", true);
+    std::vector<std::string> lowered;
+    auto result = Frontend::runStreaming(ts, false, [&](Parser::NodeIdentifier node)
+                                         {
+                                             if (auto function = node.get<Parser::NodeFunction>())
+                                                 lowered.push_back(function->symbol_name.value()); });
+    EXPECT_EQ(result.syntaxErrors, 0u);
+    EXPECT_FALSE(result.typeError);
+    EXPECT_EQ(lowered, (std::vector<std::string>{"ra", "rc", "rd"}));
+    EXPECT_TRUE(result.nodes.empty());
+    // Only the signature of rb is left, with the name given by the pragma.
+    auto &overloads = Context::ContextProvider::getInstance().functions[Lexer::Symbol("rb")].overloads;
+    ASSERT_EQ(overloads.size(), 1u);
+    EXPECT_EQ(overloads[0].symbolName, "rc");
+}
@@ -8,6 +8,14 @@ Usage: ./gkc [options] [file]
 Options:
   -s, --silent        Do not print AST
   --print-llvm        Print LLVM IR
+  -j, --jobs N        Compile on N threads
+  --pipeline          Overlap parsing, type checking and code generation
+  --stream            Compile block by block in bounded memory
+  --cache-dir DIR     Reuse the AST and the code of unchanged functions from DIR
+  --server SOCKET     Compile the requests of gkc-client on SOCKET until interrupted,
+                      -j N of them at once, one per hardware thread by default
+  --lsp               Run a language server on the standard input and output
+  --watch             Compile again each time the file changes, until interrupted
   -h, --help          Print this help message
 EOF
 )
@@ -77,6 +85,37 @@ function test_stderr
     fi
 }
 
+# Compile toCompile in the default mode, then with each of the other modes:
+# the exit status, the diagnostics and the result of the program must not change.
+function test_modes
+{
+    toCompile=$1
+
+    echo "$toCompile" > "functest.kc"
+    rm -rf functest-cache
+    expected=""
+    for mode in "" "-j 2" "--pipeline" "--stream" "--cache-dir functest-cache" "--cache-dir functest-cache"; do
+        rm -f output.o a.out
+        $executablePath "functest.kc" --silent $mode > functest.out 2>&1
+        return_code=$?
+        # The cache reports its hits and misses, which no other mode does.
+        diagnostics=$(grep -v "^Object cache:" functest.out)
+        result="none"
+        if [ $return_code -eq 0 ]; then
+            gcc output.o > /dev/null 2>&1 && ./a.out
+            result=$?
+        fi
+        actual="$return_code $result $diagnostics"
+        if [ -z "$mode" ]; then
+            expected=$actual
+        elif [ "$actual" != "$expected" ]; then
+            echo "Wrong output with $mode: $toCompile | Expected: $expected Got: $actual"
+            exit 1
+        fi
+    done
+    rm -rf functest-cache functest.out
+}
+
 # Basic tests
 test "return 42;" 42 "int32"
 test "int32 i := 42; return i;" 42 "int32"
@@ -148,4 +187,12 @@ test "return -42;" 214 "int32"
 
 # Wrong option
 test_stderr "Test no options" "" "$text_no_input_file" 1
-test_stdout "Test wrong option" "--wrong-option" "$text_help" 1
\ No newline at end of file
+test_stdout "Test wrong option" "--wrong-option" "$text_help" 1
+
+# Every mode compiles the same way
+test_modes "function ma(int32 a) return int32 is return a * 3; endfunction
+function mb() return int32 is return ma(4) + 2; endfunction
+pragma mb symbol_name is main;"
+test_modes "function main() return int32 is return (1; endfunction
+function mc() return int32 is int32 x := ; return 1; endfunction"
+test_modes "function main() return int32 is return uint32(1); endfunction"
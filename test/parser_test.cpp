@@ -1,5 +1,8 @@
 #include "lexer_test.hpp"
 #include "parser.hpp"
+#include "flatTree.hpp"
+#include "visitor/dispatcher.hpp"
+#include "visitor/typeVisitor.hpp"
 #include <gtest/gtest.h>
 
 using namespace testing;
@@ -16,7 +19,53 @@ TEST_F(ParserTest, missingSemicolon) {
     MockTokenStream ts(stream);
     EXPECT_CALL(ts, unexpectedToken(Token(TokenType::TOKEN_EOF, std::string(""), 1, sizeof("int64 i := 0")), std::optional<TokenType>(TokenType::SEMICOLON)))
         .Times(1);
-    EXPECT_THROW(Parser::parseBlock(ts), std::exception);
+    Parser::NodeIdentifier block;
+    ASSERT_NO_THROW(block = Parser::parseBlock(ts));
+    EXPECT_THAT(block.get(), IsNull());
+    EXPECT_TRUE(Parser::hasError());
+}
+
+TEST_F (ParserTest, recoverAfterErrors)
+{
+    // Three broken statements, every one is reported and the valid blocks
+    // around them are kept.
+    auto stream = std::stringstream("function f() return int32 is int32 a := 1; a := ; a := 1 2; return a; endfunction int32 b := ( 1 ; int32 c := 3;");
+    MockTokenStream ts(stream);
+    EXPECT_CALL(ts, unexpectedToken(_, _)).Times(3);
+    const std::size_t errors = Parser::errorCount();
+    std::vector<Parser::NodeIdentifier> blocks;
+    while (!ts.isEmpty())
+    {
+        auto block = Parser::parseBlock(ts);
+        if (block.get() == nullptr)
+            Parser::synchronize(ts);
+        else
+            blocks.push_back(block);
+    }
+    EXPECT_EQ(Parser::errorCount() - errors, 3);
+    ASSERT_EQ(blocks.size(), 2);
+    auto function = blocks[0].get<Parser::NodeFunction>();
+    ASSERT_THAT(function, NotNull());
+    EXPECT_EQ(function->body.value().get<Parser::NodeMultiBlock>()->blocks.size(), 2);
+    EXPECT_THAT(blocks[1].get<Parser::NodeVariableDeclaration>(), NotNull());
+}
+
+TEST_F (ParserTest, numberOutOfRange)
+{
+    auto stream = std::stringstream("function main() return int32 is return 99999999999; endfunction int32 b := 2147483647;");
+    TokenStream ts(stream);
+    std::vector<Diagnostic> diagnostics;
+    ts.collectDiagnostics(&diagnostics);
+    const std::size_t errors = Parser::errorCount();
+    Parser::NodeIdentifier block;
+    ASSERT_NO_THROW(block = Parser::parseBlock(ts));
+    // The statement is dropped, the function and the next block are kept.
+    EXPECT_THAT(block.get<Parser::NodeFunction>(), NotNull());
+    EXPECT_EQ(Parser::errorCount() - errors, 1);
+    ASSERT_EQ(diagnostics.size(), 1);
+    EXPECT_EQ(diagnostics[0].message, "Number out of range: 99999999999");
+    EXPECT_EQ(diagnostics[0].ranges, std::vector<SourceRange>({{{1, 40}, {1, 51}}}));
+    EXPECT_THAT(Parser::parseBlock(ts).get<Parser::NodeVariableDeclaration>(), NotNull());
 }
 
 TEST_F (ParserTest, parseFunction)
@@ -49,7 +98,7 @@ TEST_F (ParserTest, assertThrowsInGet)
     auto functionCall = Parser::parseExpression(ts);
     ASSERT_THAT(functionCall.get(), NotNull());
     // check if function is of type NodeFunction
-    ASSERT_THAT(functionCall.get<Parser::NodeText>().get(), IsNull());
+    ASSERT_THAT(functionCall.get<Parser::NodeText>(), IsNull());
 }
 
 TEST_F (ParserTest, parseFunctionCall)
@@ -62,5 +111,214 @@ TEST_F (ParserTest, parseFunctionCall)
     auto functionCall = Parser::parseExpression(ts);
     ASSERT_THAT(functionCall.get(), NotNull());
     // check if function is of type NodeFunction
-    ASSERT_THAT(functionCall.get<Parser::NodeFunctionCall>().get(), NotNull());
-}
\ No newline at end of file
+    ASSERT_THAT(functionCall.get<Parser::NodeFunctionCall>(), NotNull());
+}
+TEST_F (ParserTest, nodeKinds)
+{
+    auto stream = std::stringstream("int32 a := - (1 + 2);");
+    MockTokenStream ts(stream);
+    auto declaration = Parser::parseBlock(ts);
+    ASSERT_THAT(declaration.get<Parser::NodeVariableDeclaration>(), NotNull());
+    ASSERT_THAT(declaration.get<Parser::NodeStatement>(), NotNull());
+    ASSERT_THAT(declaration.get<Parser::NodeBlock>(), NotNull());
+    ASSERT_THAT(declaration.get<Parser::NodeExpression>(), IsNull());
+    auto value = declaration.get<Parser::NodeVariableDeclaration>()->value.value();
+    ASSERT_THAT(value.get<Parser::NodeUnaryOperator>(), NotNull());
+    ASSERT_THAT(value.get<Parser::NodeExpression>(), NotNull());
+    ASSERT_THAT(value.get<Parser::NodeBlock>(), IsNull());
+    ASSERT_EQ(value->thisNode.node, value.node);
+}
+
+TEST_F (ParserTest, arenaReset)
+{
+    Parser::Arena &previous = Parser::Arena::getCurrent();
+    Parser::Arena arena;
+    Parser::Arena::setCurrent(arena);
+    auto stream = std::stringstream("function f(int32 a) return int32 is return a * 2; endfunction");
+    MockTokenStream ts(stream);
+    ASSERT_THAT(Parser::parseBlock(ts).get<Parser::NodeFunction>(), NotNull());
+    ASSERT_GT(arena.bytesUsed(), 0u);
+    arena.reset();
+    ASSERT_EQ(arena.bytesUsed(), 0u);
+    Parser::Arena::setCurrent(previous);
+}
+
+TEST_F (ParserTest, flatTree)
+{
+    const std::string source = "function f(int32 a) return int32 is\nreturn a * (a + 2);\nendfunction";
+    auto stream = std::stringstream(source);
+    MockTokenStream ts(stream);
+    auto function = Parser::parseBlock(ts);
+    auto tree = Parser::FlatTree::build({function});
+    ASSERT_EQ(tree.roots.size(), 1u);
+    const auto root = tree.roots[0];
+    // Post-order: the root is the last node and every child precedes its parent.
+    ASSERT_EQ(root, tree.size() - 1);
+    ASSERT_EQ(tree.kinds[root], Parser::NodeKind::Function);
+    for (Parser::FlatTree::Index node = 0; node < tree.size(); node++)
+        for (auto i = tree.firstChild[node]; i < tree.firstChild[node] + tree.childCount[node]; i++)
+        {
+            ASSERT_LT(tree.children[i], node);
+            ASSERT_EQ(tree.parents[tree.children[i]], node);
+        }
+    auto text = [&](Parser::FlatTree::Index node)
+    { return source.substr(tree.spans[node].begin, tree.spans[node].end - tree.spans[node].begin); };
+    ASSERT_EQ(text(root), source);
+    // The return statement spans "return" to the closing parenthesis.
+    auto returnNode = tree.children[tree.firstChild[tree.children[tree.firstChild[root]]]];
+    ASSERT_EQ(tree.kinds[returnNode], Parser::NodeKind::Return);
+    ASSERT_EQ(text(returnNode), "return a * (a + 2)");
+    const Lexer::SourceRange range = ts.rangeOf(tree.spans[returnNode]);
+    EXPECT_EQ(range.begin, (Lexer::SourcePosition{2, 1}));
+    EXPECT_EQ(range.end, (Lexer::SourcePosition{2, 19}));
+}
+
+TEST_F (ParserTest, flatTreeInnermostExpression)
+{
+    const std::string source = "function f(int32 a) return int32 is\nreturn a * (a + 2);\nendfunction";
+    auto stream = std::stringstream(source);
+    MockTokenStream ts(stream);
+    auto tree = Parser::FlatTree::build({Parser::parseBlock(ts)});
+    auto at = [&](std::size_t offset)
+    {
+        const auto node = tree.innermostExpression([&](Lexer::Span span)
+                                                   { return span.begin <= offset && offset < span.end; });
+        return node == Parser::FlatTree::none ? std::string() : source.substr(tree.spans[node].begin, tree.spans[node].end - tree.spans[node].begin);
+    };
+    const std::size_t body = source.find('\n') + 1;
+    EXPECT_EQ(at(body + 7), "a");
+    EXPECT_EQ(at(body + 9), "a * (a + 2)");
+    EXPECT_EQ(at(body + 12), "a");
+    EXPECT_EQ(at(body + 14), "(a + 2)");
+    EXPECT_EQ(at(body + 16), "2");
+    EXPECT_EQ(at(body), "");
+    EXPECT_EQ(at(0), "");
+}
+
+template <bool Enter>
+class RecordingVisitor final : public Parser::Visitor, public visitor::Dispatcher<RecordingVisitor<Enter>>
+{
+public:
+    static constexpr bool visitsEnterNode = Enter;
+    std::vector<std::string> calls;
+    void enterNode(Parser::Node &node) override { calls.push_back("enter"); }
+    void visitNode(Parser::Node &node) override { calls.push_back("node"); }
+    void visitNodeIf(Parser::NodeIf &node) override { calls.push_back("if"); }
+    void visitNodeGoto(Parser::NodeGoto &node) override { calls.push_back("goto"); }
+    void visitBinOperator(Parser::NodeBinOperator &node) override { calls.push_back("binop"); }
+    void visitNodeNumber(Parser::NodeNumber &node) override { calls.push_back("number"); }
+    void visitNodeVariableDeclaration(Parser::NodeVariableDeclaration &node) override { calls.push_back("declaration"); }
+    void visitNodeVariableAssignment(Parser::NodeVariableAssignment &node) override { calls.push_back("assignment"); }
+    void visitNodeBlockModifier(Parser::NodeBlockModifier &node) override { calls.push_back("modifier"); }
+    void visitNodeText(Parser::NodeText &node) override { calls.push_back("text"); }
+    void visitNodeReturn(Parser::NodeReturn &node) override { calls.push_back("return"); }
+    void visitNodeUnaryOperator(Parser::NodeUnaryOperator &node) override { calls.push_back("unary"); }
+    void visitNodeFunction(Parser::NodeFunction &node) override { calls.push_back("function"); }
+    void visitNodeFunctionCall(Parser::NodeFunctionCall &node) override { calls.push_back("call"); }
+    void visitNodePragma(Parser::NodePragma &node) override { calls.push_back("pragma"); }
+    void visitNodeCast(Parser::NodeCast &node) override { calls.push_back("cast"); }
+};
+
+TEST_F (ParserTest, dispatchMatchesAccept)
+{
+    auto stream = std::stringstream("int32 a := 1; #here a := 2; if a > 1 then goto here; fi function f() return int32; return a;");
+    MockTokenStream ts(stream);
+    auto root = Parser::parseMultiBlock(ts);
+    RecordingVisitor<true> accepted, dispatched;
+    RecordingVisitor<false> withoutEnter;
+    root->accept(accepted);
+    dispatched.dispatch(root);
+    withoutEnter.dispatch(root);
+    ASSERT_THAT(accepted.calls, Contains("modifier"));
+    ASSERT_EQ(dispatched.calls, accepted.calls);
+    accepted.calls.erase(std::remove(accepted.calls.begin(), accepted.calls.end(), "enter"), accepted.calls.end());
+    ASSERT_EQ(withoutEnter.calls, accepted.calls);
+
+    // Past a few hundred levels dispatch continues from its work stack.
+    std::string deep = "int32 b := ";
+    for (int i = 0; i < 300; i++)
+        deep += "( - ( int32 ( a ) + ";
+    deep += "1";
+    for (int i = 0; i < 300; i++)
+        deep += " ) * 2 )";
+    stream = std::stringstream(deep + ";");
+    MockTokenStream deepTs(stream);
+    root = Parser::parseBlock(deepTs);
+    ASSERT_THAT(root.get(), NotNull());
+    RecordingVisitor<true> deepAccepted, deepDispatched;
+    root->accept(deepAccepted);
+    deepDispatched.dispatch(root);
+    ASSERT_EQ(deepDispatched.calls, deepAccepted.calls);
+}
+
+TEST_F (ParserTest, deepExpressions)
+{
+    // Far deeper than the native stack allows for a recursive walk.
+    const int depth = 100000;
+    std::string chain = "int32 a := 1; int32 b := a";
+    for (int i = 0; i < depth; i++)
+        chain += " + a";
+    std::string nested = "int32 c := ";
+    for (int i = 0; i < depth; i++)
+        nested += "( ";
+    nested += "a";
+    for (int i = 0; i < depth; i++)
+        nested += " )";
+    // In a function, the initial values of globals are constants.
+    const std::string header = "function deep() return int32 is ";
+    auto stream = std::stringstream(header + chain + "; " + nested + "; return a; endfunction");
+    MockTokenStream ts(stream);
+    const std::size_t errors = Parser::errorCount();
+    auto root = Parser::parseMultiBlock(ts);
+    ASSERT_THAT(root.get(), NotNull());
+    ASSERT_EQ(Parser::errorCount(), errors);
+
+    visitor::typeVisitor types;
+    ASSERT_NO_THROW(types.dispatch(root));
+    auto function = root.get<Parser::NodeMultiBlock>()->blocks[0].get<Parser::NodeFunction>();
+    ASSERT_THAT(function, NotNull());
+    auto &body = *function->body.value().get<Parser::NodeMultiBlock>();
+    auto chained = body.blocks[1].get<Parser::NodeVariableDeclaration>();
+    ASSERT_THAT(chained, NotNull());
+    EXPECT_EQ(chained->value.value()->span.begin, header.size() + chain.find(":= a") + 3);
+    EXPECT_EQ(chained->value.value()->span.end, header.size() + chain.size());
+    auto parenthesized = body.blocks[2].get<Parser::NodeVariableDeclaration>();
+    ASSERT_THAT(parenthesized, NotNull());
+    EXPECT_EQ(parenthesized->value.value()->span.begin, header.size() + chain.size() + 2 + nested.find('('));
+    EXPECT_EQ(parenthesized->value.value()->span.end, header.size() + chain.size() + 2 + nested.size());
+    auto tree = Parser::FlatTree::build({root});
+    EXPECT_EQ(tree.kinds[tree.roots[0]], Parser::NodeKind::MultiBlock);
+}
+
+std::string shape(Parser::NodeIdentifier node)
+{
+    if (auto text = node.get<Parser::NodeText>())
+        return text->name.str();
+    if (auto number = node.get<Parser::NodeNumber>())
+        return std::to_string(number->value);
+    if (auto unary = node.get<Parser::NodeUnaryOperator>())
+        return Lexer::tokenTypeToString(unary->op) + shape(unary->right);
+    if (auto binary = node.get<Parser::NodeBinOperator>())
+        return "(" + shape(binary->left) + " " + Lexer::tokenTypeToString(binary->op) + " " + shape(binary->right) + ")";
+    if (auto cast = node.get<Parser::NodeCast>())
+        return cast->type.str() + "(" + shape(cast->value) + ")";
+    return "?";
+}
+
+TEST_F (ParserTest, precedenceAndAssociativity)
+{
+    auto parse = [](std::string source)
+    {
+        auto stream = std::stringstream(source);
+        MockTokenStream ts(stream);
+        return shape(Parser::parseExpression(ts));
+    };
+    ASSERT_EQ(parse("a * b / c"), "(a * (b / c))");
+    ASSERT_EQ(parse("a - b - c"), "((a - b) - c)");
+    ASSERT_EQ(parse("a + b * c < d"), "((a + (b * c)) < d)");
+    ASSERT_EQ(parse("- a + b * c"), "-(a + (b * c))");
+    ASSERT_EQ(parse("a * - b + c"), "(a * -(b + c))");
+    ASSERT_EQ(parse("(a + b) * c"), "((a + b) * c)");
+    ASSERT_EQ(parse("a << 1 + 2 or b and c"), "((a << (1 + 2)) or (b and c))");
+    ASSERT_EQ(parse("int32(a) % 2 = 0 xor not b"), "(((int32(a) % 2) = 0) xor notb)");
+}
@@ -0,0 +1,110 @@
+#include "query.hpp"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+TEST(QueryTest, valuesAreComputedOnceUntilAnInputChanges)
+{
+    Query::Engine engine;
+    Query::Input<std::string, int> input(engine, "input");
+    int calls = 0;
+    Query::Derived<std::string, int> twice(engine, "twice", [&](const std::string &key)
+                                           {
+                                               calls++;
+                                               return input.get(key) * 2; });
+    input.set("a", 1);
+    input.set("b", 10);
+    EXPECT_EQ(twice.get("a"), 2);
+    EXPECT_EQ(twice.get("a"), 2);
+    EXPECT_EQ(twice.get("b"), 20);
+    EXPECT_EQ(calls, 2);
+
+    // Only the reader of the changed input is computed again.
+    input.set("a", 3);
+    EXPECT_EQ(twice.get("a"), 6);
+    EXPECT_EQ(twice.get("b"), 20);
+    EXPECT_EQ(calls, 3);
+    // Setting the same value changes nothing.
+    input.set("b", 10);
+    EXPECT_EQ(twice.get("b"), 20);
+    EXPECT_EQ(calls, 3);
+    // A key never set reads as a default value.
+    EXPECT_EQ(twice.get("c"), 0);
+}
+
+TEST(QueryTest, anEqualValueStopsTheInvalidation)
+{
+    Query::Engine engine;
+    Query::Input<int, int> input(engine, "input");
+    int parityCalls = 0;
+    int labelCalls = 0;
+    Query::Derived<int, bool> even(engine, "even", [&](const int &key)
+                                   {
+                                       parityCalls++;
+                                       return input.get(key) % 2 == 0; });
+    Query::Derived<int, std::string> label(engine, "label", [&](const int &key)
+                                           {
+                                               labelCalls++;
+                                               return even.get(key) ? std::string("even") : std::string("odd"); });
+    input.set(0, 2);
+    EXPECT_EQ(label.get(0), "even");
+    input.set(0, 4);
+    EXPECT_EQ(label.get(0), "even");
+    EXPECT_EQ(parityCalls, 2);
+    EXPECT_EQ(labelCalls, 1);
+    input.set(0, 5);
+    EXPECT_EQ(label.get(0), "odd");
+    EXPECT_EQ(labelCalls, 2);
+
+    const auto &statistics = engine.getStatistics();
+    EXPECT_EQ(statistics.at("even").computed, 3u);
+    EXPECT_EQ(statistics.at("even").unchanged, 1u);
+    EXPECT_EQ(statistics.at("label").computed, 2u);
+    EXPECT_EQ(statistics.at("label").reused, 1u);
+    EXPECT_DOUBLE_EQ(statistics.at("label").hitRate(), 1.0 / 3);
+    engine.resetStatistics();
+    EXPECT_EQ(engine.getStatistics().at("label").computed, 0u);
+}
+
+TEST(QueryTest, dependenciesAreTheOnesOfTheLastComputation)
+{
+    Query::Engine engine;
+    Query::Input<std::string, int> input(engine, "input");
+    int calls = 0;
+    // Reads b only when a is set.
+    Query::Derived<int, int> sum(engine, "sum", [&](const int &)
+                                 {
+                                     calls++;
+                                     const int a = input.get("a");
+                                     return a == 0 ? 0 : a + input.get("b"); });
+    EXPECT_EQ(sum.get(0), 0);
+    input.set("b", 5);
+    EXPECT_EQ(sum.get(0), 0);
+    EXPECT_EQ(calls, 1);
+    input.set("a", 1);
+    EXPECT_EQ(sum.get(0), 6);
+    input.set("b", 6);
+    EXPECT_EQ(sum.get(0), 7);
+    EXPECT_EQ(calls, 3);
+}
+
+TEST(QueryTest, failuresAndCyclesAreReported)
+{
+    Query::Engine engine;
+    Query::Input<int, int> input(engine, "input");
+    std::function<int(const int &)> next;
+    Query::Derived<int, int> chain(engine, "chain", [&](const int &key)
+                                   { return next(key); });
+    next = [&](const int &key)
+    {
+        if (input.get(key) < 0)
+            throw std::runtime_error("negative");
+        return key == 0 ? 0 : chain.get(key == 2 ? 1 : 2) + 1;
+    };
+    EXPECT_EQ(chain.get(0), 0);
+    EXPECT_THROW(chain.get(1), std::logic_error);
+    input.set(0, -1);
+    EXPECT_THROW(chain.get(0), std::runtime_error);
+    // A failed value is computed again by the next read.
+    input.set(0, 1);
+    EXPECT_EQ(chain.get(0), 0);
+}
@@ -0,0 +1,144 @@
+#include "protocol.hpp"
+#include "server.hpp"
+#include "session.hpp"
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/FileSystem.h>
+#include <gtest/gtest.h>
+#include <limits>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+class ServerTest : public ::testing::Test
+{
+protected:
+    llvm::SmallString<128> directory;
+    std::unique_ptr<Ckc::Server> server;
+    std::thread serving;
+
+    void SetUp() override
+    {
+        Lexer::LexerContext::init();
+        llvm::sys::fs::createUniqueDirectory("gkc-server-test", directory);
+        std::string error;
+        auto createTargetMachine = Ckc::hostTargetMachine(error);
+        ASSERT_TRUE(createTargetMachine) << error;
+        server = std::make_unique<Ckc::Server>(socket(), createTargetMachine, 2);
+        ASSERT_TRUE(server->listen(error)) << error;
+        serving = std::thread([this]()
+                              { server->serve(); });
+    }
+    void TearDown() override
+    {
+        if (serving.joinable())
+        {
+            server->stop();
+            serving.join();
+        }
+        server.reset();
+        llvm::sys::fs::remove_directories(directory);
+    }
+    std::string socket() { return (directory + "/gkc.sock").str(); }
+    Ckc::Request request(const std::string &source, const std::string &name)
+    {
+        Ckc::Request request;
+        request.filename = name + ".gk";
+        request.objectFilename = (directory + "/" + name + ".o").str();
+        request.source = source;
+        return request;
+    }
+};
+
+TEST_F(ServerTest, concurrentRequests)
+{
+    const int clients = 4;
+    const int requests = 5;
+    std::vector<int> compiled(clients, 0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; c++)
+        threads.emplace_back([&, c]()
+                             {
+                                 for (int i = 0; i < requests; i++)
+                                 {
+                                     auto sent = request("function f() return int32 is return " + std::to_string(i) + "; endfunction", "c" + std::to_string(c));
+                                     sent.jobs = 1 + i % 2;
+                                     Ckc::Response response;
+                                     std::string error;
+                                     compiled[c] += Ckc::compileRemote(socket(), sent, response, error) && response.compiled && response.diagnostics.empty();
+                                 } });
+    for (auto &thread : threads)
+        thread.join();
+    for (int c = 0; c < clients; c++)
+    {
+        EXPECT_EQ(compiled[c], requests);
+        EXPECT_TRUE(llvm::sys::fs::exists((directory + "/c" + std::to_string(c) + ".o").str()));
+    }
+    EXPECT_EQ(server->getStatistics().requests, std::size_t(clients * requests));
+}
+
+TEST_F(ServerTest, diagnosticsGoToTheClient)
+{
+    Ckc::Response response;
+    std::string error;
+    ASSERT_TRUE(Ckc::compileRemote(socket(), request("int32 a := ;", "bad"), response, error)) << error;
+    EXPECT_FALSE(response.compiled);
+    EXPECT_NE(response.diagnostics.find("bad.gk:1"), std::string::npos);
+    EXPECT_EQ(server->getStatistics().failed, 1u);
+}
+
+TEST_F(ServerTest, badPragmaFailsOnlyItsRequest)
+{
+    Ckc::Response response;
+    std::string error;
+    ASSERT_TRUE(Ckc::compileRemote(socket(), request("function f() return int32 is return 1; endfunction pragma f bogus is \"x\";", "pragma"), response, error)) << error;
+    EXPECT_FALSE(response.compiled);
+    EXPECT_NE(response.diagnostics.find("Pragma type IDENTIFIER not implemented"), std::string::npos) << response.diagnostics;
+    ASSERT_TRUE(Ckc::compileRemote(socket(), request("function f() return int32 is return 1; endfunction", "next"), response, error)) << error;
+    EXPECT_TRUE(response.compiled) << response.diagnostics;
+}
+
+TEST_F(ServerTest, requestsCannotExhaustTheServer)
+{
+    // As many jobs as a request can ask for run on the threads of the server.
+    auto greedy = request("function f() return int32 is return 1; endfunction", "greedy");
+    greedy.jobs = std::numeric_limits<std::uint32_t>::max();
+    Ckc::Response response;
+    std::string error;
+    ASSERT_TRUE(Ckc::compileRemote(socket(), greedy, response, error)) << error;
+    EXPECT_TRUE(response.compiled) << response.diagnostics;
+
+    // A string longer than the protocol allows drops the request.
+    sockaddr_un address;
+    ASSERT_TRUE(Ckc::socketAddress(socket(), address, error)) << error;
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    std::string message(reinterpret_cast<const char *>(&Ckc::protocolVersion), sizeof(Ckc::protocolVersion));
+    const std::uint32_t jobs = 1;
+    const std::uint64_t length = std::uint64_t(1) << 40;
+    message.append(reinterpret_cast<const char *>(&jobs), sizeof(jobs));
+    message.append(2, '\0');
+    message.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    ASSERT_EQ(write(fd, message.data(), message.size()), ssize_t(message.size()));
+    char byte;
+    EXPECT_EQ(read(fd, &byte, 1), 0);
+    close(fd);
+    EXPECT_EQ(server->getStatistics().dropped, 1u);
+    ASSERT_TRUE(Ckc::compileRemote(socket(), greedy, response, error)) << error;
+    EXPECT_TRUE(response.compiled);
+}
+
+TEST_F(ServerTest, socketIsTakenOnce)
+{
+    std::string error;
+    Ckc::Server second(socket(), Ckc::hostTargetMachine(error), 1);
+    EXPECT_FALSE(second.listen(error));
+    // Once stopped, the first server still answers the requests it accepted,
+    // and removes its socket when destroyed.
+    server->stop();
+    serving.join();
+    server.reset();
+    EXPECT_FALSE(llvm::sys::fs::exists(socket()));
+    Ckc::Response response;
+    EXPECT_FALSE(Ckc::compileRemote(socket(), request("", "none"), response, error));
+}
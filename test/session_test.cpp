@@ -0,0 +1,98 @@
+#include "session.hpp"
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/FileSystem.h>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <thread>
+
+class SessionTest : public ::testing::Test {
+ protected:
+  llvm::SmallString<128> directory;
+  Backend::TargetMachineFactory createTargetMachine;
+  void SetUp() override {
+    Lexer::LexerContext::init();
+    llvm::sys::fs::createUniqueDirectory("gkc-session-test", directory);
+    std::string error;
+    createTargetMachine = Ckc::hostTargetMachine(error);
+    ASSERT_TRUE(createTargetMachine) << error;
+  }
+  void TearDown() override {
+    llvm::sys::fs::remove_directories(directory);
+  }
+  std::string object(const std::string &name) {
+    return (directory + "/" + name + ".o").str();
+  }
+};
+
+std::shared_ptr<Lexer::SourceBuffer> source(const std::string &text)
+{
+    return std::make_shared<Lexer::SourceBuffer>(text);
+}
+
+TEST_F(SessionTest, concurrentSessions)
+{
+    // Every session declares the same function and label, which a shared
+    // function table would reject as a redefinition.
+    const std::string text = "function twice(int32 a) return int32 is\n"
+                             "    if a > 100 then goto done; fi\n"
+                             "    a := a * 2;\n"
+                             "    # done return a;\n"
+                             "endfunction\n"
+                             "function caller() return int32 is return twice(21); endfunction\n";
+    const int threads = 4;
+    const int compilations = 8;
+    std::vector<int> compiled(threads, 0);
+    std::vector<std::string> diagnostics(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&, t]()
+                             {
+                                 Ckc::Options options;
+                                 options.jobs = t % 2 == 0 ? 1 : 2;
+                                 Ckc::CompilationSession session(options, createTargetMachine);
+                                 std::ostringstream errors;
+                                 session.setDiagnostics(errors);
+                                 for (int i = 0; i < compilations; i++)
+                                     compiled[t] += session.compile(source(text), "session.gk", object("t" + std::to_string(t)));
+                                 diagnostics[t] = errors.str(); });
+    for (auto &worker : workers)
+        worker.join();
+    for (int t = 0; t < threads; t++)
+    {
+        EXPECT_EQ(compiled[t], compilations);
+        EXPECT_EQ(diagnostics[t], "");
+        EXPECT_TRUE(llvm::sys::fs::exists(object("t" + std::to_string(t))));
+    }
+}
+
+TEST_F(SessionTest, errorsDoNotOutliveACompilation)
+{
+    Ckc::CompilationSession session(Ckc::Options(), createTargetMachine);
+    std::ostringstream errors;
+    session.setDiagnostics(errors);
+    EXPECT_FALSE(session.compile(source("int32 a := ;"), "bad.gk", object("bad")));
+    EXPECT_NE(errors.str().find("1 syntax error(s)"), std::string::npos);
+    // The same thread and session, with a clean slate.
+    errors.str("");
+    EXPECT_TRUE(session.compile(source("function f() return int32 is return 1; endfunction"), "good.gk", object("good")));
+    EXPECT_TRUE(session.compile(source("function f() return int32 is return 2; endfunction"), "good.gk", object("good")));
+    EXPECT_EQ(errors.str(), "");
+}
+
+TEST_F(SessionTest, callerStateIsRestored)
+{
+    Lexer::LexerContext::addToken(Lexer::Symbol("outside"), Lexer::TokenType::FUNCTION_NAME);
+    Parser::Arena &arena = Parser::Arena::getCurrent();
+    Context::ContextProvider &provider = Context::ContextProvider::getInstance();
+    const std::size_t errors = Parser::errorCount();
+
+    Ckc::CompilationSession session(Ckc::Options(), createTargetMachine);
+    std::ostringstream diagnostics;
+    session.setDiagnostics(diagnostics);
+    EXPECT_FALSE(session.compile(source("function outside( endfunction"), "bad.gk", object("bad")));
+
+    EXPECT_EQ(&Parser::Arena::getCurrent(), &arena);
+    EXPECT_EQ(&Context::ContextProvider::getInstance(), &provider);
+    EXPECT_EQ(Parser::errorCount(), errors);
+    EXPECT_EQ(Lexer::LexerContext::getTokenType(Lexer::Symbol("outside")), Lexer::TokenType::FUNCTION_NAME);
+}
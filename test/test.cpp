@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include "lexer.hpp"
+#include "scanner.hpp"
 using namespace Lexer;
 using namespace testing;
 
@@ -56,9 +57,117 @@ TEST_F(LexerTest, crlf)
   ASSERT_THAT(Map(ts.toList(), [](Token tok) {return tok.type;}), ElementsAre(TokenType::TYPE, TokenType::IDENTIFIER, TokenType::OPERATOR_ASSIGN, TokenType::NUMBER, TokenType::SEMICOLON, TokenType::TYPE, TokenType::IDENTIFIER, TokenType::OPERATOR_ASSIGN, TokenType::NUMBER, TokenType::SEMICOLON));
 }
 
+TEST_F(LexerTest, streaming)
+{
+  const std::string source = "if a then b := 1; fi c := 2;";
+  auto eagerStream = std::stringstream(source);
+  Lexer::TokenStream eager(eagerStream);
+  auto streamingStream = std::stringstream(source);
+  Lexer::TokenStream streaming(SourceBuffer::fromStream(streamingStream), "", true);
+  ASSERT_EQ(streaming.peek(2).type, TokenType::KEYWORD_THEN);
+  for (int i = 0; i < 8; i++)
+    ASSERT_EQ(streaming.get(), eager.get());
+  // Forgetting the tokens read keeps the indices of the stream.
+  streaming.discardConsumed();
+  ASSERT_EQ(streaming.tell(), 8u);
+  ASSERT_EQ(streaming.peek().value, "c");
+  streaming.seek(10);
+  ASSERT_EQ(streaming.get().type, TokenType::NUMBER);
+  ASSERT_EQ(streaming.get().type, TokenType::SEMICOLON);
+  ASSERT_TRUE(streaming.isEmpty());
+}
+
 TEST_F(LexerTest, parseFunction)
 {
   auto stream = std::stringstream("function main() return int32 is return 0; endfunction");
   Lexer::TokenStream ts(stream);
   ASSERT_THAT(Map(ts.toList(), [](Token tok) {return tok.type;}), ElementsAre(TokenType::KEYWORD_FUNCTION, TokenType::IDENTIFIER, TokenType::PARENTHESIS_OPEN, TokenType::PARENTHESIS_CLOSE, TokenType::KEYWORD_RETURN, TokenType::TYPE, TokenType::KEYWORD_IS, TokenType::KEYWORD_RETURN, TokenType::NUMBER, TokenType::SEMICOLON, TokenType::KEYWORD_ENDFUNCTION));
-}
\ No newline at end of file
+}
+
+TEST_F(LexerTest, getLine)
+{
+  auto stream = std::stringstream("int64 i := 0;\r\n\r\nint64 j := 0;");
+  Lexer::TokenStream ts(stream);
+  ts.toList();
+  ASSERT_EQ(ts.getLine(1), "int64 i := 0;");
+  ASSERT_EQ(ts.getLine(2), "");
+  ASSERT_EQ(ts.getLine(3), "int64 j := 0;");
+  ASSERT_EQ(ts.getLine(4), "");
+}
+
+TEST_F(LexerTest, identifierSymbols)
+{
+  auto stream = std::stringstream("a := b + a;");
+  Lexer::TokenStream ts(stream);
+  auto tokens = ts.toList();
+  ASSERT_EQ(tokens[0].symbol, tokens[4].symbol);
+  ASSERT_NE(tokens[0].symbol, tokens[2].symbol);
+  ASSERT_EQ(tokens[2].symbol.str(), "b");
+  ASSERT_TRUE(tokens[1].symbol.empty());
+}
+
+TEST_F(LexerTest, scannerLevelsProduceSameTokens)
+{
+  std::string source;
+  for (int i = 0; i < 200; i++)
+  {
+    source += "function f" + std::to_string(i) + "_with_a_rather_long_identifier_name (int32 a) return int32 is\r\n";
+    source += std::string(i % 40, ' ') + "\t\tpragma x symbol_name is \"some quoted " + std::string(i % 37, 'q') + " text\";\n\n";
+    source += "  return a+" + std::to_string(i * 7919) + "<<2 \xc3\xa9t\xc3\xa9 := (b) ;\n";
+    source += "endfunction\n";
+  }
+  // Tokens view the buffer, it must outlive every stream.
+  auto buffer = std::make_shared<Lexer::SourceBuffer>(source);
+  auto lex = [&](Lexer::Scanner::Level level)
+  {
+    Lexer::Scanner::setLevel(level);
+    Lexer::TokenStream ts(buffer);
+    return ts.toList();
+  };
+  const auto detected = Lexer::Scanner::detectLevel();
+  const auto reference = lex(Lexer::Scanner::Level::Scalar);
+  for (auto level : {Lexer::Scanner::Level::SSE2, Lexer::Scanner::Level::AVX2})
+  {
+    if (level > detected)
+      continue;
+    auto tokens = lex(level);
+    ASSERT_EQ(tokens.size(), reference.size()) << Lexer::Scanner::levelToString(level);
+    for (std::size_t i = 0; i < tokens.size(); i++)
+      ASSERT_EQ(tokens[i], reference[i]) << Lexer::Scanner::levelToString(level) << " token " << i;
+  }
+  Lexer::Scanner::setLevel(detected);
+}
+
+TEST_F(LexerTest, keywordTable)
+{
+  for (const auto &definition : Lexer::tokenDefinitions)
+  {
+    ASSERT_EQ(Lexer::findKeyword(definition.spelling), definition.type) << definition.spelling;
+    if (definition.type != TokenType::TYPE)
+    {
+      ASSERT_EQ(Lexer::tokenTypeToString(definition.type), definition.spelling);
+    }
+  }
+  ASSERT_EQ(Lexer::findKeyword("partial"), std::nullopt);
+  ASSERT_EQ(Lexer::findKeyword("iff"), std::nullopt);
+  ASSERT_EQ(Lexer::findKeyword("a_rather_long_identifier"), std::nullopt);
+  static_assert(Lexer::findKeyword(":=") == Lexer::TokenType::OPERATOR_ASSIGN);
+  static_assert(Lexer::getPrecedence(Lexer::TokenType::LOGICAL_XOR) == 60);
+  static_assert(Lexer::isEndMultiBlock(Lexer::TokenType::KEYWORD_FI) && !Lexer::isEndMultiBlock(Lexer::TokenType::KEYWORD_IF));
+}
+
+TEST_F(LexerTest, contextFreeTokens)
+{
+  Lexer::LexerContext::addToken("f", TokenType::FUNCTION_NAME);
+  auto stream = std::stringstream("f(x) int32 y");
+  Lexer::TokenStream ts(stream);
+  ASSERT_EQ(ts.peek().type, TokenType::IDENTIFIER);
+  ASSERT_EQ(ts.peek(2).value, "x");
+  ASSERT_EQ(ts.peek(4).type, TokenType::TYPE);
+  ASSERT_EQ(ts.peek(42).type, TokenType::TOKEN_EOF);
+  ASSERT_EQ(ts.get().value, "f");
+  ASSERT_EQ(ts.peek(1).value, "x");
+  ASSERT_THAT(Map(ts.toList(), [](Token tok) {return tok.type;}), ElementsAre(TokenType::PARENTHESIS_OPEN, TokenType::IDENTIFIER, TokenType::PARENTHESIS_CLOSE, TokenType::TYPE, TokenType::IDENTIFIER));
+  ASSERT_TRUE(ts.isEmpty());
+  ASSERT_EQ(ts.get().type, TokenType::TOKEN_EOF);
+}
@@ -16,19 +16,33 @@ class TypeTest : public ::testing::Test {
 };
 
 TEST_F(TypeTest, wrongAddition) {
-    auto stream = std::stringstream("int64 i := 0; int32 j := 0; int32 z := i + j;");
+    auto stream = std::stringstream("int64 i := 0; int32 j := 0; function t() return int32 is int32 z := i + j; return z; endfunction");
     MockTokenStream ts(stream);
     Parser::NodeIdentifier node = Parser::parseMultiBlock(ts);
     visitor::typeVisitor visitor;
-    EXPECT_THAT([&](){node->accept(visitor);}, ThrowsMessage<different_type_error>("Operation between different types: int64 and int32 (missing cast?)"));
+    EXPECT_THAT([&](){visitor.dispatch(node);}, ThrowsMessage<different_type_error>("Operation between different types: int64 and int32 (missing cast?)"));
 }
 
 TEST_F(TypeTest, wrongAssignment) {
-    auto stream = std::stringstream("int64 i := 0; int64 j := 0; int32 z := i + j;");
+    auto stream = std::stringstream("int64 i := 0; int64 j := 0; function u() return int32 is int32 z := i + j; return z; endfunction");
     MockTokenStream ts(stream);
     Parser::NodeIdentifier node = Parser::parseMultiBlock(ts);
     visitor::typeVisitor visitor;
-    EXPECT_THAT([&](){node->accept(visitor);}, ThrowsMessage<type_error>("Type error: expected int32 but got int64"));
+    EXPECT_THAT([&](){visitor.dispatch(node);}, ThrowsMessage<type_error>("Type error: expected int32 but got int64"));
+}
+
+TEST_F(TypeTest, constantGlobals)
+{
+    auto stream = std::stringstream("int32 ca := (2 + 3) * int32(4) - 1; int32 cb := ca; "
+                                    "function cc() return int32 is int32 z := ca; return z + cb; endfunction");
+    MockTokenStream ts(stream);
+    Parser::NodeIdentifier node = Parser::parseMultiBlock(ts);
+    visitor::typeVisitor visitor;
+    auto &blocks = node.get<Parser::NodeMultiBlock>()->blocks;
+    EXPECT_NO_THROW(visitor.dispatch(blocks[0]));
+    EXPECT_THAT([&](){visitor.dispatch(blocks[1]);}, ThrowsMessage<constant_error>("Global variables must be initialized with a constant"));
+    // The rejected global is still declared for the blocks after it.
+    EXPECT_NO_THROW(visitor.dispatch(blocks[2]));
 }
 
 TEST_F(TypeTest, wrongReturn_Message)
@@ -37,5 +51,58 @@ TEST_F(TypeTest, wrongReturn_Message)
     MockTokenStream ts(stream);
     Parser::NodeIdentifier node = Parser::parseMultiBlock(ts);
     visitor::typeVisitor visitor;
-    EXPECT_THAT([&](){node->accept(visitor);}, ThrowsMessage<type_error>("Type error: expected int32 but got uint32"));
-}
\ No newline at end of file
+    EXPECT_THAT([&](){visitor.dispatch(node);}, ThrowsMessage<type_error>("Type error: expected int32 but got uint32"));
+}
+TEST_F(TypeTest, registry)
+{
+    EXPECT_EQ(::Types::TypeId::named("int16"), ::Types::int16);
+    EXPECT_EQ(::Types::TypeId::named(""), ::Types::none);
+    EXPECT_EQ(::Types::uint64.info().width, 64u);
+    EXPECT_FALSE(::Types::uint64.info().isSigned);
+    EXPECT_TRUE(::Types::int8.info().isSigned);
+    EXPECT_TRUE(::Types::boolType.info().isBoolean);
+    EXPECT_FALSE(::Types::boolType.info().isInteger());
+    EXPECT_TRUE(::Types::number.info().isLiteral);
+    EXPECT_TRUE(::Types::voidType.info().isVoid);
+
+    // Other names get a type of their own, without properties.
+    auto unknown = ::Types::TypeId::named("registryTestType");
+    EXPECT_EQ(::Types::TypeId::named("registryTestType"), unknown);
+    EXPECT_NE(unknown, ::Types::none);
+    EXPECT_EQ(unknown.str(), "registryTestType");
+    EXPECT_EQ(unknown.info().width, 0u);
+}
+
+TEST_F(TypeTest, overloadResolution)
+{
+    // Every overload returns int32, only the last one takes it.
+    auto stream = std::stringstream("function ovl(int8 a) return int32 is return 8; endfunction "
+                                    "function ovl(int16 a) return int32 is return 16; endfunction "
+                                    "function ovl(int32 a) return int32 is return 32; endfunction "
+                                    "function mix(int32 a, bool b) return int32 is return a; endfunction "
+                                    "function oc(int32 x) return int32 is return mix(ovl(ovl(ovl(x))), x > 0) + ovl(1); endfunction");
+    MockTokenStream ts(stream);
+    Parser::NodeIdentifier node = Parser::parseMultiBlock(ts);
+    visitor::typeVisitor visitor;
+    EXPECT_NO_THROW(visitor.dispatch(node));
+
+    auto wrongArity = std::stringstream("function one(int32 a) return int32 is return a; endfunction "
+                                        "function od(int32 x) return int32 is return one(x, x); endfunction");
+    MockTokenStream ts2(wrongArity);
+    node = Parser::parseMultiBlock(ts2);
+    EXPECT_THROW(visitor.dispatch(node), type_error);
+
+    // Calls nested deeper than the native stack allows.
+    std::string deep = "function oe(int32 x) return int32 is return ";
+    for (int i = 0; i < 20000; i++)
+        deep += "nest(";
+    deep += "x";
+    for (int i = 0; i < 20000; i++)
+        deep += ")";
+    auto deepStream = std::stringstream("function nest(int8 a) return int32 is return 8; endfunction "
+                                        "function nest(int32 a) return int32 is return 32; endfunction " +
+                                        deep + "; endfunction");
+    MockTokenStream ts3(deepStream);
+    node = Parser::parseMultiBlock(ts3);
+    EXPECT_NO_THROW(visitor.dispatch(node));
+}
@@ -0,0 +1,168 @@
+#include "session.hpp"
+#include "workspace.hpp"
+#include <llvm/Support/FileSystem.h>
+#include <gtest/gtest.h>
+#include <sstream>
+
+class WorkspaceTest : public ::testing::Test {
+ protected:
+  llvm::SmallString<128> directory;
+  Backend::TargetMachineFactory createTargetMachine;
+  void SetUp() override {
+    Lexer::LexerContext::init();
+    llvm::sys::fs::createUniqueDirectory("gkc-workspace-test", directory);
+    std::string error;
+    createTargetMachine = Ckc::hostTargetMachine(error);
+    ASSERT_TRUE(createTargetMachine) << error;
+  }
+  void TearDown() override {
+    llvm::sys::fs::remove_directories(directory);
+  }
+  std::string object() {
+    return (directory + "/workspace.o").str();
+  }
+};
+
+namespace
+{
+    const std::string program = "int64 limit := 10;\n"
+                                "function twice(int32 a) return int32 is\n"
+                                "    return a * 2;\n"
+                                "endfunction\n"
+                                "function clamp(int64 a) return int64 is\n"
+                                "    if a > limit then return limit; fi\n"
+                                "    return a;\n"
+                                "endfunction\n"
+                                "function main() return int32 is\n"
+                                "    int32 x := 1;\n"
+                                "    return twice(x);\n"
+                                "endfunction\n";
+
+    std::string replaced(std::string text, const std::string &from, const std::string &to)
+    {
+        return text.replace(text.find(from), from.size(), to);
+    }
+
+    std::size_t computed(const Ckc::Workspace &workspace, const std::string &query)
+    {
+        auto found = workspace.getStatistics().find(query);
+        return found == workspace.getStatistics().end() ? 0 : found->second.computed;
+    }
+}
+
+TEST_F(WorkspaceTest, bodyEditOnlyRecomputesItsFunction)
+{
+    Ckc::Workspace workspace(createTargetMachine);
+    std::ostringstream diagnostics;
+    workspace.setSource("a.gk", program);
+    ASSERT_TRUE(workspace.compile("a.gk", object(), diagnostics)) << diagnostics.str();
+    EXPECT_EQ(diagnostics.str(), "");
+    EXPECT_TRUE(llvm::sys::fs::exists(object()));
+    EXPECT_EQ(computed(workspace, "ir"), 3u);
+
+    workspace.resetStatistics();
+    workspace.setSource("a.gk", replaced(program, "return a * 2;", "return a + a;"));
+    ASSERT_TRUE(workspace.compile("a.gk", object(), diagnostics)) << diagnostics.str();
+    EXPECT_EQ(computed(workspace, "outline"), 0u);
+    EXPECT_EQ(computed(workspace, "ast"), 1u);
+    EXPECT_EQ(computed(workspace, "check"), 1u);
+    EXPECT_EQ(computed(workspace, "ir"), 1u);
+    EXPECT_EQ(computed(workspace, "object"), 1u);
+    EXPECT_EQ(computed(workspace, "outline object"), 0u);
+
+    // Nothing changed.
+    workspace.resetStatistics();
+    ASSERT_TRUE(workspace.compile("a.gk", object(), diagnostics));
+    for (auto &[name, statistics] : workspace.getStatistics())
+        EXPECT_EQ(statistics.computed, 0u) << name;
+}
+
+TEST_F(WorkspaceTest, unchangedSignaturesCutTheInvalidationOff)
+{
+    Ckc::Workspace workspace(createTargetMachine);
+    std::ostringstream diagnostics;
+    workspace.setSource("a.gk", program);
+    ASSERT_TRUE(workspace.compile("a.gk", object(), diagnostics)) << diagnostics.str();
+    workspace.resetStatistics();
+    workspace.setSource("a.gk", replaced(program, "limit := 10", "limit := 11"));
+    ASSERT_TRUE(workspace.compile("a.gk", object(), diagnostics)) << diagnostics.str();
+    EXPECT_EQ(computed(workspace, "outline"), 1u);
+    EXPECT_EQ(computed(workspace, "outline object"), 1u);
+    EXPECT_EQ(computed(workspace, "ast"), 0u);
+    EXPECT_EQ(computed(workspace, "ir"), 0u);
+
+    // twice now returns an int64: its callers are checked again.
+    workspace.resetStatistics();
+    workspace.setSource("a.gk", replaced(program, "function twice(int32 a) return int32", "function twice(int32 a) return int64"));
+    EXPECT_FALSE(workspace.compile("a.gk", object(), diagnostics));
+    EXPECT_NE(diagnostics.str().find("Type error: expected int64 but got int32"), std::string::npos) << diagnostics.str();
+    EXPECT_NE(diagnostics.str().find("Type error: expected int32 but got int64"), std::string::npos) << diagnostics.str();
+}
+
+TEST_F(WorkspaceTest, diagnosticsAreTheOnesOfGkc)
+{
+    Ckc::Workspace workspace(createTargetMachine);
+    std::ostringstream diagnostics;
+    workspace.setSource("a.gk", replaced(program, "return a * 2;", "return a * ;"));
+    EXPECT_FALSE(workspace.compile("a.gk", object(), diagnostics));
+    EXPECT_NE(diagnostics.str().find("a.gk:3:16"), std::string::npos) << diagnostics.str();
+    EXPECT_NE(diagnostics.str().find("Error parsing file: 1 syntax error(s)"), std::string::npos) << diagnostics.str();
+
+    diagnostics.str("");
+    workspace.setSource("a.gk", replaced(program, "return twice(x);", "return limit;"));
+    EXPECT_FALSE(workspace.compile("a.gk", object(), diagnostics));
+    EXPECT_NE(diagnostics.str().find("Type error: expected int32 but got int64"), std::string::npos) << diagnostics.str();
+    EXPECT_NE(diagnostics.str().find("a.gk:11:12"), std::string::npos) << diagnostics.str();
+}
+
+TEST_F(WorkspaceTest, pragmaErrorsAreDiagnostics)
+{
+    Ckc::Workspace workspace(createTargetMachine);
+    std::ostringstream diagnostics;
+    workspace.setSource("a.gk", program + "pragma twice bogus is \"x\";\n");
+    EXPECT_FALSE(workspace.compile("a.gk", object(), diagnostics));
+    EXPECT_NE(diagnostics.str().find("Pragma type IDENTIFIER not implemented"), std::string::npos) << diagnostics.str();
+    EXPECT_NE(diagnostics.str().find("a.gk:13:1"), std::string::npos) << diagnostics.str();
+
+    // An unknown target is a syntax error, as for gkc.
+    diagnostics.str("");
+    workspace.setSource("a.gk", program + "pragma nothere symbol_name is \"x\";\n");
+    EXPECT_FALSE(workspace.compile("a.gk", object(), diagnostics));
+    EXPECT_NE(diagnostics.str().find("Unexpected token: nothere"), std::string::npos) << diagnostics.str();
+    EXPECT_NE(diagnostics.str().find("Error parsing file: 1 syntax error(s)"), std::string::npos) << diagnostics.str();
+
+    // The workspace keeps compiling once the pragma is fixed.
+    diagnostics.str("");
+    workspace.setSource("a.gk", program + "pragma twice symbol_name is \"x\";\n");
+    EXPECT_TRUE(workspace.compile("a.gk", object(), diagnostics)) << diagnostics.str();
+}
+
+TEST_F(WorkspaceTest, typeOfExpressions)
+{
+    Ckc::Workspace workspace(createTargetMachine);
+    workspace.setSource("a.gk", program);
+    // a > limit and its operands, twice(x) and its x.
+    EXPECT_EQ(workspace.typeOf("a.gk", 6, 8), Types::TypeId::named("int64"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 6, 10), Types::boolType);
+    EXPECT_EQ(workspace.typeOf("a.gk", 6, 14), Types::TypeId::named("int64"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 11, 12), Types::TypeId::named("int32"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 11, 18), Types::TypeId::named("int32"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 1, 16), Types::TypeId::named("int64"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 3, 1), std::nullopt);
+}
+
+TEST_F(WorkspaceTest, typeOfFollowsTheCallees)
+{
+    Ckc::Workspace workspace(createTargetMachine);
+    const std::string text = "function size() return int64 is return 10; endfunction\n"
+                             "function positive() return bool is\n"
+                             "    return size() > 0;\n"
+                             "endfunction\n";
+    workspace.setSource("a.gk", text);
+    EXPECT_EQ(workspace.typeOf("a.gk", 3, 12), Types::TypeId::named("int64"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 3, 19), Types::boolType);
+    // positive is the same text, checked again without any error.
+    workspace.setSource("a.gk", replaced(text, "int64", "int32"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 3, 12), Types::TypeId::named("int32"));
+    EXPECT_EQ(workspace.typeOf("a.gk", 3, 19), Types::boolType);
+}